@@ -60,6 +60,11 @@ class BedrockCommand : public SQLiteCommand {
     // read-only fashion (i.e., it opened an HTTPS request and is waiting for the response).
     virtual bool peek(SQLite& db) { STHROW("430 Unrecognized command"); }
 
+    // Called before `peek`, outside of any transaction. A command that can be answered without reading the database
+    // (i.e., from data the plugin keeps in memory) can write its response and return true, in which case no transaction
+    // is started and `peek` is not called. Otherwise, this should return false and `peek` is called as usual.
+    virtual bool peekWithoutTransaction() { return false; }
+
     // Called after a command has returned `false` to peek, and will attempt to commit and distribute a transaction
     // with any changes to the DB made by this plugin.
     virtual void process(SQLite& db) { STHROW("500 Base class process called"); }
@@ -201,6 +206,10 @@ class BedrockCommand : public SQLiteCommand {
     // Record the state we were acting under in the last call to `peek` or `process`.
     SQLiteNodeState lastPeekedOrProcessedInState = SQLiteNodeState::UNKNOWN;
 
+    // Set once we've tried to forward this command to a fresher follower because this node was staler than its
+    // `maxStalenessMS`, so that if that fails, it waits to catch up rather than being forwarded again.
+    bool forwardedForStaleness = false;
+
     // If someone is waiting for this command to complete, this will be called in the destructor.
     function<void()>* destructionCallback;
 
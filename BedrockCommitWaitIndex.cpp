@@ -0,0 +1,196 @@
+#include <BedrockCommitWaitIndex.h>
+
+BedrockCommitWaitIndex::BedrockCommitWaitIndex(BedrockCommandQueue& commandQueue)
+  : _commandQueue(commandQueue), _woken(false), _stopping(false), _commitCount(0), _nextCommitCount(UINT64_MAX), _size(0)
+{
+    _thread = thread(&BedrockCommitWaitIndex::_service, this);
+}
+
+BedrockCommitWaitIndex::~BedrockCommitWaitIndex() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stopping = true;
+        _wake();
+    }
+    _thread.join();
+}
+
+void BedrockCommitWaitIndex::push(unique_ptr<BedrockCommand>&& command, uint64_t commitCount, uint64_t currentCommitCount) {
+    notifyCommit(currentCommitCount);
+
+    lock_guard<mutex> lock(_mutex);
+    size_t entryIndex;
+    if (_freeEntries.empty()) {
+        entryIndex = _entries.size();
+        _entries.emplace_back();
+    } else {
+        entryIndex = _freeEntries.back();
+        _freeEntries.pop_back();
+    }
+    Entry& entry = _entries[entryIndex];
+    entry.timeout = command->timeout();
+    entry.commitCount = commitCount;
+    entry.command = move(command);
+    _heapPush(HEAP::COMMIT, entryIndex);
+    _heapPush(HEAP::TIMEOUT, entryIndex);
+    _nextCommitCount = _key(HEAP::COMMIT, _commitHeap.front());
+    size_t newSize = ++_size;
+
+    SINFO("Command (" << entry.command->request.methodLine << ") depends on future commit (" << commitCount
+          << "), Currently at: " << currentCommitCount << ", storing for later. Queue size: " << newSize);
+    if (newSize > 100) {
+        SHMMM("BedrockCommitWaitIndex size == " << newSize);
+    }
+
+    // `_nextCommitCount` is set before we read `_commitCount`, and `notifyCommit` sets `_commitCount` before it reads
+    // `_nextCommitCount`, so a commit that lands while we're doing this is seen by at least one of us. The service
+    // thread also needs waking if this command times out before whatever it's currently sleeping until.
+    if (_commitCount.load() >= commitCount || _timeoutHeap.front() == entryIndex) {
+        _wake();
+    }
+}
+
+void BedrockCommitWaitIndex::notifyCommit(uint64_t commitCount) {
+    uint64_t previous = _commitCount.load();
+    while (previous < commitCount && !_commitCount.compare_exchange_weak(previous, commitCount)) {
+    }
+    if (commitCount >= _nextCommitCount.load()) {
+        lock_guard<mutex> lock(_mutex);
+        _wake();
+    }
+}
+
+void BedrockCommitWaitIndex::flush() {
+    if (!_size.load()) {
+        return;
+    }
+    lock_guard<mutex> lock(_mutex);
+    while (!_commitHeap.empty()) {
+        _release(_commitHeap.front(), "shutting down");
+    }
+    _nextCommitCount = UINT64_MAX;
+}
+
+size_t BedrockCommitWaitIndex::size() const {
+    return _size.load();
+}
+
+void BedrockCommitWaitIndex::_service() {
+    SInitialize("commitWait");
+    unique_lock<mutex> lock(_mutex);
+    while (!_stopping) {
+        // Everything waiting on a commit count we've reached is ready.
+        uint64_t commitCount = _commitCount.load();
+        while (!_commitHeap.empty() && _key(HEAP::COMMIT, _commitHeap.front()) <= commitCount) {
+            _release(_commitHeap.front(), "commit count reached");
+        }
+
+        // Anything that's timed out goes back to the main queue, where it will hit its timeout in a worker thread.
+        uint64_t now = STimeNow();
+        while (!_timeoutHeap.empty() && _key(HEAP::TIMEOUT, _timeoutHeap.front()) < now) {
+            _release(_timeoutHeap.front(), "timed out");
+        }
+        _nextCommitCount = _commitHeap.empty() ? UINT64_MAX : _key(HEAP::COMMIT, _commitHeap.front());
+
+        // A commit may have landed after we read `_commitCount` but before `_nextCommitCount` was lowered, in which
+        // case nobody woke us for it.
+        if (_commitCount.load() >= _nextCommitCount.load()) {
+            continue;
+        }
+
+        if (_timeoutHeap.empty()) {
+            _cv.wait(lock, [this]() { return _woken; });
+        } else {
+            // Capped so that huge timeouts don't overflow the clock.
+            uint64_t untilTimeout = min(_key(HEAP::TIMEOUT, _timeoutHeap.front()) - now + 1, MAX_SLEEP_US);
+            _cv.wait_for(lock, chrono::microseconds(untilTimeout), [this]() { return _woken; });
+        }
+        _woken = false;
+    }
+}
+
+void BedrockCommitWaitIndex::_release(size_t entryIndex, const char* reason) {
+    Entry& entry = _entries[entryIndex];
+    SINFO("Returning command (" << entry.command->request.methodLine << ") waiting on commit " << entry.commitCount
+          << " to queue, " << reason << ", now have commit " << _commitCount.load() << ".");
+    _heapRemove(HEAP::COMMIT, entry.commitHeapIndex);
+    _heapRemove(HEAP::TIMEOUT, entry.timeoutHeapIndex);
+    _commandQueue.push(move(entry.command));
+    _freeEntries.push_back(entryIndex);
+    _size--;
+}
+
+uint64_t BedrockCommitWaitIndex::_key(HEAP heap, size_t entryIndex) const {
+    const Entry& entry = _entries[entryIndex];
+    return heap == HEAP::COMMIT ? entry.commitCount : entry.timeout;
+}
+
+vector<size_t>& BedrockCommitWaitIndex::_heap(HEAP heap) {
+    return heap == HEAP::COMMIT ? _commitHeap : _timeoutHeap;
+}
+
+void BedrockCommitWaitIndex::_setPosition(HEAP heap, size_t position) {
+    Entry& entry = _entries[_heap(heap)[position]];
+    (heap == HEAP::COMMIT ? entry.commitHeapIndex : entry.timeoutHeapIndex) = position;
+}
+
+void BedrockCommitWaitIndex::_heapPush(HEAP heap, size_t entryIndex) {
+    vector<size_t>& h = _heap(heap);
+    h.push_back(entryIndex);
+    _setPosition(heap, h.size() - 1);
+    _siftUp(heap, h.size() - 1);
+}
+
+void BedrockCommitWaitIndex::_heapRemove(HEAP heap, size_t position) {
+    vector<size_t>& h = _heap(heap);
+    size_t last = h.size() - 1;
+    if (position != last) {
+        h[position] = h[last];
+        _setPosition(heap, position);
+        h.pop_back();
+
+        // The entry moved into the hole could belong either above or below it.
+        _siftUp(heap, position);
+        _siftDown(heap, position);
+    } else {
+        h.pop_back();
+    }
+}
+
+void BedrockCommitWaitIndex::_siftUp(HEAP heap, size_t position) {
+    vector<size_t>& h = _heap(heap);
+    while (position > 0) {
+        size_t parent = (position - 1) / 2;
+        if (_key(heap, h[parent]) <= _key(heap, h[position])) {
+            break;
+        }
+        swap(h[parent], h[position]);
+        _setPosition(heap, parent);
+        _setPosition(heap, position);
+        position = parent;
+    }
+}
+
+void BedrockCommitWaitIndex::_siftDown(HEAP heap, size_t position) {
+    vector<size_t>& h = _heap(heap);
+    while (true) {
+        size_t smallest = position;
+        for (size_t child = 2 * position + 1; child <= 2 * position + 2 && child < h.size(); child++) {
+            if (_key(heap, h[child]) < _key(heap, h[smallest])) {
+                smallest = child;
+            }
+        }
+        if (smallest == position) {
+            break;
+        }
+        swap(h[smallest], h[position]);
+        _setPosition(heap, smallest);
+        _setPosition(heap, position);
+        position = smallest;
+    }
+}
+
+void BedrockCommitWaitIndex::_wake() {
+    _woken = true;
+    _cv.notify_one();
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <BedrockCommand.h>
+#include <BedrockCommandQueue.h>
+
+// Holds commands that depend on a commit count this node hasn't reached yet. We can receive a command like this if
+// we're a follower that's behind leader, and a client makes two requests, one to a node more current than ourselves,
+// and a following request to us. Commands are returned to the command queue by a dedicated thread as soon as the commit
+// count they need is committed locally, or when they time out, whichever comes first.
+//
+// Waiting commands are indexed by two binary heaps, one ordered by commit count and one by timeout. Each entry records
+// its position in both heaps, so a command released from one heap is removed from the other in O(log n) without any
+// searching, and the service thread only looks at the entries it's actually releasing.
+class BedrockCommitWaitIndex {
+  public:
+    BedrockCommitWaitIndex(BedrockCommandQueue& commandQueue);
+    ~BedrockCommitWaitIndex();
+
+    // Parks a command until the local commit count reaches `commitCount`. `currentCommitCount` is the commit count the
+    // caller saw when it decided the command needed to wait, which lets us catch commits that happen in between.
+    void push(unique_ptr<BedrockCommand>&& command, uint64_t commitCount, uint64_t currentCommitCount);
+
+    // Tells the index that the local commit count has reached `commitCount`. This is called on every commit, so it
+    // only takes the lock when there's a command waiting for a commit count this satisfies.
+    void notifyCommit(uint64_t commitCount);
+
+    // Returns every waiting command to the command queue regardless of its commit count. Used when shutting down so
+    // that no commands are left behind. Cheap when nothing's waiting.
+    void flush();
+
+    // Number of commands currently waiting.
+    size_t size() const;
+
+  private:
+    struct Entry {
+        unique_ptr<BedrockCommand> command;
+        uint64_t commitCount;
+        uint64_t timeout;
+
+        // Positions of this entry in `_commitHeap` and `_timeoutHeap`.
+        size_t commitHeapIndex;
+        size_t timeoutHeapIndex;
+    };
+
+    // Longest the service thread sleeps at once when waiting for a timeout.
+    static constexpr uint64_t MAX_SLEEP_US = 60'000'000;
+
+    // Which of the two heaps an operation applies to.
+    enum class HEAP {
+        COMMIT,
+        TIMEOUT,
+    };
+
+    // Service thread body. Releases ready and timed out commands, then sleeps until the next timeout or a wakeup.
+    void _service();
+
+    // Removes entry `entryIndex` from both heaps and moves its command to the command queue.
+    void _release(size_t entryIndex, const char* reason);
+
+    // Heap maintenance. Heaps hold indexes into `_entries`, and these keep each entry's recorded heap positions
+    // up-to-date as they move things around.
+    uint64_t _key(HEAP heap, size_t entryIndex) const;
+    vector<size_t>& _heap(HEAP heap);
+    void _setPosition(HEAP heap, size_t position);
+    void _heapPush(HEAP heap, size_t entryIndex);
+    void _heapRemove(HEAP heap, size_t position);
+    void _siftUp(HEAP heap, size_t position);
+    void _siftDown(HEAP heap, size_t position);
+
+    // Wakes the service thread. Must be called with `_mutex` held.
+    void _wake();
+
+    BedrockCommandQueue& _commandQueue;
+
+    // Protects everything below except the atomics.
+    mutable mutex _mutex;
+    condition_variable _cv;
+    bool _woken;
+    bool _stopping;
+
+    // Entry storage. Slots are reused via `_freeEntries` so that parking a command doesn't usually allocate.
+    vector<Entry> _entries;
+    vector<size_t> _freeEntries;
+    vector<size_t> _commitHeap;
+    vector<size_t> _timeoutHeap;
+
+    // The highest commit count we've been told about, and the lowest commit count any command is waiting for
+    // (UINT64_MAX if none). Together these let `notifyCommit` skip the lock when it has nothing to do.
+    atomic<uint64_t> _commitCount;
+    atomic<uint64_t> _nextCommitCount;
+    atomic<size_t> _size;
+
+    thread _thread;
+};
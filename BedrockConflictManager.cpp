@@ -1,10 +1,11 @@
 #include "BedrockConflictManager.h"
 #include <libstuff/libstuff.h>
 
-BedrockConflictManager::BedrockConflictManager() {
+BedrockConflictManager::BedrockConflictManager() : _commitCount(0), _conflictCount(0) {
 }
 
 void BedrockConflictManager::recordTables(const string& commandName, const set<string>& tables) {
+    _commitCount++;
     {
         lock_guard<mutex> lock(m);
         auto commandInfoIt = _commandInfo.find(commandName);
@@ -64,3 +65,15 @@ string BedrockConflictManager::generateReport() {
     }
     return out.str();
 }
+
+void BedrockConflictManager::recordConflict() {
+    _conflictCount++;
+}
+
+uint64_t BedrockConflictManager::getCommitCount() const {
+    return _commitCount.load();
+}
+
+uint64_t BedrockConflictManager::getConflictCount() const {
+    return _conflictCount.load();
+}
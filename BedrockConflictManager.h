@@ -1,4 +1,6 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
 #include <list>
 #include <map>
 #include <mutex>
@@ -19,7 +21,16 @@ class BedrockConflictManager {
     void recordTables(const string& commandName, const set<string>& tables);
     string generateReport();
 
+    // Records a worker commit that failed because of a conflict.
+    void recordConflict();
+
+    // Total commits (everything passed to `recordTables`) and conflicts recorded so far.
+    uint64_t getCommitCount() const;
+    uint64_t getConflictCount() const;
+
   private:
+    atomic<uint64_t> _commitCount;
+    atomic<uint64_t> _conflictCount;
     mutex m;
     map<string, BedrockConflictManagerCommandInfo> _commandInfo;
 };
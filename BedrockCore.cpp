@@ -142,17 +142,23 @@ BedrockCore::RESULT BedrockCore::peekCommand(unique_ptr<BedrockCommand>& command
         _db.setTimeout(_getRemainingTime(command, false));
 
         try {
-            if (!_db.beginTransaction(exclusive ? SQLite::TRANSACTION_TYPE::EXCLUSIVE : SQLite::TRANSACTION_TYPE::SHARED)) {
-                STHROW("501 Failed to begin " + (exclusive ? "exclusive"s : "shared"s) + " transaction");
-            }
+            // Some commands can be answered from memory, in which case we skip the transaction entirely.
+            command->reset(BedrockCommand::STAGE::PEEK);
+            bool completed = command->peekWithoutTransaction();
+            if (completed) {
+                SDEBUG("Plugin '" << command->getName() << "' peeked command '" << request.methodLine << "' without a transaction");
+            } else {
+                if (!_db.beginTransaction(exclusive ? SQLite::TRANSACTION_TYPE::EXCLUSIVE : SQLite::TRANSACTION_TYPE::SHARED)) {
+                    STHROW("501 Failed to begin " + (exclusive ? "exclusive"s : "shared"s) + " transaction");
+                }
 
-            // Make sure no writes happen while in peek command
-            _db.setQueryOnly(true);
+                // Make sure no writes happen while in peek command
+                _db.setQueryOnly(true);
 
-            // Peek.
-            command->reset(BedrockCommand::STAGE::PEEK);
-            bool completed = command->peek(_db);
-            SDEBUG("Plugin '" << command->getName() << "' peeked command '" << request.methodLine << "'");
+                // Peek.
+                completed = command->peek(_db);
+                SDEBUG("Plugin '" << command->getName() << "' peeked command '" << request.methodLine << "'");
+            }
 
             if (!completed) {
                 SDEBUG("Command '" << request.methodLine << "' not finished in peek, re-queuing.");
@@ -205,8 +211,11 @@ BedrockCore::RESULT BedrockCore::peekCommand(unique_ptr<BedrockCommand>& command
     // Unless an exception handler set this to something different, the command is complete.
     command->complete = returnValue == RESULT::COMPLETE;
 
-    // Back out of the current transaction, it doesn't need to do anything.
-    _db.rollback();
+    // Back out of the current transaction, it doesn't need to do anything. Commands answered from memory never started
+    // one.
+    if (_db.insideTransaction()) {
+        _db.rollback();
+    }
     _db.clearTimeout();
 
     // Reset, we can write now.
@@ -0,0 +1,214 @@
+#include <BedrockOnlineBackup.h>
+
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <libgen.h>
+#include <unistd.h>
+
+BedrockOnlineBackup::BedrockOnlineBackup(const string& dbPath, uint64_t maxBytesPerSecond, uint64_t maxWALBytes)
+  : defaultMaxBytesPerSecond(maxBytesPerSecond), _dbPath(dbPath), _maxWALBytes(maxWALBytes), _running(false),
+    _cancel(false), _maxBytesPerSecond(0),
+    _commitCount(0), _bytesCopied(0), _bytesTotal(0), _startTime(0), _endTime(0)
+{
+}
+
+BedrockOnlineBackup::~BedrockOnlineBackup() {
+    cancel();
+}
+
+bool BedrockOnlineBackup::start(shared_ptr<SQLitePool> dbPool, const string& destination, uint64_t maxBytesPerSecond) {
+    if (_running.exchange(true)) {
+        return false;
+    }
+
+    // The last backup has already finished if we got here, but its thread may not have been joined.
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    {
+        lock_guard<mutex> lock(_mutex);
+        _destination = destination;
+        _state = "running";
+        _commitHash.clear();
+        _error.clear();
+    }
+    _maxBytesPerSecond = maxBytesPerSecond;
+    _commitCount = 0;
+    _bytesCopied = 0;
+    _bytesTotal = 0;
+    _startTime = STimeNow();
+    _endTime = 0;
+    _thread = thread(&BedrockOnlineBackup::_run, this, dbPool);
+    return true;
+}
+
+void BedrockOnlineBackup::cancel() {
+    _cancel = true;
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+    _cancel = false;
+}
+
+bool BedrockOnlineBackup::running() const {
+    return _running;
+}
+
+bool BedrockOnlineBackup::overwritesDatabase(const string& destination) const {
+    // The backup is written to `.partial` first, so that can't be one of the database's files either.
+    const string database = _resolvePath(_dbPath);
+    for (const string& path : {destination, destination + ".partial"}) {
+        const string resolved = _resolvePath(path);
+        for (const char* suffix : {"", "-wal", "-wal2", "-shm", "-journal"}) {
+            if (resolved == database + suffix) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+STable BedrockOnlineBackup::getInfo() const {
+    STable info;
+    lock_guard<mutex> lock(_mutex);
+    if (_state.empty()) {
+        return info;
+    }
+    const uint64_t bytesCopied = _bytesCopied;
+    const uint64_t bytesTotal = _bytesTotal;
+    const uint64_t endTime = _endTime;
+    const uint64_t elapsed = (endTime ? endTime : STimeNow()) - _startTime;
+    info["state"] = _state;
+    info["destination"] = _destination;
+    info["commitCount"] = to_string(_commitCount.load());
+    info["commitHash"] = _commitHash;
+    info["bytesCopied"] = to_string(bytesCopied);
+    info["bytesTotal"] = to_string(bytesTotal);
+    info["percentComplete"] = to_string(bytesTotal ? bytesCopied * 100 / bytesTotal : 0);
+    info["elapsedMS"] = to_string(elapsed / 1000);
+    info["bytesPerSecond"] = to_string(elapsed ? (uint64_t)(bytesCopied * (double)STIME_US_PER_S / elapsed) : 0);
+    info["maxBytesPerSecond"] = to_string(_maxBytesPerSecond.load());
+    if (!_error.empty()) {
+        info["error"] = _error;
+    }
+    return info;
+}
+
+void BedrockOnlineBackup::_run(shared_ptr<SQLitePool> dbPool) {
+    SInitialize("backup");
+    string destination;
+    {
+        lock_guard<mutex> lock(_mutex);
+        destination = _destination;
+    }
+    const string temporary = destination + ".partial";
+    unlink(temporary.c_str());
+    SINFO("Starting online backup to " << destination << ", max " << _maxBytesPerSecond << " bytes/second.");
+
+    uint64_t commitCount = 0;
+    string commitHash;
+    string error;
+    int result;
+    {
+        SQLiteScopedHandle dbScope(*dbPool, dbPool->getIndex());
+        result = dbScope.db().backup(temporary, PAGES_PER_STEP, [&](uint64_t copied, uint64_t total) {
+            if (!_commitCount) {
+                _commitCount = commitCount;
+                lock_guard<mutex> lock(_mutex);
+                _commitHash = commitHash;
+            }
+            _bytesCopied = copied;
+            _bytesTotal = total;
+
+            // Checkpoints can't reset the WAL files while we're copying, so give up rather than let them fill the disk.
+            if (_maxWALBytes) {
+                const uint64_t walBytes = _walBytes();
+                if (walBytes > _maxWALBytes) {
+                    error = "WAL grew to " + to_string(walBytes) + " bytes, over the limit of " + to_string(_maxWALBytes);
+                    return false;
+                }
+            }
+
+            // Sleep until we're back under the rate limit. It's re-read each time round so that it can be changed
+            // while we sleep.
+            while (!_cancel) {
+                const uint64_t maxBytesPerSecond = _maxBytesPerSecond;
+                if (!maxBytesPerSecond) {
+                    break;
+                }
+                const uint64_t earliest = _startTime + (uint64_t)(copied * (double)STIME_US_PER_S / maxBytesPerSecond);
+                const uint64_t now = STimeNow();
+                if (now >= earliest) {
+                    break;
+                }
+                usleep(min(earliest - now, MAX_SLEEP_US));
+            }
+            return !_cancel;
+        }, commitCount, commitHash);
+    }
+
+    const bool success = result == SQLITE_OK && _finish(temporary, destination);
+    if (!success) {
+        unlink(temporary.c_str());
+        if (error.empty() && !_cancel) {
+            error = result == SQLITE_OK ? "couldn't save the backup to " + destination
+                                        : "SQLite error " + to_string(result) + ": " + sqlite3_errstr(result);
+        }
+    }
+    {
+        lock_guard<mutex> lock(_mutex);
+        _state = success ? "complete" : (_cancel ? "cancelled" : "failed");
+        _error = error;
+        _commitCount = commitCount;
+        _commitHash = commitHash;
+        _endTime = STimeNow();
+    }
+    if (success) {
+        SINFO("Finished online backup to " << destination << " at commit " << commitCount << " (" << commitHash
+              << "), " << _bytesCopied << " bytes in " << (_endTime - _startTime) / 1000 << "ms.");
+    } else {
+        SWARN("Online backup to " << destination << " did not complete, result " << result << ": " << error);
+    }
+    _running = false;
+}
+
+bool BedrockOnlineBackup::_finish(const string& temporary, const string& destination) {
+    // The copy was written without syncing, so make sure it's all on disk before it replaces any previous backup.
+    int fd = open(temporary.c_str(), O_RDONLY);
+    if (fd < 0) {
+        SWARN("Couldn't open " << temporary << " to sync it: " << strerror(errno));
+        return false;
+    }
+    const bool synced = !fsync(fd);
+    close(fd);
+    if (!synced) {
+        SWARN("Couldn't sync " << temporary << ": " << strerror(errno));
+        return false;
+    }
+    if (rename(temporary.c_str(), destination.c_str())) {
+        SWARN("Couldn't rename " << temporary << " to " << destination << ": " << strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+string BedrockOnlineBackup::_resolvePath(const string& path) {
+    char resolved[PATH_MAX];
+    if (realpath(path.c_str(), resolved)) {
+        return resolved;
+    }
+
+    // `dirname` and `basename` may modify their arguments.
+    string directory = path;
+    string name = path;
+    if (!realpath(dirname(directory.data()), resolved)) {
+        return path;
+    }
+    const string resolvedDirectory = resolved;
+    return (resolvedDirectory == "/" ? "" : resolvedDirectory) + "/" + basename(name.data());
+}
+
+uint64_t BedrockOnlineBackup::_walBytes() const {
+    return SFileSize(_dbPath + "-wal") + SFileSize(_dbPath + "-wal2");
+}
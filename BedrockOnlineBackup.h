@@ -0,0 +1,89 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLitePool.h>
+
+// Runs a backup of the database in the background while the node keeps serving. The backup copies a snapshot pinned
+// by a read transaction on one handle from the DB pool (see `SQLite::backup`), so it's consistent at a single commit,
+// which is recorded along with its hash. Progress and throughput are available for Status while it runs, and the copy
+// rate can be limited so that the backup doesn't starve the node of disk bandwidth.
+//
+// The backup is written next to `destination` and only renamed into place once it's complete and synced, so a file at
+// `destination` is never a partial backup.
+//
+// While the copy runs, its read transaction stops checkpoints from resetting the WAL files, so they grow with every
+// commit until it's done. A backup is stopped (and its partial copy removed) if the WAL files grow past `maxWALBytes`.
+class BedrockOnlineBackup {
+  public:
+    // `dbPath` is the database being backed up. A `maxWALBytes` of 0 means no limit.
+    BedrockOnlineBackup(const string& dbPath, uint64_t maxBytesPerSecond, uint64_t maxWALBytes);
+    ~BedrockOnlineBackup();
+
+    // Starts a backup to `destination` using a handle from `dbPool`. A `maxBytesPerSecond` of 0 means no limit.
+    // Returns false without doing anything if a backup is already running.
+    bool start(shared_ptr<SQLitePool> dbPool, const string& destination, uint64_t maxBytesPerSecond);
+
+    // Stops a running backup, if there is one, and waits for it to finish. Its partial copy is removed.
+    void cancel();
+
+    // Returns whether a backup is running.
+    bool running() const;
+
+    // Returns true if writing a backup to `destination` would replace the database or one of its WAL, shared memory or
+    // journal files, after resolving symlinks and relative paths.
+    bool overwritesDatabase(const string& destination) const;
+
+    // Returns the state of the current or most recent backup, for Status. Empty if there's never been one.
+    STable getInfo() const;
+
+    // The rate limit used when `start` isn't given one.
+    const uint64_t defaultMaxBytesPerSecond;
+
+  private:
+    // Pages copied per call to `sqlite3_backup_step`. Small enough that rate limiting is smooth, large enough that the
+    // per-step overhead doesn't matter.
+    static constexpr int PAGES_PER_STEP = 256;
+
+    // Longest we sleep at once when rate limiting, so that `cancel` doesn't have to wait long.
+    static constexpr uint64_t MAX_SLEEP_US = 100'000;
+
+    // Thread body.
+    void _run(shared_ptr<SQLitePool> dbPool);
+
+    // Syncs a finished backup to disk and renames it into place.
+    static bool _finish(const string& temporary, const string& destination);
+
+    // Returns `path` with symlinks and relative components resolved. Paths that don't exist yet have their directory
+    // resolved instead.
+    static string _resolvePath(const string& path);
+
+    // Returns the combined size of the database's WAL files.
+    uint64_t _walBytes() const;
+
+    const string _dbPath;
+    const uint64_t _maxWALBytes;
+
+    thread _thread;
+
+    // Protects the strings below, which are written at the start and end of a backup. Progress is in the atomics.
+    mutable mutex _mutex;
+    string _destination;
+    string _state;
+    string _commitHash;
+
+    // Why the last backup didn't complete, if it didn't.
+    string _error;
+
+    atomic<bool> _running;
+    atomic<bool> _cancel;
+    atomic<uint64_t> _maxBytesPerSecond;
+    atomic<uint64_t> _commitCount;
+    atomic<uint64_t> _bytesCopied;
+    atomic<uint64_t> _bytesTotal;
+    atomic<uint64_t> _startTime;
+    atomic<uint64_t> _endTime;
+};
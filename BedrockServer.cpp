@@ -15,6 +15,8 @@
 #include <libstuff/SRandom.h>
 #include <libstuff/AutoTimer.h>
 #include <PageLockGuard.h>
+#include <sqlitecluster/SQLiteJournalBackup.h>
+#include <sqlitecluster/SQLitePageCache.h>
 #include <sqlitecluster/SQLitePeer.h>
 
 set<string>BedrockServer::_blacklistedParallelCommands;
@@ -32,11 +34,7 @@ bool BedrockServer::canStandDown() {
         size_t blockingQueueSize = _blockingCommandQueue.size();
         size_t syncNodeQueueSize = _syncNodeQueuedCommands.size();
 
-        size_t futureCommitCommandsSize = 0;
-        {
-            lock_guard<decltype(_futureCommitCommandMutex)> lock(_futureCommitCommandMutex);
-            futureCommitCommandsSize = _futureCommitCommands.size();
-        }
+        size_t futureCommitCommandsSize = _commitWaitIndex.size();
 
         SINFO("Can't stand down with " << count << " commands remaining. Queue sizes are: "
               << "mainQueueSize: " << mainQueueSize << ", "
@@ -107,15 +105,40 @@ void BedrockServer::sync()
         workerThreads = 2;
     }
 
+    // The pool can grow and shrink between these bounds, which default to a fixed size of `workerThreads`.
+    _minWorkerThreads = max(2, args.isSet("-minWorkerThreads") ? (int)args.calc("-minWorkerThreads") : workerThreads);
+    _maxWorkerThreads = max(_minWorkerThreads, args.isSet("-maxWorkerThreads") ? (int)args.calc("-maxWorkerThreads") : workerThreads);
+    workerThreads = clamp(workerThreads, _minWorkerThreads, _maxWorkerThreads);
+    _targetWorkerThreads = workerThreads;
+    _workerBusyUS = 0;
+    _workerCPUUS = 0;
+    _lastWorkerPoolCheck = STimeNow();
+    _lastWorkerPoolCommits = _conflictManager.getCommitCount();
+    _lastWorkerPoolConflicts = _conflictManager.getConflictCount();
+
     // Initialize the DB.
     int64_t mmapSizeGB = args.isSet("-mmapSizeGB") ? stoll(args["-mmapSizeGB"]) : 0;
 
     // We use fewer FDs on test machines that have other resource restrictions in place.
-    int fdLimit = args.isSet("-live") ? 25'000 : 250;
+    int fdLimit = args.isSet("-dbPoolSize") ? args.calc("-dbPoolSize") : (args.isSet("-live") ? 25'000 : 250);
+    if (fdLimit < _maxWorkerThreads) {
+        SWARN("dbPool size " << fdLimit << " is smaller than -maxWorkerThreads " << _maxWorkerThreads
+              << ", workers will wait for DB handles.");
+    }
     SINFO("Setting dbPool size to: " << fdLimit);
-    _dbPool = make_shared<SQLitePool>(fdLimit, args["-db"], args.calc("-cacheSize"), args.calc("-maxJournalSize"), workerThreads, args["-synchronous"], mmapSizeGB, args.isSet("-hctree"));
+
+    // Journal tables are created for the largest the worker pool can get, so that growing it doesn't make workers
+    // share them.
+    _dbPool = make_shared<SQLitePool>(fdLimit, args["-db"], args.calc("-cacheSize"), args.calc("-maxJournalSize"), _maxWorkerThreads, args["-synchronous"], mmapSizeGB, args.isSet("-hctree"));
     SQLite& db = _dbPool->getBase();
 
+    // Wake any commands waiting for a commit count as soon as it's committed. This is removed along with the pool below.
+    const uint64_t commitListenerID = db.addCommitListener([this](uint64_t commitCount) {
+        _commitWaitIndex.notifyCommit(commitCount);
+    });
+    db.setResultCacheSize(args.calcU64("-resultCacheMB") * 1024 * 1024);
+    db.setCacheBudget(args.calcU64("-cacheBudget"));
+
     // Initialize the command processor.
     BedrockCore core(db, *this);
 
@@ -132,7 +155,7 @@ void BedrockServer::sync()
     // The node is now coming up, and should eventually end up in a `LEADING` or `FOLLOWING` state. We can start adding
     // our worker threads now. We don't wait until the node is `LEADING` or `FOLLOWING`, as it's state can change while
     // it's running, and our workers will have to maintain awareness of that state anyway.
-    SINFO("Starting " << workerThreads << " worker threads.");
+    SINFO("Starting " << workerThreads << " worker threads (min " << _minWorkerThreads << ", max " << _maxWorkerThreads << ").");
     list<thread> workerThreadList;
     for (int threadId = 0; threadId < workerThreads; threadId++) {
         workerThreadList.emplace_back(&BedrockServer::worker, this, threadId);
@@ -154,75 +177,15 @@ void BedrockServer::sync()
             SAUTOPREFIX(command->request);
         }
 
-        // If there were commands waiting on our commit count to come up-to-date, we'll move them back to the main
-        // command queue here. There's no place in particular that's best to do this, so we do it at the top of this
-        // main loop, as that prevents it from ever getting skipped in the event that we `continue` early from a loop
-        // iteration.
-        // We also move all commands back to the main queue here if we're shutting down, just to make sure they don't
-        // end up lost in the ether.
-        {
-            SAUTOLOCK(_futureCommitCommandMutex);
-
-            // First, see if anything has timed out, and move that back to the main queue.
-            if (_futureCommitCommandTimeouts.size()) {
-                uint64_t now = STimeNow();
-                auto it =  _futureCommitCommandTimeouts.begin();
-                while (it != _futureCommitCommandTimeouts.end() && it->first < now) {
-                    // Find commands depending on this commit.
-                    auto itPair =  _futureCommitCommands.equal_range(it->second);
-                    for (auto cmdIt = itPair.first; cmdIt != itPair.second; cmdIt++) {
-                        // Check for one with this timeout.
-                        if (cmdIt->second->timeout() == it->first) {
-                            // This command has the right commit count *and* timeout, return it.
-                            SINFO("Returning command (" << cmdIt->second->request.methodLine << ") waiting on commit " << cmdIt->first
-                                  << " to queue, timed out at: " << now << ", timeout was: " << it->first << ".");
-
-                            // Goes back to the main queue, where it will hit it's timeout in a worker thread.
-                            _commandQueue.push(move(cmdIt->second));
-
-                            // And delete it, it's gone.
-                             _futureCommitCommands.erase(cmdIt);
-
-                            // Done.
-                            break;
-                        }
-                    }
-                    it++;
-                }
-
-                // And remove everything we just iterated through.
-                if (it != _futureCommitCommandTimeouts.begin()) {
-                    _futureCommitCommandTimeouts.erase(_futureCommitCommandTimeouts.begin(), it);
-                }
-            }
-
-            // Anything that hasn't timed out might be ready to return because the commit count is up-to-date.
-            if (!_futureCommitCommands.empty()) {
-                uint64_t commitCount = db.getCommitCount();
-                auto it = _futureCommitCommands.begin();
-                while (it != _futureCommitCommands.end() && (it->first <= commitCount || _shutdownState.load() != RUNNING)) {
-                    // Save the timeout since we'll be moving the command, thus making this inaccessible.
-                    uint64_t commandTimeout = it->second->timeout();
-                    SINFO("Returning command (" << it->second->request.methodLine << ") waiting on commit " << it->first
-                          << " to queue, now have commit " << commitCount);
-                    _commandQueue.push(move(it->second));
-
-                    // Remove it from the timed out list as well.
-                    auto itPair = _futureCommitCommandTimeouts.equal_range(commandTimeout);
-                    for (auto timeoutIt = itPair.first; timeoutIt != itPair.second; timeoutIt++) {
-                        if (timeoutIt->second == it->first) {
-                             _futureCommitCommandTimeouts.erase(timeoutIt);
-                            break;
-                        }
-                    }
-                    it++;
-                }
-                if (it != _futureCommitCommands.begin()) {
-                    _futureCommitCommands.erase(_futureCommitCommands.begin(), it);
-                }
-            }
+        // If we're shutting down, move any commands waiting on our commit count to come up-to-date back to the main
+        // command queue, just to make sure they don't end up lost in the ether. We do this at the top of the main loop,
+        // as that prevents it from ever getting skipped in the event that we `continue` early from a loop iteration.
+        if (_shutdownState.load() != RUNNING) {
+            _commitWaitIndex.flush();
         }
 
+        _adjustWorkerPool(workerThreadList);
+
         // If we're in a state where we can initialize shutdown, then go ahead and do so.
         // Having responded to all clients means there are no *local* clients, but it doesn't mean there are no
         // escalated commands. This is fine though - if we're following, there can't be any escalated commands, and if
@@ -611,6 +574,10 @@ void BedrockServer::sync()
         SINFO("Sync thread exiting, setting state to: " << SQLiteNode::stateName(_replicationState.load()));
     }
 
+    // Wake any parked workers so they can see that we're DONE and exit.
+    _targetWorkerThreads = workerThreadList.size();
+    _targetWorkerThreads.notify_all();
+
     // Wait for the worker threads to finish.
     int threadId = 0;
     for (auto& workerThread : workerThreadList) {
@@ -640,6 +607,13 @@ void BedrockServer::sync()
     // until they return.
     atomic_store(&_syncNode, shared_ptr<SQLiteNode>(nullptr));
 
+    // An online backup holds a handle from the pool, so stop it before the pool goes away.
+    _onlineBackup.cancel();
+
+    // Stop waking commands when this file is committed to. The listener is kept with the file, not the pool, so it would
+    // otherwise outlive us.
+    _dbPool->getBase().removeCommitListener(commitListenerID);
+
     // Release the current DB pool, and zero out our pointer.
     // Note: This is not an atomic operation but should not matter. Nothing should use this that can happen with no
     // sync thread.
@@ -664,6 +638,13 @@ void BedrockServer::worker(int threadId)
     // We just run this loop looking for commands to process forever. There's a check for appropriate exit conditions
     // at the bottom, which will cause our loop and thus this thread to exit when that becomes true.
     while (true) {
+        // If the pool has shrunk below us, park until it grows again (or we're shutting down).
+        int targetWorkerThreads = _targetWorkerThreads.load();
+        while (threadId >= targetWorkerThreads && _shutdownState.load() != DONE) {
+            _targetWorkerThreads.wait(targetWorkerThreads);
+            targetWorkerThreads = _targetWorkerThreads.load();
+        }
+
         try {
             // Set a signal handler function that we can call even if we die early with no command.
             SSetSignalHandlerDieFunc([&](){
@@ -677,7 +658,11 @@ void BedrockServer::worker(int threadId)
             SINFO("Dequeued command " << command->request.methodLine << " (" << command->id << ") in worker, "
                   << commandQueue.size() << " commands in " << (threadId ? "" : "blocking") << " queue.");
 
+            const uint64_t start = STimeNow();
+            const uint64_t cpuStart = _threadCPUTimeUS();
             runCommand(move(command), threadId == 0, false);
+            _workerBusyUS += STimeNow() - start;
+            _workerCPUUS += _threadCPUTimeUS() - cpuStart;
         } catch (const BedrockCommandQueue::timeout_error& e) {
             // No commands to process after 1 second.
             // If the sync node has shut down, we can return now, there will be no more work to do.
@@ -689,6 +674,86 @@ void BedrockServer::worker(int threadId)
     }
 }
 
+uint64_t BedrockServer::_threadCPUTimeUS() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1'000'000ull + ts.tv_nsec / 1'000;
+}
+
+void BedrockServer::_adjustWorkerPool(list<thread>& workerThreadList) {
+    const uint64_t now = STimeNow();
+    if (now < _lastWorkerPoolCheck + WORKER_POOL_INTERVAL_US) {
+        return;
+    }
+    const uint64_t elapsed = now - _lastWorkerPoolCheck;
+    _lastWorkerPoolCheck = now;
+
+    // Gather everything that happened since the last check.
+    const uint64_t busyUS = _workerBusyUS.exchange(0);
+    const uint64_t cpuUS = _workerCPUUS.exchange(0);
+    const uint64_t commitCount = _conflictManager.getCommitCount();
+    const uint64_t conflictCount = _conflictManager.getConflictCount();
+    const uint64_t commits = commitCount - _lastWorkerPoolCommits;
+    const uint64_t conflicts = conflictCount - _lastWorkerPoolConflicts;
+    _lastWorkerPoolCommits = commitCount;
+    _lastWorkerPoolConflicts = conflictCount;
+
+    const int target = _targetWorkerThreads.load();
+    const size_t queueDepth = _commandQueue.size();
+    const double utilization = (double)busyUS / (elapsed * target);
+    const double cpuRatio = busyUS ? (double)cpuUS / busyUS : 0.0;
+    const double conflictRate = (commits + conflicts) ? (double)conflicts / (commits + conflicts) : 0.0;
+
+    // Work out which way to move, if any.
+    int newTarget = target;
+    string reason;
+    if (conflictRate > WORKER_POOL_MAX_CONFLICT_RATE) {
+        if (target > _minWorkerThreads) {
+            newTarget = target - 1;
+            reason = "conflicts";
+        }
+    } else if (queueDepth > (size_t)target && target < _maxWorkerThreads) {
+        if (cpuRatio < WORKER_POOL_BLOCKED_CPU_RATIO) {
+            newTarget = min(_maxWorkerThreads, target + max(1, target / 4));
+            reason = "queued, workers blocked";
+        } else if ((unsigned int)target < thread::hardware_concurrency()) {
+            newTarget = target + 1;
+            reason = "queued, CPU available";
+        }
+    } else if (!queueDepth && utilization < WORKER_POOL_IDLE_UTILIZATION && target > _minWorkerThreads) {
+        newTarget = target - 1;
+        reason = "idle";
+    }
+
+    if (newTarget != target) {
+        SINFO("Changing worker pool target from " << target << " to " << newTarget << " (" << reason << "), queueDepth: "
+              << queueDepth << ", utilization: " << utilization << ", cpuRatio: " << cpuRatio << ", conflictRate: "
+              << conflictRate << ".");
+
+        // Any threads we've never started are started now, the rest are woken from parking.
+        while (workerThreadList.size() < (size_t)newTarget) {
+            workerThreadList.emplace_back(&BedrockServer::worker, this, workerThreadList.size());
+        }
+        _targetWorkerThreads = newTarget;
+        _targetWorkerThreads.notify_all();
+    }
+
+    lock_guard<mutex> lock(_workerPoolInfoMutex);
+    _workerPoolInfo["min"] = to_string(_minWorkerThreads);
+    _workerPoolInfo["max"] = to_string(_maxWorkerThreads);
+    _workerPoolInfo["target"] = to_string(newTarget);
+    _workerPoolInfo["started"] = to_string(workerThreadList.size());
+    _workerPoolInfo["queueDepth"] = to_string(queueDepth);
+    _workerPoolInfo["utilization"] = to_string(utilization);
+    _workerPoolInfo["cpuRatio"] = to_string(cpuRatio);
+    _workerPoolInfo["conflictRate"] = to_string(conflictRate);
+    if (newTarget != target) {
+        _workerPoolInfo["lastChange"] = to_string(target) + "->" + to_string(newTarget);
+        _workerPoolInfo["lastChangeReason"] = reason;
+        _workerPoolInfo["lastChangeTime"] = to_string(now);
+    }
+}
+
 void BedrockServer::runCommand(unique_ptr<BedrockCommand>&& _command, bool isBlocking, bool hasDedicatedThread) {
     // If there's no sync node (because we're detaching/attaching), we can only queue a command for later.
     // Also,if this command is scheduled in the future, we can't just run it, we need to enqueue it to run at that point.
@@ -756,6 +821,46 @@ void BedrockServer::runCommand(unique_ptr<BedrockCommand>&& _command, bool isBlo
     // our state right before we commit.
     SQLiteNodeState state = _replicationState.load();
 
+    // If the client asked for data no staler than `maxStalenessMS` and we're further behind than that, send the
+    // command to a follower that's caught up, or if there isn't one (or it can't be reached), wait until we are
+    // (below). Commands are only forwarded once, so a follower that's fallen behind by the time it gets the command
+    // waits as well.
+    uint64_t minCommitCount = command->request.calcU64("minCommitCount");
+    if (state == SQLiteNodeState::FOLLOWING && !command->complete && command->request.isSet("maxStalenessMS")) {
+        auto syncNodeCopy = atomic_load(&_syncNode);
+        if (syncNodeCopy && syncNodeCopy->getStalenessMS(syncNodeCopy->getCommitCount()) > command->request.calcU64("maxStalenessMS")) {
+            const uint64_t headCommitCount = syncNodeCopy->getHeadCommitCount();
+            const bool canForward = !command->forwardedForStaleness && !command->request.isSet("stalenessForwarded") && command->httpsRequests.empty();
+            const string peerName = canForward ? syncNodeCopy->getFreshestFollower(headCommitCount) : "";
+            if (!peerName.empty()) {
+                command->forwardedForStaleness = true;
+                if (hasDedicatedThread) {
+                    // Nothing else is waiting on this thread, so we can wait for the follower here.
+                    if (!_forwardForStaleness(*command, peerName)) {
+                        minCommitCount = max(minCommitCount, headCommitCount);
+                    }
+                } else if (_outstandingStalenessForwards.fetch_add(1) < MAX_STALENESS_FORWARDS) {
+                    // Don't hold up a worker waiting on another node. Whether or not it worked, the command goes back
+                    // on the queue, and is either replied to, or waits to catch up, as it's not forwarded again.
+                    thread([this, peerName, forwardCommand = move(command)]() mutable {
+                        SInitialize("forward");
+                        _forwardForStaleness(*forwardCommand, peerName);
+                        _commandQueue.push(move(forwardCommand));
+                        _outstandingStalenessForwards--;
+                    }).detach();
+                    return;
+                } else {
+                    // Enough commands are already being forwarded, so this one waits to catch up.
+                    _outstandingStalenessForwards--;
+                    SINFO("Too many commands forwarded for staleness, " << command->request.methodLine << " will wait to catch up instead.");
+                    minCommitCount = max(minCommitCount, headCommitCount);
+                }
+            } else {
+                minCommitCount = max(minCommitCount, headCommitCount);
+            }
+        }
+    }
+
     // If we're following, we will automatically escalate any command that's:
     // 1. Not already complete (complete commands are likely already returned from leader with legacy escalation) 
     // and is marked as `escalateImmediately` (which lets them skip the queue, which is particularly useful if they're waiting
@@ -764,9 +869,9 @@ void BedrockServer::runCommand(unique_ptr<BedrockCommand>&& _command, bool isBlo
     if (state == SQLiteNodeState::FOLLOWING && !command->complete && (command->escalateImmediately || _version != _leaderVersion.load())) {
         auto _clusterMessengerCopy = _clusterMessenger;
         string escalatedTo = "";
-        if (command->escalateImmediately && _clusterMessengerCopy && _clusterMessengerCopy->runOnPeer(*command, true)) {
-            // command->complete is now true for this command. It will get handled a few lines below.
-            SINFO("Immediately escalated " << command->request.methodLine << " to leader.");
+        if (command->escalateImmediately && _escalateToLeader(command)) {
+            // The reply is handled by `_escalateToLeader`.
+            return;
         } else if (_version != _leaderVersion.load() && _clusterMessengerCopy && _clusterMessengerCopy->runOnPeer(*command, false)) {
             SINFO("Escalated " << command->request.methodLine << " to follower peer.");
         } else {
@@ -884,23 +989,13 @@ void BedrockServer::runCommand(unique_ptr<BedrockCommand>&& _command, bool isBlo
             }
 
             // If this command is dependent on a commitCount newer than what we have (maybe it's a follow-up to a
-            // command that was escalated to leader), we'll set it aside for later processing. When the sync node
-            // finishes its update loop, it will re-queue any of these commands that are no longer blocked on our
-            // updated commit count.
+            // command that was escalated to leader), we'll set it aside for later processing. It's re-queued as soon as
+            // that commit count is committed locally.
             uint64_t commitCount = db.getCommitCount();
-            uint64_t commandCommitCount = command->request.calcU64("commitCount");
+            uint64_t commandCommitCount = max(command->request.calcU64("commitCount"), minCommitCount);
             if (commandCommitCount > commitCount) {
-                SAUTOLOCK(_futureCommitCommandMutex);
-                auto newQueueSize = _futureCommitCommands.size() + 1;
-                SINFO("Command (" << command->request.methodLine << ") depends on future commit (" << commandCommitCount
-                      << "), Currently at: " << commitCount << ", storing for later. Queue size: " << newQueueSize);
-                _futureCommitCommandTimeouts.insert(make_pair(command->timeout(), commandCommitCount));
-                _futureCommitCommands.insert(make_pair(commandCommitCount, move(command)));
-
                 // Don't count this as `in progress`, it's just sitting there.
-                if (newQueueSize > 100) {
-                    SHMMM("_futureCommitCommands.size() == " << newQueueSize);
-                }
+                _commitWaitIndex.push(move(command), commandCommitCount, commitCount);
                 return;
             }
 
@@ -968,7 +1063,6 @@ void BedrockServer::runCommand(unique_ptr<BedrockCommand>&& _command, bool isBlo
                 if (!canWriteParallel) {
                     // Roll back the transaction, it'll get re-run in the sync thread.
                     core.rollback();
-                    auto _clusterMessengerCopy = _clusterMessenger;
                     if (state == SQLiteNodeState::LEADING) {
                         // Limit the command timeout to 20s to avoid blocking the sync thread long enough to cause the cluster to give up and elect a new leader (causing a fork), which happens
                         // after 30s.
@@ -979,9 +1073,8 @@ void BedrockServer::runCommand(unique_ptr<BedrockCommand>&& _command, bool isBlo
                     } else if (state == SQLiteNodeState::STANDINGDOWN) {
                         SINFO("Need to process command " << command->request.methodLine << " but STANDINGDOWN, moving to _standDownQueue.");
                         _standDownQueue.push(move(command));
-                    } else if (_clusterMessengerCopy && _clusterMessengerCopy->runOnPeer(*command, true)) {
-                        SINFO("Escalated " << command->request.methodLine << " to leader and complete, responding.");
-                        _reply(command);
+                    } else if (_escalateToLeader(command)) {
+                        // The reply is handled by `_escalateToLeader`.
                     } else {
                         // TODO: Something less naive that considers how these failures happen rather than a simple
                         // endless loop of requeue and retry.
@@ -1048,6 +1141,7 @@ void BedrockServer::runCommand(unique_ptr<BedrockCommand>&& _command, bool isBlo
                         command->complete = true;
                     } else {
                         SINFO("Conflict or state change committing " << command->request.methodLine << " on worker thread.");
+                        _conflictManager.recordConflict();
                         if (_enableConflictPageLocks) {
                             lastConflictPage = db.getLastConflictPage();
                         }
@@ -1228,15 +1322,16 @@ void BedrockServer::_resetServer() {
 
 BedrockServer::BedrockServer(SQLiteNodeState state, const SData& args_)
   : SQLiteServer(), args(args_), _replicationState(SQLiteNodeState::LEADING),
-    _syncNode(nullptr), _clusterMessenger(nullptr)
+    _syncNode(nullptr), _clusterMessenger(nullptr), _commitWaitIndex(_commandQueue), _onlineBackup("", 0, 0)
 {}
 
 BedrockServer::BedrockServer(const SData& args_)
   : SQLiteServer(), shutdownWhileDetached(false), args(args_), _requestCount(0), _replicationState(SQLiteNodeState::SEARCHING),
     _upgradeInProgress(false),
     _isCommandPortLikelyBlocked(false),
-    _syncThreadComplete(false), _syncNode(nullptr), _clusterMessenger(nullptr), _shutdownState(RUNNING),
-    _multiWriteEnabled(args.test("-enableMultiWrite")), _enableConflictPageLocks(args.test("-enableConflictPageLocks")), _shouldBackup(false), _detach(args.isSet("-bootstrap")),
+    _syncThreadComplete(false), _syncNode(nullptr), _clusterMessenger(nullptr), _commitWaitIndex(_commandQueue), _shutdownState(RUNNING),
+    _multiWriteEnabled(args.test("-enableMultiWrite")), _enableConflictPageLocks(args.test("-enableConflictPageLocks")), _shouldBackup(false),
+    _onlineBackup(args["-db"], args.calcU64("-backupMaxBytesPerSecond"), args.calcU64("-backupMaxWALMB") * 1024 * 1024), _detach(args.isSet("-bootstrap")),
     _controlPort(nullptr), _commandPortPublic(nullptr), _commandPortPrivate(nullptr), _maxConflictRetries(3),
     _lastQuorumCommandTime(STimeNow()), _pluginsDetached(false), _socketThreadNumber(0),
     _outstandingSocketThreads(0), _shouldBlockNewSocketThreads(false), _upgradeCompleted(false)
@@ -1460,13 +1555,17 @@ void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
         // if we are detaching.
         unique_lock<shared_mutex> lock(_controlPortExclusionMutex);
 
-        // If we've run out of sockets or hit our timeout, we'll increment _shutdownState.
-        if (!_outstandingSocketThreads) {
+        // If we've run out of sockets (and commands being forwarded for staleness, which go back on the queue when
+        // they're done) or hit our timeout, we'll increment _shutdownState.
+        if (!_outstandingSocketThreads && !_outstandingStalenessForwards) {
             _shutdownState.store(CLIENTS_RESPONDED);
         }
         if (_outstandingSocketThreads) {
             SINFO("Have " << _outstandingSocketThreads << " socket threads to close.");
         }
+        if (_outstandingStalenessForwards) {
+            SINFO("Have " << _outstandingStalenessForwards << " commands being forwarded for staleness.");
+        }
         size_t count = BedrockCommand::getCommandCount();
         if (count) {
             // For commands not initiated by a client (those with initiatingClientID = -1), we can have commands
@@ -1510,6 +1609,11 @@ void BedrockServer::_reply(unique_ptr<BedrockCommand>& command) {
 
     command->response["nodeName"] = args["-nodeName"];
 
+    // Responses to multiplexed requests can be sent in any order, so include the ID so the follower can match them up.
+    if (command->request.test("multiplexed")) {
+        command->response["ID"] = command->id;
+    }
+
     // If we're shutting down, tell the caller to close the connection.
     // Also, if the caller wanted us to close the connection, we'll parrot that back.
     if (_shutdownState.load() != RUNNING || command->request["Connection"] == "close") {
@@ -1532,8 +1636,11 @@ void BedrockServer::_reply(unique_ptr<BedrockCommand>& command) {
                 SERROR("Couldn't find plugin '" << pluginName << ".");
             }
         } else {
-            // Otherwise we send the standard response.
-            if (!command->socket->send(command->response.serialize())) {
+            // Otherwise we send the standard response. The socket copies what we send, so each thread composes
+            // responses into the same buffer rather than allocating a new one every time.
+            static thread_local string replyBuffer;
+            command->response.serialize(replyBuffer);
+            if (!command->socket->send(replyBuffer)) {
                 // If we can't send (client closed the socket?), alert our plugin it's response was never sent.
                 SINFO("No socket to reply for: '" << command->request.methodLine << "' #" << command->initiatingClientID);
                 command->handleFailedReply();
@@ -1542,8 +1649,9 @@ void BedrockServer::_reply(unique_ptr<BedrockCommand>& command) {
             }
         }
 
-        // If `Connection: close` was set, shut down the socket, in case the caller ignores us.
-        if (SIEquals(command->request["Connection"], "close") || _shutdownState.load() != RUNNING) {
+        // If `Connection: close` was set, shut down the socket, in case the caller ignores us. Multiplexed sockets may
+        // still have other commands to reply to, so they're closed by `handleSocket` when those are done.
+        if ((SIEquals(command->request["Connection"], "close") || _shutdownState.load() != RUNNING) && !command->request.test("multiplexed")) {
             command->socket->shutdown();
         }
     } else {
@@ -1557,6 +1665,51 @@ void BedrockServer::_reply(unique_ptr<BedrockCommand>& command) {
     SINFO("[performance] Finished replying to command " << command->request.methodLine << " moving on to the next command.");
 }
 
+bool BedrockServer::_forwardForStaleness(BedrockCommand& command, const string& peerName) {
+    auto clusterMessengerCopy = _clusterMessenger;
+    if (!clusterMessengerCopy) {
+        return false;
+    }
+    SINFO("Too stale for " << command.request.methodLine << ", forwarding to " << peerName << ".");
+    SData forwardedRequest = command.request;
+    forwardedRequest["stalenessForwarded"] = "true";
+    BedrockCommand forwardedCommand(SQLiteCommand(move(forwardedRequest)), nullptr);
+    if (!clusterMessengerCopy->runOnPeer(forwardedCommand, peerName)) {
+        SINFO("Couldn't forward " << command.request.methodLine << " to " << peerName << ", waiting to catch up instead.");
+        return false;
+    }
+    command.response = forwardedCommand.response;
+    command.complete = true;
+    return true;
+}
+
+bool BedrockServer::_escalateToLeader(unique_ptr<BedrockCommand>& command) {
+    auto _clusterMessengerCopy = _clusterMessenger;
+    if (!_clusterMessengerCopy) {
+        return false;
+    }
+
+    // Leaders running other versions may not support multiplexed requests, so we use a dedicated connection and
+    // wait for the response.
+    if (_version != _leaderVersion.load()) {
+        if (!_clusterMessengerCopy->runOnPeer(*command, true)) {
+            return false;
+        }
+        SINFO("Escalated " << command->request.methodLine << " to leader and complete, responding.");
+        _reply(command);
+        return true;
+    }
+
+    const string methodLine = command->request.methodLine;
+    if (!_clusterMessengerCopy->escalateToLeader(command, [this](unique_ptr<BedrockCommand>&& escalatedCommand) {
+        SINFO("Escalated " << escalatedCommand->request.methodLine << " to leader and complete, responding.");
+        _reply(escalatedCommand);
+    })) {
+        return false;
+    }
+    SINFO("Escalated " << methodLine << " to leader, waiting for response.");
+    return true;
+}
 
 void BedrockServer::blockCommandPort(const string& reason) {
     lock_guard<mutex> lock(_portMutex);
@@ -1683,6 +1836,8 @@ void BedrockServer::_status(unique_ptr<BedrockCommand>& command) {
         content["version"] = _version;
         content["host"] = args["-nodeHost"];
         content["commandCount"] = BedrockCommand::getCommandCount();
+        const uint64_t recvSyscalls = STCPManager::recvSyscallCount;
+        content["recvBytesPerSyscall"] = recvSyscalls ? STCPManager::recvByteCount / recvSyscalls : 0;
 
         {
             // Make it known if anything is known to cause crashes.
@@ -1724,12 +1879,41 @@ void BedrockServer::_status(unique_ptr<BedrockCommand>& command) {
         content["queuedCommandList"]           = SComposeJSONArray(_commandQueue.getRequestMethodLines());
         content["syncThreadQueuedCommandList"] = SComposeJSONArray(syncNodeQueuedMethods);
 
+        shared_ptr<SQLitePool> dbPoolCopy = _dbPool;
+        if (dbPoolCopy) {
+            content["dbPool"] = SComposeJSONObject(dbPoolCopy->getInfo());
+            content["resultCache"] = SComposeJSONObject(dbPoolCopy->getBase().getResultCacheInfo());
+            content["dbCache"] = SComposeJSONObject(dbPoolCopy->getBase().getCacheInfo());
+            STable idFilterInfo = dbPoolCopy->getBase().getIDFilterInfo();
+            if (!idFilterInfo.empty()) {
+                content["idFilters"] = SComposeJSONObject(idFilterInfo);
+            }
+        }
+        if (SQLitePageCache::installed()) {
+            content["pageCache"] = SComposeJSONObject(SQLitePageCache::getInfo());
+        }
+        STable backupInfo = _onlineBackup.getInfo();
+        if (!backupInfo.empty()) {
+            content["backup"] = SComposeJSONObject(backupInfo);
+        }
+
+        {
+            lock_guard<mutex> lock(_workerPoolInfoMutex);
+            if (!_workerPoolInfo.empty()) {
+                content["workerPool"] = SComposeJSONObject(_workerPoolInfo);
+            }
+        }
+
         auto _syncNodeCopy = atomic_load(&_syncNode);
         if (_syncNodeCopy) {
             content["syncNodeAvailable"] = "true";
             // Set some information about this node.
             content["CommitCount"] = to_string(_syncNodeCopy->getCommitCount());
             content["priority"] = to_string(_syncNodeCopy->getPriority());
+            const uint64_t headCommitCount = _syncNodeCopy->getHeadCommitCount();
+            const uint64_t commitCount = _syncNodeCopy->getCommitCount();
+            content["lagCommits"] = to_string(headCommitCount > commitCount ? headCommitCount - commitCount : 0);
+            content["lagMS"] = to_string(_syncNodeCopy->getStalenessMS(commitCount));
             _syncNodeCopy = nullptr;
         } else {
             content["syncNodeAvailable"] = "false";
@@ -1772,6 +1956,7 @@ void BedrockServer::_status(unique_ptr<BedrockCommand>& command) {
 
 bool BedrockServer::_isControlCommand(const unique_ptr<BedrockCommand>& command) {
     if (SIEquals(command->request.methodLine, "BeginBackup")            ||
+        SIEquals(command->request.methodLine, "BackupJournal")          ||
         SIEquals(command->request.methodLine, "SuppressCommandPort")    ||
         SIEquals(command->request.methodLine, "ClearCommandPort")       ||
         SIEquals(command->request.methodLine, "ClearCrashCommands")     ||
@@ -1780,6 +1965,7 @@ bool BedrockServer::_isControlCommand(const unique_ptr<BedrockCommand>& command)
         SIEquals(command->request.methodLine, "Attach")                 ||
         SIEquals(command->request.methodLine, "SetConflictParams")      ||
         SIEquals(command->request.methodLine, "SetConflictPageLocks")   ||
+        SIEquals(command->request.methodLine, "SetCacheParams")         ||
         SIEquals(command->request.methodLine, "EnableSQLTracing")       ||
         SIEquals(command->request.methodLine, "BlockWrites")            ||
         SIEquals(command->request.methodLine, "UnblockWrites")          ||
@@ -1808,9 +1994,57 @@ thread* __quiesceThread = nullptr;
 void BedrockServer::_control(unique_ptr<BedrockCommand>& command) {
     SData& response = command->response;
     response.methodLine = "200 OK";
-    if (SIEquals(command->request.methodLine, "BeginBackup")) {
+    if (SIEquals(command->request.methodLine, "BeginBackup") && command->request.test("Online")) {
+        // Copy the database while we keep serving. Progress is reported in Status.
+        shared_ptr<SQLitePool> dbPoolCopy = _dbPool;
+        const string& dbPath = args["-db"];
+        string destination = command->request["Destination"];
+        if (destination.empty()) {
+            destination = "/var/tmp/" + string(basename((char*)dbPath.c_str()));
+        }
+        uint64_t maxBytesPerSecond = command->request.isSet("MaxBytesPerSecond") ? command->request.calcU64("MaxBytesPerSecond")
+                                                                                  : _onlineBackup.defaultMaxBytesPerSecond;
+        if (args.isSet("-hctree")) {
+            response.methodLine = "400 Online backup not supported with hctree";
+        } else if (_onlineBackup.overwritesDatabase(destination)) {
+            response.methodLine = "400 Destination would overwrite the database";
+        } else if (!dbPoolCopy) {
+            response.methodLine = "401 Backup prevented by server not ready";
+        } else if (!_onlineBackup.start(dbPoolCopy, destination, maxBytesPerSecond)) {
+            response.methodLine = "409 Backup already running";
+        } else {
+            response.methodLine = "202 Backup started";
+            response["destination"] = destination;
+        }
+    } else if (SIEquals(command->request.methodLine, "BeginBackup")) {
         _shouldBackup = true;
         _beginShutdown("Detach", true);
+    } else if (SIEquals(command->request.methodLine, "BackupJournal")) {
+        // Save the commits since the last backup as journal segments, for incremental backups. Without `FromCommit`,
+        // this continues from the last segment already in the directory.
+        shared_ptr<SQLitePool> dbPoolCopy = _dbPool;
+        const string& dbPath = args["-db"];
+        const string dbFilename = basename((char*)dbPath.c_str());
+        const string directory = command->request.isSet("Directory") ? command->request["Directory"] : "/var/tmp";
+        uint64_t fromCommit = command->request.isSet("FromCommit") ? command->request.calcU64("FromCommit")
+                                                                   : SQLiteJournalBackup::lastExportedCommit(directory, dbFilename);
+        if (!dbPoolCopy) {
+            response.methodLine = "401 Backup prevented by server not ready";
+        } else if (!fromCommit) {
+            response.methodLine = "400 Missing FromCommit";
+        } else {
+            SQLiteScopedHandle dbScope(*dbPoolCopy, dbPoolCopy->getIndex());
+            SQLite& db = dbScope.db();
+            const uint64_t toCommit = db.getCommitCount();
+            try {
+                list<string> segments = SQLiteJournalBackup::exportSegments(db, directory, fromCommit, toCommit);
+                response["fromCommit"] = to_string(fromCommit);
+                response["toCommit"] = to_string(max(fromCommit, toCommit));
+                response["segments"] = SComposeJSONArray(segments);
+            } catch (const SException& e) {
+                response.methodLine = e.method;
+            }
+        }
     } else if (SIEquals(command->request.methodLine, "SuppressCommandPort")) {
         blockCommandPort("MANUAL");
     } else if (SIEquals(command->request.methodLine, "ClearCommandPort")) {
@@ -1873,6 +2107,36 @@ void BedrockServer::_control(unique_ptr<BedrockCommand>& command) {
         }
     } else if (SIEquals(command->request.methodLine, "SetConflictPageLocks")) {
         _enableConflictPageLocks = command->request.test("enable");
+    } else if (SIEquals(command->request.methodLine, "SetCacheParams")) {
+        // Changes the page cache budget (in KB, 0 to give each DB handle `-cacheSize`) and mmap size (in GB) of every
+        // DB handle, and the arena page cache budget (in MB, only with `-arenaPageCache`). Any can be left out to leave
+        // it as is. Handles pick the change up at their next transaction.
+        shared_ptr<SQLitePool> dbPoolCopy = _dbPool;
+        if (!dbPoolCopy) {
+            response.methodLine = "500 DB not open";
+            return;
+        }
+        if (command->request.isSet("ArenaBudgetMB") && !SQLitePageCache::installed()) {
+            response.methodLine = "400 Arena page cache not installed";
+            return;
+        }
+        SQLite& db = dbPoolCopy->getBase();
+        STable previous = db.getCacheInfo();
+        response["previousCacheBudget"] = previous["budgetKB"];
+        response["previousMmapSizeGB"] = previous["mmapSizeGB"];
+        if (command->request.isSet("CacheBudget")) {
+            SINFO("Setting cache budget to " << command->request["CacheBudget"] << "KB");
+            db.setCacheBudget(command->request.calcU64("CacheBudget"));
+        }
+        if (command->request.isSet("MmapSizeGB")) {
+            SINFO("Setting mmap size to " << command->request["MmapSizeGB"] << "GB");
+            db.setMmapSize(command->request.calcU64("MmapSizeGB"));
+        }
+        if (command->request.isSet("ArenaBudgetMB")) {
+            response["previousArenaBudgetMB"] = to_string(SToUInt64(SQLitePageCache::getInfo()["budgetBytes"]) / (1024 * 1024));
+            SINFO("Setting arena page cache budget to " << command->request["ArenaBudgetMB"] << "MB");
+            SQLitePageCache::setBudget(command->request.calcU64("ArenaBudgetMB") * 1024 * 1024);
+        }
     } else if (SIEquals(command->request.methodLine, "BlockWrites")) {
         atomic<bool> locked(false);
         lock_guard lock(__quiesceLock);
@@ -2214,6 +2478,22 @@ void BedrockServer::handleSocket(Socket&& socket, bool fromControlPort, bool fro
     SInitialize("socket" + to_string(_socketThreadNumber++));
     SINFO("Socket thread starting");
 
+    // Followers escalating commands can send `multiplexed` requests, which we start on immediately rather than waiting
+    // for the previous command on this socket to finish (see `SQLiteClusterMessenger::EscalationChannel`). We count
+    // these so that we don't destroy the socket until they've all replied.
+    mutex multiplexedMutex;
+    condition_variable multiplexedCV;
+    size_t multiplexedCommands = 0;
+    function<void()> multiplexedCallback = [&multiplexedMutex, &multiplexedCV, &multiplexedCommands]() {
+        lock_guard lock(multiplexedMutex);
+        multiplexedCommands--;
+        multiplexedCV.notify_all();
+    };
+
+    // Set when we've read a request from the socket and there's more data buffered after it, which may be another
+    // complete request that we should handle before waiting for more data.
+    bool haveBufferedData = false;
+
     // This outer loop just runs until the entire socket life cycle is done, meaning it deserializes a command,
     // waits for it to get processed, deserializes another, etc, until the socket gets closed.
     // This whole block is largely duplicated from `postPoll` and modified to work on a single non-blocking socket.
@@ -2230,17 +2510,22 @@ void BedrockServer::handleSocket(Socket&& socket, bool fromControlPort, bool fro
         struct pollfd pollStruct = { socket.s, POLLIN, 0 };
 
         // As long as `poll` returns 0 we've timed out, indicating that we're still waiting for something to happen. In
-        // that case, we'll loop again *unless* we're shutting down.
-        while (!(pollResult = poll(&pollStruct, 1, 1'000))) {
+        // that case, we'll loop again *unless* we're shutting down (and have no multiplexed commands still to reply to).
+        while (!haveBufferedData && !(pollResult = poll(&pollStruct, 1, 1'000))) {
             if (_shutdownState != RUNNING) {
-                SINFO("Socket thread exiting because no data and shutting down.");
-                socket.shutdown(Socket::CLOSED);
-                break;
+                lock_guard lock(multiplexedMutex);
+                if (!multiplexedCommands) {
+                    SINFO("Socket thread exiting because no data and shutting down.");
+                    socket.shutdown(Socket::CLOSED);
+                    break;
+                }
             }
         }
 
         // If the above loop didn't close the socket due to inactivity at shutdown, let's handle the activity.
-        if (socket.state != STCPManager::Socket::CLOSED) {
+        if (haveBufferedData) {
+            haveBufferedData = false;
+        } else if (socket.state != STCPManager::Socket::CLOSED) {
             if (pollResult < 0) {
                 // This is an exceptional case, we'll just kill the socket if this happens and let the client reconnect.
                 SINFO("Poll failed: " << strerror(errno));
@@ -2274,6 +2559,7 @@ void BedrockServer::handleSocket(Socket&& socket, bool fromControlPort, bool fro
                 if (socket.recvBuffer.startsWithHTTPRequest()) {
                     requestSize = request.deserialize(socket.recvBuffer);
                     socket.recvBuffer.consumeFront(requestSize);
+                    haveBufferedData = requestSize && !socket.recvBuffer.empty();
                 }
 
                 // If this socket was accepted from the public command port, and that's supposed to be closed now, set
@@ -2281,6 +2567,12 @@ void BedrockServer::handleSocket(Socket&& socket, bool fromControlPort, bool fro
                 if (requestSize && fromPublicCommandPort && _isCommandPortLikelyBlocked) {
                     request["Connection"] = "close";
                 }
+
+                // Only followers escalating to us on the private command port can multiplex requests. Anyone else
+                // gets their requests handled one at a time, in order.
+                if (requestSize && !fromPrivateCommandPort) {
+                    request.erase("multiplexed");
+                }
             }
 
             // If we have a populated request, from either a plugin or our default handling, we'll queue up the
@@ -2323,7 +2615,13 @@ void BedrockServer::handleSocket(Socket&& socket, bool fromControlPort, bool fro
 
                         // Ok, none of above synchronization code gets called unless the command has a socket to respond on.
                         bool hasSocket = command->socket;
-                        if (hasSocket) {
+                        const bool multiplexed = hasSocket && command->request.test("multiplexed");
+                        if (multiplexed) {
+                            // We don't wait for this one, just count it.
+                            lock_guard lock(multiplexedMutex);
+                            multiplexedCommands++;
+                            command->destructionCallback = &multiplexedCallback;
+                        } else if (hasSocket) {
                             // Set the destructor callback for when the command finishes.
                             command->destructionCallback = &callback;
                         }
@@ -2340,7 +2638,7 @@ void BedrockServer::handleSocket(Socket&& socket, bool fromControlPort, bool fro
                         // Now that the command is queued, we wait for it to complete (if it's has a socket, and hasn't finished by the time we get to this point).
                         // When this happens, destructionCallback fires, sets `finished` to true, and we can move on to the next request.
                         unique_lock<mutex> lock(m);
-                        if (!finished && hasSocket) {
+                        if (!finished && hasSocket && !multiplexed) {
                             cv.wait(lock, [&]{return finished.load();});
                         }
                     }
@@ -2354,6 +2652,12 @@ void BedrockServer::handleSocket(Socket&& socket, bool fromControlPort, bool fro
         }
     }
 
+    // Wait for any multiplexed commands to finish with the socket before it's destroyed.
+    {
+        unique_lock lock(multiplexedMutex);
+        multiplexedCV.wait(lock, [&]{return multiplexedCommands == 0;});
+    }
+
     // At this point out socket is closed and we can clean up.
     // Note that we never return early, we always want to hit this code and decrement our counter and clean up our socket.
     _outstandingSocketThreads--;
@@ -5,6 +5,8 @@
 #include <sqlitecluster/SQLiteClusterMessenger.h>
 #include "BedrockPlugin.h"
 #include "BedrockCommandQueue.h"
+#include "BedrockCommitWaitIndex.h"
+#include "BedrockOnlineBackup.h"
 #include "BedrockConflictManager.h"
 #include "BedrockBlockingCommandQueue.h"
 #include "BedrockTimeoutCommandQueue.h"
@@ -326,10 +328,37 @@ class BedrockServer : public SQLiteServer {
     // Each worker thread runs this function. It gets the same data as the sync thread, plus its individual thread ID.
     void worker(int threadId);
 
+    // Called on every sync thread loop iteration. Every WORKER_POOL_INTERVAL_US, this looks at queue depth, how much of
+    // their busy time workers spent on CPU rather than blocked, and the worker conflict rate, and moves
+    // `_targetWorkerThreads` by a step in whichever direction those call for, starting new threads if needed.
+    void _adjustWorkerPool(list<thread>& workerThreadList);
+
+    // Returns the CPU time used by the calling thread, in microseconds.
+    static uint64_t _threadCPUTimeUS();
+
     // Send a reply for a completed command back to the initiating client. If the `originator` of the command is set,
     // then this is an error, as the command should have been sent back to a peer.
     void _reply(unique_ptr<BedrockCommand>& command);
 
+    // Escalates a command to leader, and replies to the client once leader responds. If leader is running our version,
+    // this is done over the multiplexed escalation channel, and returns as soon as the command is sent, without waiting
+    // for leader. Otherwise, it waits for leader to respond. Returns true if the command was escalated, in which case
+    // `command` has been consumed, or false if it couldn't be (i.e., there's no leader), in which case it can be
+    // retried.
+    bool _escalateToLeader(unique_ptr<BedrockCommand>& command);
+
+    // Runs a command on the named follower because this node is too stale to answer it, and waits for the response.
+    // Returns true and completes the command if that worked, or false if the follower couldn't be reached.
+    bool _forwardForStaleness(BedrockCommand& command, const string& peerName);
+
+    // Workers hand commands forwarded for staleness to a thread of their own, so they don't wait on another node. At
+    // most this many of those threads run at once. Past that, commands wait to catch up instead, which is what
+    // they'd do anyway if there were no follower to forward them to.
+    static constexpr uint64_t MAX_STALENESS_FORWARDS = 16;
+
+    // The number of those threads running, so we can bound them, and wait for them before finishing shutting down.
+    atomic<uint64_t> _outstandingStalenessForwards = 0;
+
     // The following are constants used as methodlines by status command requests.
     static constexpr auto STATUS_IS_FOLLOWER       = "GET /status/isFollower HTTP/1.1";
     static constexpr auto STATUS_HANDLING_COMMANDS = "GET /status/handlingCommands HTTP/1.1";
@@ -363,15 +392,10 @@ class BedrockServer : public SQLiteServer {
     // This stars the server shutting down.
     void _beginShutdown(const string& reason, bool detach = false);
 
-    // This is a map of commit counts in the future to commands that depend on them. We can receive a command that
-    // depends on a future commit if we're a follower that's behind leader, and a client makes two requests, one to a node
-    // more current than ourselves, and a following request to us. We'll move these commands to this special map until
-    // we catch up, and then move them back to the regular command queue.
-    multimap<uint64_t, unique_ptr<BedrockCommand>> _futureCommitCommands;
-
-    // Map of command timeouts to the indexes into _futureCommitCommands where those commands live.
-    multimap<uint64_t, uint64_t> _futureCommitCommandTimeouts;
-    recursive_mutex _futureCommitCommandMutex;
+    // Commands that depend on a commit count this node hasn't reached yet wait here until we catch up (or they time
+    // out), and are then moved back to the regular command queue. This is woken by commits, and doesn't need any
+    // attention from the sync thread.
+    BedrockCommitWaitIndex _commitWaitIndex;
 
     // A set of command names that will always be run with QUORUM consistency level.
     // Specified by the `-synchronousCommands` command-line switch.
@@ -392,6 +416,9 @@ class BedrockServer : public SQLiteServer {
 
     // Set this to cause a backup to run in detached mode
     bool _shouldBackup;
+
+    // Runs `BeginBackup` with `Online: true`, which copies the database without detaching.
+    BedrockOnlineBackup _onlineBackup;
     atomic<bool> _detach;
 
     // Pointers to the ports on which we accept commands.
@@ -449,6 +476,40 @@ class BedrockServer : public SQLiteServer {
     // The number of seconds to wait between forcing a command to QUORUM.
     uint64_t _quorumCheckpointSeconds;
 
+    // The worker pool grows and shrinks between `-minWorkerThreads` and `-maxWorkerThreads` (both default to the
+    // starting number of workers, which keeps the pool a fixed size). Workers with IDs at or above
+    // `_targetWorkerThreads` park until the target rises again, rather than exiting, so that shrinking the pool never
+    // has to wait for a thread that's in the middle of a command.
+    static constexpr uint64_t WORKER_POOL_INTERVAL_US = 1'000'000;
+
+    // Shrink when more than this fraction of worker commits conflict, as more threads only make that worse.
+    static constexpr double WORKER_POOL_MAX_CONFLICT_RATE = 0.2;
+
+    // With commands queued, workers that spend less than this fraction of their busy time on CPU are mostly waiting
+    // on something else (disk, locks, HTTPS requests), so we can add threads quickly. Otherwise we only add threads
+    // while there are idle cores.
+    static constexpr double WORKER_POOL_BLOCKED_CPU_RATIO = 0.5;
+
+    // Shrink when nothing's queued and workers are busy less than this fraction of the time.
+    static constexpr double WORKER_POOL_IDLE_UTILIZATION = 0.25;
+
+    int _minWorkerThreads = 0;
+    int _maxWorkerThreads = 0;
+    atomic<int> _targetWorkerThreads = 0;
+
+    // Wall clock and CPU time spent by workers running commands since the last adjustment.
+    atomic<uint64_t> _workerBusyUS = 0;
+    atomic<uint64_t> _workerCPUUS = 0;
+
+    // Only used by the sync thread in `_adjustWorkerPool`.
+    uint64_t _lastWorkerPoolCheck = 0;
+    uint64_t _lastWorkerPoolCommits = 0;
+    uint64_t _lastWorkerPoolConflicts = 0;
+
+    // The inputs and outcome of the most recent adjustment, for Status.
+    mutex _workerPoolInfoMutex;
+    STable _workerPoolInfo;
+
     // Timestamp for the last time we promoted a command to QUORUM.
     atomic<uint64_t> _lastQuorumCommandTime;
 
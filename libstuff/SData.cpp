@@ -1,6 +1,7 @@
 #include "SData.h"
 
 #include <libstuff/SFastBuffer.h>
+#include <libstuff/SHTTPView.h>
 
 const string SData::placeholder;
 
@@ -97,12 +98,23 @@ string SData::serialize() const {
     return SComposeHTTP(methodLine, nameValueMap, content);
 }
 
+void SData::serialize(string& buffer) const {
+    SComposeHTTP(buffer, methodLine, nameValueMap, content);
+}
+
 int SData::deserialize(const string& fromString) {
     return deserialize(fromString.c_str(), fromString.size());
 }
 
 int SData::deserialize(const char* buffer, size_t length) {
-    auto result = SParseHTTP(buffer, length, methodLine, nameValueMap, content);
+    // Most messages are located with a reused SHTTPView, which finds every header without allocating, and then copied
+    // out in one pass. Anything it doesn't handle goes through SParseHTTP, which gives the same results for everything
+    // else.
+    static thread_local SHTTPView view;
+    int result = view.parse(buffer, length);
+    if (result == SHTTPView::UNSUPPORTED || !_copyFrom(view)) {
+        result = SParseHTTP(buffer, length, methodLine, nameValueMap, content);
+    }
 
     // Why do this? It's to enable these values to be parsed quickly with simdjson, which requires up to 32 bytes of
     // space at the end of the string so that it can run on chunks bigger than a single character, while guaranteeing
@@ -116,6 +128,27 @@ int SData::deserialize(const char* buffer, size_t length) {
     return result;
 }
 
+bool SData::_copyFrom(const SHTTPView& view) {
+    methodLine.assign(view.methodLine());
+    nameValueMap.clear();
+    content.assign(view.content());
+    for (const SHTTPView::Header& header : view.headers()) {
+        string value(header.value);
+        if (header.escaped) {
+            value = SUnescape(value);
+        }
+        auto result = nameValueMap.try_emplace(string(header.name), move(value));
+        if (!result.second) {
+            // Repeated Set-Cookie headers are combined by SParseHTTP, let it do that.
+            if (SIEquals(result.first->first, "Set-Cookie")) {
+                return false;
+            }
+            result.first->second = move(value);
+        }
+    }
+    return true;
+}
+
 SData SData::create(const string& fromString) {
     SData data;
     int header = data.deserialize(fromString);
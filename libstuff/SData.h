@@ -3,6 +3,8 @@
 
 #include <libstuff/libstuff.h>
 
+class SHTTPView;
+
 using namespace std;
 
 // --------------------------------------------------------------------------
@@ -96,6 +98,9 @@ struct SData {
     // Serializes this to a string
     string serialize() const;
 
+    // Serializes this into `buffer`, replacing its contents. Reusing the same buffer avoids allocating for each message.
+    void serialize(string& buffer) const;
+
     // Deserializes from a string
     int deserialize(const string& rhs);
 
@@ -110,6 +115,11 @@ struct SData {
     // **DEPRECATED** Use the constructor that handles this instead.
     static SData create(const string& rhs);
     static const string placeholder;
+
+  private:
+    // Copies a message parsed by SHTTPView into this object, unescaping header values like SParseHTTP. Returns false
+    // for the rare messages that need to be parsed by SParseHTTP instead.
+    bool _copyFrom(const SHTTPView& view);
 };
 
 // Support output stream operations.
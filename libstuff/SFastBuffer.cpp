@@ -4,7 +4,12 @@
 SFastBuffer::SFastBuffer() : front(0) {
 }
 
-SFastBuffer::SFastBuffer(const string& str) : front(0), data(str) {
+SFastBuffer::SFastBuffer(const string& str) : front(0) {
+    assign(str.data(), str.size());
+}
+
+SFastBuffer::SFastBuffer(const SFastBuffer& other) : front(0) {
+    assign(other.c_str(), other.size());
 }
 
 bool SFastBuffer::startsWithHTTPRequest() {
@@ -19,24 +24,25 @@ bool SFastBuffer::startsWithHTTPRequest() {
     if (!headerLength) {
         size_t next = nextToCheck;
         while (!headerLength) {
-            next = data.find('\n', next);
+            const char* found = next < dataSize ? (const char*)memchr(data.get() + next, '\n', dataSize - next) : nullptr;
 
-            if (next == string::npos) {
+            if (!found) {
                 // There's nothing to find, we can give up until the next call.
                 break;
             }
+            next = found - data.get();
 
             // If we don't break above, then there we've found a `\n` in our input. We need to see if it's part of a valid separator sequence.
             // We support both `\r\n\r\n` and `\n\n` as valid seperators. Only the first is real HTTP, but the second is easier to use in many command-line tools (i.e., netcat).
             // This means there's at least one byte after this one. If it's also a `\n`, then this is a good sequence.
-            if (next < data.size() - 1) {
+            if (next < dataSize - 1) {
                 if(data[next + 1] == '\n') {
                     headerLength = next - front;
                 }
             }
 
             // Ok, the only other possible valid sequence requires that there are at least *two* bytes after this one, and one byte before.
-            if (next && (next < data.size() - 2)) {
+            if (next && (next < dataSize - 2)) {
                 // Make sure the previous and next bytes are `\r` and two bytes ahead is `\n`.
                 if (data[next - 1] == '\r' && data [next + 1] == '\r' && data[next + 2] == '\n') {
                     headerLength = next - front - 1;
@@ -51,7 +57,7 @@ bool SFastBuffer::startsWithHTTPRequest() {
     // If we still haven't found any headers, we'll just need to try again.
     if (!headerLength) {
         // We start from four bytes before the end to make sure that the whole `\r\n\r\n` sequence we're looking for is ahead of our starting point.
-        nextToCheck = data.size() - 4;
+        nextToCheck = dataSize - 4;
     }
 
     // This is good enough for what we need right now, but it suffers the same exact problem that this was meant to fix, except for the body. This may be deferred as a future improvement to
@@ -64,11 +70,11 @@ bool SFastBuffer::empty() const {
 }
 
 size_t SFastBuffer::size() const {
-    return data.size() - front;
+    return dataSize - front;
 }
 
 const char* SFastBuffer::c_str() const {
-    return data.data() + front;
+    return data ? data.get() + front : "";
 }
 
 void SFastBuffer::clear() {
@@ -76,7 +82,10 @@ void SFastBuffer::clear() {
     nextToCheck = 0;
     headerLength = 0;
     contentLength = 0;
-    data.clear();
+    dataSize = 0;
+    if (data) {
+        data[0] = 0;
+    }
 }
 
 void SFastBuffer::consumeFront(size_t bytes) {
@@ -87,34 +96,78 @@ void SFastBuffer::consumeFront(size_t bytes) {
     contentLength = 0;
 
     // If we're all caught up, reset.
-    if (front == data.size()) {
+    if (front == dataSize) {
         clear();
     }
 }
 
-void SFastBuffer::append(const char* buffer, size_t bytes) {
+void SFastBuffer::makeRoom(size_t bytes) {
+    if (data && dataCapacity - dataSize >= bytes) {
+        return;
+    }
+
     // When will we condense everything to the front of the buffer?
     // When:
     // 1. We're not already at the front of the buffer (this implies there's data in the buffer).
     // 2. We'd have to do a realloc anyway because our buffer's not big enough for the new string (including the
     //    existing consumed buffer).
-    if (front && (data.capacity() - data.size() < bytes)) {
-        memmove(&data[0], data.data() + front, size());
-        data.resize(size());
+    // If that makes enough room, and we're not holding on to more than 4x the memory we need, we're done.
+    const size_t needed = size() + bytes;
+    if (front) {
+        memmove(data.get(), data.get() + front, size());
+        dataSize = size();
+        data[dataSize] = 0;
         front = 0;
         nextToCheck = 0;
         headerLength = 0;
         contentLength = 0;
-
-        // If the capacity is more than 4x the size we need, let's give some memory back.
-        if (data.capacity() > (data.size() + bytes) * 4) {
-            data.shrink_to_fit();
+        if (dataCapacity >= needed && dataCapacity <= needed * 4) {
+            return;
         }
     }
 
-    // After the resize, we may or may not need to actually reallocate. We can append now and let the string
-    // implementation decide if it needs more room.
-    data.append(buffer, bytes);
+    // Otherwise, reallocate, at least doubling the capacity when growing so appends take amortized constant time.
+    const size_t newCapacity = dataCapacity >= needed ? needed : max(needed, dataCapacity * 2);
+    unique_ptr<char[]> newData(new char[newCapacity + 1]);
+    if (dataSize) {
+        memcpy(newData.get(), data.get(), dataSize);
+    }
+    newData[dataSize] = 0;
+    data = move(newData);
+    dataCapacity = newCapacity;
+}
+
+void SFastBuffer::assign(const char* buffer, size_t bytes) {
+    clear();
+    makeRoom(bytes);
+    if (bytes) {
+        memcpy(data.get(), buffer, bytes);
+    }
+    dataSize = bytes;
+    data[dataSize] = 0;
+}
+
+void SFastBuffer::append(const char* buffer, size_t bytes) {
+    makeRoom(bytes);
+    if (bytes) {
+        memcpy(data.get() + dataSize, buffer, bytes);
+    }
+    dataSize += bytes;
+    data[dataSize] = 0;
+}
+
+char* SFastBuffer::reserveTail(size_t bytes) {
+    // The space is handed out as is. Nothing's counted as part of the data until `commitTail`, so none of it needs to
+    // be initialized.
+    makeRoom(bytes);
+    reserved = bytes;
+    return data.get() + dataSize;
+}
+
+void SFastBuffer::commitTail(size_t bytes) {
+    dataSize += min(bytes, reserved);
+    data[dataSize] = 0;
+    reserved = 0;
 }
 
 SFastBuffer& SFastBuffer::operator+=(const string& rhs) {
@@ -123,11 +176,14 @@ SFastBuffer& SFastBuffer::operator+=(const string& rhs) {
 }
 
 SFastBuffer& SFastBuffer::operator=(const string& rhs) {
-    front = 0;
-    nextToCheck = 0;
-    headerLength = 0;
-    contentLength = 0;
-    data = rhs;
+    assign(rhs.data(), rhs.size());
+    return *this;
+}
+
+SFastBuffer& SFastBuffer::operator=(const SFastBuffer& rhs) {
+    if (this != &rhs) {
+        assign(rhs.c_str(), rhs.size());
+    }
     return *this;
 }
 
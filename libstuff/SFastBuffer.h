@@ -1,5 +1,6 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <ostream>
 
@@ -9,6 +10,7 @@ class SFastBuffer {
   public:
     SFastBuffer();
     SFastBuffer(const string& str);
+    SFastBuffer(const SFastBuffer& other);
     bool empty() const;
     bool startsWithHTTPRequest();
     size_t size() const;
@@ -16,12 +18,33 @@ class SFastBuffer {
     void clear();
     void consumeFront(size_t bytes);
     void append(const char* buffer, size_t bytes);
+
+    // Returns space for at least `bytes` bytes at the end of the buffer, so data can be read into it directly rather
+    // than copied in with `append`. `commitTail` must be called afterwards with the number of bytes actually written,
+    // before anything else is done with the buffer.
+    char* reserveTail(size_t bytes);
+    void commitTail(size_t bytes);
     SFastBuffer& operator+=(const string& rhs);
     SFastBuffer& operator=(const string& rhs);
+    SFastBuffer& operator=(const SFastBuffer& rhs);
 
   private:
+    // Makes room for `bytes` more after the end of the data, first by moving any unconsumed data to the front of the
+    // buffer, and then by reallocating.
+    void makeRoom(size_t bytes);
+
+    // Replaces the contents of the buffer with a copy of `bytes` bytes of `buffer`.
+    void assign(const char* buffer, size_t bytes);
+
+    // The data is kept in a plain array rather than a string so that `reserveTail` can hand out space without
+    // initializing it first. There's always one byte more than `dataCapacity`, so the data can be null-terminated.
     size_t front;
-    string data;
+    unique_ptr<char[]> data;
+    size_t dataSize = 0;
+    size_t dataCapacity = 0;
+
+    // The number of bytes handed out by `reserveTail` that haven't been committed.
+    size_t reserved = 0;
 
     // State for managing checking if this contains an HTTP request.
     size_t nextToCheck = 0;
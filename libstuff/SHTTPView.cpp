@@ -0,0 +1,212 @@
+#include "SHTTPView.h"
+
+#include <cctype>
+#include <cstring>
+
+SHTTPView::SHTTPView() : _index(32, 0) {
+}
+
+void SHTTPView::clear() {
+    _methodLine = string_view();
+    _content = string_view();
+    if (!_headers.empty()) {
+        _headers.clear();
+        fill(_index.begin(), _index.end(), 0);
+    }
+}
+
+int SHTTPView::parse(const char* buffer, size_t length) {
+    clear();
+
+    // This follows the structure of SParseHTTP so that the two agree on every message this accepts.
+    const char* lineStart = buffer;
+    const char* inputEnd = buffer + length;
+    while (lineStart < inputEnd) {
+        const char* lineEnd = lineStart;
+        while (lineEnd < inputEnd && *lineEnd != '\r' && *lineEnd != '\n') {
+            ++lineEnd;
+        }
+        if (lineEnd >= inputEnd) {
+            // No end of line yet, the message is incomplete.
+            clear();
+            return 0;
+        }
+
+        if (lineEnd == lineStart) {
+            // A blank line ends the headers, if we've got a method line. Otherwise it's ignored.
+            if (!_methodLine.empty()) {
+                if (find("Transfer-Encoding")) {
+                    clear();
+                    return UNSUPPORTED;
+                }
+
+                // Consume up to 2 EOL characters to find the end of the headers.
+                const char* parseEnd = lineEnd;
+                int numEOLs = 2;
+                while (parseEnd < inputEnd && (*parseEnd == '\r' || *parseEnd == '\n') && numEOLs--) {
+                    ++parseEnd;
+                }
+                const int headerLength = (int)(parseEnd - buffer);
+
+                // Only plain decimal lengths are handled here, SParseHTTP deals with anything stranger.
+                int contentLength = 0;
+                const Header* contentLengthHeader = find("Content-Length");
+                if (contentLengthHeader) {
+                    if (contentLengthHeader->escaped || contentLengthHeader->value.size() > 9) {
+                        clear();
+                        return UNSUPPORTED;
+                    }
+                    for (char c : contentLengthHeader->value) {
+                        if (c < '0' || c > '9') {
+                            clear();
+                            return UNSUPPORTED;
+                        }
+                        contentLength = contentLength * 10 + (c - '0');
+                    }
+                }
+                if (!contentLength) {
+                    return headerLength;
+                }
+                if ((int)(length - headerLength) < contentLength) {
+                    clear();
+                    return 0;
+                }
+                _content = string_view(parseEnd, contentLength);
+                return headerLength + contentLength;
+            }
+        } else if (_methodLine.empty()) {
+            // The first line is the method line, trimmed of spaces.
+            const char* start = lineStart;
+            const char* end = lineEnd;
+            while (start < end && *start == ' ') {
+                ++start;
+            }
+            while (end > start && *(end - 1) == ' ') {
+                --end;
+            }
+            if (start == end) {
+                clear();
+                return UNSUPPORTED;
+            }
+            _methodLine = string_view(start, end - start);
+        } else {
+            // Lines starting with whitespace continue the previous header.
+            if (isspace((unsigned char)*lineStart)) {
+                clear();
+                return UNSUPPORTED;
+            }
+
+            // The name is everything up to the ':', and the value is the rest of the line, both trimmed of spaces.
+            const char* colon = (const char*)memchr(lineStart, ':', lineEnd - lineStart);
+            if (!colon) {
+                clear();
+                return UNSUPPORTED;
+            }
+            const char* nameEnd = colon;
+            while (nameEnd > lineStart && *(nameEnd - 1) == ' ') {
+                --nameEnd;
+            }
+            if (nameEnd == lineStart) {
+                clear();
+                return UNSUPPORTED;
+            }
+            const char* valueStart = colon + 1;
+            const char* valueEnd = lineEnd;
+            while (valueStart < valueEnd && *valueStart == ' ') {
+                ++valueStart;
+            }
+            while (valueEnd > valueStart && *(valueEnd - 1) == ' ') {
+                --valueEnd;
+            }
+            // SUnescape stops at a NUL, so values containing one need it too to match SParseHTTP.
+            const size_t valueLength = valueEnd - valueStart;
+            const bool escaped = memchr(valueStart, '\\', valueLength) || memchr(valueStart, '\0', valueLength);
+            _addHeader(string_view(lineStart, nameEnd - lineStart), string_view(valueStart, valueLength), escaped);
+        }
+
+        // Consume the end of the line -- accept \r\n, \n\r, \r, or \n.  But *not* \n\n (that's two endings)
+        lineStart = lineEnd;
+        if (inputEnd - lineStart >= 2 && ((lineStart[0] == '\r' && lineStart[1] == '\n') || (lineStart[0] == '\n' && lineStart[1] == '\r'))) {
+            lineStart += 2;
+        } else {
+            ++lineStart;
+        }
+    }
+
+    // Reached the end of the input and haven't finished parsing the header.
+    clear();
+    return 0;
+}
+
+const SHTTPView::Header* SHTTPView::find(string_view name) const {
+    const uint32_t slot = _index[_findSlot(name, hashName(name))];
+    return slot ? &_headers[slot - 1] : nullptr;
+}
+
+uint32_t SHTTPView::hashName(string_view name) {
+    // FNV-1a over the lower-cased name.
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : name) {
+        if (c >= 'A' && c <= 'Z') {
+            c |= 0x20;
+        }
+        hash ^= c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void SHTTPView::_addHeader(string_view name, string_view value, bool escaped) {
+    const uint32_t hash = hashName(name);
+    _headers.push_back({name, value, hash, escaped});
+    if (_headers.size() * 2 > _index.size()) {
+        _reindex(_index.size() * 2);
+    } else {
+        _index[_findSlot(name, hash)] = _headers.size();
+    }
+}
+
+void SHTTPView::_reindex(size_t slots) {
+    _index.assign(slots, 0);
+
+    // Later headers replace earlier ones with the same name, so `find` returns the last one.
+    for (size_t i = 0; i < _headers.size(); i++) {
+        _index[_findSlot(_headers[i].name, _headers[i].hash)] = i + 1;
+    }
+}
+
+size_t SHTTPView::_findSlot(string_view name, uint32_t hash) const {
+    const size_t mask = _index.size() - 1;
+    size_t slot = hash & mask;
+    while (_index[slot]) {
+        const Header& header = _headers[_index[slot] - 1];
+        if (header.hash == hash && _namesEqual(header.name, name)) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+bool SHTTPView::_namesEqual(string_view lhs, string_view rhs) {
+    if (lhs.size() != rhs.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lhs.size(); i++) {
+        unsigned char l = lhs[i];
+        unsigned char r = rhs[i];
+        if (l != r) {
+            // Only ASCII letters compare equal ignoring case, to match `hashName`.
+            if (l >= 'A' && l <= 'Z') {
+                l |= 0x20;
+            }
+            if (r >= 'A' && r <= 'Z') {
+                r |= 0x20;
+            }
+            if (l != r) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// A parsed HTTP-like message that refers directly into the buffer it was parsed from rather than copying anything out
+// of it. The method line, header names and values, and content are all views into that buffer, and headers are kept in
+// a flat array with an open-addressed index of case-insensitive name hashes, so lookups don't need any string compares
+// until a hash matches. An SHTTPView is meant to be reused: after the first few messages, `parse` doesn't allocate.
+//
+// The views are only valid as long as the buffer passed to `parse` is unchanged.
+//
+// This handles the common case of SParseHTTP exactly (including header values that need unescaping, which are flagged
+// rather than unescaped). Anything less common, like chunked bodies, folded header lines, or header lines with no
+// name, is reported as unsupported so the caller can fall back to SParseHTTP.
+class SHTTPView {
+  public:
+    struct Header {
+        string_view name;
+
+        // The value with leading and trailing spaces trimmed. If `escaped` is set, it's still slash-escaped (or contains
+        // a NUL), and needs SUnescape to get the value SParseHTTP would give.
+        string_view value;
+        uint32_t hash;
+        bool escaped;
+    };
+
+    // Returned by `parse` for messages that should be parsed with SParseHTTP instead.
+    static constexpr int UNSUPPORTED = -1;
+
+    SHTTPView();
+
+    // Parses the message at the start of `buffer`. Returns the number of bytes it took up, 0 if `buffer` doesn't hold a
+    // complete message yet, or UNSUPPORTED.
+    int parse(const char* buffer, size_t length);
+
+    // Forgets the current message.
+    void clear();
+
+    string_view methodLine() const { return _methodLine; }
+    string_view content() const { return _content; }
+
+    // All headers, in the order they appeared, including duplicates.
+    const vector<Header>& headers() const { return _headers; }
+
+    // Returns the last header with this name (compared case-insensitively), or nullptr if there isn't one.
+    const Header* find(string_view name) const;
+
+    // Case-insensitive (for ASCII) hash of a header name.
+    static uint32_t hashName(string_view name);
+
+  private:
+    // Adds a header to `_headers` and the index, with later duplicates replacing earlier ones in the index.
+    void _addHeader(string_view name, string_view value, bool escaped);
+
+    // Rebuilds `_index` with `slots` slots. `slots` must be a power of two.
+    void _reindex(size_t slots);
+
+    // Returns the position in `_index` where `name` is, or the empty slot where it would go.
+    size_t _findSlot(string_view name, uint32_t hash) const;
+
+    static bool _namesEqual(string_view lhs, string_view rhs);
+
+    string_view _methodLine;
+    string_view _content;
+    vector<Header> _headers;
+
+    // Each slot is 0 if empty, or one more than an index into `_headers`. Kept at most half full.
+    vector<uint32_t> _index;
+};
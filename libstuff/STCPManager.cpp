@@ -1,5 +1,8 @@
 #include "STCPManager.h"
 
+#include <cstring>
+#include <fcntl.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <libstuff/libstuff.h>
@@ -7,6 +10,8 @@
 #include <libstuff/SX509.h>
 
 atomic<uint64_t> STCPManager::Socket::socketCount(1);
+atomic<uint64_t> STCPManager::recvByteCount(0);
+atomic<uint64_t> STCPManager::recvSyscallCount(0);
 
 void STCPManager::prePoll(fd_map& fdm, Socket& socket) {
     // Make sure it's not closed
@@ -251,13 +256,18 @@ bool STCPManager::Socket::send(size_t* bytesSentCount) {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
     // Send data
     bool result = false;
-    size_t oldSize = sendBuffer.size();
+    size_t bytesSent = 0;
     if (ssl) {
+        size_t oldSize = sendBuffer.size();
         result = SSSLSendConsume(ssl, sendBuffer);
+        bytesSent = oldSize - sendBuffer.size();
+    } else if (s > 0 && !sharedSendQueue.empty()) {
+        result = sendVectored(bytesSent);
     } else if (s > 0) {
+        size_t oldSize = sendBuffer.size();
         result = S_sendconsume(s, sendBuffer);
+        bytesSent = oldSize - sendBuffer.size();
     }
-    size_t bytesSent = oldSize - sendBuffer.size();
     if (bytesSent) {
         lastSendTime = STimeNow();
         if (bytesSentCount) {
@@ -272,8 +282,12 @@ bool STCPManager::Socket::send(const string& buffer, size_t* bytesSentCount) {
 
     // If the socket's in a valid state for sending, append to the sendBuffer, otherwise warn
     if (state.load() < Socket::State::SHUTTINGDOWN) {
-        sendBuffer += buffer;
-    } else if (!sendBuffer.empty()) {
+        if (sharedSendQueue.empty()) {
+            sendBuffer += buffer;
+        } else {
+            sharedSendQueue.push_back(make_shared<const string>(buffer));
+        }
+    } else if (!sendBufferEmpty()) {
         SWARN("Not appending to sendBuffer in socket state " << state.load());
     }
 
@@ -281,19 +295,99 @@ bool STCPManager::Socket::send(const string& buffer, size_t* bytesSentCount) {
     return send(bytesSentCount);
 }
 
+bool STCPManager::Socket::send(const SSharedBuffer& buffer, size_t* bytesSentCount) {
+    lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
+    if (ssl) {
+        return send(*buffer, bytesSentCount);
+    }
+    if (state.load() < Socket::State::SHUTTINGDOWN) {
+        sharedSendQueue.push_back(buffer);
+    } else if (!sendBufferEmpty()) {
+        SWARN("Not appending to sendBuffer in socket state " << state.load());
+    }
+    return send(bytesSentCount);
+}
+
+bool STCPManager::Socket::sendVectored(size_t& bytesSent) {
+    // Gather up to 64 buffers (well under IOV_MAX, which is 1024 on Linux); anything left goes out on the next send.
+    static constexpr size_t MAX_BUFFERS = 64;
+    iovec iov[MAX_BUFFERS];
+    size_t count = 0;
+    if (!sendBuffer.empty()) {
+        iov[count++] = {(void*)sendBuffer.c_str(), sendBuffer.size()};
+    }
+    size_t offset = sharedSendOffset;
+    for (auto it = sharedSendQueue.begin(); it != sharedSendQueue.end() && count < MAX_BUFFERS; it++) {
+        iov[count++] = {(void*)((*it)->data() + offset), (*it)->size() - offset};
+        offset = 0;
+    }
+
+    msghdr message{};
+    message.msg_iov = iov;
+    message.msg_iovlen = count;
+    ssize_t numSent = sendmsg(s, &message, MSG_NOSIGNAL);
+    if (numSent < 0) {
+        const int error = errno;
+
+        // As in S_sendconsume, if we failed to send with over 1GB queued, give up on this socket, even if the error
+        // would normally be non-fatal.
+        size_t queued = sendBuffer.size();
+        for (const auto& buffer : sharedSendQueue) {
+            queued += buffer->size();
+        }
+        queued -= sharedSendOffset;
+        if (queued > 1024 * 1024 * 1024) {
+            SWARN("sendmsg() failed with response '" << strerror(error) << "' (#" << error << "), and buffer size: "
+                  << queued << ", closing.");
+            return false;
+        }
+        return SCheckNetworkErrorType("sendmsg", SGetPeerName(s), error);
+    }
+
+    bytesSent = numSent;
+
+    // Consume what was sent, first from the copied buffer and then from the shared ones, releasing our reference to
+    // each shared buffer as soon as it's completely sent.
+    size_t remaining = numSent;
+    size_t fromBuffer = min(remaining, sendBuffer.size());
+    if (fromBuffer) {
+        sendBuffer.consumeFront(fromBuffer);
+        remaining -= fromBuffer;
+    }
+    while (remaining) {
+        const size_t left = sharedSendQueue.front()->size() - sharedSendOffset;
+        if (remaining < left) {
+            sharedSendOffset += remaining;
+            break;
+        }
+        remaining -= left;
+        sharedSendQueue.pop_front();
+        sharedSendOffset = 0;
+    }
+    return true;
+}
+
 bool STCPManager::Socket::sendBufferEmpty() {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
-    return sendBuffer.empty();
+    return sendBuffer.empty() && sharedSendQueue.empty();
 }
 
 string STCPManager::Socket::sendBufferCopy() {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
-    return string(sendBuffer.c_str(), sendBuffer.size());
+    string copy(sendBuffer.c_str(), sendBuffer.size());
+    size_t offset = sharedSendOffset;
+    for (const auto& buffer : sharedSendQueue) {
+        copy.append(*buffer, offset);
+        offset = 0;
+    }
+    return copy;
 }
 
 void STCPManager::Socket::setSendBuffer(const string& buffer) {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
     sendBuffer = buffer;
+    sharedSendQueue.clear();
+    sharedSendOffset = 0;
 }
 
 bool STCPManager::Socket::recv() {
@@ -305,7 +399,13 @@ bool STCPManager::Socket::recv() {
     if (ssl) {
         result = SSSLRecvAppend(ssl, recvBuffer);
     } else if (s > 0) {
-        result = S_recvappend(s, recvBuffer);
+        if (!blocking) {
+            blocking = !(fcntl(s, F_GETFL) & O_NONBLOCK);
+        }
+        uint64_t syscalls = 0;
+        result = S_recvappend(s, recvBuffer, *blocking, &syscalls);
+        recvSyscallCount += syscalls;
+        recvByteCount += recvBuffer.size() - oldSize;
     }
 
     // We've received new data
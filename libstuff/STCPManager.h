@@ -1,8 +1,11 @@
 #pragma once
 #include <atomic>
+#include <deque>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <netinet/in.h>
+#include <optional>
 #include <poll.h>
 #include <string>
 
@@ -14,6 +17,10 @@ class SX509;
 
 using namespace std;
 
+// An immutable, reference-counted buffer of bytes to send. The same buffer can be queued on any number of sockets
+// without being copied into each of them.
+typedef shared_ptr<const string> SSharedBuffer;
+
 // Convenience base class for managing a series of TCP sockets. This includes filling receive buffers, emptying send
 // buffers, completing connections, performing graceful shutdowns, etc.
 struct STCPManager {
@@ -38,6 +45,10 @@ struct STCPManager {
         void* data;
         bool send(size_t* bytesSentCount = nullptr);
         bool send(const string& buffer, size_t* bytesSentCount = nullptr);
+
+        // Like `send(const string&)`, but queues a reference to the buffer rather than copying it, unless this is an
+        // SSL socket, which needs to encrypt its own copy anyway.
+        bool send(const SSharedBuffer& buffer, size_t* bytesSentCount = nullptr);
         bool recv();
         void shutdown(State toState = SHUTTINGDOWN);
         uint64_t id;
@@ -56,6 +67,18 @@ struct STCPManager {
         // NOTE: Currently there's no synchronization around `recvBuffer`. It can only be accessed by one thread.
         SFastBuffer sendBuffer;
 
+        // Shared buffers queued by `send(const SSharedBuffer&)`, and how much of the first one has been sent. All of
+        // these are queued after everything in `sendBuffer`, so while this is non-empty, anything else that's sent is
+        // queued here as well, to keep everything in order.
+        deque<SSharedBuffer> sharedSendQueue;
+        size_t sharedSendOffset = 0;
+
+        // Sends as much of `sendBuffer` followed by `sharedSendQueue` as we can in a single `sendmsg` call.
+        bool sendVectored(size_t& bytesSent);
+
+        // Whether this socket is blocking, looked up the first time we receive on it, rather than every time.
+        optional<bool> blocking;
+
         // Each socket owns it's own SX509 object to avoid thread-safety issues reading/writing the same certificate in
         // the underlying ssl code. Once assigned, the socket owns this object for it's lifetime and will delete it
         // upon destruction.
@@ -72,6 +95,10 @@ struct STCPManager {
         const string host;
     };
 
+    // Totals across all (non-SSL) sockets of bytes received and the `recv` calls made to receive them.
+    static atomic<uint64_t> recvByteCount;
+    static atomic<uint64_t> recvSyscallCount;
+
     // Updates all managed sockets
     // TODO: Actually explain what these do.
     static void prePoll(fd_map& fdm, Socket& socket);
@@ -751,7 +751,7 @@ const char* _SParseHTTP_GetUpToNext(const char* start, const char* lineEnd, char
     const char* separatorPos = end;
 
     // Found the separator, trim off any trailing whitespace
-    while (*(end - 1) == ' ')
+    while (end > start && *(end - 1) == ' ')
         --end;
 
     // If there's anything left, that's the output
@@ -771,7 +771,7 @@ void _SParseHTTP_GetUpToEnd(const char* start, const char* end, string& out) {
     // Get everything up to the end of the line, triming leading and trailing whitespace
     while (*start == ' ')
         ++start;
-    while (*(end - 1) == ' ')
+    while (end > start && *(end - 1) == ' ')
         --end;
     int length = (int)(end - start);
     if (length > 0) {
@@ -1152,10 +1152,11 @@ bool SParseURIPath(const char* buffer, int length, string& path, STable& nameVal
 void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameValueMap, const string& content) {
     bool tryGzip = false;
 
-    // Just walk across and compose a valid HTTP-like message
+    // Just walk across and compose a valid HTTP-like message. This appends each piece directly so that composing
+    // into a reused buffer doesn't allocate once it's big enough.
     buffer.clear();
-    buffer += methodLine + "\r\n";
-    for (pair<string, string> item : nameValueMap) {
+    buffer.append(methodLine).append("\r\n");
+    for (const auto& item : nameValueMap) {
         if (SIEquals("Set-Cookie", item.first)) {
             // Parse this list and generate a separate cookie for each.
             // Technically, this shouldn't be necessary: RFC2109 section 4.2.2
@@ -1171,7 +1172,16 @@ void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameVa
         } else if (SIEquals("Content-Encoding", item.first) && SIEquals("gzip", item.second)) {
             tryGzip = !content.empty();
         } else {
-            buffer += item.first + ": " + SEscape(item.second, "\r\n\t") + "\r\n";
+            buffer.append(item.first).append(": ");
+
+            // Most values have nothing to escape, so skip building an escaped copy for those. SEscape also truncates
+            // at a NUL, so anything containing one goes through it too.
+            if (item.second.find_first_of(string_view("\r\n\t\\\0", 5)) == string::npos) {
+                buffer.append(item.second);
+            } else {
+                buffer.append(SEscape(item.second, "\r\n\t"));
+            }
+            buffer.append("\r\n");
         }
     }
 
@@ -1184,11 +1194,11 @@ void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameVa
     }
 
     // Always add a Content-Length, even if no content, so there is no ambiguity
-    buffer += "Content-Length: " + SToStr(finalContent.size()) + "\r\n";
+    buffer.append("Content-Length: ").append(to_string(finalContent.size())).append("\r\n");
 
     // Finish the message and add the content, if any
-    buffer += "\r\n";
-    buffer += finalContent;
+    buffer.append("\r\n");
+    buffer.append(finalContent);
 }
 
 // --------------------------------------------------------------------------
@@ -1295,29 +1305,130 @@ string SDecodeURIComponent(const char* buffer, int length) {
 // --------------------------------------------------------------------------
 extern const char* _SParseJSONValue(const char* ptr, const char* end, string& value, bool populateValue);
 
-string SToJSON(const int64_t value, const bool forceString) {
-    return SToJSON(to_string(value), forceString);
+// JSON strings are scanned 8 bytes at a time, using the usual bit tricks to test every byte of a word at once.
+// `_SJSONZeroBytes` sets the high bit of each zero byte in `v` (and possibly of bytes above a zero byte, which doesn't
+// matter, as we only use it to find the first interesting byte), and `_SJSONBytesLessThan` does the same for bytes less
+// than `n`, for n <= 128.
+const uint64_t _SJSON_ONES = 0x0101010101010101ull;
+const uint64_t _SJSON_HIGHS = 0x8080808080808080ull;
+
+inline uint64_t _SJSONZeroBytes(uint64_t v) {
+    return (v - _SJSON_ONES) & ~v & _SJSON_HIGHS;
 }
 
-string SToJSON(const string& value, const bool forceString) {
-    // Is it an integer?
-    if (SToStr(SToInt64(value.c_str())) == value) {
-        return value;
+inline uint64_t _SJSONBytesEqual(uint64_t v, unsigned char c) {
+    return _SJSONZeroBytes(v ^ (_SJSON_ONES * c));
+}
+
+inline uint64_t _SJSONBytesLessThan(uint64_t v, unsigned char n) {
+    return (v - _SJSON_ONES * n) & ~v & _SJSON_HIGHS;
+}
+
+// Returns the first '"', '\\' or NUL in [ptr, end), or `end` if there isn't one.
+const char* _SJSONFindStringSpecial(const char* ptr, const char* end) {
+    while (end - ptr >= 8) {
+        uint64_t v;
+        memcpy(&v, ptr, 8);
+        if (_SJSONBytesEqual(v, '"') | _SJSONBytesEqual(v, '\\') | _SJSONZeroBytes(v)) {
+            break;
+        }
+        ptr += 8;
     }
-    // Is it a float?
-    if (SToStr(SToFloat(value.c_str())) == value) {
-        return value;
+    while (ptr < end && *ptr != '"' && *ptr != '\\' && *ptr) {
+        ++ptr;
+    }
+    return ptr;
+}
+
+// Returns the first character in [ptr, end) that SToJSON needs to escape, or `end` if there isn't one.
+const char* _SJSONFindEscape(const char* ptr, const char* end) {
+    while (end - ptr >= 8) {
+        uint64_t v;
+        memcpy(&v, ptr, 8);
+        if (_SJSONBytesLessThan(v, 0x20) | _SJSONBytesEqual(v, 0x7f) | _SJSONBytesEqual(v, '"') |
+            _SJSONBytesEqual(v, '\\') | _SJSONBytesEqual(v, '/')) {
+            break;
+        }
+        ptr += 8;
+    }
+    while (ptr < end) {
+        const unsigned char c = *ptr;
+        if (c < 0x20 || c == 0x7f || c == '"' || c == '\\' || c == '/') {
+            break;
+        }
+        ++ptr;
+    }
+    return ptr;
+}
+
+// Returns true if `SToStr(SToInt64(value)) == value`, without converting anything unless the value is long enough to
+// overflow.
+bool _SJSONIsInteger(const string& value) {
+    const size_t start = (!value.empty() && value[0] == '-') ? 1 : 0;
+    const size_t digits = value.size() - start;
+    if (!digits) {
+        return false;
+    }
+    for (size_t i = start; i < value.size(); i++) {
+        if (value[i] < '0' || value[i] > '9') {
+            return false;
+        }
+    }
+
+    // No leading zeros, and no "-0".
+    if (value[start] == '0' && (digits > 1 || start)) {
+        return false;
+    }
+    if (digits >= 19) {
+        return SToStr(SToInt64(value)) == value;
+    }
+    return true;
+}
+
+// Returns true if `SToStr(SToFloat(value)) == value`. SToStr prints floats in fixed notation with 6 decimal places (or
+// as inf or nan), so only values of that shape are actually converted to check.
+bool _SJSONIsFloat(const string& value) {
+    const size_t size = value.size();
+    bool candidate = false;
+    if (size == 3 || size == 4) {
+        candidate = value == "inf" || value == "nan" || value == "-inf" || value == "-nan";
+    } else if (size >= 8 && value[size - 7] == '.') {
+        candidate = true;
+        const size_t start = value[0] == '-' ? 1 : 0;
+        for (size_t i = start; i < size && candidate; i++) {
+            candidate = (i == size - 7) || (value[i] >= '0' && value[i] <= '9');
+        }
+        candidate = candidate && size - 7 > start;
+    }
+    return candidate && SToStr(SToFloat(value)) == value;
+}
+
+void SAppendJSON(string& out, const int64_t value, const bool forceString) {
+    SAppendJSON(out, to_string(value), forceString);
+}
+
+void SAppendJSON(string& out, const string& value, const bool forceString) {
+    // Is it a number?
+    if (_SJSONIsInteger(value) || _SJSONIsFloat(value)) {
+        out += value;
+        return;
     }
 
     // Is it boolean?
-    if (SIEquals(value, "true"))
-        return "true";
-    if (SIEquals(value, "false"))
-        return "false";
+    if (SIEquals(value, "true")) {
+        out += "true";
+        return;
+    }
+    if (SIEquals(value, "false")) {
+        out += "false";
+        return;
+    }
 
     // Is it null?
-    if (SIEquals(value, "null"))
-        return "null";
+    if (SIEquals(value, "null")) {
+        out += "null";
+        return;
+    }
 
     // Is it already a JSON array or object?
     if (!forceString && value.size() >= 2 &&
@@ -1327,16 +1438,56 @@ string SToJSON(const string& value, const bool forceString) {
         const char* ptr = value.c_str();
         const char* end = ptr + value.size();
         const char* parseEnd = _SParseJSONValue(ptr, end, ignore, false);
-        if (parseEnd == end) // Parsed it all.
-            return value;
+        if (parseEnd == end) { // Parsed it all.
+            out += value;
+            return;
+        }
+    }
+
+    // Otherwise, it's a string -- escape and return. We need to escape all control characters in the string, not just
+    // the white-space control characters. Runs of characters that don't need escaping are copied as they are.
+    out += '"';
+    const char* ptr = value.data();
+    const char* end = ptr + value.size();
+    while (ptr < end) {
+        const char* special = _SJSONFindEscape(ptr, end);
+        out.append(ptr, special - ptr);
+        if (special == end || !*special) {
+            // Like SEscape, stop at a NUL.
+            break;
+        }
+        const unsigned char c = *special;
+        out += '\\';
+        if (c == '\b') {
+            out += 'b';
+        } else if (c == '\f') {
+            out += 'f';
+        } else if (c == '\n') {
+            out += 'n';
+        } else if (c == '\r') {
+            out += 'r';
+        } else if (c == '\t') {
+            out += 't';
+        } else if (c < 0x20 || c == 0x7f) {
+            char utfCode[6] = {0};
+            snprintf(utfCode, sizeof(utfCode), "u%04x", c);
+            out += utfCode;
+        } else {
+            out += c;
+        }
+        ptr = special + 1;
     }
+    out += '"';
+}
 
-    // Otherwise, it's a string -- escape and return
-    // We need to escape all control characters in the string, not just the white-space control characters.
-    return "\"" + SEscape(value,     "\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
-                                 "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f\x7f\"\\/",
-                          '\\') +
-           "\"";
+string SToJSON(const int64_t value, const bool forceString) {
+    return SToJSON(to_string(value), forceString);
+}
+
+string SToJSON(const string& value, const bool forceString) {
+    string out;
+    SAppendJSON(out, value, forceString);
+    return out;
 }
 
 // --------------------------------------------------------------------------
@@ -1344,11 +1495,14 @@ string SComposeJSONObject(const STable& nameValueMap, const bool forceString) {
     if (nameValueMap.empty())
         return "{}";
     string working = "{";
-    for (pair<string, string> item : nameValueMap) {
-        working += "\"" + item.first + "\":" + SToJSON(item.second, forceString) + ",";
-    }
-    working.resize(working.size() - 1);
-    working += "}";
+    for (const auto& item : nameValueMap) {
+        working += '"';
+        working += item.first;
+        working += "\":";
+        SAppendJSON(working, item.second, forceString);
+        working += ',';
+    }
+    working.back() = '}';
     return working;
 }
 
@@ -1388,21 +1542,29 @@ const char* _SParseJSONString(const char* ptr, const char* end, string& out, boo
     _JSONWS();
     _JSONTEST('"');
     const char* strStart = ptr;
-    for (; ptr < end && *ptr; ++ptr) {
-        // Found the end of this string
-        if (*ptr == '"')
-            break;
+    bool escaped = false;
+    while (true) {
+        ptr = _SJSONFindStringSpecial(ptr, end);
 
         // We want to skip all escaped characters so we don't mistakenly count
         // an escaped double-quote as the actual end.
-        else if (*ptr == '\\')
-            ++ptr;
+        if (ptr < end && *ptr == '\\') {
+            escaped = true;
+            ptr += 2;
+            continue;
+        }
+        break;
     }
     _JSONTEST('"');
 
     if (populateOut) {
-        string strOut(strStart, ptr - strStart - 1);
-        out += SUnescape(strOut.c_str(), '\\');
+        if (escaped) {
+            string strOut(strStart, ptr - strStart - 1);
+            out += SUnescape(strOut.c_str(), '\\');
+        } else {
+            // Nothing to unescape, so copy it straight out.
+            out.append(strStart, ptr - strStart - 1);
+        }
     }
     return ptr;
 }
@@ -1971,32 +2133,34 @@ bool S_recvappend(int s, SFastBuffer& recvBuffer) {
     SASSERT(s);
     // Figure out if this socket is blocking or non-blocking
     int flags = fcntl(s, F_GETFL);
-    bool blocking = !(flags & O_NONBLOCK);
-
-    // Log size of the buffer before we read from it.
-    int bytesInBuffer = 0;
-    int ret = 0;
-    ret = ioctl(s, FIONREAD, &bytesInBuffer);
-
-    if (ret < 0) {
-        SHMMM("Unable to get length of socket buffer error: " << strerror(S_errno));
-    }
+    return S_recvappend(s, recvBuffer, !(flags & O_NONBLOCK));
+}
 
-    // Keep trying to receive as long as we can
-    char buffer[4096];
-    int totalRecv = 0;
+bool S_recvappend(int s, SFastBuffer& recvBuffer, bool blocking, uint64_t* syscallCount) {
+    SASSERT(s);
+    // Start with reads big enough for most messages, and double that each time a read fills all the space we gave it,
+    // so a large transfer is read in a few big chunks rather than thousands of small ones.
+    static constexpr size_t MIN_READ_SIZE = 64 * 1024;
+    static constexpr size_t MAX_READ_SIZE = 1024 * 1024;
+    size_t readSize = MIN_READ_SIZE;
     ssize_t numRecv = 0;
-    sockaddr_in fromAddr;
-    socklen_t fromAddrLen = sizeof(fromAddr);
-    while ((numRecv = recvfrom(s, buffer, sizeof(buffer), 0, (sockaddr*)&fromAddr, &fromAddrLen)) > 0) {
-        // Got some more data
-        recvBuffer.append(buffer, numRecv);
-        totalRecv += numRecv;
+    while (true) {
+        char* tail = recvBuffer.reserveTail(readSize);
+        numRecv = recv(s, tail, readSize, 0);
+        recvBuffer.commitTail(max(numRecv, (ssize_t)0));
+        if (syscallCount) {
+            (*syscallCount)++;
+        }
+        if (numRecv <= 0) {
+            break;
+        }
 
-        // If this is a blocking socket, don't try again, once is enough
-        if (blocking) {
+        // If this is a blocking socket, don't try again, once is enough. If the read didn't fill the space we gave
+        // it, there was nothing more waiting, so don't spend another call finding that out.
+        if (blocking || (size_t)numRecv < readSize) {
             return true; // We're still alive
         }
+        readSize = min(readSize * 2, MAX_READ_SIZE);
     }
 
     // See how we finished
@@ -2004,9 +2168,8 @@ bool S_recvappend(int s, SFastBuffer& recvBuffer) {
         return false; // Graceful shutdown; socket closed
     }
     // Some kind of error -- what happened?
-    stringstream addrStr;
-    addrStr << fromAddr;
-    return SCheckNetworkErrorType("recv", addrStr.str(), S_errno);
+    const int error = S_errno;
+    return SCheckNetworkErrorType("recv", SGetPeerName(s), error);
 }
 
 // --------------------------------------------------------------------------
@@ -3054,7 +3217,21 @@ string SCURRENT_TIMESTAMP() {
 }
 
 bool STableComp::operator()(const string& s1, const string& s2) const {
-    return lexicographical_compare(s1.begin(), s1.end(), s2.begin(), s2.end(), nocase_compare());
+    // Equivalent to lexicographical_compare with nocase_compare, but only lower-cases characters that differ, which
+    // most characters in matching header names don't.
+    const size_t length = min(s1.size(), s2.size());
+    for (size_t i = 0; i < length; i++) {
+        const unsigned char c1 = s1[i];
+        const unsigned char c2 = s2[i];
+        if (c1 != c2) {
+            const int lower1 = tolower(c1);
+            const int lower2 = tolower(c2);
+            if (lower1 != lower2) {
+                return lower1 < lower2;
+            }
+        }
+    }
+    return s1.size() < s2.size();
 }
 
 bool STableComp::nocase_compare::operator()(const unsigned char& c1, const unsigned char& c2) const {
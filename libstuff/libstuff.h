@@ -467,17 +467,21 @@ template <typename T> string SComposeList(const T& valueList, const string& sepa
 string SToJSON(const string& value, const bool forceString = false);
 string SToJSON(const int64_t value, const bool forceString = false);
 
+// Like SToJSON, but appends to `out` rather than returning a new string.
+void SAppendJSON(string& out, const string& value, const bool forceString = false);
+void SAppendJSON(string& out, const int64_t value, const bool forceString = false);
+
 template <typename T>
 string SComposeJSONArray(const T& valueList) {
     if (valueList.empty()) {
         return "[]";
     }
     string working = "[";
-    for (auto value : valueList) {
-        working += SToJSON(value) + ",";
+    for (const auto& value : valueList) {
+        SAppendJSON(working, value);
+        working += ',';
     }
-    working.resize(working.size() - 1);
-    working += "]";
+    working.back() = ']';
     return working;
 }
 
@@ -512,6 +516,10 @@ int S_socket(const string& host, bool isTCP, bool isPort, bool isBlocking);
 int S_accept(int port, sockaddr_in& fromAddr, bool isBlocking);
 ssize_t S_recvfrom(int s, char* recvBuffer, int recvBufferSize, sockaddr_in& fromAddr);
 bool S_recvappend(int s, SFastBuffer& recvBuffer);
+
+// Like the above, but for a socket whose blocking mode is already known. Reads directly into `recvBuffer` in chunks
+// that grow while the socket keeps filling them, and adds the number of `recv` calls made to `syscallCount` if given.
+bool S_recvappend(int s, SFastBuffer& recvBuffer, bool blocking, uint64_t* syscallCount = nullptr);
 bool S_sendconsume(int s, SFastBuffer& sendBuffer);
 int S_poll(fd_map& fdm, uint64_t timeout);
 
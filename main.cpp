@@ -17,6 +17,8 @@
 #include <plugins/MySQL.h>
 #include <libstuff/libstuff.h>
 #include <sqlitecluster/SQLite.h>
+#include <sqlitecluster/SQLiteJournalBackup.h>
+#include <sqlitecluster/SQLitePageCache.h>
 
 /////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////
@@ -164,6 +166,11 @@ int main(int argc, char* argv[]) {
     // Disable a mutex around `malloc`, which is *EXTREMELY IMPORTANT* for multi-threaded performance. Without this
     // setting, all reads are essentially single-threaded as they'll all fight with each other for this mutex.
     SASSERT(sqlite3_config(SQLITE_CONFIG_MEMSTATUS, 0) == SQLITE_OK);
+
+    // Replace SQLite's page cache, if requested.
+    if (args.isSet("-arenaPageCache")) {
+        SASSERT(SQLitePageCache::install(args.calcU64("-arenaPageCacheMB") * 1024 * 1024, args.isSet("-hugePages")));
+    }
     sqlite3_initialize();
     SASSERT(sqlite3_threadsafe());
 
@@ -229,6 +236,9 @@ int main(int argc, char* argv[]) {
         cout << "-plugins        <list>      Enable these plugins (defaults to 'db,jobs,cache,mysql')" << endl;
         cout << "-cacheSize      <kb>        number of KB to allocate for a page cache (defaults to 1GB)" << endl;
         cout << "-workerThreads  <#>         Number of worker threads to start (min 1, defaults to # of cores)" << endl;
+        cout << "-minWorkerThreads <#>       Fewest worker threads to shrink to under light load (defaults to -workerThreads)" << endl;
+        cout << "-maxWorkerThreads <#>       Most worker threads to grow to under heavy load (defaults to -workerThreads)" << endl;
+        cout << "-dbPoolSize     <#>         Maximum number of DB handles to open (defaults to 25000 with -live, else 250)" << endl;
         cout << "-queryLog       <filename>  Set the query log filename (default 'queryLog.csv', SIGUSR2/SIGQUIT to "
                 "enable/disable)"
              << endl;
@@ -237,6 +247,24 @@ int main(int argc, char* argv[]) {
         cout << "-synchronous    <value>     Set the PRAGMA schema.synchronous "
                 "(defaults see https://sqlite.org/pragma.html#pragma_synchronous)"
              << endl;
+        cout << "-backupMaxBytesPerSecond <#> Rate limit for online backups, overridable per backup (default 0, no limit)"
+             << endl;
+        cout << "-backupMaxWALMB <#>         Stop an online backup if the WAL grows past this while it runs (default 4096, 0 "
+                "for no limit)"
+             << endl;
+        cout << "-cacheBudget    <kb>        Total KB of page cache split between all DB handles, instead of -cacheSize "
+                "each (default 0, off). Can be changed with SetCacheParams"
+             << endl;
+        cout << "-arenaPageCache             Keep DB pages in large arenas instead of individual heap allocations" << endl;
+        cout << "-arenaPageCacheMB <#>       Total MB for the arena page cache across all DB handles (default 0, no limit). "
+                "Applies on top of -cacheSize/-cacheBudget, whichever is reached first. Can be changed with SetCacheParams"
+             << endl;
+        cout << "-hugePages                  Back the arena page cache with huge pages if reserved, else transparent ones"
+             << endl;
+        cout << "-resultCacheMB  <#>         MB of memory for results of deterministic reads shared between commands "
+                "(default 64, 0 to disable)"
+             << endl;
+        cout << "-restoreJournal <directory> Replay the journal segments in <directory> onto -db, then exit" << endl;
         cout << endl;
         cout << "Quick Start Tips:" << endl;
         cout << "-----------------" << endl;
@@ -298,8 +326,10 @@ int main(int argc, char* argv[]) {
     SETDEFAULT("-plugins", "db,jobs,cache,mysql");
     SETDEFAULT("-priority", "100");
     SETDEFAULT("-maxJournalSize", "1000000");
+    SETDEFAULT("-resultCacheMB", "64");
     SETDEFAULT("-queryLog", "queryLog.csv");
     SETDEFAULT("-enableMultiWrite", "true");
+    SETDEFAULT("-backupMaxWALMB", "4096");
 
     args["-plugins"] = SComposeList(loadPlugins(args));
 
@@ -320,6 +350,21 @@ int main(int argc, char* argv[]) {
         SASSERT(SFileExists(args["-db"]));
     }
 
+    // Replay incremental backups onto a base backup and exit, if requested.
+    if (args.isSet("-restoreJournal")) {
+        const string& dbPath = args["-db"];
+        SQLite db(dbPath, args.calc("-cacheSize"), args.calc("-maxJournalSize"), -2);
+        try {
+            uint64_t applied = SQLiteJournalBackup::restore(db, args["-restoreJournal"], basename((char*)dbPath.c_str()));
+            cout << "Restored " << applied << " commits, " << dbPath << " is at commit " << db.getCommitCount()
+                 << " (" << db.getCommittedHash() << ")." << endl;
+            return 0;
+        } catch (const SException& e) {
+            cout << "Restore failed at commit " << db.getCommitCount() << ": " << e.what() << endl;
+            return 1;
+        }
+    }
+
     // Set our soft limit to the same as our hard limit to allow for more file handles.
     struct rlimit limits;
     if (!getrlimit(RLIMIT_NOFILE, &limits)) {
@@ -2,6 +2,9 @@
 
 #include <BedrockServer.h>
 #include <libstuff/SQResult.h>
+#include <libstuff/SRandom.h>
+#include <sqlitecluster/SQLiteCompression.h>
+#include <sqlitecluster/SQLiteUtils.h>
 
 const string BedrockPlugin_Cache::name("Cache");
 const string& BedrockPlugin_Cache::getName() const {
@@ -15,7 +18,9 @@ BedrockCacheCommand::BedrockCacheCommand(SQLiteCommand&& baseCommand, BedrockPlu
 
 const set<string, STableComp> BedrockPlugin_Cache::supportedRequestVerbs = {
     "ReadCache",
+    "ReadCacheMulti",
     "WriteCache",
+    "WriteCacheMulti",
 };
 
 unique_ptr<BedrockCommand> BedrockPlugin_Cache::getCommand(SQLiteCommand&& baseCommand) {
@@ -30,37 +35,67 @@ BedrockPlugin_Cache::LRUMap::LRUMap() {
 }
 
 BedrockPlugin_Cache::LRUMap::~LRUMap() {
-    // Just delete all the entries
-    while (!empty()) {
-        // Pop it off
-        popLRU();
-    }
+    // Entries are owned by their shards, nothing to clean up.
 }
 
 bool BedrockPlugin_Cache::LRUMap::empty() {
-    // Both the map and list are the same size, so check either
-    lock_guard<decltype(_mutex)> lock(_mutex);
-    return _lruList.empty();
-}
-
-void BedrockPlugin_Cache::LRUMap::pushMRU(const string& name) {
-    // See if if it's already there
-    lock_guard<decltype(_mutex)> lock(_mutex);
-    map<string, Entry*>::iterator mapIt = _lruMap.find(name);
-    if (mapIt == _lruMap.end()) {
-        // Not in the map -- add a new entry
-        Entry* entry = new Entry;
-        entry->name = name;
-
-        // Insert into the map and list, retaining iterators to both
-        entry->mapIt = _lruMap.insert(std::pair<string, Entry*>(name, entry)).first;
-        entry->listIt = _lruList.insert(_lruList.end(), entry);
-    } else {
-        // Already in the map, just move to the end of the list
-        Entry* entry = mapIt->second;
-        _lruList.erase(entry->listIt);
-        entry->listIt = _lruList.insert(_lruList.end(), entry);
+    return !_size;
+}
+
+uint64_t BedrockPlugin_Cache::LRUMap::currentEpoch() {
+    return STimeNow() / (EPOCH_SECONDS * STIME_US_PER_S);
+}
+
+BedrockPlugin_Cache::LRUMap::Shard& BedrockPlugin_Cache::LRUMap::_getShard(const string& name) {
+    return _shards[hash<string>()(name) % SHARD_COUNT];
+}
+
+void BedrockPlugin_Cache::LRUMap::_touch(Shard& shard, const string& name, Entry& entry, uint64_t epoch, bool persisted) {
+    // Move the epoch forward, unless someone else already moved it further.
+    uint64_t previous = entry.epoch.load();
+    while (previous < epoch && !entry.epoch.compare_exchange_weak(previous, epoch));
+
+    if (persisted) {
+        previous = entry.persistedEpoch.load();
+        while (previous < epoch && !entry.persistedEpoch.compare_exchange_weak(previous, epoch));
+    } else if (entry.persistedEpoch < entry.epoch && !entry.queued.exchange(true)) {
+        // This is the first use since the epoch was last persisted, queue it to be written.
+        lock_guard<mutex> lock(shard.unpersistedMutex);
+        shard.unpersisted.push_back(name);
+    }
+}
+
+void BedrockPlugin_Cache::LRUMap::pushMRU(const string& name, bool persisted) {
+    const uint64_t epoch = currentEpoch();
+    Shard& shard = _getShard(name);
+
+    // Most of the time the name is already there, and we only need a shared lock.
+    {
+        shared_lock<shared_mutex> lock(shard.entriesMutex);
+        auto it = shard.entries.find(name);
+        if (it != shard.entries.end()) {
+            _touch(shard, name, *it->second, epoch, persisted);
+            return;
+        }
+    }
+
+    // Not in the map -- add a new entry
+    unique_lock<shared_mutex> lock(shard.entriesMutex);
+    auto result = shard.entries.try_emplace(name, make_unique<Entry>());
+    if (result.second) {
+        _size++;
+    }
+    _touch(shard, name, *result.first->second, epoch, persisted);
+}
+
+void BedrockPlugin_Cache::LRUMap::load(const string& name, uint64_t epoch) {
+    Shard& shard = _getShard(name);
+    unique_lock<shared_mutex> lock(shard.entriesMutex);
+    auto result = shard.entries.try_emplace(name, make_unique<Entry>());
+    if (result.second) {
+        _size++;
     }
+    _touch(shard, name, *result.first->second, epoch, true);
 }
 
 // ==========================================================================
@@ -68,30 +103,191 @@ void BedrockPlugin_Cache::LRUMap::pushMRU(const string& name) {
 // a bool of whether or not the cache was empty when we tried to pop. If the
 // cache is empty, the LRU item will be an empty string and the bool will be false.
 pair<string, bool> BedrockPlugin_Cache::LRUMap::popLRU() {
-    // Make sure we're not empty
-    lock_guard<decltype(_mutex)> lock(_mutex);
-    if (empty()) {
-        return make_pair("", false);
+    while (!empty()) {
+        // Sample a few entries from the next few shards, and pick the oldest of them. If the next shards are all
+        // empty, we keep moving the hand until we find something.
+        size_t oldestShard = SHARD_COUNT;
+        string oldestName;
+        uint64_t oldestEpoch = UINT64_MAX;
+        for (size_t sampled = 0, visited = 0; sampled < SAMPLE_SHARDS && visited < SHARD_COUNT; visited++) {
+            const size_t shardIndex = _clockHand++ % SHARD_COUNT;
+            Shard& shard = _shards[shardIndex];
+            shared_lock<shared_mutex> lock(shard.entriesMutex);
+            if (shard.entries.empty()) {
+                continue;
+            }
+            sampled++;
+
+            // Start at a random bucket so we don't always look at the same entries in this shard.
+            const size_t bucketCount = shard.entries.bucket_count();
+            const size_t firstBucket = SRandom::limitedRand64(0, bucketCount - 1);
+            size_t count = 0;
+            for (size_t i = 0; i < bucketCount && count < SAMPLE_SIZE; i++) {
+                const size_t bucket = (firstBucket + i) % bucketCount;
+                for (auto it = shard.entries.begin(bucket); it != shard.entries.end(bucket) && count < SAMPLE_SIZE; it++, count++) {
+                    if (it->second->epoch < oldestEpoch) {
+                        oldestShard = shardIndex;
+                        oldestName = it->first;
+                        oldestEpoch = it->second->epoch;
+                    }
+                }
+            }
+        }
+
+        if (oldestShard == SHARD_COUNT) {
+            // Everything was removed while we were looking.
+            continue;
+        }
+
+        // Remove it, unless someone beat us to it, in which case we try again.
+        Shard& shard = _shards[oldestShard];
+        unique_lock<shared_mutex> lock(shard.entriesMutex);
+        if (shard.entries.erase(oldestName)) {
+            _size--;
+            return make_pair(oldestName, true);
+        }
+    }
+    return make_pair("", false);
+}
+
+list<pair<string, uint64_t>> BedrockPlugin_Cache::LRUMap::popUnpersisted(size_t max) {
+    list<pair<string, uint64_t>> result;
+    for (size_t i = 0; i < SHARD_COUNT && result.size() < max; i++) {
+        Shard& shard = _shards[_clockHand++ % SHARD_COUNT];
+        list<string> names;
+        {
+            lock_guard<mutex> lock(shard.unpersistedMutex);
+            while (!shard.unpersisted.empty() && result.size() + names.size() < max) {
+                names.push_back(move(shard.unpersisted.front()));
+                shard.unpersisted.pop_front();
+            }
+        }
+        shared_lock<shared_mutex> lock(shard.entriesMutex);
+        for (const string& name : names) {
+            auto it = shard.entries.find(name);
+            if (it != shard.entries.end()) {
+                Entry& entry = *it->second;
+                entry.queued = false;
+                const uint64_t epoch = entry.epoch;
+                entry.persistedEpoch = epoch;
+                result.emplace_back(name, epoch);
+            }
+        }
+    }
+    return result;
+}
+
+BedrockPlugin_Cache::HotValues::HotValues(size_t maxBytes) : _maxBytes(maxBytes) {
+    if (_maxBytes) {
+        SINFO("Keeping up to " << _maxBytes << " bytes of hot cache values in memory");
+    }
+}
+
+bool BedrockPlugin_Cache::HotValues::get(const string& name, string& value) {
+    Shard& shard = _shards[hash<string>()(name) % SHARD_COUNT];
+    shared_lock<shared_mutex> lock(shard.mutex);
+    auto it = shard.entries.find(name);
+    if (it == shard.entries.end()) {
+        return false;
+    }
+    it->second->referenced = true;
+    value = it->second->value;
+    return true;
+}
+
+void BedrockPlugin_Cache::HotValues::put(const string& name, int64_t rowID, const string& value, uint64_t generation) {
+    // Don't let a single value take over the whole shard.
+    const size_t maxShardBytes = _maxBytes / SHARD_COUNT;
+    if (name.size() + value.size() > maxShardBytes / 4) {
+        return;
+    }
+
+    Shard& shard = _shards[hash<string>()(name) % SHARD_COUNT];
+    unique_lock<shared_mutex> lock(shard.mutex);
+
+    // If anything was invalidated since the caller started its transaction, this value may already be out of date. The
+    // generation is incremented before invalidating, and checked here while holding the shard lock, so either we see
+    // the new generation, or the invalidation removes this entry after we add it.
+    if (generation != _generation) {
+        return;
+    }
+
+    auto it = shard.entries.find(name);
+    if (it != shard.entries.end()) {
+        _erase(shard, it);
+    }
+    auto entry = make_unique<Entry>();
+    entry->value = value;
+    entry->rowID = rowID;
+    entry->position = shard.order.insert(shard.order.end(), name);
+    shard.entries.emplace(name, move(entry));
+    shard.namesByRowID[rowID] = name;
+    shard.bytes += name.size() + value.size();
+
+    // Evict until we're back under the limit, giving entries that have been read since we last looked a second chance.
+    while (shard.bytes > maxShardBytes) {
+        auto oldest = shard.entries.find(shard.order.front());
+        if (oldest->second->referenced.exchange(false)) {
+            shard.order.splice(shard.order.end(), shard.order, shard.order.begin());
+        } else {
+            _erase(shard, oldest);
+        }
+    }
+}
+
+void BedrockPlugin_Cache::HotValues::invalidate(const set<int64_t>& rowIDs) {
+    if (rowIDs.empty()) {
+        clear();
+        return;
+    }
+    _generation++;
+    for (Shard& shard : _shards) {
+        unique_lock<shared_mutex> lock(shard.mutex);
+        if (shard.namesByRowID.empty()) {
+            continue;
+        }
+        for (int64_t rowID : rowIDs) {
+            auto nameIt = shard.namesByRowID.find(rowID);
+            if (nameIt != shard.namesByRowID.end()) {
+                _erase(shard, shard.entries.find(nameIt->second));
+            }
+        }
     }
-    // Take the first item off the list
-    Entry* entry = _lruList.front();
-    _lruList.erase(entry->listIt);
-    _lruMap.erase(entry->mapIt);
-    string nameCopy = entry->name;
-    delete entry;
-    return make_pair(nameCopy, true);
+}
+
+void BedrockPlugin_Cache::HotValues::clear() {
+    _generation++;
+    for (Shard& shard : _shards) {
+        unique_lock<shared_mutex> lock(shard.mutex);
+        shard.entries.clear();
+        shard.namesByRowID.clear();
+        shard.order.clear();
+        shard.bytes = 0;
+    }
+}
+
+void BedrockPlugin_Cache::HotValues::_erase(Shard& shard, unordered_map<string, unique_ptr<Entry>>::iterator it) {
+    shard.bytes -= it->first.size() + it->second->value.size();
+    shard.namesByRowID.erase(it->second->rowID);
+    shard.order.erase(it->second->position);
+    shard.entries.erase(it);
+}
+
+int64_t BedrockPlugin_Cache::parseSize(const string& sizeString) {
+    const string& size = SToUpper(sizeString);
+    int64_t bytes = SToInt64(size);
+    if (SEndsWith(size, "KB"))
+        bytes *= 1024;
+    if (SEndsWith(size, "MB"))
+        bytes *= 1024 * 1024;
+    if (SEndsWith(size, "GB"))
+        bytes *= 1024 * 1024 * 1024;
+    return bytes;
 }
 
 int64_t BedrockPlugin_Cache::initCacheSize(string cacheString) {
     // Check the configuration
-    const string& maxCache = SToUpper(cacheString);
-    int64_t maxCacheSize = SToInt64(maxCache);
-    if (SEndsWith(maxCache, "KB"))
-        maxCacheSize *= 1024;
-    if (SEndsWith(maxCache, "MB"))
-        maxCacheSize *= 1024 * 1024;
-    if (SEndsWith(maxCache, "GB"))
-        maxCacheSize *= 1024 * 1024 * 1024;
+    int64_t maxCacheSize = parseSize(cacheString);
     if (!maxCacheSize) {
         // Provide a default
         SINFO("No -cache.max specified, defaulting to 16GB");
@@ -103,14 +299,44 @@ int64_t BedrockPlugin_Cache::initCacheSize(string cacheString) {
 }
 
 BedrockPlugin_Cache::BedrockPlugin_Cache(BedrockServer& s)
-    : BedrockPlugin(s), _maxCacheSize(initCacheSize(server.args["-cache.max"]))
+    : BedrockPlugin(s), _maxCacheSize(initCacheSize(server.args["-cache.max"])),
+      _compressValueBytes(server.args.calcU64("-cache.compressValueBytes")),
+      _hotValues(max(parseSize(server.args["-cache.hotBytes"]), (int64_t)0))
 {
+    // Drop hot values as soon as their rows change, whether that's from a command on this node or replication. Only
+    // changes to `name` and `value` (columns 0 and 1, see `upgradeDatabase`) count, so writing back the access epochs
+    // of the names being read most doesn't evict them from memory.
+    if (_hotValues.enabled()) {
+        SQLite::addTableChangeListener("cache", [this](const set<int64_t>& rowIDs) {
+            _hotValues.invalidate(rowIDs);
+        }, {0, 1});
+    }
+
+    // New rows get random rowids, which can mostly be checked against a filter in memory rather than the table.
+    if (server.args.isSet("-cache.idFilter")) {
+        SQLite::addIDFilter("cache", "rowid");
+    }
 }
 
 BedrockPlugin_Cache::~BedrockPlugin_Cache() {
     // Nothing to clean up
 }
 
+void BedrockPlugin_Cache::stateChanged(SQLite& db, SQLiteNodeState newState) {
+    // While following, we didn't see the names written by the old leader, so reload them. Uses we've already recorded
+    // are kept, as loading never moves an epoch backwards.
+    if (newState == SQLiteNodeState::LEADING) {
+        lock_guard<mutex> lock(_lruMapLoadMutex);
+        _lruMapLoadRowID = INT64_MIN;
+        _lruMapLoaded = false;
+    }
+}
+
+void BedrockPlugin_Cache::onDetach() {
+    // The DB may be replaced while we're detached, so forget anything we've read from it.
+    _hotValues.clear();
+}
+
 #undef SLOGPREFIX
 #define SLOGPREFIX "{" << getName() << "} "
 
@@ -118,37 +344,170 @@ void BedrockPlugin_Cache::upgradeDatabase(SQLite& db) {
     // Create or verify the cache table
     bool ignore;
     while (!db.verifyTable("cache", "CREATE TABLE cache ( "
+                                    "name  TEXT NOT NULL PRIMARY KEY, "
+                                    "value BLOB NOT NULL, "
+                                    "accessEpoch INTEGER NOT NULL DEFAULT 0 ) ",
+                           ignore)) {
+        if (db.verifyTable("cache", "CREATE TABLE cache ( "
                                     "name  TEXT NOT NULL PRIMARY KEY, "
                                     "value BLOB NOT NULL ) ",
                            ignore)) {
-        // Drop and rebuild the table
-        SASSERT(db.write("DROP TABLE cache;"));
+            // This is the schema from before we tracked when each name was last used, add the column.
+            SASSERT(db.addColumn("cache", "accessEpoch", "INTEGER NOT NULL DEFAULT 0"));
+        } else {
+            // Drop and rebuild the table
+            SASSERT(db.write("DROP TABLE cache;"));
+        }
     }
 
-    // Add a one row, one column table to keep track of the current size of the cache
-    SASSERT(db.verifyTable("cacheSize", "CREATE TABLE cacheSize ( size INTEGER )", ignore));
-    SQResult result;
-    SASSERT(db.read("SELECT * FROM cacheSize;", result));
-    if (result.empty()) {
-        // Insert the first (and only) row into the cache
-        SASSERT(db.write("INSERT INTO cacheSize VALUES ( 0 );"));
+    // Add the sharded one row, one column tables that keep track of the current size of the cache, and the triggers to
+    // maintain them. (Enable recursive triggers so INSERT OR REPLACE triggers a delete when replacing.)
+    SASSERT(db.write("PRAGMA recursive_triggers = 1;"));
+    for (int shard = 0; shard < CACHE_SIZE_SHARDS; shard++) {
+        // Each shard's triggers only fire for rows whose rowid selects that shard.
+        const string tableName = getCacheSizeTableName(shard);
+        auto inShard = [shard](const string& row) {
+            return "(" + row + ".rowid & " + SQ(CACHE_SIZE_SHARDS - 1) + ") = " + SQ(shard);
+        };
+        bool created = false;
+        SASSERT(db.verifyTable(tableName, "CREATE TABLE " + tableName + " ( size INTEGER NOT NULL )", created));
+        if (created) {
+            // Start with the size of everything already in this shard.
+            SASSERT(db.write("INSERT INTO " + tableName + " "
+                             "SELECT COALESCE(SUM(LENGTH(value)), 0) FROM cache WHERE " + inShard("cache") + ";"));
+        }
+        SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS cacheOnInsert_" + tableName + " AFTER INSERT ON cache "
+                         "WHEN " + inShard("NEW") + " "
+                         "BEGIN "
+                         "UPDATE " + tableName + " SET size = size + LENGTH( NEW.value ); "
+                         "END;"));
+        // Only updates to the value change the size, so updates to `accessEpoch` don't touch (and conflict on) the
+        // size tables.
+        SASSERT(db.write("DROP TRIGGER IF EXISTS cacheOnUpdate_" + tableName + ";"));
+        SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS cacheOnValueUpdate_" + tableName + " AFTER UPDATE OF value ON cache "
+                         "WHEN " + inShard("NEW") + " "
+                         "BEGIN "
+                         "UPDATE " + tableName + " SET size = size - LENGTH( OLD.value ) + LENGTH( NEW.value ); "
+                         "END;"));
+        SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS cacheOnDelete_" + tableName + " AFTER DELETE ON cache "
+                         "WHEN " + inShard("OLD") + " "
+                         "BEGIN "
+                         "UPDATE " + tableName + " SET size = size - LENGTH( OLD.value ); "
+                         "END;"));
     }
 
-    // Add the triggers to track the cache size.  (Enable recursive triggers so
-    // INSERT OR REPLACE triggers a delete when replacing.)
-    SASSERT(db.write("PRAGMA recursive_triggers = 1;"));
-    SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS cacheOnInsert AFTER INSERT ON cache "
-                     "BEGIN "
-                     "UPDATE cacheSize SET size = size + LENGTH( NEW.value ); "
-                     "END;"));
-    SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS cacheOnUpdate AFTER UPDATE ON cache "
-                     "BEGIN "
-                     "UPDATE cacheSize SET size = size - LENGTH( OLD.value ) + LENGTH( NEW.value ); "
-                     "END;"));
-    SASSERT(db.write("CREATE TRIGGER IF NOT EXISTS cacheOnDelete AFTER DELETE ON cache "
-                     "BEGIN "
-                     "UPDATE cacheSize SET size = size - LENGTH( OLD.value ); "
-                     "END;"));
+    // Remove the old, unsharded, size tracking.
+    SASSERT(db.write("DROP TRIGGER IF EXISTS cacheOnInsert;"));
+    SASSERT(db.write("DROP TRIGGER IF EXISTS cacheOnUpdate;"));
+    SASSERT(db.write("DROP TRIGGER IF EXISTS cacheOnDelete;"));
+    SASSERT(db.write("DROP TABLE IF EXISTS cacheSize;"));
+}
+
+string BedrockPlugin_Cache::getCacheSizeTableName(int shard) {
+    char tableName[12] = {0};
+    snprintf(tableName, 12, "cacheSize%02i", shard);
+    return tableName;
+}
+
+string BedrockPlugin_Cache::getCacheSizeQuery() {
+    list<string> shards;
+    for (int shard = 0; shard < CACHE_SIZE_SHARDS; shard++) {
+        shards.push_back("SELECT size FROM " + getCacheSizeTableName(shard));
+    }
+    return "SELECT SUM(size) FROM (" + SComposeList(shards, " UNION ALL ") + ");";
+}
+
+bool BedrockCacheCommand::shouldPrePeek() {
+    return SIEquals(request.getVerb(), "WriteCache") || SIEquals(request.getVerb(), "WriteCacheMulti");
+}
+
+void BedrockCacheCommand::prePeek(SQLite& db) {
+    // We only prePeek writes, to look up the current size of the cache.
+    _cacheSize = SToInt64(db.read(BedrockPlugin_Cache::getCacheSizeQuery()));
+
+    if (plugin().server.getState() != SQLiteNodeState::LEADING) {
+        // Followers don't write to the cache, so names read here would never have their epochs stored. Send them to
+        // the leader along with this command, which will be escalated (see `serializeData`).
+        if (_accessEpochs.empty()) {
+            for (const auto& [usedName, epoch] : plugin()._lruMap.popUnpersisted(BedrockPlugin_Cache::MAX_ACCESS_EPOCH_WRITES)) {
+                _accessEpochs[usedName] = to_string(epoch);
+            }
+        }
+        return;
+    }
+
+    // Until the LRU map has been rebuilt from the epochs stored in the DB, each WriteCache loads the next chunk of it.
+    // We do this here so that the write transaction doesn't read any more of the cache table than it needs to. If
+    // another command is already loading a chunk, we don't wait for it.
+    unique_lock<mutex> lock(plugin()._lruMapLoadMutex, try_to_lock);
+    if (lock.owns_lock() && !plugin()._lruMapLoaded) {
+        SQResult result;
+        if (!db.read("SELECT rowid, name, accessEpoch FROM cache "
+                     "WHERE rowid > " + SQ(plugin()._lruMapLoadRowID) + " "
+                     "ORDER BY rowid LIMIT " + SQ(BedrockPlugin_Cache::LRU_LOAD_ROWS) + ";", result)) {
+            STHROW("502 Query failed (loading LRU)");
+        }
+        for (const auto& row : result.rows) {
+            plugin()._lruMap.load(row[1], SToUInt64(row[2]));
+            plugin()._lruMapLoadRowID = SToInt64(row[0]);
+        }
+        if (result.size() < BedrockPlugin_Cache::LRU_LOAD_ROWS) {
+            plugin()._lruMapLoaded = true;
+            SINFO("Finished loading the LRU map.");
+        }
+    }
+}
+
+string BedrockCacheCommand::serializeData() const {
+    return _accessEpochs.empty() ? "" : SComposeJSONObject(_accessEpochs);
+}
+
+void BedrockCacheCommand::deserializeData(const string& data) {
+    _accessEpochs = SParseJSONObject(data);
+}
+
+bool BedrockCacheCommand::isExactName(const string& name) {
+    return name.find_first_of("*?[") == string::npos;
+}
+
+bool BedrockCacheCommand::peekWithoutTransaction() {
+    const bool isReadMulti = SIEquals(request.getVerb(), "ReadCacheMulti");
+    if ((!SIEquals(request.getVerb(), "ReadCache") && !isReadMulti) || !plugin()._hotValues.enabled()) {
+        return false;
+    }
+
+    // Record the generation before our transaction starts, in case we end up reading this from the DB.
+    _hotGeneration = plugin()._hotValues.getGeneration();
+    if (isReadMulti) {
+        // We can only skip the transaction if we have every one of the values.
+        const list<string> names = _parseNames();
+        string content;
+        list<int64_t> valueLengths;
+        for (const string& name : names) {
+            string value;
+            if (!isExactName(name) || !plugin()._hotValues.get(name, value)) {
+                return false;
+            }
+            valueLengths.push_back(value.size());
+            content += value;
+        }
+        for (const string& name : names) {
+            plugin()._lruMap.pushMRU(name);
+        }
+        response["names"] = SComposeJSONArray(names);
+        response["valueLengths"] = SComposeJSONArray(valueLengths);
+        response.content = move(content);
+        return true;
+    }
+
+    BedrockPlugin::verifyAttributeSize(request, "name", 1, BedrockPlugin::MAX_SIZE_SMALL);
+    const string& name = request["name"];
+    if (!isExactName(name) || !plugin()._hotValues.get(name, response.content)) {
+        return false;
+    }
+    response["name"] = name;
+    plugin()._lruMap.pushMRU(name);
+    return true;
 }
 
 bool BedrockCacheCommand::peek(SQLite& db) {
@@ -170,32 +529,50 @@ bool BedrockCacheCommand::peek(SQLite& db) {
         const string& name = request["name"];
         crashIdentifyingValues.insert("name");
 
-        // Get the list
-        SQResult result;
-        if (!db.read("SELECT name, value "
-                     "FROM cache "
-                     "WHERE name GLOB " +
-                         SQ(name) + " "
-                                    "LIMIT 1;",
-                     result)) {
-            STHROW("502 Query failed");
-        }
-
         // If we didn't get any results, respond failure
-        if (result.empty()) {
+        string foundName;
+        if (!_readValue(db, name, foundName, response.content)) {
             // No results
             STHROW("404 No match found");
-        } else {
-            // Return that item
-            SASSERT(result[0].size() == 2);
-            response["name"] = result[0][0];
-            response.content = result[0][1];
-            SINFO("Pushing " << response["name"] << " to LRU cache");
+        }
 
-            // Update the LRU Map
-            plugin()._lruMap.pushMRU(response["name"]);
-            return true;
+        // Return that item
+        SINFO("Pushed " << foundName << " to LRU cache");
+        response["name"] = foundName;
+        return true;
+    } else if (SIEquals(request.getVerb(), "ReadCacheMulti")) {
+        // - ReadCacheMulti( names )
+        //
+        //     Looks up the cached values for many names at once, in a single transaction.
+        //
+        //     Parameters:
+        //     - names - JSON array of name patterns (in GLOB syntax), up to MAX_MULTI_NAMES
+        //
+        //     Returns:
+        //     - 200 - OK
+        //         . names        - JSON array of the names matched, in the order requested. Patterns that didn't
+        //                          match anything are left out.
+        //         . valueLengths - JSON array of the length of each value
+        //         . content      - the values, one after the other
+        //
+        const list<string> names = _parseNames();
+        crashIdentifyingValues.insert("names");
+
+        list<string> foundNames;
+        list<int64_t> valueLengths;
+        for (const string& name : names) {
+            string foundName;
+            string value;
+            if (_readValue(db, name, foundName, value)) {
+                foundNames.push_back(foundName);
+                valueLengths.push_back(value.size());
+                response.content += value;
+            }
         }
+        SINFO("Found " << foundNames.size() << " of " << names.size() << " names, pushed them to LRU cache");
+        response["names"] = SComposeJSONArray(foundNames);
+        response["valueLengths"] = SComposeJSONArray(valueLengths);
+        return true;
     }
 
     // Didn't recognize this command
@@ -232,7 +609,7 @@ void BedrockCacheCommand::process(SQLite& db) {
             }
         } else if (!request.content.empty()) {
             // Value is provided via the body -- make sure it's not too long
-            if (request.content.size() > 64 * 1024 * 1024) {
+            if (request.content.size() > MAX_CONTENT_SIZE) {
                 STHROW("402 Content too large, 64MB max");
             }
         } else {
@@ -241,48 +618,210 @@ void BedrockCacheCommand::process(SQLite& db) {
         }
 
         // Make sure we're not trying to cache something larger than the cache itself
-        int64_t contentSize = valueHeader.empty() ? request.content.size() : valueHeader.size();
-        if (contentSize > plugin()._maxCacheSize) {
+        const string& value = valueHeader.empty() ? request.content : valueHeader;
+        if ((int64_t)value.size() > plugin()._maxCacheSize) {
             // Just refuse
             STHROW("402 Content larger than the cache itself");
         }
 
-        // Optionally invalidate other entries in the cache at the same time.
-        // Note that we will leave these items in the lruMap in memory, but
-        // that's non-harmful.
-        if (!request["invalidateName"].empty()) {
-            if (!db.write("DELETE FROM cache WHERE name GLOB " + SQ(request["invalidateName"]) + ";"))
-                STHROW("502 Query failed (invalidating)");
+        int64_t cacheSize = _cacheSize;
+        _invalidate(db, cacheSize);
+        _writeValue(db, name, value, cacheSize);
+        _writeAccessEpochs(db);
+        return;
+    } else if (SIEquals(request.getVerb(), "WriteCacheMulti")) {
+        // - WriteCacheMulti( names, valueLengths, [invalidateName] )
+        //
+        //     Records many named values into the cache in a single transaction, as if by a WriteCache for each. The
+        //     invalidation happens once, before any of the values are written.
+        //
+        //     Parameters:
+        //     - names          - JSON array of names, up to MAX_MULTI_NAMES
+        //     - valueLengths   - JSON array of the length of the value for each name
+        //     - content        - the values, one after the other (64MB max in total)
+        //     - invalidateName - A name pattern to erase from the cache (optional)
+        //
+        const list<string> names = _parseNames();
+        crashIdentifyingValues.insert("names");
+        if (request.content.size() > MAX_CONTENT_SIZE) {
+            STHROW("402 Content too large, 64MB max");
         }
 
-        // Clear out room for the new object
-        while (SToInt64(db.read("SELECT size FROM cacheSize;")) + contentSize > plugin()._maxCacheSize) {
-            // Find the least recently used (LRU) item if there is one.  (If the server was recently restarted,
-            // its LRU might not be fully populated.)
-            auto popResult = plugin()._lruMap.popLRU();
-            const string& name = (popResult.second ? popResult.first : db.read("SELECT name FROM cache LIMIT 1"));
-            SASSERT(!name.empty());
-            SINFO("Deleting " << response["name"] << " from the cache");
-
-            // Delete it
-            if (!db.write("DELETE FROM cache WHERE name=" + SQ(name) + ";")) {
-                STHROW("502 Query failed (deleting)");
+        // Split up the content.
+        const list<string> valueLengths = SParseJSONArray(request["valueLengths"]);
+        if (valueLengths.size() != names.size()) {
+            STHROW("402 Malformed valueLengths");
+        }
+        list<string> values;
+        size_t offset = 0;
+        for (const string& lengthString : valueLengths) {
+            const int64_t length = SToInt64(lengthString);
+            if (length <= 0 || offset + length > request.content.size()) {
+                STHROW("402 Malformed valueLengths");
+            }
+            if (length > plugin()._maxCacheSize) {
+                STHROW("402 Content larger than the cache itself");
             }
+            values.push_back(request.content.substr(offset, length));
+            offset += length;
+        }
+        if (offset != request.content.size()) {
+            STHROW("402 Malformed valueLengths");
         }
 
-        // Insert the new entry
-        const string& safeValue = SQ(valueHeader.empty() ? request.content : valueHeader);
-        if (!db.write("INSERT OR REPLACE INTO cache ( name, value ) "
-                      "VALUES( " +
-                      SQ(name) + ", " + safeValue + " );")) {
-                          STHROW("502 Query failed (inserting)");
-                      }
-
-        // Writing is a form of "use", so this is the new MRU.  Note that we're
-        // adding it to the MRU, even before we commit.  So if this transaction
-        // gets rolled back for any reason, the MRU will have a record for a
-        // name that isn't in the database.  But that is fine.
-        plugin()._lruMap.pushMRU(name);
+        int64_t cacheSize = _cacheSize;
+        _invalidate(db, cacheSize);
+        auto valueIt = values.begin();
+        for (const string& name : names) {
+            _writeValue(db, name, *valueIt++, cacheSize);
+        }
+        _writeAccessEpochs(db);
         return;
     }
 }
+
+list<string> BedrockCacheCommand::_parseNames() {
+    BedrockPlugin::verifyAttributeSize(request, "names", 1, BedrockPlugin::MAX_SIZE_QUERY);
+    const list<string> names = SParseJSONArray(request["names"]);
+    if (names.empty()) {
+        STHROW("402 Missing names");
+    }
+    if (names.size() > MAX_MULTI_NAMES) {
+        STHROW("402 Too many names, " + to_string(MAX_MULTI_NAMES) + " max");
+    }
+    for (const string& name : names) {
+        if (name.empty() || name.size() > BedrockPlugin::MAX_SIZE_SMALL) {
+            STHROW("402 Malformed names");
+        }
+    }
+    return names;
+}
+
+bool BedrockCacheCommand::_readValue(SQLite& db, const string& name, string& foundName, string& value) {
+    if (plugin()._hotValues.enabled() && isExactName(name) && plugin()._hotValues.get(name, value)) {
+        foundName = name;
+    } else {
+        SQResult result;
+        if (!db.read("SELECT name, DECOMPRESS(value), rowid "
+                     "FROM cache "
+                     "WHERE name GLOB " +
+                         SQ(name) + " "
+                                    "LIMIT 1;",
+                     result)) {
+            STHROW("502 Query failed");
+        }
+        if (result.empty()) {
+            return false;
+        }
+        SASSERT(result[0].size() == 3);
+        foundName = result[0][0];
+        value = result[0][1];
+
+        // Keep a copy in memory for next time, if we looked this up by its exact name.
+        if (plugin()._hotValues.enabled() && isExactName(name)) {
+            plugin()._hotValues.put(name, SToInt64(result[0][2]), value, _hotGeneration);
+        }
+    }
+
+    // Update the LRU Map
+    plugin()._lruMap.pushMRU(foundName);
+    return true;
+}
+
+void BedrockCacheCommand::_invalidate(SQLite& db, int64_t& cacheSize) {
+    // Optionally invalidate other entries in the cache at the same time.
+    // Note that we will leave these items in the lruMap in memory, but
+    // that's non-harmful.
+    if (!request["invalidateName"].empty()) {
+        cacheSize -= SToInt64(db.read("SELECT SUM(LENGTH(value)) FROM cache WHERE name GLOB " + SQ(request["invalidateName"]) + ";"));
+        if (!db.write("DELETE FROM cache WHERE name GLOB " + SQ(request["invalidateName"]) + ";"))
+            STHROW("502 Query failed (invalidating)");
+    }
+}
+
+void BedrockCacheCommand::_writeValue(SQLite& db, const string& name, const string& value, int64_t& cacheSize) {
+    // Remove any existing entry with this name, as we'll replace it.
+    const string existingSize = db.read("SELECT LENGTH(value) FROM cache WHERE name=" + SQ(name) + ";");
+    if (!existingSize.empty()) {
+        cacheSize -= SToInt64(existingSize);
+        if (!db.write("DELETE FROM cache WHERE name=" + SQ(name) + ";")) {
+            STHROW("502 Query failed (replacing)");
+        }
+    }
+
+    // Large values are stored compressed, and count towards the cache size at the size they're stored at.
+    size_t storedSize = 0;
+    const string storedValue = SQLiteCompression::literal(value, plugin()._compressValueBytes, &storedSize);
+
+    // Clear out room for the new object. We don't read the size tables here, as every other write to the cache
+    // changes them, so we update the size we read in prePeek as we go. See `_cacheSize` for how far over the maximum
+    // this lets concurrent writes go.
+    const int64_t contentSize = storedSize;
+    while (cacheSize + contentSize > plugin()._maxCacheSize) {
+        // Find the least recently used (LRU) item if there is one.  (If the server was recently restarted,
+        // its LRU might not be fully populated.)
+        auto popResult = plugin()._lruMap.popLRU();
+        const string& lruName = (popResult.second ? popResult.first : db.read("SELECT name FROM cache LIMIT 1"));
+        if (lruName.empty()) {
+            // The cache is empty, so the size we read in prePeek was out of date.
+            break;
+        }
+        const string size = db.read("SELECT LENGTH(value) FROM cache WHERE name=" + SQ(lruName) + ";");
+        if (size.empty()) {
+            // Already gone (the LRU can have names that were invalidated or never committed).
+            continue;
+        }
+        SINFO("Deleting " << lruName << " from the cache");
+
+        // Delete it
+        if (!db.write("DELETE FROM cache WHERE name=" + SQ(lruName) + ";")) {
+            STHROW("502 Query failed (deleting)");
+        }
+        cacheSize -= SToInt64(size);
+    }
+
+    // Insert the new entry. We pick a random rowid rather than letting sqlite append to the end of the table, so
+    // that concurrent writes don't all conflict on the last page of the table, and so that they're spread across
+    // the size tables.
+    const int64_t rowID = SQLiteUtils::getRandomID(db, "cache", "rowid");
+    if (!db.write("INSERT INTO cache ( rowid, name, value, accessEpoch ) "
+                  "VALUES( " +
+                  SQ(rowID) + ", " + SQ(name) + ", " + storedValue + ", " + SQ(BedrockPlugin_Cache::LRUMap::currentEpoch()) + " );")) {
+        STHROW("502 Query failed (inserting)");
+    }
+    cacheSize += contentSize;
+
+    // Writing is a form of "use", so this is the new MRU.  Note that we're
+    // adding it to the MRU, even before we commit.  So if this transaction
+    // gets rolled back for any reason, the MRU will have a record for a
+    // name that isn't in the database.  But that is fine.
+    plugin()._lruMap.pushMRU(name, true);
+}
+
+void BedrockCacheCommand::_writeAccessEpochs(SQLite& db) {
+    // Write back the epochs of a few names that have been read recently, so that they're replicated and survive a
+    // restart or failover. If this transaction is rolled back, these are lost until they're next used, which only
+    // makes eviction slightly less accurate.
+    list<pair<string, uint64_t>> accessEpochs = plugin()._lruMap.popUnpersisted(BedrockPlugin_Cache::MAX_ACCESS_EPOCH_WRITES);
+
+    // Add the ones a follower sent with this command (see prePeek). Epochs from the future are treated as now.
+    const uint64_t currentEpoch = BedrockPlugin_Cache::LRUMap::currentEpoch();
+    size_t forwarded = 0;
+    for (const auto& [usedName, epochString] : _accessEpochs) {
+        if (forwarded++ == BedrockPlugin_Cache::MAX_ACCESS_EPOCH_WRITES) {
+            break;
+        }
+        if (usedName.empty() || usedName.size() > BedrockPlugin::MAX_SIZE_SMALL) {
+            continue;
+        }
+        const uint64_t epoch = min(SToUInt64(epochString), currentEpoch);
+        plugin()._lruMap.load(usedName, epoch);
+        accessEpochs.emplace_back(usedName, epoch);
+    }
+
+    for (const auto& [usedName, epoch] : accessEpochs) {
+        if (!db.write("UPDATE cache SET accessEpoch = " + SQ(epoch) + " WHERE name=" + SQ(usedName) + " AND accessEpoch < " + SQ(epoch) + ";")) {
+            STHROW("502 Query failed (updating accessEpoch)");
+        }
+    }
+}
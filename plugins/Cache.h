@@ -1,4 +1,7 @@
 #pragma once
+#include <mutex>
+#include <unordered_map>
+
 #include <libstuff/libstuff.h>
 #include "../BedrockPlugin.h"
 
@@ -13,9 +16,14 @@ class BedrockPlugin_Cache : public BedrockPlugin {
     virtual const string& getName() const;
     virtual void upgradeDatabase(SQLite& db);
     virtual unique_ptr<BedrockCommand> getCommand(SQLiteCommand&& baseCommand);
+    virtual void stateChanged(SQLite& db, SQLiteNodeState newState);
+    virtual void onDetach();
     static const string name;
 
-    // Bedrock Cache LRU map
+    // Bedrock Cache LRU map. This is an approximate LRU: each name records the "epoch" (a coarse timestamp) it was
+    // last used in, and eviction samples names across the shards and picks the oldest. Names are spread over
+    // independently locked shards, and recording a use of a name that's already in the map only takes a shared lock
+    // and an atomic update, so reads don't serialize on a single mutex.
     class LRUMap {
       public:
         // Constructor / Destructor
@@ -25,41 +33,215 @@ class BedrockPlugin_Cache : public BedrockPlugin {
         // Tests if anything is in the map
         bool empty();
 
-        // Mark a name as being the most recently used (MRU)
-        void pushMRU(const string& name);
+        // Mark a name as being the most recently used (MRU). If `persisted` is true, the caller is writing the new
+        // epoch to the DB itself, so it doesn't need to be returned by `popUnpersisted`.
+        void pushMRU(const string& name, bool persisted = false);
+
+        // Add a name with the epoch stored for it in the DB (used to rebuild the map at startup). This never moves a
+        // name's epoch backwards.
+        void load(const string& name, uint64_t epoch);
 
-        // Remove the name that is the least recently used (LRU)
+        // Remove the name that is (approximately) the least recently used (LRU)
         pair<string, bool> popLRU();
 
+        // Returns up to `max` names that have been used since their epoch was last written to the DB, with their
+        // current epochs. These are considered persisted once returned.
+        list<pair<string, uint64_t>> popUnpersisted(size_t max);
+
+        // The current epoch, in units of EPOCH_SECONDS.
+        static uint64_t currentEpoch();
+        static constexpr uint64_t EPOCH_SECONDS = 300;
+
       private:
         // A single entry being tracked
         struct Entry {
-            // Attributes
-            string name;
-            list<Entry*>::iterator listIt;
-            map<string, Entry*>::iterator mapIt;
+            // The most recent epoch in which this was used, and the most recent epoch written to the DB.
+            atomic<uint64_t> epoch = 0;
+            atomic<uint64_t> persistedEpoch = 0;
+
+            // True while this entry's name is in its shard's `unpersisted` list.
+            atomic<bool> queued = false;
+        };
+
+        struct Shard {
+            shared_mutex entriesMutex;
+            unordered_map<string, unique_ptr<Entry>> entries;
+
+            // Names with an epoch newer than what's in the DB. Locked separately so it can be appended to while holding
+            // `entriesMutex` in shared mode.
+            mutex unpersistedMutex;
+            list<string> unpersisted;
         };
 
+        // Updates an entry's epoch (never backwards), and queues it to be persisted if needed.
+        void _touch(Shard& shard, const string& name, Entry& entry, uint64_t epoch, bool persisted);
+
+        Shard& _getShard(const string& name);
+
+        static constexpr size_t SHARD_COUNT = 64;
+
+        // Eviction looks at SAMPLE_SIZE entries in each of SAMPLE_SHARDS shards. `_clockHand` rotates through the
+        // shards so successive evictions look at different parts of the map.
+        static constexpr size_t SAMPLE_SHARDS = 4;
+        static constexpr size_t SAMPLE_SIZE = 8;
+
         // Attributes
-        recursive_mutex _mutex;
-        list<Entry*> _lruList;
-        map<string, Entry*> _lruMap;
+        Shard _shards[SHARD_COUNT];
+        atomic<size_t> _clockHand = 0;
+        atomic<size_t> _size = 0;
+    };
+
+    // An optional in-memory copy of the values of frequently read names, which lets ReadCache answer for an exact name
+    // without starting a transaction. It's bounded by `-cache.hotBytes`, and values are dropped as soon as a commit
+    // changes their row in the cache table (on every node, as it applies replicated transactions), so it never
+    // returns a value that's been overwritten or invalidated.
+    class HotValues {
+      public:
+        HotValues(size_t maxBytes);
+
+        // True if this was configured with a non-zero size.
+        bool enabled() const { return _maxBytes; }
+
+        // Looks up a value by exact name. Returns true and sets `value` if it's present.
+        bool get(const string& name, string& value);
+
+        // Returns a generation to pass to `put`. This must be called before starting the transaction that reads the
+        // value, so that `put` can tell if the row may have changed in the meantime.
+        uint64_t getGeneration() const { return _generation; }
+
+        // Stores a value read from the DB, unless any rows have been invalidated since `generation`.
+        void put(const string& name, int64_t rowID, const string& value, uint64_t generation);
+
+        // Drops any values stored for the given rowids of the cache table, or everything if `rowIDs` is empty.
+        void invalidate(const set<int64_t>& rowIDs);
+
+        // Drops everything.
+        void clear();
+
+      private:
+        struct Entry {
+            string value;
+            int64_t rowID;
+
+            // Position of this name in its shard's `order`.
+            list<string>::iterator position;
+
+            // Set when read, and cleared when eviction passes over it. Entries that haven't been read since eviction
+            // last looked at them are evicted first (i.e., the CLOCK approximation of LRU).
+            atomic<bool> referenced = false;
+        };
+
+        struct Shard {
+            shared_mutex mutex;
+            unordered_map<string, unique_ptr<Entry>> entries;
+            unordered_map<int64_t, string> namesByRowID;
+            list<string> order;
+            size_t bytes = 0;
+        };
+
+        // Removes an entry from a shard, which must be locked exclusively.
+        static void _erase(Shard& shard, unordered_map<string, unique_ptr<Entry>>::iterator it);
+
+        static constexpr size_t SHARD_COUNT = 16;
+        const size_t _maxBytes;
+        Shard _shards[SHARD_COUNT];
+
+        // Incremented before any values are invalidated.
+        atomic<uint64_t> _generation = 0;
     };
 
     static int64_t initCacheSize(string cacheString);
 
+    // Parses a size given as bytes with an optional KB, MB or GB suffix.
+    static int64_t parseSize(const string& sizeString);
+
+    // The total size of the cache is tracked across this many single-row `cacheSizeNN` tables, so that concurrent
+    // writes to the cache don't all conflict updating the same page. A row's size is counted in the table selected by
+    // the low bits of its rowid, and the total is the sum of all of them.
+    static constexpr int CACHE_SIZE_SHARDS = 16;
+    static string getCacheSizeTableName(int shard);
+
+    // Returns a query for the total size of the cache.
+    static string getCacheSizeQuery();
+
     // Constants
     const int64_t _maxCacheSize;
+
+    // Values at least this long are stored compressed (see SQLiteCompression), set with `-cache.compressValueBytes`.
+    // Cache sizes count the compressed size. 0 (the default) stores values as is.
+    const uint64_t _compressValueBytes;
     LRUMap _lruMap;
+    HotValues _hotValues;
+
+    // While leading, `_lruMap` is rebuilt from the `accessEpoch` column of the cache table LRU_LOAD_ROWS rows at a time
+    // by successive WriteCache commands, so no one command reads the whole table. Rowids are random, so until it's
+    // complete, the names loaded so far are a sample of the whole cache to evict from. `_lruMapLoadRowID` is the last
+    // rowid loaded, and is reset when we start leading, so the new leader picks up everything written while it was
+    // following.
+    mutex _lruMapLoadMutex;
+    int64_t _lruMapLoadRowID = INT64_MIN;
+    bool _lruMapLoaded = false;
+    static constexpr size_t LRU_LOAD_ROWS = 10'000;
+
+    // Number of recently used names whose epochs we write back to the DB in each WriteCache. Followers send theirs to
+    // the leader with the WriteCache commands they escalate.
+    static constexpr size_t MAX_ACCESS_EPOCH_WRITES = 20;
     static const set<string, STableComp> supportedRequestVerbs;
 };
 
 class BedrockCacheCommand : public BedrockCommand {
   public:
     BedrockCacheCommand(SQLiteCommand&& baseCommand, BedrockPlugin_Cache* plugin);
+    virtual bool shouldPrePeek();
+    virtual void prePeek(SQLite& db);
+    virtual bool peekWithoutTransaction();
     virtual bool peek(SQLite& db);
     virtual void process(SQLite& db);
+    virtual string serializeData() const;
+    virtual void deserializeData(const string& data);
 
   private:
     BedrockPlugin_Cache& plugin() { return static_cast<BedrockPlugin_Cache&>(*_plugin); }
+
+    // True if a ReadCache name has no GLOB wildcards, so it can only match the row with exactly that name.
+    static bool isExactName(const string& name);
+
+    // Limits on the size of requests.
+    static constexpr size_t MAX_MULTI_NAMES = 1000;
+    static constexpr size_t MAX_CONTENT_SIZE = 64 * 1024 * 1024;
+
+    // Parses and verifies the `names` of a ReadCacheMulti or WriteCacheMulti.
+    list<string> _parseNames();
+
+    // Looks up the value of the first name matching `name` (from memory if possible), and records it as used. Returns
+    // false if nothing matched.
+    bool _readValue(SQLite& db, const string& name, string& foundName, string& value);
+
+    // Deletes the names matching the request's `invalidateName`, if any, subtracting their size from `cacheSize`.
+    void _invalidate(SQLite& db, int64_t& cacheSize);
+
+    // Writes a single value, replacing any existing one with the same name, and evicting the least recently used
+    // values as needed to keep the cache under its maximum size. `cacheSize` is updated to match.
+    void _writeValue(SQLite& db, const string& name, const string& value, int64_t& cacheSize);
+
+    // Writes back the access epochs of some recently read names (see `LRUMap::popUnpersisted`), and any sent by the
+    // follower that escalated this command.
+    void _writeAccessEpochs(SQLite& db);
+
+    // The size of the cache, as read in prePeek. We read this outside of the transaction that writes to the cache so
+    // that the write transaction doesn't depend on (and so conflict with) every other write to the cache. prePeek runs
+    // again each time the command is retried, so this is never older than the attempt that uses it.
+    //
+    // This means writes that are processed at the same time all start from the size before any of them committed, and
+    // can each fill the same free space. The cache can go over `-cache.max` by at most the total size of the values
+    // written by the commands being processed at once (so at most MAX_CONTENT_SIZE per worker thread), and the next
+    // write reads the committed size and evicts back down under the maximum.
+    int64_t _cacheSize = 0;
+
+    // Names read on the follower that escalated this command, and the epochs they were last read in, for the leader
+    // to write along with this command.
+    STable _accessEpochs;
+
+    // The hot value generation from before the peek transaction started, for ReadCache.
+    uint64_t _hotGeneration = 0;
 };
@@ -2,6 +2,7 @@
 
 #include <BedrockServer.h>
 #include <libstuff/SQResult.h>
+#include <sqlitecluster/SQLiteCompression.h>
 #include <sqlitecluster/SQLiteUtils.h>
 
 #undef SLOGPREFIX
@@ -61,8 +62,23 @@ BedrockJobsCommand::BedrockJobsCommand(SQLiteCommand&& baseCommand, BedrockPlugi
 
 BedrockPlugin_Jobs::BedrockPlugin_Jobs(BedrockServer& s) :
     BedrockPlugin(s),
-    isLive(server.args.isSet("-live"))
+    isLive(server.args.isSet("-live")),
+    compressDataBytes(server.args.calcU64("-jobs.compressDataBytes"))
 {
+    // `-jobs.idAllocation` can be set to "thread" or "time" to cluster new jobs onto fewer pages of the jobs table.
+    // See SQLiteUtils::ID_ALLOCATION.
+    if (server.args.isSet("-jobs.idAllocation")) {
+        SQLiteUtils::ID_ALLOCATION allocation = SQLiteUtils::ID_ALLOCATION::RANDOM;
+        if (!SQLiteUtils::parseIDAllocation(server.args["-jobs.idAllocation"], allocation)) {
+            SERROR("Unknown -jobs.idAllocation '" << server.args["-jobs.idAllocation"] << "', expected random, thread or time.");
+        }
+        SQLiteUtils::setIDAllocation("jobs", allocation);
+    }
+
+    // `-jobs.idFilter` keeps a filter of job IDs in memory, so checking new ones are unused rarely needs the jobs table.
+    if (server.args.isSet("-jobs.idFilter")) {
+        SQLite::addIDFilter("jobs", "jobID");
+    }
 }
 
 unique_ptr<BedrockCommand> BedrockPlugin_Jobs::getCommand(SQLiteCommand&& baseCommand) {
@@ -174,7 +190,7 @@ bool BedrockJobsCommand::peek(SQLite& db) {
 
         // Verify there is a job like this
         SQResult result;
-        if (!db.read("SELECT created, jobID, state, name, nextRun, lastRun, repeat, data, retryAfter, priority "
+        if (!db.read("SELECT created, jobID, state, name, nextRun, lastRun, repeat, DECOMPRESS(data), retryAfter, priority "
                      "FROM jobs "
                      "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
                      result)) {
@@ -252,7 +268,7 @@ bool BedrockJobsCommand::peek(SQLite& db) {
             if (parentJobID) {
                 SINFO("parentJobID passed, checking existing job with ID " << parentJobID);
                 SQResult result;
-                if (!db.read("SELECT state, data FROM jobs WHERE jobID=" + SQ(parentJobID) + ";", result)) {
+                if (!db.read("SELECT state, DECOMPRESS(data) FROM jobs WHERE jobID=" + SQ(parentJobID) + ";", result)) {
                     STHROW("502 Select failed");
                 }
                 if (result.empty()) {
@@ -286,10 +302,10 @@ bool BedrockJobsCommand::peek(SQLite& db) {
                 SINFO("Unique flag was passed, checking existing job with name " << job["name"] << ", mocked? "
                       << (mockRequest ? "true" : "false"));
                 string operation = mockRequest ? "IS NOT" : "IS";
-                if (!db.read("SELECT jobID, data "
+                if (!db.read("SELECT jobID, DECOMPRESS(data) "
                              "FROM jobs "
                              "WHERE name=" + SQ(job["name"]) +
-                             "  AND JSON_EXTRACT(data, '$.mockRequest') " + operation + " NULL;",
+                             "  AND JSON_EXTRACT(DECOMPRESS(data), '$.mockRequest') " + operation + " NULL;",
                              result)) {
                     STHROW("502 Select failed");
                 }
@@ -462,10 +478,10 @@ void BedrockJobsCommand::process(SQLite& db) {
                 SINFO("Unique flag was passed, checking existing job with name " << job["name"] << ", mocked? "
                       << (mockRequest ? "true" : "false"));
                 string operation = mockRequest ? "IS NOT" : "IS";
-                if (!db.read("SELECT jobID, data "
+                if (!db.read("SELECT jobID, DECOMPRESS(data) "
                              "FROM jobs "
                              "WHERE name=" + SQ(job["name"]) +
-                             "  AND JSON_EXTRACT(data, '$.mockRequest') " + operation + " NULL;",
+                             "  AND JSON_EXTRACT(DECOMPRESS(data), '$.mockRequest') " + operation + " NULL;",
                              result)) {
                     STHROW("502 Select failed");
                 }
@@ -530,7 +546,7 @@ void BedrockJobsCommand::process(SQLite& db) {
             int64_t parentJobID = SContains(job, "parentJobID") ? SToInt64(job["parentJobID"]) : 0;
             if (parentJobID) {
                 SQResult result;
-                if (!db.read("SELECT state, parentJobID, data FROM jobs WHERE jobID=" + SQ(parentJobID) + ";", result)) {
+                if (!db.read("SELECT state, parentJobID, DECOMPRESS(data) FROM jobs WHERE jobID=" + SQ(parentJobID) + ";", result)) {
                     STHROW("502 Select failed");
                 }
                 if (result.empty()) {
@@ -560,7 +576,7 @@ void BedrockJobsCommand::process(SQLite& db) {
                     // Update the existing job.
                     if(!db.writeIdempotent("UPDATE jobs SET "
                                              "repeat   = " + SQ(SToUpper(job["repeat"])) + ", " +
-                                             "data     = JSON_PATCH(data, " + safeData + "), " +
+                                             "data     = " + _storedData("JSON_PATCH(DECOMPRESS(data), " + safeData + ")") + ", " +
                                              "priority = " + SQ(priority) + " " +
                                            "WHERE jobID = " + SQ(updateJobID) + ";"))
                     {
@@ -593,8 +609,12 @@ void BedrockJobsCommand::process(SQLite& db) {
                 // If no data was provided, use an empty object
                 const string& safeRetryAfter = SContains(job, "retryAfter") && !job["retryAfter"].empty() ? SQ(job["retryAfter"]) : SQ("");
 
+                // Large data is stored compressed.
+                const string storedData = SQLiteCompression::literal(!SContains(job, "data") || job["data"].empty() ? "{}" : job["data"],
+                                                                     plugin().compressDataBytes);
+
                 // Create this new job with a new generated ID
-                const int64_t jobIDToUse = SQLiteUtils::getRandomID(db, "jobs", "jobID");
+                const int64_t jobIDToUse = SQLiteUtils::getNewID(db, "jobs", "jobID");
                 SINFO("Next jobID to be used " << jobIDToUse);
                 if (!db.writeIdempotent("INSERT INTO jobs ( jobID, created, state, name, nextRun, repeat, data, priority, parentJobID, retryAfter ) "
                          "VALUES( " +
@@ -604,7 +624,7 @@ void BedrockJobsCommand::process(SQLite& db) {
                             SQ(job["name"]) + ", " +
                             safeFirstRun + ", " +
                             SQ(SToUpper(job["repeat"])) + ", " +
-                            safeData + ", " +
+                            storedData + ", " +
                             SQ(priority) + ", " +
                             SQ(parentJobID) + ", " +
                             safeRetryAfter + " " +
@@ -648,17 +668,17 @@ void BedrockJobsCommand::process(SQLite& db) {
         string selectQuery;
         if (request.isSet("jobPriority")) {
             selectQuery =
-                "SELECT jobID, name, data, parentJobID, retryAfter, created, repeat, lastRun, nextRun, priority "
+                "SELECT jobID, name, DECOMPRESS(data), parentJobID, retryAfter, created, repeat, lastRun, nextRun, priority "
                 "FROM jobs "
                 "WHERE state IN ('QUEUED', 'RUNQUEUED') "
                     "AND priority=" + SQ(request.calc("jobPriority")) + " "
                     "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
                     "AND +name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                    string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
+                    string(!mockRequest ? " AND JSON_EXTRACT(DECOMPRESS(data), '$.mockRequest') IS NULL " : "") +
                 "ORDER BY nextRun ASC LIMIT " + safeNumResults + ";";
         } else {
             selectQuery =
-                "SELECT jobID, name, data, parentJobID, retryAfter, created, repeat, lastRun, nextRun, priority FROM ( "
+                "SELECT jobID, name, DECOMPRESS(data), parentJobID, retryAfter, created, repeat, lastRun, nextRun, priority FROM ( "
                     "SELECT * FROM ("
                         "SELECT jobID, name, data, priority, parentJobID, retryAfter, created, repeat, lastRun, nextRun "
                         "FROM jobs "
@@ -666,7 +686,7 @@ void BedrockJobsCommand::process(SQLite& db) {
                             "AND priority=1000 "
                             "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
                             "AND name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                            string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
+                            string(!mockRequest ? " AND JSON_EXTRACT(DECOMPRESS(data), '$.mockRequest') IS NULL " : "") +
                         "ORDER BY nextRun ASC LIMIT " + safeNumResults +
                     ") "
                 "UNION ALL "
@@ -677,7 +697,7 @@ void BedrockJobsCommand::process(SQLite& db) {
                             "AND priority=850 "
                             "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
                             "AND name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                            string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
+                            string(!mockRequest ? " AND JSON_EXTRACT(DECOMPRESS(data), '$.mockRequest') IS NULL " : "") +
                         "ORDER BY nextRun ASC LIMIT " + safeNumResults +
                     ") "
                 "UNION ALL "
@@ -688,7 +708,7 @@ void BedrockJobsCommand::process(SQLite& db) {
                             "AND priority=750 "
                             "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
                             "AND name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                            string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
+                            string(!mockRequest ? " AND JSON_EXTRACT(DECOMPRESS(data), '$.mockRequest') IS NULL " : "") +
                         "ORDER BY nextRun ASC LIMIT " + safeNumResults +
                     ") "
                 "UNION ALL "
@@ -699,7 +719,7 @@ void BedrockJobsCommand::process(SQLite& db) {
                             "AND priority=500 "
                             "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
                             "AND name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                            string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
+                            string(!mockRequest ? " AND JSON_EXTRACT(DECOMPRESS(data), '$.mockRequest') IS NULL " : "") +
                         "ORDER BY nextRun ASC LIMIT " + safeNumResults +
                     ") "
                 "UNION ALL "
@@ -710,7 +730,7 @@ void BedrockJobsCommand::process(SQLite& db) {
                             "AND priority=250 "
                             "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
                             "AND name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                            string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
+                            string(!mockRequest ? " AND JSON_EXTRACT(DECOMPRESS(data), '$.mockRequest') IS NULL " : "") +
                         "ORDER BY nextRun ASC LIMIT " + safeNumResults +
                     ") "
                 "UNION ALL "
@@ -721,7 +741,7 @@ void BedrockJobsCommand::process(SQLite& db) {
                             "AND priority=0 "
                             "AND " + SCURRENT_TIMESTAMP() + ">=nextRun "
                             "AND name " + (nameList.size() > 1 ? "IN (" + SQList(nameList) + ")" : "GLOB " + SQ(request["name"])) + " " +
-                            string(!mockRequest ? " AND JSON_EXTRACT(data, '$.mockRequest') IS NULL " : "") +
+                            string(!mockRequest ? " AND JSON_EXTRACT(DECOMPRESS(data), '$.mockRequest') IS NULL " : "") +
                         "ORDER BY nextRun ASC LIMIT " + safeNumResults +
                     ") "
                 ") "
@@ -770,7 +790,7 @@ void BedrockJobsCommand::process(SQLite& db) {
             if (parentJobID) {
                 // Has a parent job, add the parent data
                 job["parentJobID"] = SToStr(parentJobID);;
-                job["parentData"] = db.read("SELECT data FROM jobs WHERE jobID=" + SQ(parentJobID) + ";");
+                job["parentData"] = db.read("SELECT DECOMPRESS(data) FROM jobs WHERE jobID=" + SQ(parentJobID) + ";");
             }
 
             // Add jobID to the respective list depending on if retryAfter is set
@@ -782,7 +802,7 @@ void BedrockJobsCommand::process(SQLite& db) {
 
             // See if this job has any FINISHED/CANCELLED child jobs, indicating it is being resumed
             SQResult childJobs;
-            if (!db.read("SELECT jobID, data, state FROM jobs WHERE parentJobID != 0 AND parentJobID=" + result[c][0] + " AND state IN ('FINISHED', 'CANCELLED');", childJobs)) {
+            if (!db.read("SELECT jobID, DECOMPRESS(data), state FROM jobs WHERE parentJobID != 0 AND parentJobID=" + result[c][0] + " AND state IN ('FINISHED', 'CANCELLED');", childJobs)) {
                 STHROW("502 Failed to select finished child jobs");
             }
 
@@ -847,7 +867,7 @@ void BedrockJobsCommand::process(SQLite& db) {
                 if (!SStartsWith(job["name"], "manual")) {
                     // Set this so we don't retry infinitely for non manual jobs (see above)
                     // We also set originalNextRun so we don't lose track of the original nextRun (which we are overriding here)
-                    dataUpdateQuery = ", data = JSON_SET(data, '$.retryAfterCount', COALESCE(JSON_EXTRACT(data, '$.retryAfterCount'), 0) + 1" + (isRepeatBasedOnScheduledTime ? ", '$.originalNextRun', " + SQ(job["nextRun"]) + ") ": ") ");
+                    dataUpdateQuery = ", data = " + _storedData("JSON_SET(DECOMPRESS(data), '$.retryAfterCount', COALESCE(JSON_EXTRACT(DECOMPRESS(data), '$.retryAfterCount'), 0) + 1" + (isRepeatBasedOnScheduledTime ? ", '$.originalNextRun', " + SQ(job["nextRun"]) + ")": ")")) + " ";
                 }
                 string updateQuery = "UPDATE jobs "
                                      "SET state = 'RUNQUEUED', "
@@ -921,7 +941,7 @@ void BedrockJobsCommand::process(SQLite& db) {
 
         // Verify there is a job like this
         SQResult result;
-        if (!db.read("SELECT jobID, nextRun, lastRun, JSON_EXTRACT(data, '$.mockRequest') "
+        if (!db.read("SELECT jobID, nextRun, lastRun, JSON_EXTRACT(DECOMPRESS(data), '$.mockRequest') "
                      "FROM jobs "
                      "WHERE jobID=" + SQ(request.calc64("jobID")) + ";",
                      result)) {
@@ -954,7 +974,7 @@ void BedrockJobsCommand::process(SQLite& db) {
         // Update the data
         if (!db.writeIdempotent("UPDATE jobs "
                                 "SET data=" +
-                                SQ(SComposeJSONObject(newData)) +
+                                SQLiteCompression::literal(SComposeJSONObject(newData), plugin().compressDataBytes) +
                                 (request["repeat"].size() ? ", repeat=" + SQ(SToUpper(request["repeat"])) : "") +
                                 (!newNextRun.empty() ? ", nextRun=" + newNextRun : "") +
                                 (request.isSet("jobPriority") ? ", priority=" + SQ(request.calc64("jobPriority")) + " " : "") +
@@ -1005,7 +1025,7 @@ void BedrockJobsCommand::process(SQLite& db) {
 
         // Verify there is a job like this and it's running
         SQResult result;
-        if (!db.read("SELECT state, nextRun, lastRun, repeat, parentJobID, json_extract(data, '$.mockRequest'), retryAfter, json_extract(data, '$.originalNextRun') "
+        if (!db.read("SELECT state, nextRun, lastRun, repeat, parentJobID, json_extract(DECOMPRESS(data), '$.mockRequest'), retryAfter, json_extract(DECOMPRESS(data), '$.originalNextRun') "
                      "FROM jobs "
                      "WHERE jobID=" + SQ(jobID) + ";",
                      result)) {
@@ -1069,13 +1089,13 @@ void BedrockJobsCommand::process(SQLite& db) {
             }
 
             // Update the data to the new value.
-            if (!db.writeIdempotent("UPDATE jobs SET data=" + SQ(data) + " WHERE jobID=" + SQ(jobID) + ";")) {
+            if (!db.writeIdempotent("UPDATE jobs SET data=" + SQLiteCompression::literal(data, plugin().compressDataBytes) + " WHERE jobID=" + SQ(jobID) + ";")) {
                 STHROW("502 Failed to update job data");
             }
         }
 
         // Reset the retryAfterCount (set by GetJob(s)).
-        if (!db.writeIdempotent("UPDATE jobs SET data = JSON_REMOVE(data, '$.retryAfterCount') WHERE jobID=" + SQ(jobID) + ";")) {
+        if (!db.writeIdempotent("UPDATE jobs SET data = " + _storedData("JSON_REMOVE(DECOMPRESS(data), '$.retryAfterCount')") + " WHERE jobID=" + SQ(jobID) + ";")) {
             STHROW("502 Failed to update job retryAfterCount");
         }
 
@@ -1278,7 +1298,7 @@ void BedrockJobsCommand::process(SQLite& db) {
         list<string> updateList;
         if (request.isSet("data")) {
             // Update the data too
-            updateList.push_back("data=" + SQ(request["data"]));
+            updateList.push_back("data=" + SQLiteCompression::literal(request["data"], plugin().compressDataBytes));
         }
 
         // Not repeating; just finish
@@ -1344,7 +1364,7 @@ void BedrockJobsCommand::process(SQLite& db) {
             string nameQuery = name.empty() ? "" : ", name = " + SQ(name) + "";
             string decrementFailuresQuery;
             if (request.test("decrementFailures")) {
-                 decrementFailuresQuery = ", data = JSON_SET(data, '$.retryAfterCount', COALESCE(JSON_EXTRACT(data, '$.retryAfterCount'), 1) - 1)";
+                 decrementFailuresQuery = ", data = " + _storedData("JSON_SET(DECOMPRESS(data), '$.retryAfterCount', COALESCE(JSON_EXTRACT(DECOMPRESS(data), '$.retryAfterCount'), 1) - 1)");
             }
             string updateQuery = "UPDATE jobs SET state = 'QUEUED', nextRun = created"+ nameQuery + decrementFailuresQuery + " WHERE jobID IN(" + SQList(jobIDs)+ ");";
             if (!db.writeIdempotent(updateQuery)) {
@@ -1448,6 +1468,14 @@ void BedrockJobsCommand::_validatePriority(const int64_t priority) {
     }
 }
 
+string BedrockJobsCommand::_storedData(const string& expression) {
+    // Compression happens on each node as it runs the query, which is fine, as it's deterministic.
+    if (!plugin().compressDataBytes) {
+        return expression;
+    }
+    return "COMPRESS(" + expression + ", " + SQ(plugin().compressDataBytes) + ")";
+}
+
 void BedrockJobsCommand::_handleFailedRetryAfterQuery(SQLite& db, const string& jobID) {
     SALERT("ENSURE_BUGBOT Query error when updating job with retryAfter. JobID: " << jobID);
     if (!db.writeIdempotent("UPDATE jobs "
@@ -19,6 +19,15 @@ class BedrockPlugin_Jobs : public BedrockPlugin {
 
     const bool isLive;
 
+    // Job data at least this long is stored compressed (see SQLiteCompression), set with `-jobs.compressDataBytes`.
+    // 0 (the default) stores it as is.
+    //
+    // Reads pay to decompress it: gunzipping job data takes roughly 5us plus 3us per KB (measured with zlib on one
+    // core, for 1KB to 64KB of JSON). GetJobs without `mockRequest` filters on `JSON_EXTRACT(DECOMPRESS(data),
+    // '$.mockRequest')`, so it decompresses the data of every job it considers, and then again for the jobs it
+    // returns. Set this well above the size of most jobs' data, so only the occasional large one pays that.
+    const uint64_t compressDataBytes;
+
   private:
     static const string name;
     static const int64_t JOBS_DEFAULT_PRIORITY;
@@ -38,6 +47,11 @@ class BedrockJobsCommand : public BedrockCommand {
     bool _hasPendingChildJobs(SQLite& db, int64_t jobID);
     void _validatePriority(const int64_t priority);
 
+    // Returns SQL to store `expression`, which computes new job data, compressing it if it's long enough.
+    string _storedData(const string& expression);
+
+    BedrockPlugin_Jobs& plugin() { return static_cast<BedrockPlugin_Jobs&>(*_plugin); }
+
     // Do not throw an exception when something goes wrong with the query to update a job's retryAfter.
     // Update the job to the failed state and log a Bugbot instead.
     // This is to avoid causing GetJob(s) to error which will render BWM unable to fetch any jobs that need to be run.
@@ -5,6 +5,7 @@
 
 #include <libstuff/libstuff.h>
 #include <libstuff/SQResult.h>
+#include <sqlitecluster/SQLiteCompression.h>
 
 #define DBINFO(_MSG_) SINFO("{" << _filename << "} " << _MSG_)
 
@@ -17,6 +18,10 @@ sqlite3* SQLite::getDBHandle() {
 
 thread_local string SQLite::_mostRecentSQLiteErrorLog;
 thread_local int64_t SQLite::_conflictPage;
+map<string, SQLite::TableChangeListeners> SQLite::_tableChangeListeners;
+shared_mutex SQLite::_tableChangeListenersMutex;
+atomic<bool> SQLite::_hasTableChangeListeners(false);
+map<string, string, STableComp> SQLite::_idFilterColumns;
 
 const string SQLite::getMostRecentSQLiteErrorLog() const {
     return _mostRecentSQLiteErrorLog;
@@ -46,6 +51,10 @@ const set<string>& SQLite::getTablesUsed() const {
     return _tablesUsed;
 }
 
+string SQLite::getReplicationTables() const {
+    return _schemaChanged ? "" : SComposeList(_tablesUsed);
+}
+
 SQLite::SharedData& SQLite::initializeSharedData(sqlite3* db, const string& filename, const vector<string>& journalNames, bool hctree) {
     static struct SharedDataLookupMapType {
         map<string, SharedData*> m;
@@ -90,6 +99,12 @@ SQLite::SharedData& SQLite::initializeSharedData(sqlite3* db, const string& file
             SERROR("Loaded commit count " << commitCount << " with empty hash.");
         }
 
+        // Create ID filters before anything else can use this file, so `_preUpdateHookCallback` adds every ID written
+        // from then on. What's in the tables already is read in the background.
+        for (const auto& [tableName, column] : _idFilterColumns) {
+            _initializeIDFilter(db, *sharedData, filename, tableName, column);
+        }
+
         // Insert our SharedData object into the global map.
         sharedDataLookupMap.m.emplace(filename, sharedData);
         return *sharedData;
@@ -198,13 +213,17 @@ void SQLite::commonConstructorInitialization(bool hctree) {
     if (_mmapSizeGB) {
         SASSERT(!SQuery(_db, "enabling memory-mapped I/O", "PRAGMA mmap_size=" + to_string(_mmapSizeGB * 1024 * 1024 * 1024) + ";"));
     }
+    _appliedMmapSizeGB = _mmapSizeGB;
 
     // Enable tracing for performance analysis.
     sqlite3_trace_v2(_db, SQLITE_TRACE_STMT, _sqliteTraceCallback, this);
 
-    // Update the cache. -size means KB; +size means pages
-    SINFO("Setting cache_size to " << _cacheSize << "KB");
-    SQuery(_db, "increasing cache size", "PRAGMA cache_size = -" + SQ(_cacheSize) + ";");
+    // Update the cache. With a cache budget, every handle's share just got smaller, so they all need to recalculate.
+    _sharedData.handleCount++;
+    if (_sharedData.cacheBudgetKB) {
+        _sharedData.cacheSettingsGeneration++;
+    }
+    _applyCacheSettings();
 
     // Register the authorizer callback which allows callers to whitelist particular data in the DB.
     sqlite3_set_authorizer(_db, _sqliteAuthorizerCallback, this);
@@ -216,6 +235,15 @@ void SQLite::commonConstructorInitialization(bool hctree) {
     // Setting a wal hook prevents auto-checkpointing.
     sqlite3_wal_hook(_db, _walHookCallback, this);
 
+    // Record changed rows for ID filters and table change listeners. We use the preupdate hook rather than the update
+    // hook, as it can see the old and new values of an updated row. It's also called for rows deleted by REPLACE
+    // conflict resolution, and having one set turns off the truncate optimization for `DELETE FROM table`, so every
+    // changed row is reported.
+    sqlite3_preupdate_hook(_db, _preUpdateHookCallback, this);
+
+    // COMPRESS and DECOMPRESS, for large values stored compressed.
+    SQLiteCompression::registerFunctions(_db);
+
     // Check if synchronous has been set and run query to use a custom synchronous setting
     if (!_synchronous.empty()) {
         SASSERT(!SQuery(_db, "setting custom synchronous commits", "PRAGMA synchronous = " + SQ(_synchronous)  + ";"));
@@ -274,6 +302,287 @@ int SQLite::_walHookCallback(void* sqliteObject, sqlite3* db, const char* name,
     return SQLITE_OK;
 }
 
+void SQLite::_preUpdateHookCallback(void* sqliteObject, sqlite3* db, int operation, const char* database, const char* table,
+                                    sqlite3_int64 oldRowID, sqlite3_int64 newRowID) {
+    SQLite* sqlite = static_cast<SQLite*>(sqliteObject);
+
+    // Only rows in the main database count, as an attached (or temp) one can have a table by the same name.
+    if (strcmp(database, "main")) {
+        return;
+    }
+
+    // New IDs go in the filter as soon as they're written, so they're there before the transaction commits and
+    // anyone else could find them in the table. If it rolls back instead, they're just false positives.
+    if (operation != SQLITE_DELETE && !sqlite->_sharedData.idFilters.empty()) {
+        auto filterIt = sqlite->_sharedData.idFilters.find(table);
+        if (filterIt != sqlite->_sharedData.idFilters.end()) {
+            filterIt->second->filter.add(newRowID);
+        }
+    }
+
+    // This runs for every row written, so don't take the lock at all unless someone's listening.
+    if (!_hasTableChangeListeners.load(memory_order_acquire)) {
+        return;
+    }
+    shared_lock<shared_mutex> lock(_tableChangeListenersMutex);
+    auto listenersIt = _tableChangeListeners.find(table);
+    if (listenersIt == _tableChangeListeners.end()) {
+        return;
+    }
+    const TableChangeListeners& listeners = listenersIt->second;
+    if (operation == SQLITE_UPDATE && oldRowID == newRowID && !listeners.allColumns &&
+        !_updateChangedColumns(db, listeners.columns)) {
+        return;
+    }
+    set<int64_t>& changedRows = sqlite->_changedRows[table];
+    if (operation != SQLITE_INSERT) {
+        changedRows.insert(oldRowID);
+    }
+    if (operation != SQLITE_DELETE) {
+        changedRows.insert(newRowID);
+    }
+}
+
+bool SQLite::_updateChangedColumns(sqlite3* db, const set<int>& columns) {
+    const int columnCount = sqlite3_preupdate_count(db);
+    for (int column : columns) {
+        sqlite3_value* oldValue = nullptr;
+        sqlite3_value* newValue = nullptr;
+        if (column >= columnCount || sqlite3_preupdate_old(db, column, &oldValue) != SQLITE_OK ||
+            sqlite3_preupdate_new(db, column, &newValue) != SQLITE_OK) {
+            // If we can't tell, assume it changed.
+            return true;
+        }
+        const int type = sqlite3_value_type(oldValue);
+        if (type != sqlite3_value_type(newValue)) {
+            return true;
+        }
+        switch (type) {
+            case SQLITE_NULL:
+                break;
+            case SQLITE_INTEGER:
+                if (sqlite3_value_int64(oldValue) != sqlite3_value_int64(newValue)) {
+                    return true;
+                }
+                break;
+            case SQLITE_FLOAT:
+                if (sqlite3_value_double(oldValue) != sqlite3_value_double(newValue)) {
+                    return true;
+                }
+                break;
+            default: {
+                // TEXT or BLOB. Read each as a blob, so text isn't converted.
+                const void* oldData = sqlite3_value_blob(oldValue);
+                const int oldSize = sqlite3_value_bytes(oldValue);
+                const void* newData = sqlite3_value_blob(newValue);
+                if (oldSize != sqlite3_value_bytes(newValue) || (oldSize && memcmp(oldData, newData, oldSize))) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+void SQLite::addTableChangeListener(const string& tableName, function<void(const set<int64_t>&)> listener,
+                                    const set<int>& columns) {
+    unique_lock<shared_mutex> lock(_tableChangeListenersMutex);
+    TableChangeListeners& listeners = _tableChangeListeners[tableName];
+    listeners.listeners.push_back(listener);
+    if (columns.empty()) {
+        listeners.allColumns = true;
+    }
+    listeners.columns.insert(columns.begin(), columns.end());
+    _hasTableChangeListeners.store(true, memory_order_release);
+}
+
+uint64_t SQLite::addCommitListener(function<void(uint64_t)> listener) {
+    unique_lock<shared_mutex> lock(_sharedData.commitListenersMutex);
+    const uint64_t listenerID = _sharedData.nextCommitListenerID++;
+    _sharedData.commitListeners.emplace(listenerID, move(listener));
+    return listenerID;
+}
+
+void SQLite::removeCommitListener(uint64_t listenerID) {
+    unique_lock<shared_mutex> lock(_sharedData.commitListenersMutex);
+    _sharedData.commitListeners.erase(listenerID);
+}
+
+void SQLite::addIDFilter(const string& tableName, const string& column) {
+    _idFilterColumns[tableName] = column;
+}
+
+SQLite::IDFilter::IDFilter(const string& column, size_t capacity) :
+    column(column), filter(capacity), ready(false), stopBuilding(false), usable(false), checkedGeneration(0), checks(0),
+    skipped(0)
+{
+}
+
+SQLite::IDFilter::~IDFilter() {
+    if (buildThread.joinable()) {
+        stopBuilding = true;
+        buildThread.join();
+    }
+}
+
+void SQLite::_initializeIDFilter(sqlite3* db, SharedData& sharedData, const string& filename, const string& tableName,
+                                 const string& column) {
+    auto idFilter = make_unique<IDFilter>(column, MIN_ID_FILTER_CAPACITY);
+    idFilter->usable = _isRowIDColumn(db, tableName, column);
+    idFilter->checkedGeneration = sharedData.schemaGeneration.load();
+    if (idFilter->usable) {
+        // Reading every ID can take minutes for a large table, so we don't make the node wait for it to start. The
+        // filter's address never changes once it's in `idFilters`, so the thread can keep a reference to it.
+        idFilter->buildThread = thread(_buildIDFilter, filename, tableName, ref(*idFilter));
+    } else {
+        // There's nothing to read, and if the table is created with the right column later, every row goes through
+        // `_preUpdateHookCallback`.
+        idFilter->ready = true;
+        SINFO("ID filter for " << tableName << "." << column << " not usable until the table exists with that column as its rowid.");
+    }
+    sharedData.idFilters.emplace(tableName, move(idFilter));
+}
+
+void SQLite::_buildIDFilter(const string& filename, const string& tableName, IDFilter& idFilter) {
+    SInitialize("idFilter");
+    const uint64_t start = STimeNow();
+    sqlite3* db = nullptr;
+    if (sqlite3_open_v2(filename.c_str(), &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+        SWARN("Couldn't open " << filename << " to build ID filter for " << tableName << ", not using it: "
+              << sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return;
+    }
+
+    // Leave room for the table to double before the filter has to grow.
+    SQResult result;
+    if (!SQuery(db, "counting IDs for filter", "SELECT COUNT(*) FROM " + tableName + ";", result) && !result.empty()) {
+        idFilter.filter.reserve(SToUInt64(result[0][0]) * 2);
+    }
+
+    // Read the IDs straight from the statement, as there may be far too many to hold as strings in an SQResult. Any
+    // row written after the filter was created has been added by `_preUpdateHookCallback`, so it doesn't matter which
+    // snapshot each batch sees, as long as it's newer than that.
+    sqlite3_stmt* statement = nullptr;
+    const string& column = idFilter.column;
+    const string query = "SELECT " + column + " FROM " + tableName + " WHERE " + column + " > ? ORDER BY " + column +
+                         " LIMIT " + to_string(ID_FILTER_BUILD_ROWS) + ";";
+    bool complete = sqlite3_prepare_v2(db, query.c_str(), -1, &statement, nullptr) == SQLITE_OK;
+    int64_t lastID = INT64_MIN;
+    while (complete && !idFilter.stopBuilding) {
+        sqlite3_bind_int64(statement, 1, lastID);
+        int64_t rows = 0;
+        int code;
+        while ((code = sqlite3_step(statement)) == SQLITE_ROW) {
+            lastID = sqlite3_column_int64(statement, 0);
+            idFilter.filter.add(lastID);
+            rows++;
+        }
+        sqlite3_reset(statement);
+        if (code != SQLITE_DONE) {
+            SWARN("Error " << code << " reading IDs for filter for " << tableName << ", not using it: " << sqlite3_errmsg(db));
+            complete = false;
+        } else if (rows < ID_FILTER_BUILD_ROWS) {
+            break;
+        }
+    }
+    sqlite3_finalize(statement);
+    sqlite3_close(db);
+    if (complete && !idFilter.stopBuilding) {
+        idFilter.ready = true;
+        SINFO("Built ID filter for " << tableName << "." << column << " with " << idFilter.filter.size() << " IDs ("
+              << idFilter.filter.bytes() << " bytes) in " << (STimeNow() - start) / 1000 << "ms.");
+    }
+}
+
+bool SQLite::_isRowIDColumn(sqlite3* db, const string& tableName, const string& column) {
+    // A column is the rowid if it's one of the rowid's own names (and the table doesn't have a real column by that
+    // name), or if it's the only primary key column, declared exactly "INTEGER", and not `DESC` (which gets its own
+    // index, so we check there isn't one). WITHOUT ROWID tables don't have one at all.
+    const string table = SQ(tableName);
+    const string query =
+        "SELECT NOT wr AND CASE WHEN " + SQ(column) + " IN ('rowid', '_rowid_', 'oid') COLLATE NOCASE "
+            "THEN NOT EXISTS (SELECT 1 FROM pragma_table_info(" + table + ") WHERE name = " + SQ(column) + " COLLATE NOCASE) "
+            "ELSE (SELECT COUNT(*) FROM pragma_table_info(" + table + ") WHERE pk > 0) = 1 "
+                "AND EXISTS (SELECT 1 FROM pragma_table_info(" + table + ") WHERE pk = 1 AND name = " + SQ(column) + " COLLATE NOCASE "
+                    "AND upper(type) = 'INTEGER') "
+                "AND NOT EXISTS (SELECT 1 FROM pragma_index_list(" + table + ") WHERE origin = 'pk') END "
+        "FROM pragma_table_list WHERE schema = 'main' AND type = 'table' AND name = " + table + " COLLATE NOCASE;";
+    SQResult result;
+    SASSERT(!SQuery(db, "checking ID filter column", query, result));
+    return !result.empty() && result[0][0] == "1";
+}
+
+bool SQLite::idMayExist(const string& tableName, const string& column, int64_t id) const {
+    if (_sharedData.idFilters.empty()) {
+        return true;
+    }
+    auto filterIt = _sharedData.idFilters.find(tableName);
+    if (filterIt == _sharedData.idFilters.end() || !SIEquals(filterIt->second->column, column)) {
+        return true;
+    }
+    IDFilter& idFilter = *filterIt->second;
+    idFilter.checks++;
+
+    // If the schema has changed since we last looked, make sure the column is (still) the rowid. This runs on our own
+    // handle, so it's checked on whatever snapshot we're reading.
+    const uint64_t generation = _sharedData.schemaGeneration;
+    if (idFilter.checkedGeneration != generation) {
+        _authorizerBypassed = true;
+        idFilter.usable = _isRowIDColumn(_db, tableName, column);
+        _authorizerBypassed = false;
+        idFilter.checkedGeneration = generation;
+    }
+    if (!idFilter.ready || !idFilter.usable || idFilter.filter.mayContain(id)) {
+        return true;
+    }
+    idFilter.skipped++;
+    return false;
+}
+
+STable SQLite::getIDFilterInfo() const {
+    STable info;
+    for (const auto& [tableName, idFilter] : _sharedData.idFilters) {
+        STable filterInfo;
+        filterInfo["column"] = idFilter->column;
+        filterInfo["usable"] = idFilter->usable ? "true" : "false";
+        filterInfo["ready"] = idFilter->ready ? "true" : "false";
+        filterInfo["layers"] = to_string(idFilter->filter.layers());
+        filterInfo["ids"] = to_string(idFilter->filter.size());
+        filterInfo["capacity"] = to_string(idFilter->filter.capacity());
+        filterInfo["bytes"] = to_string(idFilter->filter.bytes());
+        filterInfo["checks"] = to_string(idFilter->checks.load());
+        filterInfo["skipped"] = to_string(idFilter->skipped.load());
+        info[tableName] = SComposeJSONObject(filterInfo);
+    }
+    return info;
+}
+
+void SQLite::_notifyTableChangeListeners() {
+    if (!_hasTableChangeListeners.load(memory_order_acquire)) {
+        _changedRows.clear();
+        return;
+    }
+    shared_lock<shared_mutex> lock(_tableChangeListenersMutex);
+    if (_schemaChanged) {
+        // Schema changes (like dropping a table) don't report the rows they change, so every listener has to assume
+        // anything in its table could have changed.
+        _changedRows.clear();
+        for (const auto& [table, listeners] : _tableChangeListeners) {
+            for (const auto& listener : listeners.listeners) {
+                listener({});
+            }
+        }
+        return;
+    }
+    for (const auto& [table, rowIDs] : _changedRows) {
+        for (const auto& listener : _tableChangeListeners.at(table).listeners) {
+            listener(rowIDs);
+        }
+    }
+    _changedRows.clear();
+}
+
 void SQLite::_sqliteLogCallback(void* pArg, int iErrCode, const char* zMsg) {
     _mostRecentSQLiteErrorLog = "{SQLITE} Code: "s + to_string(iErrCode) + ", Message: "s + zMsg;
     SRedactSensitiveValues(_mostRecentSQLiteErrorLog);
@@ -319,6 +628,10 @@ SQLite::~SQLite() {
     DBINFO("Closing database '" << _filename << ".");
     SASSERTWARN(_uncommittedQuery.empty());
     SASSERT(!sqlite3_close(_db));
+    _sharedData.handleCount--;
+    if (_sharedData.cacheBudgetKB) {
+        _sharedData.cacheSettingsGeneration++;
+    }
     DBINFO("Database closed.");
 }
 
@@ -361,10 +674,27 @@ bool SQLite::beginTransaction(TRANSACTION_TYPE type) {
     // Reset before the query, as it's possible the query sets these.
     _autoRolledBack = false;
 
+    if (_cacheSettingsGeneration != _sharedData.cacheSettingsGeneration) {
+        _applyCacheSettings();
+    }
+
     SDEBUG("[concurrent] Beginning transaction");
     uint64_t before = STimeNow();
+    _schemaGenerationAtStart = _sharedData.schemaGeneration;
     _insideTransaction = !SQuery(_db, "starting db transaction", "BEGIN CONCURRENT");
 
+    // `BEGIN CONCURRENT` doesn't pick a snapshot until something is read, so to use the result cache, read something
+    // now. If no commit was in progress from before the read until after it, the snapshot is at the commit count.
+    _snapshotCommitCount = 0;
+    if (_insideTransaction && _sharedData.resultCache.enabled() && !whitelist && !_enableRewrite) {
+        const uint64_t sequence = _sharedData.commitSequence;
+        const uint64_t commitCount = _sharedData.commitCount;
+        if (!(sequence & 1) && !SQuery(_db, "starting snapshot", "PRAGMA schema_version;") &&
+            _sharedData.commitSequence == sequence) {
+            _snapshotCommitCount = commitCount;
+        }
+    }
+
     // Because some other thread could commit once we've run `BEGIN CONCURRENT`, this value can be slightly behind
     // where we're actually able to start such that we know we shouldn't get a conflict if this commits successfully on
     // leader. However, this is perfectly safe, it just adds the possibility that threads on followers wait for an
@@ -373,6 +703,7 @@ bool SQLite::beginTransaction(TRANSACTION_TYPE type) {
     _dbCountAtStart = getCommitCount();
     _queryCache.clear();
     _tablesUsed.clear();
+    _schemaChanged = false;
     _queryCount = 0;
     _cacheHits = 0;
     _beginElapsed = STimeNow() - before;
@@ -475,10 +806,24 @@ bool SQLite::read(const string& query, SQResult& result) const {
         _cacheHits++;
         queryResult = true;
     } else {
-        _isDeterministicQuery = true;
-        queryResult = !SQuery(_db, "read only query", query, result);
-        if (_isDeterministicQuery && queryResult) {
+        // Other transactions at the same commit may have already run this. Results read under a whitelist, or that
+        // could have been rewritten, aren't shared, even if those were turned on after the transaction began.
+        const bool shared = _snapshotCommitCount && !whitelist && !_enableRewrite;
+        vector<string> tables;
+        if (shared && _sharedData.resultCache.get(_snapshotCommitCount, query, result, tables)) {
+            _tablesUsed.insert(tables.begin(), tables.end());
             _queryCache.emplace(make_pair(query, result));
+            _cacheHits++;
+            queryResult = true;
+        } else {
+            _isDeterministicQuery = true;
+            queryResult = !_authorizedQuery("read only query", query, result);
+            if (_isDeterministicQuery && queryResult) {
+                _queryCache.emplace(make_pair(query, result));
+                if (shared) {
+                    _sharedData.resultCache.put(_snapshotCommitCount, query, result, _statementTables);
+                }
+            }
         }
     }
     _checkInterruptErrors("SQLite::read"s);
@@ -539,6 +884,7 @@ bool SQLite::writeUnmodified(const string& query) {
 bool SQLite::_writeIdempotent(const string& query, bool alwaysKeepQueries) {
     SASSERT(_insideTransaction);
     _queryCache.clear();
+    _snapshotCommitCount = 0;
     _queryCount++;
 
     // Must finish everything with semicolon.
@@ -569,7 +915,7 @@ bool SQLite::_writeIdempotent(const string& query, bool alwaysKeepQueries) {
                 _currentlyRunningRewritten = false;
             }
         } else {
-            resultCode = SQuery(_db, "read/write transaction", query);
+            resultCode = _authorizedQuery("read/write transaction", query, results);
         }
     }
 
@@ -592,6 +938,10 @@ bool SQLite::_writeIdempotent(const string& query, bool alwaysKeepQueries) {
     uint64_t schemaAfter = SToUInt64(results[0][0]);
     uint64_t changesAfter = sqlite3_total_changes(_db);
 
+    if (schemaAfter > schemaBefore) {
+        _schemaChanged = true;
+    }
+
     // If something changed, or we're always keeping queries, then save this.
     if (alwaysKeepQueries || (schemaAfter > schemaBefore) || (changesAfter > changesBefore)) {
         _uncommittedQuery += usedRewrittenQuery ? _rewrittenQuery : query;
@@ -641,7 +991,7 @@ bool SQLite::prepare(uint64_t* transactionID, string* transactionhash) {
     string query = "INSERT INTO " + _journalName + " VALUES (" + SQ(commitCount + 1) + ", " + SQ(_uncommittedQuery) + ", " + SQ(_uncommittedHash) + " )";
 
     // These are the values we're currently operating on, until we either commit or rollback.
-    _sharedData.prepareTransactionInfo(commitCount + 1, _uncommittedQuery, _uncommittedHash, _dbCountAtStart);
+    _sharedData.prepareTransactionInfo(commitCount + 1, _uncommittedQuery, _uncommittedHash, _dbCountAtStart, getReplicationTables());
 
     int result = SQuery(_db, "updating journal", query);
     _prepareElapsed += STimeNow() - before;
@@ -701,6 +1051,7 @@ int SQLite::commit(const string& description, function<void()>* preCheckpointCal
     _conflictPage = 0;
     uint64_t before = STimeNow();
     uint64_t beforeCommit = STimeNow();
+    _sharedData.commitSequence++;
     result = SQuery(_db, "committing db transaction", "COMMIT");
     _lastConflictPage = _conflictPage;
     if (_lastConflictPage) {
@@ -729,6 +1080,10 @@ int SQLite::commit(const string& description, function<void()>* preCheckpointCal
         _commitElapsed += STimeNow() - before;
         _journalSize = newJournalSize;
         _sharedData.incrementCommit(_uncommittedHash);
+        _sharedData.commitSequence++;
+        if (_schemaChanged) {
+            _sharedData.schemaGeneration++;
+        }
         _insideTransaction = false;
         _uncommittedHash.clear();
         _uncommittedQuery.clear();
@@ -737,6 +1092,18 @@ int SQLite::commit(const string& description, function<void()>* preCheckpointCal
         _mutexLocked = false;
         _queryCache.clear();
 
+        // Now that the commit is visible to other handles, tell anyone with the changed rows in memory.
+        _notifyTableChangeListeners();
+        {
+            shared_lock<shared_mutex> lock(_sharedData.commitListenersMutex);
+            if (!_sharedData.commitListeners.empty()) {
+                uint64_t commitCount = _sharedData.commitCount.load();
+                for (const auto& [listenerID, listener] : _sharedData.commitListeners) {
+                    listener(commitCount);
+                }
+            }
+        }
+
         if (preCheckpointCallback != nullptr) {
             (*preCheckpointCallback)();
         }
@@ -761,8 +1128,10 @@ int SQLite::commit(const string& description, function<void()>* preCheckpointCal
         _queryCount = 0;
         _cacheHits = 0;
         _dbCountAtStart = 0;
+        _snapshotCommitCount = 0;
         _lastConflictPage = 0;
     } else {
+        _sharedData.commitSequence++;
         SINFO("Commit failed, waiting for rollback.");
     }
 
@@ -771,7 +1140,7 @@ int SQLite::commit(const string& description, function<void()>* preCheckpointCal
     return result;
 }
 
-map<uint64_t, tuple<string, string, uint64_t>> SQLite::popCommittedTransactions() {
+map<uint64_t, tuple<string, string, uint64_t, string>> SQLite::popCommittedTransactions() {
     return _sharedData.popCommittedTransactions();
 }
 
@@ -810,10 +1179,12 @@ void SQLite::rollback() {
         SINFO("Rolling back but not inside transaction, ignoring.");
     }
     _queryCache.clear();
+    _changedRows.clear();
     SDEBUG("Transaction rollback with " << _queryCount << " queries attempted, " << _cacheHits << " served from cache.");
     _queryCount = 0;
     _cacheHits = 0;
     _dbCountAtStart = 0;
+    _snapshotCommitCount = 0;
 }
 
 uint64_t SQLite::getLastTransactionTiming(uint64_t& begin, uint64_t& read, uint64_t& write, uint64_t& prepare,
@@ -869,6 +1240,67 @@ bool SQLite::getCommits(uint64_t fromIndex, uint64_t toIndex, SQResult& result)
     return !SQuery(_db, "getting commits", query, result);
 }
 
+int SQLite::backup(const string& destination, int pagesPerStep, const function<bool(uint64_t, uint64_t)>& onStep,
+                   uint64_t& commitCount, string& commitHash) {
+    // This runs on its own thread, so failures are returned rather than asserted, and the caller reports them.
+    if (_insideTransaction) {
+        SWARN("Can't start a backup inside a transaction.");
+        return SQLITE_MISUSE;
+    }
+
+    // Reading the commit count opens a read transaction, and it stays open until we're done. In WAL mode that pins
+    // every page we copy to the same snapshot, so commits from other handles neither block us nor restart the backup,
+    // and the copy is exactly the database as of `commitCount`.
+    int rc = SQuery(_db, "starting backup", "BEGIN");
+    if (rc) {
+        return rc;
+    }
+    SQResult result;
+    string query = "SELECT MAX(maxIDs) FROM (" + _getJournalQuery({"SELECT MAX(id) as maxIDs FROM"}, true) + ")";
+    rc = SQuery(_db, "getting backup commit count", query, result);
+    if (!rc) {
+        commitCount = result.empty() ? 0 : SToUInt64(result[0][0]);
+        string ignore;
+        getCommit(_db, _journalNames, commitCount, ignore, commitHash);
+        rc = SQuery(_db, "getting backup page size", "PRAGMA page_size", result);
+    }
+    if (rc) {
+        SQuery(_db, "ending backup", "ROLLBACK");
+        return rc;
+    }
+    const uint64_t pageSize = result.empty() ? 0 : SToUInt64(result[0][0]);
+
+    // The destination is only a copy until it's finished, so there's no need to journal or sync each step.
+    sqlite3* destinationDB;
+    rc = sqlite3_open_v2(destination.c_str(), &destinationDB, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL);
+    if (rc == SQLITE_OK) {
+        SQuery(destinationDB, "", "PRAGMA journal_mode = OFF", result);
+        SQuery(destinationDB, "", "PRAGMA synchronous = OFF", result);
+        sqlite3_backup* backup = sqlite3_backup_init(destinationDB, "main", _db, "main");
+        if (backup) {
+            do {
+                rc = sqlite3_backup_step(backup, pagesPerStep);
+                const uint64_t total = sqlite3_backup_pagecount(backup);
+                const uint64_t copied = total - sqlite3_backup_remaining(backup);
+                if ((rc == SQLITE_OK || rc == SQLITE_DONE) && !onStep(copied * pageSize, total * pageSize)) {
+                    rc = SQLITE_INTERRUPT;
+                } else if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+                    usleep(10'000);
+                }
+            } while (rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED);
+            sqlite3_backup_finish(backup);
+        } else {
+            rc = sqlite3_errcode(destinationDB);
+        }
+    }
+    if (rc != SQLITE_DONE) {
+        SWARN("Backup to " << destination << " failed with " << rc << ": " << sqlite3_errmsg(destinationDB));
+    }
+    sqlite3_close_v2(destinationDB);
+    SQuery(_db, "ending backup", "ROLLBACK");
+    return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
 int64_t SQLite::getLastInsertRowID() {
     // Make sure it *does* happen after an INSERT, but not with a IGNORE
     SASSERTWARN(SContains(_uncommittedQuery, "INSERT") || SContains(_uncommittedQuery, "REPLACE"));
@@ -886,6 +1318,73 @@ size_t SQLite::getLastWriteChangeCount() {
     return count > 0 ? (size_t)count : 0;
 }
 
+void SQLite::setCacheBudget(uint64_t budgetKB) {
+    _sharedData.cacheBudgetKB = budgetKB;
+    _sharedData.cacheSettingsGeneration++;
+}
+
+void SQLite::setMmapSize(int64_t mmapSizeGB) {
+    _sharedData.mmapSizeGB = mmapSizeGB;
+    _sharedData.cacheSettingsGeneration++;
+}
+
+STable SQLite::getCacheInfo() const {
+    STable info;
+    const uint64_t budgetKB = _sharedData.cacheBudgetKB;
+    const uint64_t handleCount = _sharedData.handleCount;
+    const int64_t mmapSizeGB = _sharedData.mmapSizeGB;
+    const int64_t perHandleKB = budgetKB ? _budgetShareKB(budgetKB, handleCount) : _cacheSize;
+    info["budgetKB"] = to_string(budgetKB);
+    info["handles"] = to_string(handleCount);
+    info["perHandleKB"] = to_string(perHandleKB);
+
+    // What the handles can actually use between them, which is more than the budget once there are enough handles
+    // that each one gets MIN_CACHE_KB.
+    info["effectiveTotalKB"] = to_string(perHandleKB * handleCount);
+    info["mmapSizeGB"] = to_string(mmapSizeGB >= 0 ? mmapSizeGB : _mmapSizeGB);
+    return info;
+}
+
+void SQLite::_applyCacheSettings() {
+    // The whitelist and rewrite handlers could deny the `PRAGMA`s, so wait until neither is in use.
+    if (whitelist || _enableRewrite) {
+        return;
+    }
+    _cacheSettingsGeneration = _sharedData.cacheSettingsGeneration;
+
+    // -size means KB; +size means pages
+    const uint64_t budgetKB = _sharedData.cacheBudgetKB;
+    const uint64_t handleCount = _sharedData.handleCount;
+    const int64_t cacheKB = budgetKB ? _budgetShareKB(budgetKB, handleCount) : _cacheSize;
+    if (cacheKB != _appliedCacheKB) {
+        SINFO("Setting cache_size to " << cacheKB << "KB");
+        if (budgetKB && (uint64_t)cacheKB * handleCount > budgetKB) {
+            SWARN("Cache budget of " << budgetKB << "KB is too small for " << handleCount << " handles, each is getting "
+                  << MIN_CACHE_KB << "KB, " << cacheKB * handleCount << "KB in total.");
+        }
+        SQuery(_db, "setting cache size", "PRAGMA cache_size = -" + SQ(cacheKB) + ";");
+        _appliedCacheKB = cacheKB;
+    }
+    const int64_t mmapSizeGB = _sharedData.mmapSizeGB;
+    if (mmapSizeGB >= 0 && mmapSizeGB != _appliedMmapSizeGB) {
+        SINFO("Setting mmap_size to " << mmapSizeGB << "GB");
+        SQuery(_db, "setting mmap size", "PRAGMA mmap_size=" + to_string(mmapSizeGB * 1024 * 1024 * 1024) + ";");
+        _appliedMmapSizeGB = mmapSizeGB;
+    }
+}
+
+int64_t SQLite::_budgetShareKB(uint64_t budgetKB, uint64_t handleCount) {
+    return max<int64_t>(budgetKB / max<uint64_t>(handleCount, 1), MIN_CACHE_KB);
+}
+
+void SQLite::setResultCacheSize(size_t bytes) {
+    _sharedData.resultCache.setMaxBytes(bytes);
+}
+
+STable SQLite::getResultCacheInfo() const {
+    return _sharedData.resultCache.getInfo();
+}
+
 void SQLite::enableRewrite(bool enable) {
     _enableRewrite = enable;
 }
@@ -906,7 +1405,146 @@ int SQLite::_sqliteAuthorizerCallback(void* pUserData, int actionCode, const cha
                                       const char* detail3, const char* detail4)
 {
     SQLite* db = static_cast<SQLite*>(pUserData);
-    return db->_authorize(actionCode, detail1, detail2, detail3, detail4);
+    if (db->_authorizerBypassed) {
+        return SQLITE_OK;
+    }
+    int result = db->_authorize(actionCode, detail1, detail2, detail3, detail4);
+    if (result != SQLITE_OK) {
+        db->_statementAuthorized = false;
+    }
+    return result;
+}
+
+int SQLite::_authorizedQuery(const char* e, const string& query, SQResult& result) const {
+    // With rewriting on, the authorizer may deny a query to have it rewritten, and after a schema change in this
+    // transaction, we'd be seeing a schema no one else can, so neither can use the cache. Queries under a whitelist
+    // always go through the authorizer, so that every column they read is checked against it.
+    _statementTables.clear();
+    _statementAuthorized = true;
+    _statementDeterministic = true;
+    const uint64_t generation = _insideTransaction ? _schemaGenerationAtStart : _sharedData.schemaGeneration.load();
+    if (whitelist || _enableRewrite || _schemaChanged || generation != _sharedData.schemaGeneration) {
+        return SQuery(_db, e, query, result);
+    }
+
+    string key = _authorizerKey(query);
+    auto it = _authorizerCache.find(key);
+    if (it != _authorizerCache.end() && it->second.schemaGeneration == generation &&
+        it->second.writing == _currentlyWriting) {
+        _tablesUsed.insert(it->second.tables.begin(), it->second.tables.end());
+        _statementTables = it->second.tables;
+        if (!it->second.deterministic) {
+            _isDeterministicQuery = false;
+        }
+        _authorizerBypassed = true;
+        int code = SQuery(_db, e, query, result);
+        _authorizerBypassed = false;
+        return code;
+    }
+
+    int code = SQuery(_db, e, query, result);
+    if (!code && _statementAuthorized) {
+        if (_authorizerCache.size() >= MAX_AUTHORIZER_CACHE_SIZE) {
+            _authorizerCache.clear();
+        }
+        _authorizerCache[move(key)] = {_statementTables, _statementDeterministic, _currentlyWriting, generation};
+    }
+    return code;
+}
+
+string SQLite::_authorizerKey(const string& query) {
+    // Same as SQLite's tokenizer: anything past ASCII can be part of an identifier.
+    auto isIdentifierChar = [](char c) {
+        return isalnum((unsigned char)c) || c == '_' || c == '$' || (unsigned char)c >= 0x80;
+    };
+
+    // SQLite reads a string where it expects a name as an identifier (`FROM 'a'`, `'a'.b`, `SET 'b' = 1`), so a string
+    // literal is only replaced when the token before it can only be followed by an expression, and it's not followed
+    // by a `.`. Anything else is kept as is. This is true after these keywords and after operators.
+    static const set<string, STableComp> expressionKeywords = {
+        "AND", "BETWEEN", "CASE", "ELSE", "ESCAPE", "GLOB", "IS", "LIKE", "MATCH", "NOT", "OR", "REGEXP", "THEN", "WHEN",
+    };
+    bool expressionExpected = false;
+
+    string key;
+    key.reserve(query.size());
+    const size_t size = query.size();
+    size_t i = 0;
+    while (i < size) {
+        const char c = query[i];
+        if (c == '\'') {
+            // String literal, where a quote is escaped by doubling it.
+            const size_t start = i;
+            for (i++; i < size; i++) {
+                if (query[i] == '\'') {
+                    if (i + 1 < size && query[i + 1] == '\'') {
+                        i++;
+                    } else {
+                        i++;
+                        break;
+                    }
+                }
+            }
+            size_t next = i;
+            while (next < size && isspace((unsigned char)query[next])) {
+                next++;
+            }
+            if (expressionExpected && (next == size || query[next] != '.')) {
+                key += '?';
+            } else {
+                key.append(query, start, i - start);
+            }
+            expressionExpected = false;
+        } else if (c == '"' || c == '`' || c == '[') {
+            // Quoted identifier, which is kept.
+            const char close = c == '[' ? ']' : c;
+            const size_t end = query.find(close, i + 1);
+            const size_t next = end == string::npos ? size : end + 1;
+            key.append(query, i, next - i);
+            i = next;
+            expressionExpected = false;
+        } else if (c == '-' && i + 1 < size && query[i + 1] == '-') {
+            // Comments are kept, but are whitespace as far as the tokens around them are concerned.
+            const size_t end = query.find('\n', i);
+            const size_t next = end == string::npos ? size : end;
+            key.append(query, i, next - i);
+            i = next;
+        } else if (c == '/' && i + 1 < size && query[i + 1] == '*') {
+            const size_t end = query.find("*/", i + 2);
+            const size_t next = end == string::npos ? size : end + 2;
+            key.append(query, i, next - i);
+            i = next;
+        } else if (isdigit((unsigned char)c)) {
+            // Numeric literal, including hex and exponents. Digits in an identifier are consumed with it below.
+            const size_t start = i;
+            const bool hex = c == '0' && i + 1 < size && (query[i + 1] == 'x' || query[i + 1] == 'X');
+            for (i++; i < size; i++) {
+                const char n = query[i];
+                const bool exponentSign = !hex && (n == '+' || n == '-') && (query[i - 1] == 'e' || query[i - 1] == 'E') &&
+                                          i + 1 < size && isdigit((unsigned char)query[i + 1]) && i - 1 > start;
+                if (!isIdentifierChar(n) && n != '.' && !exponentSign) {
+                    break;
+                }
+            }
+            key += '?';
+            expressionExpected = false;
+        } else if (isIdentifierChar(c)) {
+            // Keyword or identifier.
+            const size_t start = i;
+            while (i < size && isIdentifierChar(query[i])) {
+                i++;
+            }
+            key.append(query, start, i - start);
+            expressionExpected = expressionKeywords.count(query.substr(start, i - start));
+        } else {
+            key += c;
+            i++;
+            if (!isspace((unsigned char)c)) {
+                expressionExpected = c && strchr("=<>!|+-*/%&~", c);
+            }
+        }
+    }
+    return key;
 }
 
 int SQLite::_authorize(int actionCode, const char* detail1, const char* detail2, const char* detail3, const char* detail4) {
@@ -917,23 +1555,35 @@ int SQLite::_authorize(int actionCode, const char* detail1, const char* detail2,
     }
 
     // Record all tables touched.
-    if (set<int>{SQLITE_INSERT, SQLITE_DELETE, SQLITE_READ, SQLITE_UPDATE}.count(actionCode)) {
+    if (actionCode == SQLITE_INSERT || actionCode == SQLITE_DELETE || actionCode == SQLITE_READ || actionCode == SQLITE_UPDATE) {
         _tablesUsed.insert(detail1);
+        if (find(_statementTables.begin(), _statementTables.end(), detail1) == _statementTables.end()) {
+            _statementTables.push_back(detail1);
+        }
     }
 
     // Here's where we can check for non-deterministic functions for the cache.
     if (actionCode == SQLITE_FUNCTION && detail2) {
         if (!strcmp(detail2, "random") ||
+            !strcmp(detail2, "randomblob") ||
             !strcmp(detail2, "date") ||
             !strcmp(detail2, "time") ||
             !strcmp(detail2, "datetime") ||
             !strcmp(detail2, "julianday") ||
             !strcmp(detail2, "strftime") ||
+            !strcmp(detail2, "unixepoch") ||
+            !strcmp(detail2, "timediff") ||
+            !strcmp(detail2, "current_date") ||
+            !strcmp(detail2, "current_time") ||
+            !strcmp(detail2, "current_timestamp") ||
+            !strcmp(detail2, "total_changes") ||
             !strcmp(detail2, "changes") ||
             !strcmp(detail2, "last_insert_rowid") ||
-            !strcmp(detail2, "sqlite3_version")
+            !strcmp(detail2, "sqlite3_version") ||
+            !strcmp(detail2, "sqlite_version")
         ) {
             _isDeterministicQuery = false;
+            _statementDeterministic = false;
         }
 
         if (!strcmp(detail2, "current_timestamp")) {
@@ -1110,7 +1760,14 @@ _commitEnabled(true),
 _commitLockTimer("commit lock timer", {
     {"EXCLUSIVE", chrono::steady_clock::duration::zero()},
     {"SHARED", chrono::steady_clock::duration::zero()},
-})
+}),
+schemaGeneration(0),
+commitSequence(0),
+cacheBudgetKB(0),
+mmapSizeGB(-1),
+cacheSettingsGeneration(0),
+handleCount(0),
+nextCommitListenerID(0)
 { }
 
 void SQLite::SharedData::setCommitEnabled(bool enable) {
@@ -1125,9 +1782,9 @@ void SQLite::SharedData::incrementCommit(const string& commitHash) {
     lastCommittedHash.store(commitHash);
 }
 
-void SQLite::SharedData::prepareTransactionInfo(uint64_t commitID, const string& query, const string& hash, uint64_t dbCountAtTransactionStart) {
+void SQLite::SharedData::prepareTransactionInfo(uint64_t commitID, const string& query, const string& hash, uint64_t dbCountAtTransactionStart, const string& tables) {
     lock_guard<decltype(_internalStateMutex)> lock(_internalStateMutex);
-    _preparedTransactions.insert_or_assign(commitID, make_tuple(query, hash, dbCountAtTransactionStart));
+    _preparedTransactions.insert_or_assign(commitID, make_tuple(query, hash, dbCountAtTransactionStart, tables));
 }
 
 void SQLite::SharedData::commitTransactionInfo(uint64_t commitID) {
@@ -1135,7 +1792,7 @@ void SQLite::SharedData::commitTransactionInfo(uint64_t commitID) {
     _committedTransactions.insert(_preparedTransactions.extract(commitID));
 }
 
-map<uint64_t, tuple<string, string, uint64_t>> SQLite::SharedData::popCommittedTransactions() {
+map<uint64_t, tuple<string, string, uint64_t, string>> SQLite::SharedData::popCommittedTransactions() {
     lock_guard<decltype(_internalStateMutex)> lock(_internalStateMutex);
     decltype(_committedTransactions) result;
     result = move(_committedTransactions);
@@ -1,6 +1,10 @@
 #pragma once
+#include <unordered_map>
+
 #include <libstuff/sqlite3.h>
 #include <libstuff/SPerformanceTimer.h>
+#include <sqlitecluster/SQLiteIDFilter.h>
+#include <sqlitecluster/SQLiteResultCache.h>
 
 class SQLite {
   public:
@@ -124,6 +128,11 @@ class SQLite {
 
     const set<string>& getTablesUsed() const;
 
+    // Returns the tables used by the current transaction as a list, for followers to work out which replicated
+    // transactions can be applied in parallel. Returns an empty string if the transaction changed the schema, as that
+    // can affect any table.
+    string getReplicationTables() const;
+
     // Prepare to commit or rollback the transaction. This also inserts the current uncommitted query into the
     // journal; no additional writes are allowed until the next transaction has begun.
     // The transactionID and transactionHash, if passed, will be updated with the values prepared for this transaction.
@@ -180,6 +189,29 @@ class SQLite {
     // Returns the total number of changes on this database
     int getChangeCount() { return sqlite3_total_changes(_db); }
 
+    // Sets the total page cache, in KB, for every handle for this file, each getting an equal share (but at least
+    // `MIN_CACHE_KB`, so with enough handles the total goes over the budget, which is logged and reported by
+    // `getCacheInfo`). 0 (the default) gives each handle the `cacheSize` it was created with instead. Handles pick up
+    // the change the next time they begin a transaction.
+    void setCacheBudget(uint64_t budgetKB);
+
+    // Sets the mmap size, in GB, for every handle for this file, the same way as `setCacheBudget`. This can't go past
+    // the maximum set at startup with `SQLITE_CONFIG_MMAP_SIZE`.
+    void setMmapSize(int64_t mmapSizeGB);
+
+    // Returns the cache budget, mmap size, handle count, each handle's share of the budget and the total of those
+    // shares, for Status.
+    STable getCacheInfo() const;
+
+    // The smallest page cache a handle gets from the cache budget, in KB.
+    static constexpr int64_t MIN_CACHE_KB = 512;
+
+    // Sets the size limit of the result cache shared by every handle for this file. 0 (the default) disables it.
+    void setResultCacheSize(size_t bytes);
+
+    // Returns the result cache's size and hit rate, for Status.
+    STable getResultCacheInfo() const;
+
     // Returns the timing of the last command
     uint64_t getLastTransactionTiming(uint64_t& begin, uint64_t& read, uint64_t& write, uint64_t& prepare,
                                       uint64_t& commit, uint64_t& rollback);
@@ -223,6 +255,19 @@ class SQLite {
     // Looks up a range of commits.
     bool getCommits(uint64_t fromIndex, uint64_t toIndex, SQResult& result);
 
+    // Copies a consistent snapshot of the database into a new database at `destination` with the SQLite online backup
+    // API, while other handles carry on reading and committing. `commitCount` and `commitHash` are set to the last
+    // commit included in the copy. Pages are copied `pagesPerStep` at a time, and after each step `onStep` is called
+    // with the bytes copied so far and the total; it can sleep to limit the rate, or return false to cancel. This must
+    // be called outside of a transaction. Returns an sqlite3 result code, and never asserts, as it's run from a
+    // background thread.
+    //
+    // The read transaction keeps the snapshot's frames in the WAL until the copy finishes, so checkpoints can't reset
+    // the WAL files and they grow with every commit made during the backup. Long or heavily rate limited backups of a
+    // busy database need `onStep` to watch the WAL's size (see BedrockOnlineBackup).
+    int backup(const string& destination, int pagesPerStep, const function<bool(uint64_t, uint64_t)>& onStep,
+               uint64_t& commitCount, string& commitHash);
+
     // Set a time limit for this transaction, in US from the current time.
     void setTimeout(uint64_t timeLimitUS);
 
@@ -230,9 +275,9 @@ class SQLite {
     void clearTimeout();
 
     // This atomically removes and returns committed transactions from our internal list. SQLiteNode can call this, and
-    // it will return a map of transaction IDs to tuples of (query, hash, dbCountAtTransactionStart), so that those
-    // transactions can be replicated out to peers.
-    map<uint64_t, tuple<string,string, uint64_t>> popCommittedTransactions();
+    // it will return a map of transaction IDs to tuples of (query, hash, dbCountAtTransactionStart, tables), so that
+    // those transactions can be replicated out to peers. `tables` is as returned by `getReplicationTables`.
+    map<uint64_t, tuple<string, string, uint64_t, string>> popCommittedTransactions();
 
     // The whitelist is either nullptr, in which case the feature is disabled, or it's a map of table names to sets of
     // column names that are allowed for reading. Using whitelist at all put the database handle into a more
@@ -271,7 +316,70 @@ class SQLite {
     void exclusiveLockDB();
     void exclusiveUnlockDB();
 
+    // Registers a function to be called with the rowids of any rows in `tableName` that were inserted, updated or
+    // deleted by a transaction, once that transaction has committed. This applies to every SQLite object in the
+    // process, so it sees transactions replicated from other nodes as well as local ones. This allows plugins to keep
+    // data from a table in memory and drop it as soon as it changes. If a transaction changes the schema, every
+    // listener is called with an empty set, meaning anything in the table may have changed. Listeners are called on
+    // the committing thread, while it's not holding the commit lock, and should be quick.
+    //
+    // If `columns` is given (as positions in the table, from 0), updates that leave the rowid and all of those columns
+    // as they were aren't reported, so bookkeeping columns can be written without invalidating anything. If several
+    // listeners are registered for a table, an update is reported to all of them if any of them would report it.
+    static void addTableChangeListener(const string& tableName, function<void(const set<int64_t>&)> listener,
+                                       const set<int>& columns = {});
+
+    // Registers a function to be called with the new commit count each time any handle for this DB file commits a
+    // transaction. Like table change listeners, these are called on the committing thread after the commit lock is
+    // released, and should be quick. Returns an ID to pass to `removeCommitListener`, which must be called before
+    // anything the listener uses is destroyed.
+    uint64_t addCommitListener(function<void(uint64_t)> listener);
+    void removeCommitListener(uint64_t listenerID);
+
+    // Keeps an in-memory filter of the IDs in `column` of `tableName`, so `idMayExist` can rule out most new IDs
+    // without reading the table. Each DB file gets its own, filled from the table in the background after the file is
+    // first opened (it's not used until that's done), and updated as rows are written from then on, whether by commands
+    // on this node or by replication. It grows as the table does (see `SQLiteIDFilter`). Only works when
+    // `column` is the table's rowid (`rowid` or an INTEGER PRIMARY KEY), and is ignored otherwise. Like table change
+    // listeners, this must be called at startup, before any DB handles are opened.
+    static void addIDFilter(const string& tableName, const string& column);
+
+    // Returns false if `id` is definitely not in `column` of `tableName`, and true if it may be, or if there's no
+    // usable ID filter for that table and column.
+    bool idMayExist(const string& tableName, const string& column, int64_t id) const;
+
+    // Returns the size and memory used by each ID filter, and how many lookups it answered, for Status.
+    STable getIDFilterInfo() const;
+
   private:
+    // The ID filter for one table in one DB file (see `addIDFilter`).
+    struct IDFilter {
+        IDFilter(const string& column, size_t capacity);
+
+        // Stops and waits for `buildThread`, if it's running.
+        ~IDFilter();
+
+        const string column;
+        SQLiteIDFilter filter;
+
+        // Set once every ID that was in the table when the file was opened has been added to `filter`. Until then,
+        // `idMayExist` doesn't use it. IDs written since the file was opened are added as they're written either way.
+        atomic<bool> ready;
+
+        // Reads the table's IDs into `filter` in the background (see `_buildIDFilter`), and tells it to stop early.
+        thread buildThread;
+        atomic<bool> stopBuilding;
+
+        // Whether `column` was the table's rowid as of schema generation `checkedGeneration`. Tables can be created
+        // or replaced after the filter is built, so this is checked again whenever the schema changes.
+        atomic<bool> usable;
+        atomic<uint64_t> checkedGeneration;
+
+        // Calls to `idMayExist` for this table, and how many of them the filter answered without reading the table.
+        atomic<uint64_t> checks;
+        atomic<uint64_t> skipped;
+    };
+
     // This structure contains all of the data that's shared between a set of SQLite objects that share the same
     // underlying database file.
     class SharedData {
@@ -287,7 +395,7 @@ class SQLite {
         void incrementCommit(const string& commitHash);
 
         // This removes and returns all committed transactions.
-        map<uint64_t, tuple<string, string, uint64_t>> popCommittedTransactions();
+        map<uint64_t, tuple<string, string, uint64_t, string>> popCommittedTransactions();
 
         // This is the last committed hash by *any* thread for this file.
         atomic<string> lastCommittedHash;
@@ -298,7 +406,7 @@ class SQLite {
 
         // When `SQLite::prepare` is called, we need to save a set of info that will be broadcast to peers when the
         // transaction is ultimately committed. This should be cleared out if the transaction is rolled back.
-        void prepareTransactionInfo(uint64_t commitID, const string& query, const string& hash, uint64_t dbCountAtTransactionStart);
+        void prepareTransactionInfo(uint64_t commitID, const string& query, const string& hash, uint64_t dbCountAtTransactionStart, const string& tables);
 
         // When a transaction that was prepared is committed, we move the data from the prepared list to the committed
         // list.
@@ -328,11 +436,42 @@ class SQLite {
         // This can be locked in exclusive mode to prevent all writes. This exists to support the `BlockWrites` command.
         shared_mutex writeLock;
 
+        // Incremented each time a transaction that changed the schema commits, so that handles know that what they've
+        // cached about the schema (see `_authorizerCache`) is out of date.
+        atomic<uint64_t> schemaGeneration;
+
+        // Incremented just before a commit and again once `commitCount` includes it, so it's odd while there may be a
+        // commit visible in the database that isn't counted yet. Used to find the exact commit a snapshot is at.
+        atomic<uint64_t> commitSequence;
+
+        // Results of deterministic reads, shared by every handle for this file.
+        SQLiteResultCache resultCache;
+
+        // Page cache and mmap settings that can be changed while we're running (see `setCacheBudget` and
+        // `setMmapSize`). Handles can't be changed from other threads, so each one applies these itself when it sees
+        // that `cacheSettingsGeneration` has changed. `mmapSizeGB` is -1 until set, so handles keep what they were
+        // created with.
+        atomic<uint64_t> cacheBudgetKB;
+        atomic<int64_t> mmapSizeGB;
+        atomic<uint64_t> cacheSettingsGeneration;
+
+        // Number of open handles for this file, which share `cacheBudgetKB`.
+        atomic<uint64_t> handleCount;
+
+        // Listeners registered with `addCommitListener`, by ID, and the mutex protecting them.
+        map<uint64_t, function<void(uint64_t)>> commitListeners;
+        shared_mutex commitListenersMutex;
+        uint64_t nextCommitListenerID;
+
+        // ID filters for this file, by table name. Created along with this object, and never added to or removed
+        // after that, so they can be read without locking.
+        map<string, unique_ptr<IDFilter>, STableComp> idFilters;
+
       private:
         // The data required to replicate transactions, in two lists, depending on whether this has only been prepared
         // or if it's been committed.
-        map<uint64_t, tuple<string, string, uint64_t>> _preparedTransactions;
-        map<uint64_t, tuple<string, string, uint64_t>> _committedTransactions;
+        map<uint64_t, tuple<string, string, uint64_t, string>> _preparedTransactions;
+        map<uint64_t, tuple<string, string, uint64_t, string>> _committedTransactions;
 
         // This mutex is locked when we need to change the state of the _shareData object. It is shared between a
         // variety of operations (i.e., updating _committedTransactions, etc).
@@ -455,6 +594,55 @@ class SQLite {
     // Callback function for progress tracking.
     static int _progressHandlerCallback(void* arg);
 
+    // Callback for every row changed, used to add new IDs to ID filters and record rows to pass to table change
+    // listeners.
+    static void _preUpdateHookCallback(void* sqliteObject, sqlite3* db, int operation, const char* database, const char* table,
+                                       sqlite3_int64 oldRowID, sqlite3_int64 newRowID);
+
+    // Calls the table change listeners for the current transaction and clears `_changedRows`.
+    void _notifyTableChangeListeners();
+
+    // Listeners registered with `addTableChangeListener` for one table, and the columns updates are reported for
+    // (`allColumns` if any listener didn't name any).
+    struct TableChangeListeners {
+        list<function<void(const set<int64_t>&)>> listeners;
+        set<int> columns;
+        bool allColumns = false;
+    };
+
+    // Returns whether the update being reported to `_preUpdateHookCallback` changed any of `columns`.
+    static bool _updateChangedColumns(sqlite3* db, const set<int>& columns);
+
+    // Listeners registered with `addTableChangeListener`, by table name, and the mutex protecting them.
+    static map<string, TableChangeListeners> _tableChangeListeners;
+    static shared_mutex _tableChangeListenersMutex;
+
+    // Set once the first listener is added, so writes don't take the mutex above until there's one to call.
+    static atomic<bool> _hasTableChangeListeners;
+
+    // Columns registered with `addIDFilter`, by table name.
+    static map<string, string, STableComp> _idFilterColumns;
+
+    // Smallest number of IDs an ID filter is sized for, so tables that start out empty don't fill theirs right away.
+    static constexpr size_t MIN_ID_FILTER_CAPACITY = 1'000'000;
+
+    // Creates the ID filter for `tableName` as `db`'s file is first opened, and starts filling it from the table's
+    // current contents in the background.
+    static void _initializeIDFilter(sqlite3* db, SharedData& sharedData, const string& filename, const string& tableName,
+                                    const string& column);
+
+    // Adds every ID in `tableName` of `filename` to `idFilter`, on a handle of its own, and marks it ready. IDs are read
+    // ID_FILTER_BUILD_ROWS at a time, each batch in its own read transaction, so a large table doesn't hold one
+    // snapshot (and keep the WAL from being reset) for the whole scan.
+    static void _buildIDFilter(const string& filename, const string& tableName, IDFilter& idFilter);
+    static constexpr int64_t ID_FILTER_BUILD_ROWS = 100'000;
+
+    // Returns whether `tableName` exists and `column` is its rowid.
+    static bool _isRowIDColumn(sqlite3* db, const string& tableName, const string& column);
+
+    // Rows changed in tables with listeners by the current transaction.
+    map<string, set<int64_t>> _changedRows;
+
     // Callback when the db checkpoints. Does little except record the number of pages outstanding.
     // Registering this has the important side effect of preventing the DB from auto-checkpointing.
     static int _walHookCallback(void* sqliteObject, sqlite3* db, const char* name, int walFileSize);
@@ -470,6 +658,57 @@ class SQLite {
     // Called internally by _sqliteAuthorizerCallback to authorize columns for a query.
     int _authorize(int actionCode, const char* detail1, const char* detail2, const char* detail3, const char* detail4);
 
+    // What the authorizer found out about a query the last time it ran, so that running the same query again (with
+    // the same or different literal values) doesn't need to go through the authorizer for every table, column and
+    // function in it. Only kept for queries where the authorizer allowed everything, and only valid for the schema
+    // generation and read/write mode it was recorded with, as those change what the authorizer decides. Never used
+    // while a whitelist is set.
+    struct AuthorizerInfo {
+        vector<string> tables;
+        bool deterministic;
+        bool writing;
+        uint64_t schemaGeneration;
+    };
+
+    // Entries in `_authorizerCache` before it's cleared and starts again.
+    static constexpr size_t MAX_AUTHORIZER_CACHE_SIZE = 2000;
+
+    // Runs `query` with `SQuery`, using `_authorizerCache` to skip the authorizer if it's been run before.
+    int _authorizedQuery(const char* e, const string& query, SQResult& result) const;
+
+    // Returns the key used for `query` in `_authorizerCache`: the query with each numeric literal, and each string that
+    // can only be a literal, replaced by `?`, as literal values don't change anything the authorizer looks at.
+    static string _authorizerKey(const string& query);
+
+    // Authorizer results by `_authorizerKey`.
+    mutable unordered_map<string, AuthorizerInfo> _authorizerCache;
+
+    // Set while running a query found in `_authorizerCache`, to make the authorizer allow everything.
+    mutable bool _authorizerBypassed = false;
+
+    // What the authorizer has seen in the query currently running, to add to `_authorizerCache` afterward.
+    mutable vector<string> _statementTables;
+    mutable bool _statementAuthorized = true;
+    mutable bool _statementDeterministic = true;
+
+    // `SharedData::schemaGeneration` from just before the current transaction began.
+    uint64_t _schemaGenerationAtStart = 0;
+
+    // Applies the shared page cache and mmap settings to this handle, if they've changed since it last did.
+    void _applyCacheSettings();
+
+    // Each handle's share of a cache budget, in KB.
+    static int64_t _budgetShareKB(uint64_t budgetKB, uint64_t handleCount);
+
+    // The `SharedData::cacheSettingsGeneration` this handle last applied, and what it applied.
+    uint64_t _cacheSettingsGeneration = 0;
+    int64_t _appliedCacheKB = 0;
+    int64_t _appliedMmapSizeGB = 0;
+
+    // The commit count of the current transaction's snapshot, if we know it exactly and the transaction hasn't written
+    // anything, so that its reads can use `SharedData::resultCache`. Otherwise 0.
+    uint64_t _snapshotCommitCount = 0;
+
     // It's possible for certain transactions (namely, timing out a write operation, see here:
     // https://sqlite.org/c3ref/interrupt.html) to cause a transaction to be automatically rolled back. If this
     // happens, we store a flag internally indicating that we don't need to perform the rollback ourselves. Then when
@@ -485,7 +724,10 @@ class SQLite {
     mutable map<string, SQResult> _queryCache;
 
     // List of table names used during this transaction.
-    set<string> _tablesUsed;
+    mutable set<string> _tablesUsed;
+
+    // True if a write in this transaction changed the schema.
+    bool _schemaChanged = false;
 
     // Number of queries that have been attempted in this transaction (for metrics only).
     mutable int64_t _queryCount = 0;
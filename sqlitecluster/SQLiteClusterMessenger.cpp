@@ -10,6 +10,13 @@ SQLiteClusterMessenger::SQLiteClusterMessenger(const shared_ptr<const SQLiteNode
  : _node(node), _socketPool()
 { }
 
+SQLiteClusterMessenger::~SQLiteClusterMessenger() {
+    // Destroy the channels (failing anything still outstanding) before the rest of our members go away.
+    lock_guard<mutex> lock(_escalationChannelMutex);
+    _escalationChannel.reset();
+    _retiredEscalationChannels.clear();
+}
+
 void SQLiteClusterMessenger::setErrorResponse(BedrockCommand& command) {
     command.response.methodLine = "500 Internal Server Error";
     command.response.nameValueMap.clear();
@@ -132,24 +139,27 @@ bool SQLiteClusterMessenger::runOnPeer(BedrockCommand& command, const string& pe
     return result;
 }
 
-bool SQLiteClusterMessenger::_sendCommandOnSocket(SHTTPSManager::Socket& socket, BedrockCommand& command) const {
-    bool sent = false;
-
+SData SQLiteClusterMessenger::_getEscalationRequest(BedrockCommand& command) {
     // This is what we need to send.
     SData request = command.request;
 
-    // If the command has https requests, we serialize them to escalate. In this case we also check if the command has data
-    // that needs serialization, and if so, we serialize that as well.
+    // If the command has https requests, we serialize them to escalate. We also check if the command has data that
+    // needs serialization, and if so, we serialize that as well.
     if (command.httpsRequests.size()) {
         request["httpsRequests"] = command.serializeHTTPSRequests();
-        string serializedData = command.serializeData();
-        if (serializedData.size()) {
-            request["serializedData"] = move(serializedData);
-        }
+    }
+    string serializedData = command.serializeData();
+    if (serializedData.size()) {
+        request["serializedData"] = move(serializedData);
     }
 
     request.nameValueMap["ID"] = command.id;
-    SFastBuffer buf(request.serialize());
+    return request;
+}
+
+bool SQLiteClusterMessenger::_sendCommandOnSocket(SHTTPSManager::Socket& socket, BedrockCommand& command) const {
+    bool sent = false;
+    SFastBuffer buf(_getEscalationRequest(command).serialize());
 
     // We only have one FD to poll.
     pollfd fdspec = {socket.s, POLLOUT, 0};
@@ -332,3 +342,282 @@ bool SQLiteClusterMessenger::commandWillCloseSocket(BedrockCommand& command) {
 
     return false;
 }
+
+bool SQLiteClusterMessenger::escalateToLeader(unique_ptr<BedrockCommand>& command, const EscalationCallback& callback) {
+    const string leaderAddress = _node->leaderCommandAddress();
+    if (leaderAddress.empty()) {
+        SINFO("[HTTPESC] No leader address.");
+        return false;
+    }
+
+    // Channels we no longer need are destroyed after we release the lock, as that waits for their threads to exit.
+    list<shared_ptr<EscalationChannel>> finishedChannels;
+    shared_ptr<EscalationChannel> channel;
+    {
+        lock_guard<mutex> lock(_escalationChannelMutex);
+        for (auto it = _retiredEscalationChannels.begin(); it != _retiredEscalationChannels.end();) {
+            if ((*it)->isFinished()) {
+                finishedChannels.push_back(move(*it));
+                it = _retiredEscalationChannels.erase(it);
+            } else {
+                it++;
+            }
+        }
+
+        // If leader has changed or our connection has closed, open a new one. The old one keeps running until it's
+        // received everything it can for commands already sent on it, and is then destroyed by a later call.
+        if (_escalationChannel && (!_escalationChannel->isOpen() || _escalationChannel->address != leaderAddress)) {
+            _escalationChannel->close();
+            _retiredEscalationChannels.push_back(move(_escalationChannel));
+        }
+        if (!_escalationChannel) {
+            unique_ptr<SHTTPSManager::Socket> socket = _getSocketForAddress(leaderAddress);
+            if (!socket) {
+                return false;
+            }
+            SINFO("[HTTPESC] Opening escalation channel to " << leaderAddress);
+            _escalationChannel = make_shared<EscalationChannel>(*this, leaderAddress, move(socket));
+        }
+        channel = _escalationChannel;
+    }
+
+    // Our reference keeps the channel alive even if it's replaced while we're sending, so we don't need to hold the
+    // lock, and other threads can escalate at the same time.
+    return channel->send(command, callback);
+}
+
+SQLiteClusterMessenger::EscalationChannel::EscalationChannel(const SQLiteClusterMessenger& messenger, const string& address_,
+                                                             unique_ptr<SHTTPSManager::Socket>&& socket)
+  : address(address_), _messenger(messenger), _socket(move(socket))
+{
+    _receiveThread = thread(&EscalationChannel::_receive, this);
+}
+
+SQLiteClusterMessenger::EscalationChannel::~EscalationChannel() {
+    _exit = true;
+    if (_receiveThread.joinable()) {
+        _receiveThread.join();
+    }
+    _fail();
+}
+
+bool SQLiteClusterMessenger::EscalationChannel::isFinished() {
+    lock_guard<mutex> lock(_pendingMutex);
+    return !_open && _pending.empty();
+}
+
+void SQLiteClusterMessenger::EscalationChannel::close() {
+    // Taking the send lock means any `send` that saw us open has finished queueing its request, and any later one
+    // sees us closed and takes its command back.
+    lock_guard<mutex> sendLock(_sendMutex);
+    _open = false;
+}
+
+bool SQLiteClusterMessenger::EscalationChannel::send(unique_ptr<BedrockCommand>& command, const EscalationCallback& callback) {
+    if (!_open) {
+        return false;
+    }
+
+    // Other commands share this socket, so we don't pass on a client's request to close it.
+    SData request = _getEscalationRequest(*command);
+    if (SIEquals(request["Connection"], "close")) {
+        request.erase("Connection");
+    }
+    request["multiplexed"] = "true";
+    const string serialized = request.serialize();
+    const string id = command->id;
+
+    // Register the command before sending it, as the response could arrive before we return.
+    command->escalationTimeUS = STimeNow();
+    {
+        lock_guard<mutex> lock(_pendingMutex);
+        if (_pending.count(id)) {
+            SWARN("[HTTPESC] Command " << id << " already escalated, not sending again.");
+            return false;
+        }
+        _pending.emplace(id, Pending{move(command), callback});
+    }
+
+    // Queue the request and send as much as the socket will take without blocking. Anything left over is sent by the
+    // receiving thread as the socket becomes writable, so we never wait for leader here.
+    bool sent;
+    {
+        lock_guard<mutex> sendLock(_sendMutex);
+        if (_open) {
+            _sendBuffer += serialized;
+            sent = _flush();
+        } else {
+            sent = false;
+        }
+    }
+    if (sent) {
+        return true;
+    }
+
+    // Either this was closed, or we failed part way through sending. Leader only runs complete requests, and nothing
+    // else can be sent on this socket, so if the receiving thread hasn't already failed this command, we take it back
+    // so the caller can retry it.
+    SINFO("[HTTPESC] Couldn't send on escalation channel to " << address << ", closing it.");
+    _open = false;
+    lock_guard<mutex> lock(_pendingMutex);
+    auto it = _pending.find(id);
+    if (it == _pending.end()) {
+        return true;
+    }
+    command = move(it->second.command);
+    command->escalationTimeUS = 0;
+    _pending.erase(it);
+    return false;
+}
+
+bool SQLiteClusterMessenger::EscalationChannel::_flush() {
+    while (!_sendBuffer.empty()) {
+        ssize_t bytesSent = ::send(_socket->s, _sendBuffer.c_str(), _sendBuffer.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (bytesSent == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                // The socket's full, the rest is sent when it's writable again.
+                return true;
+            } else if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        _sendBuffer.consumeFront(bytesSent);
+    }
+    return true;
+}
+
+void SQLiteClusterMessenger::EscalationChannel::_receive() {
+    SInitialize("escalation");
+    SFastBuffer buffer;
+    char chunk[4096];
+    while (!_exit) {
+        // Once we're closed and there's nothing outstanding, we're done.
+        if (isFinished()) {
+            break;
+        }
+
+        // Wait for responses, and for room to send anything `send` couldn't.
+        short events = POLLIN;
+        {
+            lock_guard<mutex> sendLock(_sendMutex);
+            if (!_sendBuffer.empty()) {
+                events |= POLLOUT;
+            }
+        }
+        pollfd fdspec = {_socket->s, events, 0};
+        int result = poll(&fdspec, 1, 100);
+
+        // Fail anything that's timed out, or everything if we're shutting down.
+        const uint64_t now = STimeNow();
+        if (_messenger._shutDownBy && now > _messenger._shutDownBy) {
+            SINFO("[HTTPESC] Giving up on escalated commands because shutting down.");
+            _fail();
+            break;
+        }
+        list<string> timedOut;
+        {
+            lock_guard<mutex> lock(_pendingMutex);
+            for (const auto& [id, pending] : _pending) {
+                if (pending.command->timeout() < now) {
+                    timedOut.push_back(id);
+                }
+            }
+        }
+        if (!timedOut.empty()) {
+            SINFO("[HTTPESC] " << timedOut.size() << " escalated commands timed out.");
+            _fail(timedOut);
+        }
+
+        if (result < 0 && errno != EAGAIN && errno != EINTR) {
+            SWARN("[HTTPESC] poll error (recv): " << errno);
+            _fail();
+            break;
+        } else if (result <= 0) {
+            continue;
+        }
+
+        if (fdspec.revents & POLLOUT) {
+            lock_guard<mutex> sendLock(_sendMutex);
+            if (!_flush()) {
+                SINFO("[HTTPESC] Failed to send on escalation channel to " << address << ", closing it.");
+                _fail();
+                break;
+            }
+        }
+        if (!(fdspec.revents & (POLLIN | POLLERR | POLLHUP))) {
+            continue;
+        }
+
+        ssize_t bytesRead = recv(_socket->s, chunk, sizeof(chunk), 0);
+        if (bytesRead == 0 || (bytesRead == -1 && errno != EAGAIN && errno != EINTR)) {
+            SINFO("[HTTPESC] Escalation channel to " << address << " disconnected.");
+            _fail();
+            break;
+        } else if (bytesRead == -1) {
+            continue;
+        }
+        buffer.append(chunk, bytesRead);
+
+        // Dispatch every complete response we've received.
+        while (true) {
+            SData response;
+            int size = response.deserialize(buffer);
+            if (!size) {
+                break;
+            }
+            buffer.consumeFront(size);
+
+            // If leader wants to close this connection (i.e., it's shutting down), stop sending new commands on it.
+            if (SIEquals(response["Connection"], "close")) {
+                _open = false;
+            }
+
+            Pending pending;
+            {
+                lock_guard<mutex> lock(_pendingMutex);
+                auto it = _pending.find(response["ID"]);
+                if (it == _pending.end()) {
+                    // Already timed out.
+                    SINFO("[HTTPESC] Got response for unknown escalated command '" << response["ID"] << "', ignoring.");
+                    continue;
+                }
+                pending = move(it->second);
+                _pending.erase(it);
+            }
+            pending.command->response = move(response);
+            pending.command->complete = true;
+            pending.command->escalated = true;
+            pending.command->escalationTimeUS = STimeNow() - pending.command->escalationTimeUS;
+            pending.callback(move(pending.command));
+        }
+    }
+}
+
+void SQLiteClusterMessenger::EscalationChannel::_fail(const list<string>& ids) {
+    list<Pending> failed;
+    {
+        lock_guard<mutex> lock(_pendingMutex);
+        if (ids.empty()) {
+            _open = false;
+            for (auto& [id, pending] : _pending) {
+                failed.push_back(move(pending));
+            }
+            _pending.clear();
+        } else {
+            for (const string& id : ids) {
+                auto it = _pending.find(id);
+                if (it != _pending.end()) {
+                    failed.push_back(move(it->second));
+                    _pending.erase(it);
+                }
+            }
+        }
+    }
+    for (Pending& pending : failed) {
+        // These have (or may have) been sent, so we can't retry them.
+        setErrorResponse(*pending.command);
+        pending.command->escalationTimeUS = STimeNow() - pending.command->escalationTimeUS;
+        pending.callback(move(pending.command));
+    }
+}
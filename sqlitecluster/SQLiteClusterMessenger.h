@@ -19,6 +19,19 @@ class SQLiteClusterMessenger {
     };
 
     SQLiteClusterMessenger(const shared_ptr<const SQLiteNode> node);
+    ~SQLiteClusterMessenger();
+
+    // Called with an escalated command once it's complete, either with leader's response or an error.
+    typedef function<void(unique_ptr<BedrockCommand>&& command)> EscalationCallback;
+
+    // Escalates a command to leader over a single persistent connection that's shared by all escalated commands (see
+    // EscalationChannel below). Unlike `runOnPeer`, this doesn't wait for leader to respond. Returns true if the
+    // command was sent, in which case this takes ownership of `command` and passes it to `callback` when it's
+    // complete, from a different thread. Returns false if the command couldn't be sent (for instance, if there's no
+    // leader), in which case `command` is left unchanged and can be retried later.
+    // Leader must support multiplexed requests (see `BedrockServer::handleSocket`), so this should only be used when
+    // leader is running the same version as this node.
+    bool escalateToLeader(unique_ptr<BedrockCommand>& command, const EscalationCallback& callback);
 
     // Attempts to make a TCP connection to a peer, that could be the leader or not, and run the given command there,
     //  setting the appropriate response from the peer in the command, and marking it as complete if possible.
@@ -49,6 +62,70 @@ class SQLiteClusterMessenger {
     void shutdownBy(uint64_t shutdownTimestamp);
 
   private:
+    // A connection to leader that can have any number of escalated commands in flight at once. Each request is sent
+    // with `multiplexed: true`, which tells leader to start on it right away rather than waiting for the previous
+    // command on the socket to finish, and to echo the command's ID in the response. The thread that escalates a
+    // command only queues the request and sends what it can without blocking. A thread owned by the channel sends the
+    // rest, reads the responses, matches them to commands by ID, and hands each completed command to its callback.
+    class EscalationChannel {
+      public:
+        EscalationChannel(const SQLiteClusterMessenger& messenger, const string& address, unique_ptr<SHTTPSManager::Socket>&& socket);
+
+        // Stops the receiving thread and fails any commands still waiting for a response.
+        ~EscalationChannel();
+
+        // See `escalateToLeader`.
+        bool send(unique_ptr<BedrockCommand>& command, const EscalationCallback& callback);
+
+        // False once the connection has failed or leader has asked us to close it. No new commands can be sent on a
+        // closed channel, but responses for commands already sent are still delivered.
+        bool isOpen() const { return _open; }
+
+        // Stops new commands being sent on this channel. Commands already sent still get their responses, after which
+        // the channel is finished.
+        void close();
+
+        // True if this is closed and has no commands waiting for responses, so it can be destroyed.
+        bool isFinished();
+
+        // The address of the leader this is connected to.
+        const string address;
+
+      private:
+        struct Pending {
+            unique_ptr<BedrockCommand> command;
+            EscalationCallback callback;
+        };
+
+        // Reads and dispatches responses (and sends anything queued) until the socket fails, or the channel is closed
+        // with nothing pending.
+        void _receive();
+
+        // Sends as much of `_sendBuffer` as the socket will take without blocking. Returns false if the socket failed.
+        // `_sendMutex` must be held.
+        bool _flush();
+
+        // Sets an error response on (and calls the callbacks for) the given commands, or all pending commands if no
+        // IDs are given. No new commands are sent after failing all of them.
+        void _fail(const list<string>& ids = {});
+
+        const SQLiteClusterMessenger& _messenger;
+        unique_ptr<SHTTPSManager::Socket> _socket;
+
+        // Requests queued to be sent, in order, so they aren't interleaved. Only held while copying into the buffer and
+        // for non-blocking sends.
+        mutex _sendMutex;
+        SFastBuffer _sendBuffer;
+
+        // Commands that have been sent and are waiting for a response, by ID.
+        mutex _pendingMutex;
+        map<string, Pending> _pending;
+
+        atomic<bool> _open = true;
+        atomic<bool> _exit = false;
+        thread _receiveThread;
+    };
+
     // This takes a pollfd with either POLLIN or POLLOUT set, and waits for the socket to be ready to read or write,
     // respectively. It returns true if ready, or false if error or timeout. The timeout is specified as a timestamp in
     // microseconds.
@@ -60,6 +137,9 @@ class SQLiteClusterMessenger {
     // Checks if a command will cause the server to close this socket, indicating we can't reuse it.
     static bool commandWillCloseSocket(BedrockCommand& command);
 
+    // Builds the request to send to a peer to run `command` there.
+    static SData _getEscalationRequest(BedrockCommand& command);
+
     // Sends command to the host associated with socket. Returns true if the
     // command was sent successfully (command.complete will be set to true in
     // that case), false otherwise.
@@ -79,4 +159,12 @@ class SQLiteClusterMessenger {
 
     // For managing many connections to leader, we have a socket pool.
     SMultiHostSocketPool _socketPool;
+
+    // The current channel for escalating to leader, replaced when it closes or leader changes. Threads sending on a
+    // channel hold a reference to it, so it's only held while picking the channel.
+    mutex _escalationChannelMutex;
+    shared_ptr<EscalationChannel> _escalationChannel;
+
+    // Channels that have been replaced, but are still waiting for responses to commands sent on them.
+    list<shared_ptr<EscalationChannel>> _retiredEscalationChannels;
 };
@@ -0,0 +1,108 @@
+#include "SQLiteCompression.h"
+
+#include <zlib.h>
+
+#include <libstuff/libstuff.h>
+
+string SQLiteCompression::literal(const string& value, size_t minBytes, size_t* storedBytes) {
+    const string compressed = _compress(value.data(), value.size(), minBytes);
+    if (storedBytes) {
+        *storedBytes = compressed.empty() ? value.size() : compressed.size();
+    }
+    if (compressed.empty()) {
+        return SQ(value);
+    }
+    return "X'" + SToHex(compressed) + "'";
+}
+
+void SQLiteCompression::registerFunctions(sqlite3* db) {
+    // Both are deterministic, so they can be used in indexes and in queries that are replicated to other nodes.
+    const int flags = SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS;
+    SASSERT(sqlite3_create_function_v2(db, "COMPRESS", 2, flags, nullptr, _compressFunction, nullptr, nullptr, nullptr) == SQLITE_OK);
+    SASSERT(sqlite3_create_function_v2(db, "DECOMPRESS", 1, flags, nullptr, _decompressFunction, nullptr, nullptr, nullptr) == SQLITE_OK);
+}
+
+string SQLiteCompression::_compress(const char* value, size_t size, size_t minBytes) {
+    if (!minBytes || size < minBytes) {
+        return "";
+    }
+    const string compressed = SGZip(string(value, size));
+    if (compressed.empty() || compressed.size() >= size) {
+        return "";
+    }
+    return compressed;
+}
+
+bool SQLiteCompression::_isCompressed(const char* value, size_t size) {
+    // The gzip magic number, followed by the deflate method.
+    return size >= 3 && (unsigned char)value[0] == 0x1f && (unsigned char)value[1] == 0x8b && value[2] == 8;
+}
+
+void SQLiteCompression::_compressFunction(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    if (sqlite3_value_type(argv[0]) == SQLITE_TEXT) {
+        const char* text = (const char*)sqlite3_value_text(argv[0]);
+        const int64_t minBytes = sqlite3_value_int64(argv[1]);
+        const string compressed = _compress(text, sqlite3_value_bytes(argv[0]), max<int64_t>(minBytes, 0));
+        if (!compressed.empty()) {
+            sqlite3_result_blob64(context, compressed.data(), compressed.size(), SQLITE_TRANSIENT);
+            return;
+        }
+    }
+    sqlite3_result_value(context, argv[0]);
+}
+
+string SQLiteCompression::_decompress(const char* value, size_t size, size_t maxBytes, string& decompressed) {
+    // This is SGUnzip, except that it gives up as soon as the output passes `maxBytes`, so a small value that inflates
+    // to gigabytes can't make us allocate them first.
+    z_stream stream = {};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        return "DECOMPRESS: couldn't initialize zlib";
+    }
+    stream.next_in = (Bytef*)value;
+    stream.avail_in = size;
+    char buffer[16384];
+    int status;
+    do {
+        stream.next_out = (Bytef*)buffer;
+        stream.avail_out = sizeof(buffer);
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status != Z_OK && status != Z_STREAM_END) {
+            break;
+        }
+        const size_t have = sizeof(buffer) - stream.avail_out;
+        if (decompressed.size() + have > maxBytes) {
+            inflateEnd(&stream);
+            return "DECOMPRESS: value is larger than " + to_string(maxBytes) + " bytes";
+        }
+        decompressed.append(buffer, have);
+    } while (status == Z_OK);
+    inflateEnd(&stream);
+
+    // We never compress empty values, so an empty result means it couldn't be decompressed either.
+    if (status != Z_STREAM_END || decompressed.empty()) {
+        return "DECOMPRESS: value is corrupt";
+    }
+    return "";
+}
+
+void SQLiteCompression::_decompressFunction(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    if (sqlite3_value_type(argv[0]) == SQLITE_BLOB) {
+        const char* blob = (const char*)sqlite3_value_blob(argv[0]);
+        const size_t size = sqlite3_value_bytes(argv[0]);
+        if (_isCompressed(blob, size)) {
+            // Nothing longer than the handle's length limit could have been stored uncompressed, so no value we
+            // compressed decompresses to more than that.
+            const int lengthLimit = sqlite3_limit(sqlite3_context_db_handle(context), SQLITE_LIMIT_LENGTH, -1);
+            const size_t maxBytes = min<size_t>(max(lengthLimit, 0), MAX_DECOMPRESSED_BYTES);
+            string decompressed;
+            const string error = _decompress(blob, size, maxBytes, decompressed);
+            if (!error.empty()) {
+                sqlite3_result_error(context, error.c_str(), -1);
+                return;
+            }
+            sqlite3_result_text64(context, decompressed.data(), decompressed.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+            return;
+        }
+    }
+    sqlite3_result_value(context, argv[0]);
+}
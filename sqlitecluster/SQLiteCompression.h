@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+
+#include <libstuff/sqlite3.h>
+
+using namespace std;
+
+// Compressed storage for large text values, such as job data or cache values.
+//
+// A compressed value is stored as a BLOB holding the value gzipped, while values that aren't compressed stay TEXT, so
+// a column can hold a mix of both, and values written before compression was turned on (or after it's turned off)
+// still read back correctly. Every DB handle has two SQL functions for these:
+//
+//     DECOMPRESS(value)            - The original text of a compressed value. Anything else is returned unchanged, so
+//                                    reads can always use this, e.g. `JSON_EXTRACT(DECOMPRESS(data), '$.key')`.
+//     COMPRESS(value, minBytes)    - `value` compressed, if it's TEXT of at least `minBytes` bytes (and compressing
+//                                    makes it smaller). Otherwise, it's returned unchanged. This is for values computed
+//                                    in SQL, e.g. `COMPRESS(JSON_SET(DECOMPRESS(data), ...), 1024)`.
+//
+// Values sent from C++ should use `literal`, which does the compression before the query is written, so the query
+// that's replicated to other nodes and saved in the journal is smaller too.
+class SQLiteCompression {
+  public:
+    // Returns `value` as an SQL literal: compressed if it's at least `minBytes` long and compressing makes it smaller,
+    // and quoted as is (with `SQ`) otherwise. A `minBytes` of 0 never compresses. If `storedBytes` is passed, it's set
+    // to the size the value will take up in the DB, which is what `LENGTH(value)` will return.
+    static string literal(const string& value, size_t minBytes, size_t* storedBytes = nullptr);
+
+    // Adds the `COMPRESS` and `DECOMPRESS` functions to `db`.
+    static void registerFunctions(sqlite3* db);
+
+    // `DECOMPRESS` fails rather than return more than this, or the handle's `SQLITE_LIMIT_LENGTH` if that's lower, so
+    // a small corrupt or malicious value can't expand to fill memory. This is twice the largest cache value.
+    static constexpr size_t MAX_DECOMPRESSED_BYTES = 128 * 1024 * 1024;
+
+  private:
+    // Returns `value` gzipped, or an empty string if it's shorter than `minBytes` or doesn't get any smaller.
+    static string _compress(const char* value, size_t size, size_t minBytes);
+
+    // Gunzips `value` into `decompressed`. Returns an error message if it's corrupt, or would be more than `maxBytes`
+    // long, and an empty string on success.
+    static string _decompress(const char* value, size_t size, size_t maxBytes, string& decompressed);
+
+    // Returns whether a BLOB looks like one we compressed.
+    static bool _isCompressed(const char* value, size_t size);
+
+    // SQL function implementations.
+    static void _compressFunction(sqlite3_context* context, int argc, sqlite3_value** argv);
+    static void _decompressFunction(sqlite3_context* context, int argc, sqlite3_value** argv);
+};
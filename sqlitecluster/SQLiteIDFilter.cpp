@@ -0,0 +1,140 @@
+#include "SQLiteIDFilter.h"
+
+#include <algorithm>
+
+SQLiteIDFilter::Layer::Layer(size_t capacity) : capacity(capacity), blockCount(1), size(0) {
+    // Round up to a power of two blocks, so picking one is a mask rather than a division.
+    const size_t blocksNeeded = max<size_t>(capacity * BITS_PER_ID / (sizeof(Block) * 8), 1);
+    while (blockCount < blocksNeeded) {
+        blockCount <<= 1;
+    }
+    blocks.reset(new Block[blockCount]);
+    for (size_t i = 0; i < blockCount; i++) {
+        for (auto& word : blocks[i].words) {
+            word.store(0, memory_order_relaxed);
+        }
+    }
+}
+
+SQLiteIDFilter::SQLiteIDFilter(size_t capacity) : _layerCount(1) {
+    _layers[0] = make_unique<Layer>(max<size_t>(capacity, 1));
+}
+
+uint64_t SQLiteIDFilter::_hash(int64_t id) {
+    // The splitmix64 finalizer. IDs may be sequential or share high bits, so they need mixing before we take bits
+    // from them.
+    uint64_t x = (uint64_t)id;
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+const SQLiteIDFilter::Block& SQLiteIDFilter::Layer::_block(uint64_t hash) const {
+    return blocks[hash & (blockCount - 1)];
+}
+
+uint64_t SQLiteIDFilter::_mask(uint64_t bits, size_t word) {
+    return 1ull << ((bits >> (word * 6)) & 63);
+}
+
+void SQLiteIDFilter::Layer::add(uint64_t hash) {
+    Block& block = const_cast<Block&>(_block(hash));
+
+    // The low bits of `hash` picked the block, so mix it again to pick the bits within it independently of that.
+    const uint64_t bits = _hash((int64_t)hash);
+    for (size_t i = 0; i < WORDS_PER_BLOCK; i++) {
+        // Relaxed is enough: IDs are added before the transaction that wrote them commits, and anyone who could see
+        // that commit has synchronized with it through SQLite's own locking since.
+        const uint64_t mask = _mask(bits, i);
+        if (!(block.words[i].load(memory_order_relaxed) & mask)) {
+            block.words[i].fetch_or(mask, memory_order_relaxed);
+        }
+    }
+    size.fetch_add(1, memory_order_relaxed);
+}
+
+bool SQLiteIDFilter::Layer::mayContain(uint64_t hash) const {
+    const Block& block = _block(hash);
+    const uint64_t bits = _hash((int64_t)hash);
+    for (size_t i = 0; i < WORDS_PER_BLOCK; i++) {
+        if (!(block.words[i].load(memory_order_relaxed) & _mask(bits, i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SQLiteIDFilter::add(int64_t id) {
+    const size_t last = _layerCount.load(memory_order_acquire) - 1;
+    Layer& layer = *_layers[last];
+    if (layer.size.load(memory_order_relaxed) >= layer.capacity && last + 1 < MAX_LAYERS) {
+        _grow(last, layer.capacity * GROWTH_FACTOR);
+        _layers[_layerCount.load(memory_order_acquire) - 1]->add(_hash(id));
+        return;
+    }
+    layer.add(_hash(id));
+}
+
+bool SQLiteIDFilter::mayContain(int64_t id) const {
+    const uint64_t hash = _hash(id);
+    const size_t layerCount = _layerCount.load(memory_order_acquire);
+    for (size_t i = 0; i < layerCount; i++) {
+        if (_layers[i]->mayContain(hash)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SQLiteIDFilter::reserve(size_t count) {
+    const size_t last = _layerCount.load(memory_order_acquire) - 1;
+    const Layer& layer = *_layers[last];
+    const size_t used = layer.size.load(memory_order_relaxed);
+    if (used + count > layer.capacity && last + 1 < MAX_LAYERS) {
+        _grow(last, max(count, layer.capacity * GROWTH_FACTOR));
+    }
+}
+
+void SQLiteIDFilter::_grow(size_t full, size_t capacity) {
+    lock_guard<mutex> lock(_growMutex);
+    const size_t layerCount = _layerCount.load(memory_order_relaxed);
+    if (layerCount != full + 1 || layerCount == MAX_LAYERS) {
+        return;
+    }
+    _layers[layerCount] = make_unique<Layer>(capacity);
+    _layerCount.store(layerCount + 1, memory_order_release);
+}
+
+size_t SQLiteIDFilter::size() const {
+    size_t total = 0;
+    const size_t layerCount = _layerCount.load(memory_order_acquire);
+    for (size_t i = 0; i < layerCount; i++) {
+        total += _layers[i]->size.load(memory_order_relaxed);
+    }
+    return total;
+}
+
+size_t SQLiteIDFilter::capacity() const {
+    size_t total = 0;
+    const size_t layerCount = _layerCount.load(memory_order_acquire);
+    for (size_t i = 0; i < layerCount; i++) {
+        total += _layers[i]->capacity;
+    }
+    return total;
+}
+
+size_t SQLiteIDFilter::bytes() const {
+    size_t total = 0;
+    const size_t layerCount = _layerCount.load(memory_order_acquire);
+    for (size_t i = 0; i < layerCount; i++) {
+        total += _layers[i]->blockCount * sizeof(Block);
+    }
+    return total;
+}
+
+size_t SQLiteIDFilter::layers() const {
+    return _layerCount.load(memory_order_acquire);
+}
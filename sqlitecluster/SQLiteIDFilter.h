@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+using namespace std;
+
+// A blocked Bloom filter of 64-bit IDs. `mayContain` never returns false for an ID that was added, and returns true
+// for one that wasn't with a probability of around 1% while no more than `capacity` IDs have been added. Each ID only
+// touches one 64-byte block, so a lookup is a single cache miss.
+//
+// A Bloom filter can't be resized, so when it fills, the filter grows by starting a new layer with GROWTH_FACTOR times
+// the capacity of the last, and new IDs go there (i.e., a scalable Bloom filter). A lookup checks every layer, so each
+// one adds a cache miss and about 1% to the false positive rate. Callers that know roughly how many IDs are coming
+// should `reserve` room for them up front. Once MAX_LAYERS are in use, the last one keeps filling, and its false
+// positive rate climbs gradually.
+//
+// IDs can be added and looked up from any number of threads at once without locking (only starting a new layer
+// takes a lock). IDs can't be removed.
+class SQLiteIDFilter {
+  public:
+    // Creates a filter sized for `capacity` IDs.
+    SQLiteIDFilter(size_t capacity);
+
+    void add(int64_t id);
+    bool mayContain(int64_t id) const;
+
+    // Makes sure the current layer has room for `count` more IDs, starting a new one if it doesn't.
+    void reserve(size_t count);
+
+    // The number of times `add` has been called (adding the same ID twice counts twice), and the total number of IDs
+    // the layers were sized for.
+    size_t size() const;
+    size_t capacity() const;
+
+    // Memory used by the filter itself, and the number of layers it's grown to.
+    size_t bytes() const;
+    size_t layers() const;
+
+    static constexpr size_t GROWTH_FACTOR = 4;
+    static constexpr size_t MAX_LAYERS = 8;
+
+  private:
+    // Bits per ID the filter is sized for. Each ID sets one bit in each of the 8 words of its block.
+    static constexpr size_t BITS_PER_ID = 10;
+    static constexpr size_t WORDS_PER_BLOCK = 8;
+
+    struct alignas(64) Block {
+        atomic<uint64_t> words[WORDS_PER_BLOCK];
+    };
+
+    // A fixed size Bloom filter.
+    class Layer {
+      public:
+        Layer(size_t capacity);
+        void add(uint64_t hash);
+        bool mayContain(uint64_t hash) const;
+
+        const size_t capacity;
+        size_t blockCount;
+        unique_ptr<Block[]> blocks;
+        atomic<size_t> size;
+
+      private:
+        // Picks the block for an ID's `hash`, and, from a second hash (`bits`), the bit for it in each of the block's
+        // words.
+        const Block& _block(uint64_t hash) const;
+    };
+
+    static uint64_t _mask(uint64_t bits, size_t word);
+    static uint64_t _hash(int64_t id);
+
+    // Starts a new layer with room for at least `capacity` IDs, unless someone else already started a new one after
+    // `full` (the index of the layer that was found to be full).
+    void _grow(size_t full, size_t capacity);
+
+    // Layers are only ever appended. Each is set before `_layerCount` is incremented to include it, so the first
+    // `_layerCount` can be read without locking.
+    unique_ptr<Layer> _layers[MAX_LAYERS];
+    atomic<size_t> _layerCount;
+    mutex _growMutex;
+};
@@ -0,0 +1,181 @@
+#include "SQLiteJournalBackup.h"
+
+#include <cinttypes>
+#include <dirent.h>
+
+#include <libstuff/SData.h>
+#include <libstuff/SQResult.h>
+
+list<string> SQLiteJournalBackup::exportSegments(SQLite& db, const string& directory, uint64_t fromCommit, uint64_t toCommit) {
+    list<string> filenames;
+    if (toCommit <= fromCommit) {
+        return filenames;
+    }
+    const string dbFilename = basename((char*)db.getFilename().c_str());
+
+    // Everything is verified against the hash chain from the commit we start after.
+    string hash, ignore;
+    if (fromCommit && !db.getCommit(fromCommit, ignore, hash)) {
+        STHROW("500 Journal no longer has commit " + to_string(fromCommit) + ", take a full backup");
+    }
+
+    uint64_t segmentStart = fromCommit;
+    string buffer;
+    while (segmentStart < toCommit) {
+        SData segment("JOURNAL_SEGMENT");
+        segment["FromCommit"] = to_string(segmentStart);
+        segment["StartHash"] = hash;
+        uint64_t commit = segmentStart;
+
+        // Read the journal a page at a time until the segment is full.
+        while (commit < toCommit && commit - segmentStart < MAX_SEGMENT_COMMITS && segment.content.size() < MAX_SEGMENT_BYTES) {
+            const uint64_t pageEnd = min(toCommit, commit + 1'000);
+            SQResult result;
+            if (!db.getCommits(commit + 1, pageEnd, result)) {
+                STHROW("500 Error reading journal");
+            }
+            if (result.size() != pageEnd - commit) {
+                STHROW("500 Journal no longer has commits " + to_string(commit + 1) + "-" + to_string(pageEnd) + ", take a full backup");
+            }
+            for (const auto& row : result.rows) {
+                commit++;
+                hash = SToHex(SHashSHA1(hash + row[1]));
+                if (hash != row[0]) {
+                    STHROW("500 Hash mismatch at commit " + to_string(commit));
+                }
+                SData commitMessage("COMMIT");
+                commitMessage["CommitIndex"] = to_string(commit);
+                commitMessage["Hash"] = row[0];
+                commitMessage.content = row[1];
+                commitMessage.serialize(buffer);
+                segment.content += buffer;
+            }
+        }
+        segment["ToCommit"] = to_string(commit);
+        segment["EndHash"] = hash;
+        segment["NumCommits"] = to_string(commit - segmentStart);
+
+        // Written under a temporary name and renamed, so a segment file is never partial.
+        const string filename = _segmentFilename(directory, dbFilename, segmentStart, commit);
+        const string compressed = SGZip(segment.serialize());
+        if (compressed.empty() || !SFileSave(filename + ".partial", compressed) || rename((filename + ".partial").c_str(), filename.c_str())) {
+            SFileDelete(filename + ".partial");
+            STHROW("500 Couldn't write " + filename);
+        }
+        SINFO("Exported commits " << segmentStart + 1 << "-" << commit << " to " << filename << ", "
+              << compressed.size() << " bytes.");
+        filenames.push_back(filename);
+        segmentStart = commit;
+    }
+    return filenames;
+}
+
+uint64_t SQLiteJournalBackup::lastExportedCommit(const string& directory, const string& dbFilename) {
+    map<uint64_t, pair<uint64_t, string>> segments = _listSegments(directory, dbFilename);
+    return segments.empty() ? 0 : segments.rbegin()->second.first;
+}
+
+uint64_t SQLiteJournalBackup::restore(SQLite& db, const string& directory, const string& dbFilename) {
+    uint64_t applied = 0;
+    for (const auto& [fromCommit, segmentInfo] : _listSegments(directory, dbFilename)) {
+        const auto& [toCommit, filename] = segmentInfo;
+        if (toCommit <= db.getCommitCount()) {
+            continue;
+        }
+        if (fromCommit > db.getCommitCount()) {
+            STHROW("500 Segments are missing commits " + to_string(db.getCommitCount() + 1) + "-" + to_string(fromCommit));
+        }
+        Segment segment = _readSegment(filename);
+
+        // The database needs to be where the segment says it is before we add to it. It may already have some of
+        // the segment's commits, if its base backup was taken after the segment started.
+        if (segment.fromCommit == db.getCommitCount() && segment.startHash != db.getCommittedHash()) {
+            STHROW("500 " + filename + " starts from hash " + segment.startHash + ", database is at " + db.getCommittedHash());
+        }
+
+        // Replay the commits the same way a follower synchronizes them from a peer.
+        SData commit;
+        const char* content = segment.commits.c_str();
+        size_t remaining = segment.commits.size();
+        while (int messageSize = commit.deserialize(content, remaining)) {
+            content += messageSize;
+            remaining -= messageSize;
+            const uint64_t commitIndex = commit.calcU64("CommitIndex");
+            if (commitIndex <= db.getCommitCount()) {
+                if (commitIndex == db.getCommitCount() && commit["Hash"] != db.getCommittedHash()) {
+                    STHROW("500 Database has a different hash than " + filename + " at commit " + to_string(commitIndex));
+                }
+                continue;
+            }
+            if (!db.beginTransaction()) {
+                STHROW("500 Failed to begin transaction");
+            }
+            if (!db.writeUnmodified(commit.content) || !db.prepare()) {
+                db.rollback();
+                STHROW("500 Failed to apply commit " + to_string(commitIndex));
+            }
+            db.commit("RESTORE");
+            if (db.getCommittedHash() != commit["Hash"]) {
+                STHROW("500 Hash mismatch after applying commit " + to_string(commitIndex));
+            }
+            applied++;
+        }
+        SINFO("Restored through commit " << segment.toCommit << " from " << filename << ".");
+    }
+    return applied;
+}
+
+string SQLiteJournalBackup::_segmentFilename(const string& directory, const string& dbFilename, uint64_t fromCommit, uint64_t toCommit) {
+    char range[42];
+    snprintf(range, sizeof(range), "%020" PRIu64 "-%020" PRIu64, fromCommit + 1, toCommit);
+    return directory + "/" + dbFilename + "." + range + ".journal.gz";
+}
+
+map<uint64_t, pair<uint64_t, string>> SQLiteJournalBackup::_listSegments(const string& directory, const string& dbFilename) {
+    map<uint64_t, pair<uint64_t, string>> segments;
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) {
+        return segments;
+    }
+    const string prefix = dbFilename + ".";
+    const string suffix = ".journal.gz";
+    while (dirent* entry = readdir(dir)) {
+        const string name = entry->d_name;
+        if (name.size() == prefix.size() + 41 + suffix.size() && SStartsWith(name, prefix) && SEndsWith(name, suffix) &&
+            name[prefix.size() + 20] == '-') {
+            const uint64_t firstCommit = SToUInt64(name.substr(prefix.size(), 20));
+            const uint64_t lastCommit = SToUInt64(name.substr(prefix.size() + 21, 20));
+            segments[firstCommit - 1] = make_pair(lastCommit, directory + "/" + name);
+        }
+    }
+    closedir(dir);
+    return segments;
+}
+
+SQLiteJournalBackup::Segment SQLiteJournalBackup::_readSegment(const string& filename) {
+    SData header;
+    const string serialized = SGUnzip(SFileLoad(filename));
+    if (!header.deserialize(serialized) || !SIEquals(header.methodLine, "JOURNAL_SEGMENT")) {
+        STHROW("500 " + filename + " is not a journal segment");
+    }
+    Segment segment = {header.calcU64("FromCommit"), header.calcU64("ToCommit"), header["StartHash"], header["EndHash"], move(header.content)};
+
+    // Check the whole segment before anything is applied from it.
+    string hash = segment.startHash;
+    uint64_t expected = segment.fromCommit;
+    SData commit;
+    const char* content = segment.commits.c_str();
+    size_t remaining = segment.commits.size();
+    while (int messageSize = commit.deserialize(content, remaining)) {
+        content += messageSize;
+        remaining -= messageSize;
+        hash = SToHex(SHashSHA1(hash + commit.content));
+        if (!SIEquals(commit.methodLine, "COMMIT") || commit.calcU64("CommitIndex") != ++expected || commit["Hash"] != hash) {
+            STHROW("500 " + filename + " fails verification at commit " + to_string(expected));
+        }
+    }
+    if (remaining || expected != segment.toCommit || hash != segment.endHash || expected - segment.fromCommit != header.calcU64("NumCommits")) {
+        STHROW("500 " + filename + " is incomplete");
+    }
+    return segment;
+}
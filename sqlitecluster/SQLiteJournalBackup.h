@@ -0,0 +1,58 @@
+#pragma once
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLite.h>
+
+// Incremental backups built from the commit journal. Every transaction is already in the journal tables with its query
+// and the hash of the database after it, so rather than copying the whole database again, we can save the commits made
+// since the last backup and replay them on top of it later.
+//
+// Commits are saved in gzipped segment files, each holding a run of consecutive commits in the same `COMMIT` message
+// format that `SYNCHRONIZE_RESPONSE` uses, behind a header recording the range and the hashes it starts and ends at.
+// Segment files are named for the database and the range they hold, zero-padded so that they sort in commit order:
+//
+//     bedrock.db.00000000000000000101-00000000000000000200.journal.gz
+//
+// Each commit's hash is checked against the hash chain (the SHA1 of the previous hash and the query) when it's
+// exported, when it's read back, and again when it's replayed, so a corrupt, missing or out of order segment is caught
+// before it's applied.
+class SQLiteJournalBackup {
+  public:
+    // Segments are read into memory in one piece, so they're capped at this many commits or bytes of queries.
+    static constexpr uint64_t MAX_SEGMENT_COMMITS = 100'000;
+    static constexpr uint64_t MAX_SEGMENT_BYTES = 64 * 1024 * 1024;
+
+    // Saves every commit after `fromCommit` through `toCommit` into new segment files in `directory`, and returns their
+    // names. Throws if the journal doesn't have them all anymore (because they've been truncated, in which case a full
+    // backup is needed), or if they don't match the hash chain.
+    static list<string> exportSegments(SQLite& db, const string& directory, uint64_t fromCommit, uint64_t toCommit);
+
+    // Returns the last commit in the segments for `dbFilename` in `directory`, or 0 if there aren't any.
+    static uint64_t lastExportedCommit(const string& directory, const string& dbFilename);
+
+    // Replays the commits in the segments for `dbFilename` in `directory` that come after the commit `db` is at, in
+    // order, and returns the number applied. `db` is normally a base backup, and must be at a commit covered by the
+    // segments, with the same hash. Throws if any segment is missing, corrupt, or doesn't verify.
+    static uint64_t restore(SQLite& db, const string& directory, const string& dbFilename);
+
+  private:
+    // A segment read back from disk.
+    struct Segment {
+        uint64_t fromCommit;
+        uint64_t toCommit;
+        string startHash;
+        string endHash;
+
+        // The serialized `COMMIT` messages.
+        string commits;
+    };
+
+    // Returns the name of the segment file holding commits `fromCommit + 1` through `toCommit`.
+    static string _segmentFilename(const string& directory, const string& dbFilename, uint64_t fromCommit, uint64_t toCommit);
+
+    // Lists the segment files for `dbFilename` in `directory`, keyed by the commit they start from (the one before
+    // their first commit), with the last commit they hold.
+    static map<uint64_t, pair<uint64_t, string>> _listSegments(const string& directory, const string& dbFilename);
+
+    // Reads and verifies a segment file. Throws if it's not a valid segment.
+    static Segment _readSegment(const string& filename);
+};
@@ -202,11 +202,12 @@ void SQLiteNode::_replicate(SQLitePeer* peer, SData command, size_t sqlitePoolIn
             // Transactions are either ASYNC or QUORUM. QUORUM transactions can only start when the DB is completely
             // up-to-date. ASYNC transactions can start as soon as the DB is at `dbCountAtStart` (the same value that
             // the DB was at when the transaction began on leader).
+            // Either can start earlier if none of the transactions it would wait for use the same tables.
             bool quorum = !SStartsWith(command["ID"], "ASYNC");
-            uint64_t waitForCount = SStartsWith(command["ID"], "ASYNC") ? command.calcU64("dbCountAtStart") : currentCount;
+            uint64_t waitForCount = _replicationStartCount(newCount, quorum ? currentCount : command.calcU64("dbCountAtStart"));
             SDEBUG("Thread for commit " << newCount << " waiting on DB count " << waitForCount << " (" << (quorum ? "QUORUM" : "ASYNC") << ")");
             while (true) {
-                SQLiteSequentialNotifier::RESULT result = _localCommitNotifier.waitFor(waitForCount, false);
+                SQLiteSequentialNotifier::RESULT result = _localCommitNotifier.waitFor(waitForCount);
                 if (result == SQLiteSequentialNotifier::RESULT::UNKNOWN) {
                     // This should be impossible.
                     SERROR("Got UNKNOWN result from waitFor, which shouldn't happen");
@@ -234,18 +235,16 @@ void SQLiteNode::_replicate(SQLitePeer* peer, SData command, size_t sqlitePoolIn
                         auto start = chrono::steady_clock::now();
                         _handleBeginTransaction(db, peer, command, commitAttemptCount > 1);
 
-                        // Now we need to wait for the DB to be up-to-date (if the transaction is QUORUM, we can
-                        // skip this, we did it above) to enforce that commits are in the same order on followers as on
-                        // leader.
-                        if (!quorum) {
-                            SDEBUG("Waiting at commit " << db.getCommitCount() << " for commit " << currentCount);
-                            SQLiteSequentialNotifier::RESULT waitResult = _localCommitNotifier.waitFor(currentCount, true);
-                            if (waitResult == SQLiteSequentialNotifier::RESULT::CANCELED) {
-                                SINFO("Replication canceled mid-transaction, stopping.");
-                                --_concurrentReplicateTransactions;
-                                db.rollback();
-                                break;
-                            }
+                        // Now we need to wait for the DB to be up-to-date to enforce that commits are in the same
+                        // order on followers as on leader. This is the only part of applying a transaction that's
+                        // serialized.
+                        SDEBUG("Waiting at commit " << db.getCommitCount() << " for commit " << currentCount);
+                        SQLiteSequentialNotifier::RESULT waitResult = _localCommitNotifier.waitFor(currentCount);
+                        if (waitResult == SQLiteSequentialNotifier::RESULT::CANCELED) {
+                            SINFO("Replication canceled mid-transaction, stopping.");
+                            --_concurrentReplicateTransactions;
+                            db.rollback();
+                            break;
                         }
 
                         // Ok, almost ready.
@@ -264,7 +263,7 @@ void SQLiteNode::_replicate(SQLitePeer* peer, SData command, size_t sqlitePoolIn
                     // don't send LEADER the approval for this until inside of `prepare`. This potentially makes us
                     // wait while holding the commit lock for non-concurrent transactions, but I guess nobody else with
                     // a commit after us will be able to commit, either.
-                    SQLiteSequentialNotifier::RESULT waitResult = _leaderCommitNotifier.waitFor(command.calcU64("NewCount"), true);
+                    SQLiteSequentialNotifier::RESULT waitResult = _leaderCommitNotifier.waitFor(command.calcU64("NewCount"));
                     if (uniqueContraintsError) {
                         SINFO("Got unique constraints error in replication, restarting.");
                         --_concurrentReplicateTransactions;
@@ -309,6 +308,38 @@ void SQLiteNode::_replicate(SQLitePeer* peer, SData command, size_t sqlitePoolIn
     }
 }
 
+uint64_t SQLiteNode::_replicationStartCount(uint64_t newCount, uint64_t waitForCount) {
+    lock_guard<mutex> lock(_replicationTablesMutex);
+
+    // Forget about anything that's been committed.
+    const uint64_t commitCount = _db.getCommitCount();
+    _replicationTables.erase(_replicationTables.begin(), _replicationTables.upper_bound(commitCount));
+
+    auto tablesIt = _replicationTables.find(newCount);
+    if (tablesIt == _replicationTables.end() || tablesIt->second.empty()) {
+        return waitForCount;
+    }
+    const set<string>& tables = tablesIt->second;
+
+    // Work back from `waitForCount` until we find a transaction we'd need to wait for.
+    for (uint64_t count = waitForCount; count > commitCount; count--) {
+        auto it = _replicationTables.find(count);
+        if (it == _replicationTables.end() || it->second.empty()) {
+            return count;
+        }
+        for (const string& table : it->second) {
+            if (tables.count(table)) {
+                return count;
+            }
+        }
+    }
+    if (waitForCount > commitCount) {
+        SINFO("Starting replicated transaction " << newCount << " at commit " << commitCount << " rather than " << waitForCount
+              << ", no intervening transactions use its tables.");
+    }
+    return commitCount;
+}
+
 void SQLiteNode::startCommit(ConsistencyLevel consistency) {
     unique_lock<decltype(_stateMutex)> uniqueLock(_stateMutex);
 
@@ -446,6 +477,9 @@ void SQLiteNode::_sendOutstandingTransactions(const set<uint64_t>& commitOnlyIDs
             transaction["leaderSendTime"] = sendTime;
             transaction["dbCountAtStart"] = to_string(dbCountAtStart);
             transaction["ID"] = idHeader;
+            if (!get<3>(i.second).empty()) {
+                transaction["Tables"] = get<3>(i.second);
+            }
             transaction.content = query;
             for (auto peer : _peerList) {
                 // Clear the response flag from the last transaction
@@ -470,12 +504,57 @@ void SQLiteNode::_sendOutstandingTransactions(const set<uint64_t>& commitOnlyIDs
 list<STable> SQLiteNode::getPeerInfo() const {
     shared_lock<decltype(_stateMutex)> sharedLock(_stateMutex);
     list<STable> peerData;
+    const uint64_t headCommitCount = getHeadCommitCount();
     for (SQLitePeer* peer : _peerList) {
-        peerData.emplace_back(peer->getData());
+        STable data = peer->getData();
+        const uint64_t peerCommitCount = peer->commitCount;
+        data["lagCommits"] = to_string(headCommitCount > peerCommitCount ? headCommitCount - peerCommitCount : 0);
+        data["lagMS"] = to_string(getStalenessMS(peerCommitCount));
+        peerData.emplace_back(move(data));
     }
     return peerData;
 }
 
+string SQLiteNode::getFreshestFollower(uint64_t minCommitCount) const {
+    const string leaderVersion = getLeaderVersion();
+    SQLitePeer* freshestPeer = nullptr;
+    for (SQLitePeer* peer : _peerList) {
+        if (peer->version.load() != leaderVersion || peer->state.load() != SQLiteNodeState::FOLLOWING) {
+            continue;
+        }
+        if (peer->commitCount >= minCommitCount && (!freshestPeer || peer->commitCount > freshestPeer->commitCount)) {
+            freshestPeer = peer;
+        }
+    }
+    return freshestPeer ? freshestPeer->name : "";
+}
+
+uint64_t SQLiteNode::getHeadCommitCount() const {
+    lock_guard<mutex> lock(_commitTimesMutex);
+    return max(_commitTimes.empty() ? 0 : _commitTimes.back().first, _db.getCommitCount());
+}
+
+uint64_t SQLiteNode::getStalenessMS(uint64_t commitCount) const {
+    lock_guard<mutex> lock(_commitTimesMutex);
+    auto it = upper_bound(_commitTimes.begin(), _commitTimes.end(), commitCount, [](uint64_t count, const pair<uint64_t, uint64_t>& entry) {
+        return count < entry.first;
+    });
+    if (it == _commitTimes.end()) {
+        return 0;
+    }
+    return (STimeNow() - it->second) / 1000;
+}
+
+void SQLiteNode::_recordHeadCommitCount(uint64_t commitCount) {
+    lock_guard<mutex> lock(_commitTimesMutex);
+    if (_commitTimes.empty() || commitCount > _commitTimes.back().first) {
+        _commitTimes.emplace_back(commitCount, STimeNow());
+        if (_commitTimes.size() > MAX_COMMIT_TIMES) {
+            _commitTimes.pop_front();
+        }
+    }
+}
+
 string SQLiteNode::getEligibleFollowerForForwardingAddress() const {
     vector<string> validPeers;
     const string leaderVersion = getLeaderVersion();
@@ -530,6 +609,7 @@ string SQLiteNode::getEligibleFollowerForForwardingAddress() const {
 // Each state transitions according to the following events and operates as follows:
 bool SQLiteNode::update() {
     unique_lock<decltype(_stateMutex)> uniqueLock(_stateMutex);
+    _recordHeadCommitCount(_db.getCommitCount());
 
     // Process the database state machine
     switch (_state) {
@@ -1076,6 +1156,10 @@ bool SQLiteNode::update() {
                 transaction.set("ID", _lastSentTransactionID + 1);
             }
             transaction.content = _db.getUncommittedQuery();
+            const string tables = _db.getReplicationTables();
+            if (!tables.empty()) {
+                transaction["Tables"] = tables;
+            }
 
             for (auto peer : _peerList) {
                 // Clear the response flag from the last transaction
@@ -1211,6 +1295,16 @@ bool SQLiteNode::update() {
             return true; // Re-update
         }
 
+        // Let the other followers know how far we've got. Peers treat a STATE with no change of state as new commits.
+        if (_db.getCommitCount() != _lastBroadcastCommitCount && STimeNow() >= _lastCommitBroadcastTime + COMMIT_BROADCAST_INTERVAL_US) {
+            _lastBroadcastCommitCount = _db.getCommitCount();
+            _lastCommitBroadcastTime = STimeNow();
+            SData state("STATE");
+            state["StateChangeCount"] = to_string(_stateChangeCount);
+            state["State"] = stateName(_state);
+            state["Priority"] = SToStr(_priority);
+            _sendToAllPeers(state);
+        }
         break;
 
     default:
@@ -1235,7 +1329,7 @@ void SQLiteNode::_onMESSAGE(SQLitePeer* peer, const SData& message) {
             SINFO("Received PING from peer '" << peer->name << "'. Sending PONG.");
             SData pong("PONG");
             pong["Timestamp"] = message["Timestamp"];
-            peer->sendMessage(pong.serialize());
+            peer->sendMessage(pong);
             return;
         } else if (SIEquals(message.methodLine, "PONG")) {
             // Latency must be > 0 because we treat 0 as "not connected".
@@ -1255,6 +1349,7 @@ void SQLiteNode::_onMESSAGE(SQLitePeer* peer, const SData& message) {
             peer->commandAddress = message["commandAddress"];
         }
         peer->setCommit(message.calcU64("CommitCount"), message["Hash"]);
+        _recordHeadCommitCount(peer->commitCount);
 
         // If we're leading, see if this peer meets the definition of "up-to-date", which is to say, it's close enough to in-sync with us.
         // We can skip checking if the peer is a permafollower, because we don't care about his state.
@@ -1324,6 +1419,9 @@ void SQLiteNode::_onMESSAGE(SQLitePeer* peer, const SData& message) {
             peer->version = message["Version"];
             peer->state = stateFromName(message["State"]);
 
+            // Peers that can read the binary format say so, and we only send it to them. We accept either format.
+            peer->binaryProtocol = message.calc("BinaryProtocol") >= SQLitePeer::BINARY_PROTOCOL_VERSION;
+
             // Let the server know that a peer has logged in.
             _server.onNodeLogin(peer);
         } else if (!peer->loggedIn) {
@@ -1566,7 +1664,7 @@ void SQLiteNode::_onMESSAGE(SQLitePeer* peer, const SData& message) {
                         PWARN("Error processing message '" << message.methodLine << "' (" << e.what() << "), reconnecting.");
                         SData reconnect("RECONNECT");
                         reconnect["Reason"] = e.what();
-                        peer->sendMessage(reconnect.serialize());
+                        peer->sendMessage(reconnect);
                         peer->shutdownSocket();
                     }
 
@@ -1703,6 +1801,16 @@ void SQLiteNode::_onMESSAGE(SQLitePeer* peer, const SData& message) {
             if (_replicationThreadsShouldExit) {
                 SINFO("Discarding replication message, stopping FOLLOWING");
             } else {
+                // Record which tables each transaction uses before starting its thread, so that every transaction's
+                // thread can see the tables of all the transactions before it.
+                if (SIEquals(message.methodLine, "BEGIN_TRANSACTION")) {
+                    set<string> tables;
+                    for (const string& table : SParseList(message["Tables"])) {
+                        tables.insert(STrim(table));
+                    }
+                    lock_guard<mutex> lock(_replicationTablesMutex);
+                    _replicationTables[message.calcU64("NewCount")] = move(tables);
+                }
                 auto threadID = _replicationThreadCount.fetch_add(1);
                 SDEBUG("Spawning concurrent replicate thread (blocks until DB handle available): " << threadID);
                 try {
@@ -1772,7 +1880,7 @@ void SQLiteNode::_onMESSAGE(SQLitePeer* peer, const SData& message) {
         PWARN("Error processing message '" << message.methodLine << "' (" << e.what() << "), reconnecting.");
         SData reconnect("RECONNECT");
         reconnect["Reason"] = e.what();
-        peer->sendMessage(reconnect.serialize());
+        peer->sendMessage(reconnect);
         peer->shutdownSocket();
     }
 }
@@ -1787,6 +1895,7 @@ void SQLiteNode::_onConnect(SQLitePeer* peer) {
     login["State"] = stateName(_state);
     login["Version"] = _version;
     login["Permafollower"] = _originalPriority ? "false" : "true";
+    login["BinaryProtocol"] = to_string(SQLitePeer::BINARY_PROTOCOL_VERSION);
     _sendToPeer(peer, login);
 }
 
@@ -1888,18 +1997,32 @@ void SQLiteNode::_sendToPeer(SQLitePeer* peer, const SData& message) {
     // We can treat this whole function as atomic and thread-safe as it sends data to a peer with it's own atomic
     // `sendMessage` and the peer itself (assuming it's something from _peerList, which, if not, don't do that) is
     // const and will exist without changing until destruction.
-    peer->sendMessage(_addPeerHeaders(message).serialize());
+    peer->sendMessage(_addPeerHeaders(message));
 }
 
 void SQLiteNode::_sendToAllPeers(const SData& message, bool subscribedOnly) {
-    const string serializedMessage = _addPeerHeaders(message).serialize();
+    const SData fullMessage = _addPeerHeaders(message);
+
+    // Serialize the message once in each format that's in use, rather than once per peer. Every peer's socket then
+    // queues a reference to the same buffer, so large transactions aren't copied once per follower.
+    bool needText = false;
+    bool needBinary = false;
+    for (auto peer : _peerList) {
+        if (!subscribedOnly || peer->subscribed) {
+            (peer->binaryProtocol ? needBinary : needText) = true;
+        }
+    }
+    const SSharedBuffer serializedText = needText ? make_shared<const string>(fullMessage.serialize()) : nullptr;
+    const SSharedBuffer serializedBinary = needBinary ? make_shared<const string>(SQLitePeer::serializeBinary(fullMessage)) : nullptr;
 
     // Loop across all connected peers and send the message. _peerList is const so this is thread-safe.
     for (auto peer : _peerList) {
         // This check is strictly thread-safe, as SQLitePeer::subscribed is atomic, but there's still a race condition
-        // around checking subscribed and then sending, as subscribed could technically change.
+        // around checking subscribed and then sending, as subscribed could technically change. The same goes for
+        // binaryProtocol, which is why the peer picks the buffer itself, and serializes the message for just itself if
+        // its format changed since we checked above.
         if (!subscribedOnly || peer->subscribed) {
-            peer->sendMessage(serializedMessage);
+            peer->sendMessage(fullMessage, serializedText, serializedBinary);
         }
     }
 }
@@ -1938,6 +2061,10 @@ void SQLiteNode::_changeState(SQLiteNodeState newState) {
             // Guaranteed to be done right now.
             _localCommitNotifier.reset();
             _leaderCommitNotifier.reset();
+            {
+                lock_guard<mutex> lock(_replicationTablesMutex);
+                _replicationTables.clear();
+            }
 
             // We have no leader anymore.
             _leadPeer = nullptr;
@@ -2602,7 +2729,7 @@ void SQLiteNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
             {
                 SData login("NODE_LOGIN");
                 login["Name"] = _name;
-                peer->sendMessage(login.serialize());
+                peer->sendMessage(login);
                 _sendPING(peer);
                 _onConnect(peer);
             }
@@ -2611,7 +2738,7 @@ void SQLiteNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
             {
                 SData reconnect("RECONNECT");
                 reconnect["Reason"] = "socket error";
-                peer->sendMessage(reconnect.serialize());
+                peer->sendMessage(reconnect);
                 peer->shutdownSocket();
             }
             break;
@@ -2663,7 +2790,7 @@ void SQLiteNode::_sendPING(SQLitePeer* peer) {
     SASSERT(peer);
     SData ping("PING");
     ping["Timestamp"] = SToStr(STimeNow());
-    peer->sendMessage(ping.serialize());
+    peer->sendMessage(ping);
 }
 
 SQLitePeer* SQLiteNode::getPeerByName(const string& name) const {
@@ -109,13 +109,25 @@ class SQLiteNode : public STCPManager {
     // Can block.
     const string getLeaderVersion() const;
 
-    // Gets a copy of the peer state as an STable.
+    // Gets a copy of the peer state as an STable, including each peer's lag (see `getStalenessMS`).
     // Can block.
     list<STable> getPeerInfo() const;
 
     // Gets a random follower peer that is in the same version as leader.
     string getEligibleFollowerForForwardingAddress() const;
 
+    // Gets the name of the follower with the most commits, if it's in the same version as leader and has at least
+    // `minCommitCount` commits. Returns an empty string if there's no such follower.
+    string getFreshestFollower(uint64_t minCommitCount) const;
+
+    // Returns the highest commit count we know of in the cluster, from our own DB or any peer.
+    // Does not block.
+    uint64_t getHeadCommitCount() const;
+
+    // Returns how stale a DB at `commitCount` is: the time in ms since the cluster first reached a commit count
+    // higher than that, or 0 if there is none. This is how replication lag is measured for both this node and peers.
+    uint64_t getStalenessMS(uint64_t commitCount) const;
+
     // Returns our current priority.
     // Does not block.
     int getPriority() const;
@@ -243,7 +255,8 @@ class SQLiteNode : public STCPManager {
     // ROLLBACK_TRANSACTION and COMMIT_TRANSACTION are trivial, they record the new highest commit number from LEADER,
     // or instruct the node to go SEARCHING and reconnect if a distributed ROLLBACK happens.
     //
-    // BEGIN_TRANSACTION is where the interesting case is. This starts all transactions in parallel, and then waits
+    // BEGIN_TRANSACTION is where the interesting case is. This starts all transactions in parallel (as soon as no
+    // earlier, uncommitted transaction uses any of the same tables, see `_replicationStartCount`), and then waits
     // until each previous transaction is committed such that the final commit order matches LEADER. It also handles
     // commit conflicts by re-running the transaction from the beginning. Most of the logic for making sure
     // transactions are ordered correctly is done in `SQLiteSequentialNotifier`, which is worth reading.
@@ -252,6 +265,13 @@ class SQLiteNode : public STCPManager {
     // which happens when a node stops FOLLOWING.
     void _replicate(SQLitePeer* peer, SData command, size_t sqlitePoolIndex, uint64_t threadAttemptStartTimestamp);
 
+    // Returns the commit count a replicated transaction needs the DB to reach before it can begin. This is
+    // `waitForCount`, unless every transaction between the current commit count and `waitForCount` uses different
+    // tables to transaction `newCount`, in which case it can begin earlier and run in parallel with them. Commits
+    // still happen in order, and if the transaction does conflict with an earlier one (for instance on a page both
+    // allocated), its commit fails and it's re-run in order like any other conflict.
+    uint64_t _replicationStartCount(uint64_t newCount, uint64_t waitForCount);
+
     // Replicates any transactions that have been made on our database by other threads to peers.
     void _sendOutstandingTransactions(const set<uint64_t>& commitOnlyIDs = {});
     void _sendPING(SQLitePeer* peer);
@@ -320,6 +340,28 @@ class SQLiteNode : public STCPManager {
     SQLiteSequentialNotifier _leaderCommitNotifier;
     SQLiteSequentialNotifier _localCommitNotifier;
 
+    // Records the first time we saw the cluster reach `commitCount`, for `getStalenessMS`.
+    void _recordHeadCommitCount(uint64_t commitCount);
+
+    // Pairs of commit counts and the times we first saw them, in increasing order, bounded by MAX_COMMIT_TIMES.
+    static constexpr size_t MAX_COMMIT_TIMES = 100'000;
+    mutable mutex _commitTimesMutex;
+    deque<pair<uint64_t, uint64_t>> _commitTimes;
+
+    // Followers otherwise only hear from each other when their state changes, so while following, we re-send our
+    // STATE to every peer when our commit count has moved on, at most once per COMMIT_BROADCAST_INTERVAL_US. This is
+    // how a follower that's fallen behind knows which of the others it can forward reads to (see
+    // `getFreshestFollower`). Only the sync thread uses these.
+    static constexpr uint64_t COMMIT_BROADCAST_INTERVAL_US = 100'000;
+    uint64_t _lastBroadcastCommitCount = 0;
+    uint64_t _lastCommitBroadcastTime = 0;
+
+    // The tables used by each replicated transaction we've received but not yet committed, by commit count, as sent by
+    // leader in the `Tables` header. An empty set means the tables aren't known, and the transaction needs to be
+    // treated as using every table.
+    mutex _replicationTablesMutex;
+    map<uint64_t, set<string>> _replicationTables;
+
     // We can spin up threads to handle responding to `SYNCHRONIZE` messages out-of-band. We want to make sure we don't
     // shut down in the middle of running these, so we keep a count of them.
     atomic<size_t> _pendingSynchronizeResponses = 0;
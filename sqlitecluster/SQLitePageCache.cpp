@@ -0,0 +1,383 @@
+#include "SQLitePageCache.h"
+
+#include <sys/mman.h>
+
+// A cached page. It sits at the start of its slot in an arena, followed by the page itself and then SQLite's extra
+// data, which `base` points to. `base` has to be first, as SQLite gives us back a pointer to it.
+struct SQLitePageCache::Page {
+    sqlite3_pcache_page base;
+    unsigned key;
+    bool pinned;
+    Page* hashNext;
+    Page* lruPrev;
+    Page* lruNext;
+};
+
+// Slots of a single size, carved out of large mappings. Free slots are kept in a list threaded through their first
+// word.
+struct SQLitePageCache::Arena {
+    Arena(size_t size) : slotSize(size), freeList(nullptr), next(nullptr), end(nullptr) { }
+    const size_t slotSize;
+    mutex m;
+    void* freeList;
+    char* next;
+    char* end;
+};
+
+struct SQLitePageCache::Cache {
+    Cache(int sizePage, int sizeExtra, bool isPurgeable, Arena& slotArena)
+      : szPage(sizePage), szExtra(sizeExtra), purgeable(isPurgeable), arena(slotArena), maxPages(0), pageCount(0),
+        buckets(64, nullptr)
+    {
+        // The LRU list is circular through `lru`, with the least recently used page at `lru.lruNext`.
+        lru.lruPrev = &lru;
+        lru.lruNext = &lru;
+    }
+    const int szPage;
+    const int szExtra;
+    const bool purgeable;
+    Arena& arena;
+    unsigned maxPages;
+    unsigned pageCount;
+
+    // Chained hash table of every page, by key. Always a power of two in size.
+    vector<Page*> buckets;
+    Page lru;
+};
+
+sqlite3_pcache_methods2 SQLitePageCache::_methods = {
+    2,
+    nullptr,
+    SQLitePageCache::_init,
+    SQLitePageCache::_shutdown,
+    SQLitePageCache::_create,
+    SQLitePageCache::_cachesize,
+    SQLitePageCache::_pagecount,
+    SQLitePageCache::_fetch,
+    SQLitePageCache::_unpin,
+    SQLitePageCache::_rekey,
+    SQLitePageCache::_truncate,
+    SQLitePageCache::_destroy,
+    SQLitePageCache::_shrink,
+};
+sqlite3_pcache_methods2 SQLitePageCache::_defaultMethods;
+bool SQLitePageCache::_installed = false;
+mutex SQLitePageCache::_arenasMutex;
+list<SQLitePageCache::Arena> SQLitePageCache::_arenas;
+bool SQLitePageCache::_hugePages = false;
+atomic<uint64_t> SQLitePageCache::_budgetBytes(0);
+atomic<uint64_t> SQLitePageCache::_usedBytes(0);
+atomic<uint64_t> SQLitePageCache::_mappedBytes(0);
+atomic<uint64_t> SQLitePageCache::_hugePageBytes(0);
+atomic<uint64_t> SQLitePageCache::_cacheCount(0);
+
+bool SQLitePageCache::install(uint64_t budgetBytes, bool hugePages) {
+    if (_installed) {
+        return true;
+    }
+    if (sqlite3_config(SQLITE_CONFIG_GETPCACHE2, &_defaultMethods) != SQLITE_OK ||
+        sqlite3_config(SQLITE_CONFIG_PCACHE2, &_methods) != SQLITE_OK) {
+        SWARN("Couldn't install arena page cache.");
+        return false;
+    }
+    _budgetBytes = budgetBytes;
+    _hugePages = hugePages;
+    _installed = true;
+    SINFO("Installed arena page cache, budget " << budgetBytes << " bytes" << (hugePages ? ", with huge pages." : "."));
+    return true;
+}
+
+bool SQLitePageCache::uninstall() {
+    if (!_installed) {
+        return true;
+    }
+    if (sqlite3_config(SQLITE_CONFIG_PCACHE2, &_defaultMethods) != SQLITE_OK) {
+        SWARN("Couldn't restore default page cache.");
+        return false;
+    }
+    _installed = false;
+    return true;
+}
+
+bool SQLitePageCache::installed() {
+    return _installed;
+}
+
+void SQLitePageCache::setBudget(uint64_t budgetBytes) {
+    _budgetBytes = budgetBytes;
+}
+
+STable SQLitePageCache::getInfo() {
+    STable info;
+    info["budgetBytes"] = to_string(_budgetBytes.load());
+    info["usedBytes"] = to_string(_usedBytes.load());
+    info["mappedBytes"] = to_string(_mappedBytes.load());
+    info["hugePageBytes"] = to_string(_hugePageBytes.load());
+    info["caches"] = to_string(_cacheCount.load());
+    return info;
+}
+
+int SQLitePageCache::_init(void*) {
+    return SQLITE_OK;
+}
+
+void SQLitePageCache::_shutdown(void*) {
+}
+
+sqlite3_pcache* SQLitePageCache::_create(int szPage, int szExtra, int bPurgeable) {
+    // Keep every part of the slot 8-byte aligned.
+    const size_t slotSize = sizeof(Page) + ((szPage + 7) & ~7) + ((szExtra + 7) & ~7);
+    Arena* arena = nullptr;
+    {
+        lock_guard<mutex> lock(_arenasMutex);
+        for (Arena& existing : _arenas) {
+            if (existing.slotSize == slotSize) {
+                arena = &existing;
+                break;
+            }
+        }
+        if (!arena) {
+            arena = &_arenas.emplace_back(slotSize);
+        }
+    }
+    _cacheCount++;
+    return (sqlite3_pcache*)new Cache(szPage, szExtra, bPurgeable, *arena);
+}
+
+void SQLitePageCache::_cachesize(sqlite3_pcache* pCache, int nCachesize) {
+    Cache& cache = *(Cache*)pCache;
+    cache.maxPages = max(nCachesize, 0);
+    _enforceLimits(cache);
+}
+
+int SQLitePageCache::_pagecount(sqlite3_pcache* pCache) {
+    return ((Cache*)pCache)->pageCount;
+}
+
+sqlite3_pcache_page* SQLitePageCache::_fetch(sqlite3_pcache* pCache, unsigned key, int createFlag) {
+    Cache& cache = *(Cache*)pCache;
+    Page* page = _find(cache, key);
+    if (page) {
+        if (!page->pinned) {
+            _lruRemove(page);
+            page->pinned = true;
+        }
+        return &page->base;
+    }
+    if (!createFlag) {
+        return nullptr;
+    }
+
+    // At our limit, reuse our least recently used page. If every page is pinned, `createFlag` 1 means we can say no,
+    // and SQLite will write out some dirty pages and try again with 2, which means we have to go over.
+    if (_atLimit(cache, cache.arena.slotSize) && cache.lru.lruNext != &cache.lru) {
+        page = cache.lru.lruNext;
+        _lruRemove(page);
+        _hashRemove(cache, page);
+    } else if (_atLimit(cache, cache.arena.slotSize) && createFlag == 1) {
+        return nullptr;
+    } else {
+        page = _allocatePage(cache);
+        if (!page) {
+            return nullptr;
+        }
+    }
+    page->key = key;
+    page->pinned = true;
+
+    // SQLite requires the start of the extra data to be zeroed for a new page.
+    *(void**)page->base.pExtra = nullptr;
+    _hashInsert(cache, page);
+    return &page->base;
+}
+
+void SQLitePageCache::_unpin(sqlite3_pcache* pCache, sqlite3_pcache_page* pPage, int discard) {
+    Cache& cache = *(Cache*)pCache;
+    Page* page = (Page*)pPage;
+    page->pinned = false;
+    if (discard) {
+        _hashRemove(cache, page);
+        _freePage(cache, page);
+    } else {
+        _lruAppend(cache, page);
+        _enforceLimits(cache);
+    }
+}
+
+void SQLitePageCache::_rekey(sqlite3_pcache* pCache, sqlite3_pcache_page* pPage, unsigned oldKey, unsigned newKey) {
+    Cache& cache = *(Cache*)pCache;
+    Page* page = (Page*)pPage;
+
+    // Anything already at `newKey` is discarded. SQLite guarantees it's not pinned.
+    Page* existing = _find(cache, newKey);
+    if (existing) {
+        if (!existing->pinned) {
+            _lruRemove(existing);
+        }
+        _hashRemove(cache, existing);
+        _freePage(cache, existing);
+    }
+    _hashRemove(cache, page);
+    page->key = newKey;
+    _hashInsert(cache, page);
+}
+
+void SQLitePageCache::_truncate(sqlite3_pcache* pCache, unsigned iLimit) {
+    Cache& cache = *(Cache*)pCache;
+    for (Page*& bucket : cache.buckets) {
+        Page** link = &bucket;
+        while (*link) {
+            Page* page = *link;
+            if (page->key >= iLimit) {
+                *link = page->hashNext;
+                if (!page->pinned) {
+                    _lruRemove(page);
+                }
+                _freePage(cache, page);
+            } else {
+                link = &page->hashNext;
+            }
+        }
+    }
+}
+
+void SQLitePageCache::_destroy(sqlite3_pcache* pCache) {
+    Cache* cache = (Cache*)pCache;
+    _truncate(pCache, 0);
+    delete cache;
+    _cacheCount--;
+}
+
+void SQLitePageCache::_shrink(sqlite3_pcache* pCache) {
+    Cache& cache = *(Cache*)pCache;
+    while (cache.lru.lruNext != &cache.lru) {
+        Page* page = cache.lru.lruNext;
+        _lruRemove(page);
+        _hashRemove(cache, page);
+        _freePage(cache, page);
+    }
+}
+
+bool SQLitePageCache::_atLimit(const Cache& cache, size_t extraBytes) {
+    return cache.purgeable && (cache.pageCount >= cache.maxPages || _overBudget(cache, extraBytes));
+}
+
+bool SQLitePageCache::_overBudget(const Cache& cache, size_t extraBytes) {
+    // Only caches with more than their share of the budget give up pages, so that idle handles holding on to pages
+    // don't leave busy ones without any.
+    const uint64_t budget = _budgetBytes;
+    return budget && _usedBytes + extraBytes > budget &&
+           (uint64_t)cache.pageCount * cache.arena.slotSize >= budget / max<uint64_t>(_cacheCount, 1);
+}
+
+void SQLitePageCache::_enforceLimits(Cache& cache) {
+    while (cache.purgeable && cache.lru.lruNext != &cache.lru &&
+           (cache.pageCount > cache.maxPages || _overBudget(cache, 0))) {
+        Page* page = cache.lru.lruNext;
+        _lruRemove(page);
+        _hashRemove(cache, page);
+        _freePage(cache, page);
+    }
+}
+
+SQLitePageCache::Page* SQLitePageCache::_find(const Cache& cache, unsigned key) {
+    Page* page = cache.buckets[key & (cache.buckets.size() - 1)];
+    while (page && page->key != key) {
+        page = page->hashNext;
+    }
+    return page;
+}
+
+void SQLitePageCache::_hashInsert(Cache& cache, Page* page) {
+    // Keep chains short by doubling the table once there are more pages than buckets.
+    if (cache.pageCount > cache.buckets.size()) {
+        vector<Page*> buckets(cache.buckets.size() * 2, nullptr);
+        for (Page* chain : cache.buckets) {
+            while (chain) {
+                Page* next = chain->hashNext;
+                Page*& bucket = buckets[chain->key & (buckets.size() - 1)];
+                chain->hashNext = bucket;
+                bucket = chain;
+                chain = next;
+            }
+        }
+        cache.buckets.swap(buckets);
+    }
+    Page*& bucket = cache.buckets[page->key & (cache.buckets.size() - 1)];
+    page->hashNext = bucket;
+    bucket = page;
+}
+
+void SQLitePageCache::_hashRemove(Cache& cache, Page* page) {
+    Page** link = &cache.buckets[page->key & (cache.buckets.size() - 1)];
+    while (*link != page) {
+        link = &(*link)->hashNext;
+    }
+    *link = page->hashNext;
+}
+
+void SQLitePageCache::_lruAppend(Cache& cache, Page* page) {
+    page->lruPrev = cache.lru.lruPrev;
+    page->lruNext = &cache.lru;
+    cache.lru.lruPrev->lruNext = page;
+    cache.lru.lruPrev = page;
+}
+
+void SQLitePageCache::_lruRemove(Page* page) {
+    page->lruPrev->lruNext = page->lruNext;
+    page->lruNext->lruPrev = page->lruPrev;
+}
+
+SQLitePageCache::Page* SQLitePageCache::_allocatePage(Cache& cache) {
+    Arena& arena = cache.arena;
+    void* slot = nullptr;
+    {
+        lock_guard<mutex> lock(arena.m);
+        if (arena.freeList) {
+            slot = arena.freeList;
+            arena.freeList = *(void**)slot;
+        } else {
+            if (arena.next + arena.slotSize > arena.end) {
+                // Explicit huge pages only work if the system has some reserved, so fall back to asking for
+                // transparent ones.
+                void* chunk = MAP_FAILED;
+                if (_hugePages) {
+                    chunk = mmap(nullptr, ARENA_CHUNK_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+                    if (chunk != MAP_FAILED) {
+                        _hugePageBytes += ARENA_CHUNK_BYTES;
+                    }
+                }
+                if (chunk == MAP_FAILED) {
+                    chunk = mmap(nullptr, ARENA_CHUNK_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                    if (chunk == MAP_FAILED) {
+                        SWARN("Couldn't map " << ARENA_CHUNK_BYTES << " bytes for page cache arena.");
+                        return nullptr;
+                    }
+                    if (_hugePages) {
+                        madvise(chunk, ARENA_CHUNK_BYTES, MADV_HUGEPAGE);
+                    }
+                }
+                _mappedBytes += ARENA_CHUNK_BYTES;
+                arena.next = (char*)chunk;
+                arena.end = arena.next + ARENA_CHUNK_BYTES;
+            }
+            slot = arena.next;
+            arena.next += arena.slotSize;
+        }
+    }
+    _usedBytes += arena.slotSize;
+    cache.pageCount++;
+    Page* page = (Page*)slot;
+    page->base.pBuf = (char*)slot + sizeof(Page);
+    page->base.pExtra = (char*)page->base.pBuf + ((cache.szPage + 7) & ~7);
+    return page;
+}
+
+void SQLitePageCache::_freePage(Cache& cache, Page* page) {
+    Arena& arena = cache.arena;
+    cache.pageCount--;
+    _usedBytes -= arena.slotSize;
+    lock_guard<mutex> lock(arena.m);
+    *(void**)page = arena.freeList;
+    arena.freeList = page;
+}
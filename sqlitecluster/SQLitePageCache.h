@@ -0,0 +1,107 @@
+#pragma once
+#include <atomic>
+#include <list>
+#include <mutex>
+
+#include <libstuff/libstuff.h>
+#include <libstuff/sqlite3.h>
+
+// A page cache for SQLite (see https://sqlite.org/c3ref/pcache_methods2.html) that keeps pages in large arenas instead
+// of allocating each one separately from the heap. Pages of the same size are packed next to each other in 64MB
+// mappings, which can be backed by huge pages, so a large hot working set is spread over far fewer TLB entries.
+//
+// Each DB handle's cache is only ever used by the thread running that handle, so lookups, pinning and the LRU list
+// need no locking. Only getting a page from, or returning one to, an arena takes a lock, and that happens on a cache
+// miss, when we're about to read from disk anyway.
+//
+// Each handle's cache is limited by its `cache_size`, as usual. On top of that, there's an optional budget for all of
+// them together. When it's exceeded, handles using more than their share of it reuse their own least recently used
+// pages rather than taking more from the arenas. Memory for the arenas is mapped as needed and reused, but never
+// returned to the system.
+//
+// The two limits are independent, and a handle stops growing at whichever it reaches first. `-cacheBudget` (see
+// `SQLite::setCacheBudget`) only sets each handle's `cache_size`, by splitting a total between the handles open on a
+// DB file, and works the same with or without these arenas. The arena budget (`-arenaPageCacheMB`) is in bytes actually
+// held, and covers every handle in the process, including ones `-cacheBudget` doesn't count, like backups. With
+// the arenas, the usual setup is to set only `-arenaPageCacheMB`, with `-cacheSize` at least as large as a handle's
+// share of it. If both are set, the smaller of `-cacheBudget` and the arena budget is the effective total.
+//
+// Arena memory is first touched by the thread that takes each page, so with the default Linux memory policy, a
+// handle's pages are allocated on the NUMA node of the thread using it.
+class SQLitePageCache {
+  public:
+    // Registers the cache with SQLite, with a budget of `budgetBytes` for all handles together (0 for no budget). If
+    // `hugePages` is set, arenas are mapped with `MAP_HUGETLB` when the system has huge pages reserved, and otherwise
+    // are advised to use transparent huge pages. Must be called before `sqlite3_initialize`, or after
+    // `sqlite3_shutdown`. Returns false if SQLite refused it.
+    static bool install(uint64_t budgetBytes, bool hugePages);
+
+    // Puts back SQLite's built-in page cache. Same requirements as `install`.
+    static bool uninstall();
+
+    // Returns whether the cache is installed.
+    static bool installed();
+
+    // Changes the budget. Handles over their share give up pages as they use them.
+    static void setBudget(uint64_t budgetBytes);
+
+    // Returns memory mapped and in use, the budget, and the number of caches, for Status.
+    static STable getInfo();
+
+  private:
+    struct Page;
+    struct Cache;
+    struct Arena;
+
+    // Size of each mapping an arena carves pages from. A multiple of the 2MB huge page size.
+    static constexpr size_t ARENA_CHUNK_BYTES = 64 * 1024 * 1024;
+
+    // `sqlite3_pcache_methods2` implementation.
+    static int _init(void*);
+    static void _shutdown(void*);
+    static sqlite3_pcache* _create(int szPage, int szExtra, int bPurgeable);
+    static void _cachesize(sqlite3_pcache* pCache, int nCachesize);
+    static int _pagecount(sqlite3_pcache* pCache);
+    static sqlite3_pcache_page* _fetch(sqlite3_pcache* pCache, unsigned key, int createFlag);
+    static void _unpin(sqlite3_pcache* pCache, sqlite3_pcache_page* pPage, int discard);
+    static void _rekey(sqlite3_pcache* pCache, sqlite3_pcache_page* pPage, unsigned oldKey, unsigned newKey);
+    static void _truncate(sqlite3_pcache* pCache, unsigned iLimit);
+    static void _destroy(sqlite3_pcache* pCache);
+    static void _shrink(sqlite3_pcache* pCache);
+
+    // Returns whether `cache` should reuse one of its own pages rather than take `extraBytes` more from its arena.
+    static bool _atLimit(const Cache& cache, size_t extraBytes);
+
+    // Returns whether taking `extraBytes` more would put us over the budget, and `cache` has at least its share.
+    static bool _overBudget(const Cache& cache, size_t extraBytes);
+
+    // Gives `cache`'s least recently used pages back to its arena until it's under its limits.
+    static void _enforceLimits(Cache& cache);
+
+    // Hash table and LRU list maintenance for a cache's pages.
+    static Page* _find(const Cache& cache, unsigned key);
+    static void _hashInsert(Cache& cache, Page* page);
+    static void _hashRemove(Cache& cache, Page* page);
+    static void _lruAppend(Cache& cache, Page* page);
+    static void _lruRemove(Page* page);
+
+    // Takes a new page from `cache`'s arena, or returns one to it.
+    static Page* _allocatePage(Cache& cache);
+    static void _freePage(Cache& cache, Page* page);
+
+    // The methods we registered, and the ones SQLite had before, to put back in `uninstall`.
+    static sqlite3_pcache_methods2 _methods;
+    static sqlite3_pcache_methods2 _defaultMethods;
+    static bool _installed;
+
+    // Arenas by page slot size. A list, so they never move once created.
+    static mutex _arenasMutex;
+    static list<Arena> _arenas;
+
+    static bool _hugePages;
+    static atomic<uint64_t> _budgetBytes;
+    static atomic<uint64_t> _usedBytes;
+    static atomic<uint64_t> _mappedBytes;
+    static atomic<uint64_t> _hugePageBytes;
+    static atomic<uint64_t> _cacheCount;
+};
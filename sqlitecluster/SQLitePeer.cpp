@@ -6,6 +6,33 @@
 #undef SLOGPREFIX
 #define SLOGPREFIX "{" << name << "} "
 
+const vector<string> SQLitePeer::_binaryHeaderNames = {
+    "CommitCount",
+    "Hash",
+    "commandAddress",
+    "ID",
+    "NewCount",
+    "NewHash",
+    "dbCountAtStart",
+    "leaderSendTime",
+    "Response",
+    "Reason",
+    "State",
+    "Priority",
+    "StateChangeCount",
+    "Timestamp",
+    "NumCommits",
+    "Version",
+};
+
+const map<string, uint8_t, STableComp> SQLitePeer::_binaryHeaderIndexes = []() {
+    map<string, uint8_t, STableComp> indexes;
+    for (size_t i = 0; i < _binaryHeaderNames.size(); i++) {
+        indexes[_binaryHeaderNames[i]] = i + 1;
+    }
+    return indexes;
+}();
+
 SQLitePeer::SQLitePeer(const string& name_, const string& host_, const STable& params_, uint64_t id_)
   : commitCount(0),
     host(host_),
@@ -13,6 +40,7 @@ SQLitePeer::SQLitePeer(const string& name_, const string& host_, const STable& p
     name(name_),
     params(params_),
     permaFollower(isPermafollower(params)),
+    binaryProtocol(false),
     latency(0),
     loggedIn(false),
     nextReconnect(0),
@@ -36,6 +64,7 @@ bool SQLitePeer::connected() const {
 
 void SQLitePeer::reset() {
     lock_guard<decltype(peerMutex)> lock(peerMutex);
+    binaryProtocol = false;
     latency = 0;
     loggedIn = false;
     priority = 0;
@@ -142,7 +171,19 @@ SData SQLitePeer::popMessage() {
     lock_guard<decltype(peerMutex)> lock(peerMutex);
     if (socket) {
         SData message;
-        size_t size = message.deserialize(socket->recvBuffer);
+        size_t size = 0;
+        if (!socket->recvBuffer.empty() && (uint8_t)socket->recvBuffer.c_str()[0] == BINARY_FRAME_MAGIC) {
+            try {
+                size = deserializeBinary(socket->recvBuffer.c_str(), socket->recvBuffer.size(), message);
+            } catch (const SException& e) {
+                // There's no way to find the start of the next message, so give up on this connection.
+                SWARN("Malformed binary message from peer (" << e.what() << "), closing connection.");
+                socket->shutdown();
+                throw out_of_range("malformed message");
+            }
+        } else {
+            size = message.deserialize(socket->recvBuffer);
+        }
         if (size) {
             socket->recvBuffer.consumeFront(size);
             return message;
@@ -232,10 +273,19 @@ bool SQLitePeer::isPermafollower(const STable& params) {
 }
 
 void SQLitePeer::sendMessage(const SData& message) {
+    sendMessage(message, nullptr, nullptr);
+}
+
+void SQLitePeer::sendMessage(const SData& message, const SSharedBuffer& serializedText, const SSharedBuffer& serializedBinary) {
     lock_guard<decltype(peerMutex)> lock(peerMutex);
     if (socket) {
+        // `binaryProtocol` can change when the peer logs in again, so this has to be read under the lock.
+        SSharedBuffer serialized = binaryProtocol ? serializedBinary : serializedText;
+        if (!serialized) {
+            serialized = make_shared<const string>(binaryProtocol ? serializeBinary(message) : message.serialize());
+        }
         size_t bytesSent = 0;
-        if (socket->send(message.serialize(), &bytesSent)) {
+        if (socket->send(serialized, &bytesSent)) {
             SINFO("No error sending " << message.methodLine << " to peer " << name << " (" << bytesSent << " bytes actually sent).");
         } else {
             SHMMM("Error sending " << message.methodLine << " to peer " << name << ".");
@@ -245,6 +295,123 @@ void SQLitePeer::sendMessage(const SData& message) {
     }
 }
 
+void SQLitePeer::_appendVarint(string& buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer += (char)((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    buffer += (char)value;
+}
+
+uint64_t SQLitePeer::_readVarint(const char*& pos, const char* end) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= end) {
+            STHROW("truncated varint");
+        }
+        const uint8_t byte = *pos++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    STHROW("varint too long");
+}
+
+string SQLitePeer::serializeBinary(const SData& message) {
+    string frame;
+    frame.reserve(6 + 16 + message.methodLine.size() + message.nameValueMap.size() * 32 + message.content.size());
+
+    // The header, with a placeholder for the length that we fill in once we know it.
+    frame += (char)BINARY_FRAME_MAGIC;
+    frame += (char)BINARY_PROTOCOL_VERSION;
+    frame.append(4, '\0');
+
+    _appendVarint(frame, message.methodLine.size());
+    frame += message.methodLine;
+
+    // Content-Length is implied by the frame length.
+    const bool hasContentLength = message.nameValueMap.count("Content-Length");
+    _appendVarint(frame, message.nameValueMap.size() - (hasContentLength ? 1 : 0));
+    for (const auto& [headerName, value] : message.nameValueMap) {
+        if (SIEquals(headerName, "Content-Length")) {
+            continue;
+        }
+        auto index = _binaryHeaderIndexes.find(headerName);
+        if (index != _binaryHeaderIndexes.end()) {
+            frame += (char)index->second;
+        } else {
+            frame += '\0';
+            _appendVarint(frame, headerName.size());
+            frame += headerName;
+        }
+        _appendVarint(frame, value.size());
+        frame += value;
+    }
+    frame += message.content;
+
+    // The length field is 32 bits. Anything that doesn't fit is sent as text, which either peer can read at any time.
+    if (frame.size() - 6 > UINT32_MAX) {
+        return message.serialize();
+    }
+    const uint32_t length = frame.size() - 6;
+    for (int i = 0; i < 4; i++) {
+        frame[2 + i] = (char)((length >> (8 * i)) & 0xFF);
+    }
+    return frame;
+}
+
+size_t SQLitePeer::deserializeBinary(const char* buffer, size_t length, SData& message) {
+    if (length < 6) {
+        return 0;
+    }
+    if ((uint8_t)buffer[0] != BINARY_FRAME_MAGIC) {
+        STHROW("not a binary message");
+    }
+    if ((uint8_t)buffer[1] != BINARY_PROTOCOL_VERSION) {
+        STHROW("unsupported binary message version " + to_string((uint8_t)buffer[1]));
+    }
+    uint32_t frameLength = 0;
+    for (int i = 0; i < 4; i++) {
+        frameLength |= (uint32_t)(uint8_t)buffer[2 + i] << (8 * i);
+    }
+    if (length < 6 + (size_t)frameLength) {
+        return 0;
+    }
+
+    const char* pos = buffer + 6;
+    const char* end = pos + frameLength;
+    auto readString = [&pos, end](string& out) {
+        const uint64_t size = _readVarint(pos, end);
+        if (size > (uint64_t)(end - pos)) {
+            STHROW("truncated string");
+        }
+        out.assign(pos, size);
+        pos += size;
+    };
+
+    message.clear();
+    readString(message.methodLine);
+    const uint64_t headerCount = _readVarint(pos, end);
+    for (uint64_t i = 0; i < headerCount; i++) {
+        if (pos >= end) {
+            STHROW("truncated header");
+        }
+        const uint8_t index = *pos++;
+        string headerName;
+        if (!index) {
+            readString(headerName);
+        } else if (index <= _binaryHeaderNames.size()) {
+            headerName = _binaryHeaderNames[index - 1];
+        } else {
+            STHROW("unknown header index " + to_string(index));
+        }
+        readString(message.nameValueMap[headerName]);
+    }
+    message.content.assign(pos, end - pos);
+    return 6 + frameLength;
+}
+
 ostream& operator<<(ostream& os, const atomic<SQLitePeer::Response>& response)
 {
     os << SQLitePeer::responseName(response.load());
@@ -42,15 +42,45 @@ class SQLitePeer {
     // Reset a peer, as if disconnected and starting the connection over.
     void reset();
 
-    // Pops a message off the *front* of the receive buffer and returns it.
+    // Pops a message off the *front* of the receive buffer and returns it. Messages can be in either the text or binary
+    // format.
     // If there are no messages, throws `std::out_of_range`.
     SData popMessage();
 
     PeerPostPollStatus postPoll(fd_map& fdm, uint64_t& nextActivity);
 
-    // Send a message to this peer. Thread-safe.
+    // Send a message to this peer, in the binary format if the peer supports it. Thread-safe.
     void sendMessage(const SData& message);
 
+    // Send a message that's already been serialized in the text and/or binary formats. This lets the same message be
+    // sent to many peers while only serializing it once, and the socket queues a reference to the serialized message
+    // rather than a copy of it. The format is chosen while holding `peerMutex`, and if the buffer for that format is
+    // null, `message` is serialized for just this peer. Thread-safe.
+    void sendMessage(const SData& message, const SSharedBuffer& serializedText, const SSharedBuffer& serializedBinary);
+
+    // Peer messages are sent as text (as by `SData::serialize`) unless both peers advertise support for the binary
+    // format in their LOGIN messages. A binary message is a frame made up of:
+    //
+    // 1 byte:  BINARY_FRAME_MAGIC, which can't start a text message, so either format can be read at any time.
+    // 1 byte:  The version of the format.
+    // 4 bytes: The length of the rest of the frame, little-endian.
+    // The method line, as a varint length followed by that many bytes.
+    // The number of headers, as a varint, followed by each header as:
+    //   1 byte: An index (starting at 1) into a fixed table of common header names, or 0 for any other name, followed
+    //           by the name as a varint length and bytes.
+    //   The value, as a varint length and bytes.
+    // The content, which is the remainder of the frame.
+    //
+    // Unlike text, this never needs to be scanned for delimiters, and the content is copied as-is.
+    static constexpr uint8_t BINARY_FRAME_MAGIC = 0xFE;
+    static constexpr uint8_t BINARY_PROTOCOL_VERSION = 1;
+    // Messages whose frame would be longer than the 4 byte length allows are returned in the text format instead.
+    static string serializeBinary(const SData& message);
+
+    // Parses a binary message from the front of a buffer. Returns the number of bytes consumed, or 0 if the buffer
+    // doesn't yet contain a complete message. Throws if the buffer contains a malformed message.
+    static size_t deserializeBinary(const char* buffer, size_t length, SData& message);
+
     // Atomically set commit and hash.
     void setCommit(uint64_t count, const string& hashString);
 
@@ -75,6 +105,9 @@ class SQLitePeer {
     const STable params;
     const bool permaFollower;
 
+    // True if this peer advertised support for the binary message format when it logged in.
+    atomic<bool> binaryProtocol;
+
     // An address on which this peer can accept commands. (a.k.a. "private command port")
     atomic<string> commandAddress;
     atomic<uint64_t> latency;
@@ -91,6 +124,15 @@ class SQLitePeer {
     // For initializing the permafollower value from the params list.
     static bool isPermafollower(const STable& params);
 
+    // Header names that are encoded as a single byte in binary messages. This can only be appended to, as the index of
+    // each name is part of the format.
+    static const vector<string> _binaryHeaderNames;
+    static const map<string, uint8_t, STableComp> _binaryHeaderIndexes;
+
+    // Varint encoding for binary messages. `_readVarint` advances `pos`, and throws if the varint runs past `end`.
+    static void _appendVarint(string& buffer, uint64_t value);
+    static uint64_t _readVarint(const char*& pos, const char* end);
+
     // The hash corresponding to commitCount.
     atomic<string> hash;
 
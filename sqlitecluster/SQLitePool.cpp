@@ -2,6 +2,9 @@
 #include "SQLite.h"
 #include "SQLitePool.h"
 
+thread_local const SQLitePool* SQLitePool::_lastPool = nullptr;
+thread_local size_t SQLitePool::_lastIndex = 0;
+
 SQLitePool::SQLitePool(size_t maxDBs,
                        const string& filename,
                        int cacheSize,
@@ -10,24 +13,32 @@ SQLitePool::SQLitePool(size_t maxDBs,
                        const string& synchronous,
                        int64_t mmapSizeGB,
                        bool hctree)
-: _maxDBs(max(maxDBs, 1ul)),
+: _maxDBs(max(maxDBs, 2ul)), // The base DB plus at least one handle to check out.
   _baseDB(filename, cacheSize, maxJournalSize, minJournalTables, synchronous, mmapSizeGB, hctree),
+  _inUse((_maxDBs + 63) / 64),
+  _returnCount(0),
+  _checkoutCount(0),
+  _affinityCount(0),
+  _exhaustedCount(0),
+  _waitTimeUS(0),
   _objects(_maxDBs, nullptr)
 {
+    // The base DB counts against our limit, so the last index is never used.
+    for (size_t index = _maxDBs - 1; index < _inUse.size() * 64; index++) {
+        _inUse[index / 64] |= 1ull << (index % 64);
+    }
 }
 
 SQLitePool::~SQLitePool() {
-    lock_guard<mutex> lock(_sync);
-    if (_inUseHandles.size()) {
-        SWARN("Destroying SQLitePool with DBs in use.");
-    }
-    for (auto dbHandle : _availableHandles) {
-        delete _objects[dbHandle];
-        _objects[dbHandle] = nullptr;
+    for (size_t index = 0; index < _maxDBs - 1; index++) {
+        if (_inUse[index / 64] & (1ull << (index % 64))) {
+            SWARN("Destroying SQLitePool with DBs in use.");
+            break;
+        }
     }
-    for (auto dbHandle : _inUseHandles) {
-        delete _objects[dbHandle];
-        _objects[dbHandle] = nullptr;
+    for (auto& dbHandle : _objects) {
+        delete dbHandle;
+        dbHandle = nullptr;
     }
 }
 
@@ -35,35 +46,59 @@ SQLite& SQLitePool::getBase() {
     return _baseDB;
 }
 
-size_t SQLitePool::getIndex(bool createHandle) {
-    while (true) {
-        unique_lock<mutex> lock(_sync);
-        if (_availableHandles.size()) {
-            // Return an existing handle.
-            auto frontIt = _availableHandles.begin();
-            size_t index = *frontIt;
-            _inUseHandles.insert(index);
-            _availableHandles.erase(frontIt);
-            SDEBUG("Returning existing DB handle");
-            return index;
-        } else if (_availableHandles.size() + _inUseHandles.size() < (_maxDBs - 1)) {
-            size_t index = _availableHandles.size() + _inUseHandles.size();
-            _inUseHandles.insert(index);
+bool SQLitePool::_tryClaim(size_t index) {
+    const uint64_t bit = 1ull << (index % 64);
+    return !(_inUse[index / 64].fetch_or(bit) & bit);
+}
+
+bool SQLitePool::_claimAny(size_t& index) {
+    for (size_t word = 0; word < _inUse.size(); word++) {
+        uint64_t bits = _inUse[word];
+        while (~bits) {
+            const int bit = __builtin_ctzll(~bits);
+            if (_inUse[word].compare_exchange_weak(bits, bits | (1ull << bit))) {
+                index = word * 64 + bit;
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-            // Create a new handle unless we're not supposed to. We unlock here as we're no longer in a position to
-            // change which indices are in use.
-            lock.unlock();
-            if (createHandle) {
-                initializeIndex(index);
+size_t SQLitePool::getIndex(bool createHandle) {
+    _checkoutCount++;
+    size_t index = 0;
+    if (_lastPool == this && _lastIndex < _maxDBs - 1 && _tryClaim(_lastIndex)) {
+        _affinityCount++;
+        index = _lastIndex;
+    } else {
+        uint64_t waitStart = 0;
+        while (true) {
+            // Read this before looking, so a handle returned after we've looked wakes us up.
+            const uint32_t returnCount = _returnCount;
+            if (_claimAny(index)) {
+                break;
             }
-            SINFO("Returning new DB handle: " << index);
-            return index;
-        } else {
+
             // Wait for a handle.
-            SINFO("Waiting for DB handle");
-            _wait.wait(lock);
+            if (!waitStart) {
+                SINFO("Waiting for DB handle");
+                _exhaustedCount++;
+                waitStart = STimeNow();
+            }
+            _returnCount.wait(returnCount);
+        }
+        if (waitStart) {
+            _waitTimeUS += STimeNow() - waitStart;
         }
     }
+
+    // Create a new handle unless we're not supposed to.
+    if (createHandle) {
+        initializeIndex(index);
+    }
+    SDEBUG("Returning DB handle: " << index);
+    return index;
 }
 
 SQLite& SQLitePool::initializeIndex(size_t index) {
@@ -78,13 +113,22 @@ SQLite& SQLitePool::initializeIndex(size_t index) {
 }
 
 void SQLitePool::returnToPool(size_t index) {
-    {
-        lock_guard<mutex> lock(_sync);
-        _availableHandles.insert(index);
-        _inUseHandles.erase(index);
-        SDEBUG("DB handle returned to pool.");
-    }
-    _wait.notify_one();
+    _inUse[index / 64] &= ~(1ull << (index % 64));
+    _lastPool = this;
+    _lastIndex = index;
+    _returnCount++;
+    _returnCount.notify_one();
+    SDEBUG("DB handle returned to pool.");
+}
+
+STable SQLitePool::getInfo() {
+    STable info;
+    info["maxDBs"] = to_string(_maxDBs);
+    info["checkouts"] = to_string(_checkoutCount);
+    info["sameHandleCheckouts"] = to_string(_affinityCount);
+    info["exhaustedCount"] = to_string(_exhaustedCount);
+    info["waitTimeUS"] = to_string(_waitTimeUS);
+    return info;
 }
 
 SQLiteScopedHandle::SQLiteScopedHandle(SQLitePool& pool, size_t index) : _pool(pool), _index(index)
@@ -1,7 +1,6 @@
 #pragma once
 #include <libstuff/libstuff.h>
 #include <sqlitecluster/SQLite.h>
-#include <condition_variable>
 
 class SQLitePool {
   public:
@@ -16,8 +15,10 @@ class SQLitePool {
 
     // Gets an index into the internal data structure for a handle that is marked as "inUse". If there are too many
     // "inUse" handles (maxDBs), this will wait until one is available.
-    // If `createHandle` is true, and all existent handles are in use, but there is space for more handles, this will
-    // create a new one and return it's index.
+    // The calling thread gets back the last handle it returned if that one's free, so workers usually keep using the
+    // same connection, with its page cache already warm. Otherwise, this returns the lowest free index, which favors
+    // handles that already exist over creating new ones.
+    // If `createHandle` is true, and the chosen index has no handle yet, this will create a new one.
     // However, if `creteHandle` is false, this will *not* create the handle, but just reserve the index, and allow the
     // handle to be created later with `initializeIndex` on this slot.
     size_t getIndex(bool createHandle = true);
@@ -28,24 +29,45 @@ class SQLitePool {
     // Return an object to the pool.
     void returnToPool(size_t index);
 
+    // Returns the size of the pool, counts of checkouts, how many of those got the same handle back, how many found the
+    // pool exhausted, and how long they spent waiting, for reporting in Status.
+    STable getInfo();
+
   private:
-    // Synchronization variables.
-    mutex _sync;
-    condition_variable _wait;
+    // Tries to mark `index` as in use, returning true if it was free.
+    bool _tryClaim(size_t index);
+
+    // Tries to claim the lowest free index, returning false if they're all in use.
+    bool _claimAny(size_t& index);
 
     // Internal limit on the number of handles we'll allow. This exists to make sure we don't go over any
-    // system-imposed limits on FDs.
+    // system-imposed limits on FDs. It's at least 2 (the base DB counts against it, so with 1 there'd be no index to
+    // hand out and `getIndex` would wait forever), even if a smaller `maxDBs` is passed in.
     size_t _maxDBs;
 
     // Our base object that all others are based upon.
     SQLite _baseDB;
 
-    // These are indexes into `_objects`.
-    set<size_t> _availableHandles;
-    set<size_t> _inUseHandles;
+    // One bit per index into `_objects`, set while that index is in use. Bits past the last usable index are always
+    // set, so they're never handed out. Claiming and returning an index is a single atomic operation on its word.
+    vector<atomic<uint64_t>> _inUse;
+
+    // Incremented each time a handle is returned, so threads waiting for one can block with `atomic::wait` until that
+    // happens.
+    atomic<uint32_t> _returnCount;
+
+    // Statistics for `getInfo`.
+    atomic<uint64_t> _checkoutCount;
+    atomic<uint64_t> _affinityCount;
+    atomic<uint64_t> _exhaustedCount;
+    atomic<uint64_t> _waitTimeUS;
 
     // This is a vector of pointers to all possibly allocated objects.
     vector<SQLite*> _objects;
+
+    // The last handle this thread returned, and the pool it came from.
+    static thread_local const SQLitePool* _lastPool;
+    static thread_local size_t _lastIndex;
 };
 
 class SQLiteScopedHandle {
@@ -0,0 +1,124 @@
+#include "SQLiteResultCache.h"
+
+SQLiteResultCache::SQLiteResultCache() : _bytes(0), _count(0), _maxBytes(0), _hits(0), _misses(0), _evictions(0)
+{
+}
+
+void SQLiteResultCache::setMaxBytes(size_t maxBytes) {
+    lock_guard<mutex> lock(_mutex);
+    _maxBytes = maxBytes;
+    if (!maxBytes) {
+        _evictions += _count;
+        _entries.clear();
+        _bytes = 0;
+        _count = 0;
+    } else if (!_entries.empty()) {
+        _evict(_entries.rbegin()->first);
+    }
+}
+
+bool SQLiteResultCache::enabled() const {
+    return _maxBytes;
+}
+
+bool SQLiteResultCache::get(uint64_t commitCount, const string& query, SQResult& result, vector<string>& tables) {
+    shared_ptr<const Entry> entry;
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto commitIt = _entries.find(commitCount);
+        if (commitIt != _entries.end()) {
+            auto queryIt = commitIt->second.find(query);
+            if (queryIt != commitIt->second.end()) {
+                entry = queryIt->second;
+            }
+        }
+    }
+    if (!entry) {
+        _misses++;
+        return false;
+    }
+    _hits++;
+    result = entry->result;
+    tables = entry->tables;
+    return true;
+}
+
+void SQLiteResultCache::put(uint64_t commitCount, const string& query, const SQResult& result, const vector<string>& tables) {
+    // Don't let one huge result push everything else out.
+    const size_t bytes = _entrySize(query, result, tables);
+    if (bytes > _maxBytes / 16) {
+        return;
+    }
+    auto entry = make_shared<const Entry>(Entry{result, tables, bytes});
+    lock_guard<mutex> lock(_mutex);
+    if (_entries[commitCount].emplace(query, move(entry)).second) {
+        _bytes += bytes;
+        _count++;
+        _evict(commitCount);
+    }
+}
+
+STable SQLiteResultCache::getInfo() const {
+    STable info;
+    {
+        lock_guard<mutex> lock(_mutex);
+        info["entries"] = to_string(_count);
+        info["bytes"] = to_string(_bytes);
+        info["commitCounts"] = to_string(_entries.size());
+    }
+    const uint64_t hits = _hits;
+    const uint64_t misses = _misses;
+    info["maxBytes"] = to_string(_maxBytes.load());
+    info["hits"] = to_string(hits);
+    info["misses"] = to_string(misses);
+    info["hitRatePercent"] = to_string(hits + misses ? hits * 100 / (hits + misses) : 0);
+    info["evictions"] = to_string(_evictions.load());
+    return info;
+}
+
+size_t SQLiteResultCache::_entrySize(const string& query, const SQResult& result, const vector<string>& tables) {
+    // Counts the characters in each string plus the size of the string object itself, which is close enough.
+    size_t bytes = sizeof(Entry) + query.size() + sizeof(string);
+    for (const string& header : result.headers) {
+        bytes += header.size() + sizeof(string);
+    }
+    for (const auto& row : result.rows) {
+        bytes += sizeof(row);
+        for (const string& value : row) {
+            bytes += value.size() + sizeof(string);
+        }
+    }
+    for (const string& table : tables) {
+        bytes += table.size() + sizeof(string);
+    }
+    return bytes;
+}
+
+void SQLiteResultCache::_evict(uint64_t keepCommitCount) {
+    for (auto it = _entries.begin(); _bytes > _maxBytes && it != _entries.end();) {
+        if (it->first == keepCommitCount) {
+            it++;
+            continue;
+        }
+        for (const auto& [query, entry] : it->second) {
+            _bytes -= entry->bytes;
+        }
+        _count -= it->second.size();
+        _evictions += it->second.size();
+        it = _entries.erase(it);
+    }
+
+    // Everything left is for the commit count we're keeping, so drop entries from it until it fits.
+    auto keepIt = _entries.find(keepCommitCount);
+    if (keepIt != _entries.end()) {
+        while (_bytes > _maxBytes && !keepIt->second.empty()) {
+            _bytes -= keepIt->second.begin()->second->bytes;
+            _count--;
+            _evictions++;
+            keepIt->second.erase(keepIt->second.begin());
+        }
+        if (keepIt->second.empty()) {
+            _entries.erase(keepIt);
+        }
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <libstuff/libstuff.h>
+#include <libstuff/SQResult.h>
+
+// Results of deterministic read queries, shared by every handle for a database, so that commands reading the same
+// snapshot (such as a burst of identical `Get` requests) only run each query once between them.
+//
+// Each result is stored with the commit count of the snapshot it was read from, and only ever returned for that same
+// commit count, so nothing is ever invalidated. Once there are newer commits, new transactions just stop asking for
+// the old entries, and when the cache is over its size limit, it evicts everything for the oldest commit count first.
+class SQLiteResultCache {
+  public:
+    SQLiteResultCache();
+
+    // Sets the size limit, in bytes. 0 disables the cache and empties it.
+    void setMaxBytes(size_t maxBytes);
+
+    // Returns whether the cache has a non-zero size limit.
+    bool enabled() const;
+
+    // Looks up `query` as read at `commitCount`. If it's there, sets `result` and the `tables` the query read, and
+    // returns true.
+    bool get(uint64_t commitCount, const string& query, SQResult& result, vector<string>& tables);
+
+    // Saves `result` of `query`, which read `tables`, as read at `commitCount`.
+    void put(uint64_t commitCount, const string& query, const SQResult& result, const vector<string>& tables);
+
+    // Returns size and hit rate counts for Status.
+    STable getInfo() const;
+
+  private:
+    struct Entry {
+        SQResult result;
+        vector<string> tables;
+        size_t bytes;
+    };
+
+    // Approximate memory used by an entry.
+    static size_t _entrySize(const string& query, const SQResult& result, const vector<string>& tables);
+
+    // Removes entries, oldest commit count first, until we're back under the size limit. Entries for `keepCommitCount`
+    // (the one just added to) go last. Call with `_mutex` locked.
+    void _evict(uint64_t keepCommitCount);
+
+    // Protects `_entries` and `_bytes`. Entries are shared pointers so results are copied out without holding it.
+    mutable mutex _mutex;
+    map<uint64_t, unordered_map<string, shared_ptr<const Entry>>> _entries;
+    size_t _bytes;
+    size_t _count;
+
+    atomic<size_t> _maxBytes;
+    atomic<uint64_t> _hits;
+    atomic<uint64_t> _misses;
+    atomic<uint64_t> _evictions;
+};
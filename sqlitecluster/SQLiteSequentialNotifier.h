@@ -1,7 +1,6 @@
 #pragma once
 #include <libstuff/libstuff.h>
 #include "SQLite.h"
-#include <condition_variable>
 
 class SQLiteSequentialNotifier {
   public:
@@ -18,7 +17,7 @@ class SQLiteSequentialNotifier {
 
     // Blocks until `_value` meets or exceeds `value`, unless an exceptional case (CANCELED, CHEKPOINT_REQUIRED) is
     // hit, and returns the corresponding RESULT.
-    SQLiteSequentialNotifier::RESULT waitFor(uint64_t value, bool insideTransaction);
+    SQLiteSequentialNotifier::RESULT waitFor(uint64_t value);
 
     // Causes any threads waiting for a value up to and including `value` to return `true`.
     void notifyThrough(uint64_t value);
@@ -38,20 +37,20 @@ class SQLiteSequentialNotifier {
     void reset();
 
   private:
-    // This encapsulates the set of values we need to have a thread wait. It's a mutex and condition_variable that the
-    // thread can use to wait, and a result indicating if the required result has actually been reached (because
-    // condition_variables can be spuriously interrupted and need a second `wait()` call).
-    struct WaitState {
-        WaitState() : result(RESULT::UNKNOWN) {}
-        mutex waitingThreadMutex;
-        condition_variable waitingThreadConditionVariable;
-        RESULT result;
+    // Waiting threads are grouped into slots by the value they're waiting for. Each slot is just a counter that's
+    // incremented whenever something a thread in that slot might be waiting for happens, and threads wait on that
+    // counter changing with `atomic::wait`, so waiting needs no allocation or locking, and `notifyThrough` only wakes
+    // the threads waiting for the values it completes (plus any that share their slots, which just wait again).
+    static constexpr size_t SLOT_COUNT = 64;
+    struct alignas(64) Slot {
+        atomic<uint32_t> generation{0};
     };
+    Slot _slots[SLOT_COUNT];
 
-    mutex _internalStateMutex;
-    multimap<uint64_t, shared_ptr<WaitState>> _valueToPendingThreadMap;
-    multimap<uint64_t, shared_ptr<WaitState>> _valueToPendingThreadMapNoCurrentTransaction;
-    uint64_t _value;
+    // Wakes the threads in every slot that could be waiting for a value in (from, through].
+    void _wake(uint64_t from, uint64_t through);
+
+    atomic<uint64_t> _value;
 
     // If there is a global result for all pending operations (i.e., they've been canceled), that is stored here.
     atomic<RESULT> _globalResult;
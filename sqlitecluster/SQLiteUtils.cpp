@@ -4,6 +4,11 @@
 #include <libstuff/SRandom.h>
 #include <sqlitecluster/SQLite.h>
 
+shared_mutex SQLiteUtils::_idAllocationMutex;
+map<string, SQLiteUtils::ID_ALLOCATION> SQLiteUtils::_idAllocations;
+atomic<uint64_t> SQLiteUtils::_nextIDPartition(0);
+thread_local int64_t SQLiteUtils::_threadIDPartition = -1;
+
 int64_t SQLiteUtils::getRandomID(const SQLite& db, const string& tableName, const string& column) {
     int64_t newID = 0;
     while (!newID) {
@@ -19,11 +24,79 @@ int64_t SQLiteUtils::getRandomID(const SQLite& db, const string& tableName, cons
 
         // Ok, now we can take the absolute value, and know we have a positive value that fits in our int64_t.
         newID = labs(newID);
-        string result = db.read("SELECT " + column + " FROM " + tableName + " WHERE " + column + " = " + to_string(newID) + ";");
-        if (!result.empty()) {
-            // This one exists! Pick a new one.
-            newID = 0;
+
+        // If the table has an ID filter, it can usually tell us the ID is unused without reading the table.
+        if (db.idMayExist(tableName, column, newID)) {
+            string result = db.read("SELECT " + column + " FROM " + tableName + " WHERE " + column + " = " + to_string(newID) + ";");
+            if (!result.empty()) {
+                // This one exists! Pick a new one.
+                newID = 0;
+            }
         }
     }
     return newID;
 }
+
+int64_t SQLiteUtils::getNewID(const SQLite& db, const string& tableName, const string& column) {
+    ID_ALLOCATION allocation = getIDAllocation(tableName);
+    if (allocation == ID_ALLOCATION::RANDOM) {
+        return getRandomID(db, tableName, column);
+    }
+    return getLocalizedID(db, tableName, column, allocation);
+}
+
+int64_t SQLiteUtils::getLocalizedID(const SQLite& db, const string& tableName, const string& column, ID_ALLOCATION allocation) {
+    SASSERT(allocation != ID_ALLOCATION::RANDOM);
+    if (_threadIDPartition < 0) {
+        _threadIDPartition = _nextIDPartition++ % (1 << ID_PARTITION_BITS);
+    }
+
+    int64_t newID = 0;
+    while (!newID) {
+        // Milliseconds since our epoch, masked to fit in its field (a clock set before the epoch just wraps, which is
+        // still unique thanks to the check below).
+        const uint64_t timeMS = (STimeNow() / 1000 - ID_EPOCH_MS) & ((1ull << ID_TIME_BITS) - 1);
+        if (allocation == ID_ALLOCATION::THREAD_PARTITIONED) {
+            // [partition][time][random]
+            const uint64_t randomBits = SRandom::rand64() & ((1ull << ID_RANDOM_BITS) - 1);
+            newID = (int64_t)(((uint64_t)_threadIDPartition << (ID_TIME_BITS + ID_RANDOM_BITS)) | (timeMS << ID_RANDOM_BITS) | randomBits);
+        } else {
+            // [time][random], where the random part also takes over the partition bits.
+            const int randomBits = ID_PARTITION_BITS + ID_RANDOM_BITS;
+            newID = (int64_t)((timeMS << randomBits) | (SRandom::rand64() & ((1ull << randomBits) - 1)));
+        }
+
+        if (db.idMayExist(tableName, column, newID)) {
+            string result = db.read("SELECT " + column + " FROM " + tableName + " WHERE " + column + " = " + to_string(newID) + ";");
+            if (!result.empty()) {
+                // This one exists! Pick a new one.
+                newID = 0;
+            }
+        }
+    }
+    return newID;
+}
+
+void SQLiteUtils::setIDAllocation(const string& tableName, ID_ALLOCATION allocation) {
+    unique_lock<shared_mutex> lock(_idAllocationMutex);
+    _idAllocations[tableName] = allocation;
+}
+
+SQLiteUtils::ID_ALLOCATION SQLiteUtils::getIDAllocation(const string& tableName) {
+    shared_lock<shared_mutex> lock(_idAllocationMutex);
+    auto it = _idAllocations.find(tableName);
+    return it == _idAllocations.end() ? ID_ALLOCATION::RANDOM : it->second;
+}
+
+bool SQLiteUtils::parseIDAllocation(const string& name, ID_ALLOCATION& allocation) {
+    if (SIEquals(name, "random")) {
+        allocation = ID_ALLOCATION::RANDOM;
+    } else if (SIEquals(name, "thread")) {
+        allocation = ID_ALLOCATION::THREAD_PARTITIONED;
+    } else if (SIEquals(name, "time")) {
+        allocation = ID_ALLOCATION::TIME_ORDERED;
+    } else {
+        return false;
+    }
+    return true;
+}
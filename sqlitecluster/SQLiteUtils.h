@@ -1,5 +1,8 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
+#include <map>
+#include <shared_mutex>
 #include <string>
 
 class SQLite;
@@ -8,7 +11,55 @@ using namespace std;
 
 class SQLiteUtils {
   public:
-       // Generates a random ID and checks the given tableName and column to ensure
-       // uniqueness.
-      static int64_t getRandomID(const SQLite& db, const string& tableName, const string& column);
+    // Strategies for choosing new IDs for a table in `getNewID`.
+    enum class ID_ALLOCATION {
+        // Fully random 63-bit IDs (the default). Every insert lands on a random leaf page of the table's B-tree.
+        RANDOM,
+
+        // IDs are prefixed with a per-thread partition, followed by the current time and a few random bits. Each
+        // thread appends to its own region of the B-tree, so a transaction's inserts cluster onto a small number of
+        // pages, and concurrent writers on different threads don't touch each other's pages.
+        THREAD_PARTITIONED,
+
+        // IDs are the current time followed by random bits. Inserts cluster on the right edge of the B-tree, which
+        // minimizes pages written, but concurrent writers are more likely to conflict with each other.
+        TIME_ORDERED,
+    };
+
+    // Generates a random ID and checks the given tableName and column to ensure
+    // uniqueness. If the table has an ID filter (see `SQLite::addIDFilter`), most IDs are checked without reading it.
+    static int64_t getRandomID(const SQLite& db, const string& tableName, const string& column);
+
+    // Generates an ID using the allocation strategy registered for tableName (RANDOM if none is registered) and checks
+    // the given tableName and column to ensure uniqueness.
+    static int64_t getNewID(const SQLite& db, const string& tableName, const string& column);
+
+    // Generates an ID with the given (non-random) strategy, checking tableName and column for uniqueness.
+    static int64_t getLocalizedID(const SQLite& db, const string& tableName, const string& column, ID_ALLOCATION allocation);
+
+    // Select the allocation strategy `getNewID` will use for a given table. This is typically called once at startup.
+    static void setIDAllocation(const string& tableName, ID_ALLOCATION allocation);
+    static ID_ALLOCATION getIDAllocation(const string& tableName);
+
+    // Parses "random", "thread" or "time" (case insensitive) into `allocation`. Returns false, leaving `allocation`
+    // unchanged, for anything else.
+    static bool parseIDAllocation(const string& name, ID_ALLOCATION& allocation);
+
+    // Layout of localized IDs, from the most significant bit down (bit 63 is always 0 so the ID stays positive).
+    static constexpr int ID_PARTITION_BITS = 6;
+    static constexpr int ID_TIME_BITS = 41;
+    static constexpr int ID_RANDOM_BITS = 63 - ID_PARTITION_BITS - ID_TIME_BITS;
+
+    // Localized IDs count milliseconds from 2020-01-01 00:00:00 UTC, which fits in ID_TIME_BITS until 2089.
+    static constexpr uint64_t ID_EPOCH_MS = 1'577'836'800'000;
+
+  private:
+    // Allocation strategies registered with `setIDAllocation`, by table name.
+    static shared_mutex _idAllocationMutex;
+    static map<string, ID_ALLOCATION> _idAllocations;
+
+    // Each thread that allocates partitioned IDs is assigned the next partition the first time it does so. Worker
+    // threads live for the life of the server, so each one keeps appending to the same region of the table.
+    static atomic<uint64_t> _nextIDPartition;
+    static thread_local int64_t _threadIDPartition;
 };
@@ -1,6 +1,8 @@
 #include <iostream>
 
 #include <libstuff/SData.h>
+#include <libstuff/SQResult.h>
+#include <sqlitecluster/SQLite.h>
 #include <test/clustertest/BedrockClusterTester.h>
 
 struct ControlCommandTest : tpunit::TestFixture {
@@ -8,7 +10,9 @@ struct ControlCommandTest : tpunit::TestFixture {
         : tpunit::TestFixture("ControlCommand",
                               BEFORE_CLASS(ControlCommandTest::setup),
                               AFTER_CLASS(ControlCommandTest::teardown),
-                              TEST(ControlCommandTest::testPreventAttach)) { }
+                              TEST(ControlCommandTest::testPreventAttach),
+                              TEST(ControlCommandTest::testOnlineBackup),
+                              TEST(ControlCommandTest::testSetCacheParams)) { }
 
     BedrockClusterTester* tester;
 
@@ -46,4 +50,82 @@ struct ControlCommandTest : tpunit::TestFixture {
         follower.executeWaitVerifyContent(attachCommand, "204", true);
     }
 
+    void testOnlineBackup()
+    {
+        BedrockTester& leader = tester->getTester(0);
+        const string destination = leader.getArg("-db") + ".backup";
+        unlink(destination.c_str());
+
+        // Backups can't be written over the database or its WAL.
+        SData command("BeginBackup");
+        command["Online"] = "true";
+        for (const string& target : {leader.getArg("-db"), leader.getArg("-db") + "-wal", leader.getArg("-db") + "-shm"}) {
+            command["Destination"] = target;
+            leader.executeWaitVerifyContent(command, "400", true);
+        }
+
+        command["Destination"] = destination;
+        leader.executeWaitVerifyContent(command, "202", true);
+
+        // Wait for it to finish, while the node keeps serving.
+        STable backup;
+        for (int i = 0; i < 100; i++) {
+            STable status = SParseJSONObject(leader.executeWaitVerifyContent(SData("Status"), "200", true));
+            backup = SParseJSONObject(status["backup"]);
+            if (backup["state"] != "running") {
+                break;
+            }
+            usleep(100'000);
+        }
+        ASSERT_EQUAL(backup["state"], "complete");
+        ASSERT_TRUE(SFileExists(destination));
+        ASSERT_EQUAL(backup["bytesCopied"], backup["bytesTotal"]);
+
+        // The backup is at the commit it reports.
+        sqlite3* db = nullptr;
+        ASSERT_EQUAL(sqlite3_open_v2(destination.c_str(), &db, SQLITE_OPEN_READONLY, NULL), SQLITE_OK);
+        SQResult journals;
+        ASSERT_FALSE(SQuery(db, "", "SELECT name FROM sqlite_schema WHERE type ='table' AND name LIKE 'journal%';", journals));
+        string hash;
+        for (const auto& row : journals.rows) {
+            SQResult result;
+            ASSERT_FALSE(SQuery(db, "", "SELECT hash FROM " + row[0] + " WHERE id = " + backup["commitCount"] + ";", result));
+            if (!result.empty()) {
+                hash = result[0][0];
+            }
+        }
+        ASSERT_EQUAL(hash, backup["commitHash"]);
+        sqlite3_close_v2(db);
+        unlink(destination.c_str());
+    }
+
+    void testSetCacheParams()
+    {
+        BedrockTester& follower = tester->getTester(1);
+        SData command("SetCacheParams");
+        command["CacheBudget"] = "65536";
+        follower.executeWaitVerifyContent(command, "200", true);
+        STable cache = SParseJSONObject(SParseJSONObject(follower.executeWaitVerifyContent(SData("Status"), "200", true))["dbCache"]);
+        ASSERT_EQUAL(cache["budgetKB"], "65536");
+        ASSERT_GREATER_THAN(SToUInt64(cache["handles"]), 0);
+        ASSERT_LESS_THAN_EQUAL(SToUInt64(cache["perHandleKB"]), 65536);
+        ASSERT_EQUAL(SToUInt64(cache["effectiveTotalKB"]), SToUInt64(cache["perHandleKB"]) * SToUInt64(cache["handles"]));
+
+        // A budget too small to give every handle the minimum is reported as the total they really get.
+        command["CacheBudget"] = "1";
+        follower.executeWaitVerifyContent(command, "200", true);
+        cache = SParseJSONObject(SParseJSONObject(follower.executeWaitVerifyContent(SData("Status"), "200", true))["dbCache"]);
+        ASSERT_EQUAL(cache["perHandleKB"], to_string(SQLite::MIN_CACHE_KB));
+        ASSERT_EQUAL(SToUInt64(cache["effectiveTotalKB"]), SQLite::MIN_CACHE_KB * SToUInt64(cache["handles"]));
+
+        // The node keeps working with its caches resized.
+        SData query("Query");
+        query["Query"] = "SELECT 1;";
+        follower.executeWaitVerifyContent(query);
+        command["CacheBudget"] = "0";
+        follower.executeWaitVerifyContent(command, "200", true);
+        cache = SParseJSONObject(SParseJSONObject(follower.executeWaitVerifyContent(SData("Status"), "200", true))["dbCache"]);
+        ASSERT_EQUAL(cache["budgetKB"], "0");
+    }
+
 } __ControlCommandTest;
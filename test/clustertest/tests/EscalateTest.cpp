@@ -5,7 +5,9 @@ struct EscalateTest : tpunit::TestFixture {
     EscalateTest() : tpunit::TestFixture("Escalate", BEFORE_CLASS(EscalateTest::setup),
                                                      AFTER_CLASS(EscalateTest::teardown),
                                                      TEST(EscalateTest::test),
-                                                     TEST(EscalateTest::socketReuse)) { }
+                                                     TEST(EscalateTest::socketReuse),
+                                                     TEST(EscalateTest::concurrent),
+                                                     TEST(EscalateTest::multiplexedOnlyForPeers)) { }
 
     BedrockClusterTester* tester = nullptr;
 
@@ -71,4 +73,41 @@ struct EscalateTest : tpunit::TestFixture {
         results = brtester.executeWaitMultipleData({cmd});
         ASSERT_EQUAL(results[0].methodLine, "200 OK");
     }
+
+    // Many commands escalated at once from the same follower share its escalation channel to leader, and each gets
+    // its own response.
+    void concurrent()
+    {
+        BedrockTester& brtester = tester->getTester(1);
+        vector<SData> requests;
+        for (int i = 0; i < 200; i++) {
+            SData cmd("WriteCache");
+            cmd["name"] = "escalate" + to_string(i);
+            cmd["value"] = to_string(i);
+            requests.push_back(cmd);
+        }
+        for (const SData& response : brtester.executeWaitMultipleData(requests, 20)) {
+            ASSERT_EQUAL(response.methodLine, "200 OK");
+        }
+
+        BedrockTester& leader = tester->getTester(0);
+        for (int i = 0; i < 200; i += 50) {
+            SData cmd("ReadCache");
+            cmd["name"] = "escalate" + to_string(i);
+            ASSERT_EQUAL(leader.executeWaitVerifyContent(cmd), to_string(i));
+        }
+    }
+
+    // Clients on the public command port can't ask for their requests to be multiplexed. Multiplexed responses carry
+    // the command's ID, so we check that this doesn't.
+    void multiplexedOnlyForPeers()
+    {
+        SData cmd("WriteCache");
+        cmd["name"] = "multiplexed";
+        cmd["value"] = "value";
+        cmd["multiplexed"] = "true";
+        auto results = tester->getTester(0).executeWaitMultipleData({cmd});
+        ASSERT_EQUAL(results[0].methodLine, "200 OK");
+        ASSERT_FALSE(results[0].isSet("ID"));
+    }
 } __EscalateTest;
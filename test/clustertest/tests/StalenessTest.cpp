@@ -0,0 +1,74 @@
+#include <libstuff/SData.h>
+#include <test/clustertest/BedrockClusterTester.h>
+
+struct StalenessTest : tpunit::TestFixture {
+    StalenessTest() : tpunit::TestFixture("Staleness", BEFORE_CLASS(StalenessTest::setup),
+                                                       AFTER_CLASS(StalenessTest::teardown),
+                                                       TEST(StalenessTest::neverStale),
+                                                       TEST(StalenessTest::forwardToFreshFollower)) { }
+
+    BedrockClusterTester* tester = nullptr;
+
+    void setup() {
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER, {"CREATE TABLE stale (id INTEGER PRIMARY KEY, value INTEGER)"});
+    }
+
+    void teardown() {
+        delete tester;
+    }
+
+    // Followers run the same query as leader to apply a transaction, so a write whose query takes a couple of seconds
+    // to run leaves both followers behind for that long after leader commits it. A read with `maxStalenessMS` sent to a
+    // follower in that time can't be answered from its own DB. There's no fresh follower to forward it to, so it has to
+    // wait to catch up (as it also does if forwarding fails), and it must see the write either way.
+    void neverStale() {
+        SData write("Query");
+        write["writeConsistency"] = "ASYNC";
+        write["query"] = "INSERT INTO stale SELECT 1, (WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 20000000) SELECT COUNT(*) FROM c);";
+        tester->getTester(0).executeWaitVerifyContent(write);
+        usleep(500'000);
+
+        SData read("Query");
+        read["query"] = "SELECT value FROM stale WHERE id = 1;";
+        read["maxStalenessMS"] = "200";
+        ASSERT_TRUE(SContains(tester->getTester(1).executeWaitVerifyContent(read), "20000000"));
+
+        // The other follower is held to the same bound.
+        ASSERT_TRUE(SContains(tester->getTester(2).executeWaitVerifyContent(read), "20000000"));
+    }
+
+    // With writes blocked on one follower, it falls behind while the other keeps up. It can't see a new write itself
+    // until it's unblocked, so a read with `maxStalenessMS` that does must have been forwarded to the other follower.
+    void forwardToFreshFollower() {
+        BedrockTester& fresh = tester->getTester(1);
+        BedrockTester& blocked = tester->getTester(2);
+        blocked.executeWaitVerifyContent(SData("BlockWrites"), "200 Blocked", true);
+
+        SData write("Query");
+        write["writeConsistency"] = "ASYNC";
+        write["query"] = "INSERT INTO stale VALUES (2, 424242);";
+        tester->getTester(0).executeWaitVerifyContent(write);
+
+        SData read("Query");
+        read["query"] = "SELECT value FROM stale WHERE id = 2;";
+        bool replicated = false;
+        for (int i = 0; i < 100 && !replicated; i++) {
+            replicated = SContains(fresh.executeWaitVerifyContent(read), "424242");
+            if (!replicated) {
+                usleep(100'000);
+            }
+        }
+        ASSERT_TRUE(replicated);
+
+        // Give the fresh follower time to tell the blocked one how far it's got.
+        sleep(2);
+
+        // If this isn't forwarded, it waits for a commit that can't happen, so don't wait long.
+        read["maxStalenessMS"] = "200";
+        read["timeout"] = "5000";
+        const SData response = blocked.executeWaitMultipleData({read}, 1)[0];
+        blocked.executeWaitVerifyContent(SData("UnblockWrites"), "200 Unblocked", true);
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_TRUE(SContains(response.content, "424242"));
+    }
+} __StalenessTest;
@@ -0,0 +1,84 @@
+#include <libstuff/SData.h>
+#include <test/clustertest/BedrockClusterTester.h>
+
+struct WorkerPoolTest : tpunit::TestFixture {
+    WorkerPoolTest() : tpunit::TestFixture("WorkerPool", BEFORE_CLASS(WorkerPoolTest::setup),
+                                                         AFTER_CLASS(WorkerPoolTest::teardown),
+                                                         TEST(WorkerPoolTest::bounds),
+                                                         TEST(WorkerPoolTest::resize)) { }
+
+    BedrockClusterTester* tester = nullptr;
+
+    // Below the floors for each of these, so the server has to raise them.
+    void setup() {
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER, {},
+                                          {{"-workerThreads", "1"}, {"-minWorkerThreads", "1"}, {"-maxWorkerThreads", "6"},
+                                           {"-dbPoolSize", "1"}});
+    }
+
+    void teardown() {
+        delete tester;
+    }
+
+    // Returns the leader's Status, once the worker pool has been checked at least once.
+    STable getStatus() {
+        BedrockTester& leader = tester->getTester(0);
+        for (int i = 0; i < 100; i++) {
+            STable json = SParseJSONObject(leader.executeWaitVerifyContent(SData("Status")));
+            if (!json["workerPool"].empty()) {
+                return json;
+            }
+            usleep(100'000);
+        }
+        return {};
+    }
+
+    void bounds() {
+        STable status = getStatus();
+        STable workerPool = SParseJSONObject(status["workerPool"]);
+        ASSERT_EQUAL(workerPool["min"], "2");
+        ASSERT_EQUAL(workerPool["max"], "6");
+        ASSERT_EQUAL(workerPool["target"], "2");
+
+        // A pool of 1 is raised to the base DB plus one handle, and still serves commands.
+        ASSERT_EQUAL(SParseJSONObject(status["dbPool"])["maxDBs"], "2");
+        SData command("testcommand");
+        tester->getTester(0).executeWaitVerifyContent(command);
+    }
+
+    void resize() {
+        // Queue up many more commands than there are workers, each of which spends its time sleeping rather than on
+        // CPU, so the pool should grow, but never past the maximum.
+        vector<SData> requests;
+        for (int i = 0; i < 60; i++) {
+            SData command("testcommand");
+            command["PeekSleep"] = "300";
+            requests.push_back(command);
+        }
+        atomic<bool> done(false);
+        thread load([&]() {
+            tester->getTester(0).executeWaitMultipleData(requests, 30);
+            done = true;
+        });
+
+        // Status is answered without waiting for a worker, so we can watch the target change under load.
+        int maxTarget = 0;
+        while (!done) {
+            const int target = SToInt(SParseJSONObject(getStatus()["workerPool"])["target"]);
+            maxTarget = max(maxTarget, target);
+            usleep(200'000);
+        }
+        load.join();
+        ASSERT_GREATER_THAN(maxTarget, 2);
+        ASSERT_LESS_THAN_EQUAL(maxTarget, 6);
+
+        // Once idle, it shrinks back down to the minimum, one thread at a time.
+        int target = maxTarget;
+        for (int i = 0; i < 300 && target > 2; i++) {
+            usleep(100'000);
+            STable workerPool = SParseJSONObject(getStatus()["workerPool"]);
+            target = SToInt(workerPool["target"]);
+        }
+        ASSERT_EQUAL(target, 2);
+    }
+} __WorkerPoolTest;
@@ -0,0 +1,28 @@
+#include "TestSQLiteDB.h"
+
+#include <unistd.h>
+
+#include <test/lib/BedrockTester.h>
+
+TestDBFile::TestDBFile(const string& prefix) : filename(BedrockTester::getTempFileName(prefix)) {
+}
+
+TestDBFile::~TestDBFile() {
+    remove(filename);
+}
+
+void TestDBFile::remove(const string& filename) {
+    for (const char* suffix : {"", "-wal", "-wal2", "-shm"}) {
+        unlink((filename + suffix).c_str());
+    }
+}
+
+TestSQLiteDB::TestSQLiteDB(const string& prefix) : TestDBFile(prefix), db(filename, 1000, 1'000'000, 0) {
+}
+
+void TestSQLiteDB::commit(SQLite& db, const string& query) {
+    if (!db.beginTransaction() || !db.write(query) || !db.prepare() || db.commit() != SQLITE_OK) {
+        db.rollback();
+        STHROW("Couldn't commit " + query);
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLite.h>
+
+// A temporary database file for tests that use SQLite directly, rather than through a server. The file and its WAL and
+// shared memory files are removed when this is destroyed.
+class TestDBFile {
+  public:
+    TestDBFile(const string& prefix);
+    ~TestDBFile();
+
+    // Removes a database file and its WAL and shared memory files.
+    static void remove(const string& filename);
+
+    const string filename;
+};
+
+// A handle on a new temporary database. As a base class, the file outlives the handle, so it's closed before its
+// files are removed.
+class TestSQLiteDB : public TestDBFile {
+  public:
+    TestSQLiteDB(const string& prefix);
+
+    // Runs `query` in a transaction of its own and commits it. Throws if that fails, which fails the test.
+    static void commit(SQLite& db, const string& query);
+
+    SQLite db;
+};
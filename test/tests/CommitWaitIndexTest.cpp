@@ -0,0 +1,132 @@
+#include <libstuff/libstuff.h>
+#include <BedrockCommitWaitIndex.h>
+#include <test/lib/BedrockTester.h>
+
+struct CommitWaitIndexTest : tpunit::TestFixture {
+    CommitWaitIndexTest() : tpunit::TestFixture("CommitWaitIndex",
+                                                TEST(CommitWaitIndexTest::commitOrder),
+                                                TEST(CommitWaitIndexTest::timeouts),
+                                                TEST(CommitWaitIndexTest::flush)) { }
+
+    static unique_ptr<BedrockCommand> makeCommand(uint64_t commitCount, uint64_t timeoutMS = 60'000) {
+        SData request("wait" + to_string(commitCount));
+        request["timeout"] = to_string(timeoutMS);
+        return make_unique<BedrockCommand>(SQLiteCommand(move(request)), nullptr);
+    }
+
+    // Waits for the index's service thread to move `count` commands to the queue, and returns their method lines.
+    static set<string> takeReleased(BedrockCommandQueue& queue, size_t count) {
+        set<string> released;
+        for (int i = 0; i < 200 && released.size() < count; i++) {
+            try {
+                released.insert(queue.get(10'000)->request.methodLine);
+            } catch (const BedrockCommandQueue::timeout_error&) {
+            }
+        }
+        return released;
+    }
+
+    // The service thread updates the index's size just after it queues a command, so give it a moment to catch up.
+    static size_t waitForSize(BedrockCommitWaitIndex& index, size_t size) {
+        for (int i = 0; i < 100 && index.size() != size; i++) {
+            usleep(10'000);
+        }
+        return index.size();
+    }
+
+    static set<string> expectedNames(const list<uint64_t>& commitCounts) {
+        set<string> names;
+        for (uint64_t commitCount : commitCounts) {
+            names.insert("wait" + to_string(commitCount));
+        }
+        return names;
+    }
+
+    void commitOrder() {
+        BedrockCommandQueue queue;
+        BedrockCommitWaitIndex index(queue);
+
+        // Push in a scrambled order, so the heap has to reorder them.
+        for (uint64_t i = 0; i < 200; i++) {
+            index.push(makeCommand((i * 73) % 200 + 1), (i * 73) % 200 + 1, 0);
+        }
+        ASSERT_EQUAL(index.size(), 200);
+        usleep(10'000);
+        ASSERT_EQUAL(queue.size(), 0);
+
+        // Each commit releases exactly the commands waiting for it or anything before it.
+        list<uint64_t> expected;
+        for (uint64_t commitCount = 1; commitCount <= 50; commitCount++) {
+            expected.push_back(commitCount);
+        }
+        index.notifyCommit(50);
+        ASSERT_EQUAL(takeReleased(queue, 50), expectedNames(expected));
+        ASSERT_EQUAL(waitForSize(index, 150), 150);
+
+        // Older commit counts don't release anything else.
+        index.notifyCommit(20);
+        usleep(10'000);
+        ASSERT_EQUAL(queue.size(), 0);
+
+        expected.clear();
+        for (uint64_t commitCount = 51; commitCount <= 200; commitCount++) {
+            expected.push_back(commitCount);
+        }
+        index.notifyCommit(200);
+        ASSERT_EQUAL(takeReleased(queue, 150), expectedNames(expected));
+        ASSERT_EQUAL(waitForSize(index, 0), 0);
+
+        // A command waiting for a commit that's already happened is released right away.
+        index.push(makeCommand(100), 100, 200);
+        ASSERT_EQUAL(takeReleased(queue, 1), expectedNames({100}));
+    }
+
+    void timeouts() {
+        BedrockCommandQueue queue;
+        BedrockCommitWaitIndex index(queue);
+
+        // Every third command times out quickly. Those are taken out of the middle of the commit heap, which then has
+        // to stay in order for the rest.
+        list<uint64_t> timingOut;
+        list<uint64_t> waiting;
+        for (uint64_t i = 0; i < 90; i++) {
+            const uint64_t commitCount = (i * 37) % 90 + 1;
+            const bool timesOut = !(commitCount % 3);
+            (timesOut ? timingOut : waiting).push_back(commitCount);
+            index.push(makeCommand(commitCount, timesOut ? 50 : 60'000), commitCount, 0);
+        }
+        ASSERT_EQUAL(takeReleased(queue, timingOut.size()), expectedNames(timingOut));
+        ASSERT_EQUAL(waitForSize(index, waiting.size()), waiting.size());
+
+        // The rest are still released in commit order, and none of the timed out ones come back.
+        list<uint64_t> expected;
+        for (uint64_t commitCount : waiting) {
+            if (commitCount <= 45) {
+                expected.push_back(commitCount);
+            }
+        }
+        index.notifyCommit(45);
+        ASSERT_EQUAL(takeReleased(queue, expected.size()), expectedNames(expected));
+        index.notifyCommit(90);
+        ASSERT_EQUAL(takeReleased(queue, waiting.size() - expected.size()).size(), waiting.size() - expected.size());
+        usleep(10'000);
+        ASSERT_EQUAL(queue.size(), 0);
+        ASSERT_EQUAL(waitForSize(index, 0), 0);
+    }
+
+    void flush() {
+        BedrockCommandQueue queue;
+        BedrockCommitWaitIndex index(queue);
+        for (uint64_t commitCount = 1; commitCount <= 10; commitCount++) {
+            index.push(makeCommand(commitCount), commitCount, 0);
+        }
+        index.flush();
+        ASSERT_EQUAL(index.size(), 0);
+        ASSERT_EQUAL(queue.size(), 10);
+
+        // Slots freed by the flush are reused.
+        index.push(makeCommand(5), 5, 0);
+        index.notifyCommit(5);
+        ASSERT_EQUAL(takeReleased(queue, 11).size(), 11);
+    }
+} __CommitWaitIndexTest;
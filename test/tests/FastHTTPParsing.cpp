@@ -1,5 +1,7 @@
 #include <libstuff/SFastBuffer.h>
 #include <libstuff/SData.h>
+#include <libstuff/SHTTPView.h>
+#include <libstuff/SRandom.h>
 #include <test/lib/BedrockTester.h>
 
 struct FastHTTPParsing : tpunit::TestFixture {
@@ -9,7 +11,12 @@ struct FastHTTPParsing : tpunit::TestFixture {
                                     TEST(FastHTTPParsing::blank),
                                     TEST(FastHTTPParsing::noHeaders),
                                     TEST(FastHTTPParsing::splitSeparators),
-                                    TEST(FastHTTPParsing::reset))
+                                    TEST(FastHTTPParsing::reset),
+                                    TEST(FastHTTPParsing::view),
+                                    TEST(FastHTTPParsing::viewFallback),
+                                    TEST(FastHTTPParsing::composeReuse),
+                                    TEST(FastHTTPParsing::nulValues),
+                                    TEST(FastHTTPParsing::fuzzParity))
     { }
 
     // We test both supported line ends everywhere.
@@ -96,4 +103,237 @@ struct FastHTTPParsing : tpunit::TestFixture {
             ASSERT_EQUAL(request["Content-length"], "1");
         }
     }
+
+    void view() {
+        for (const auto& end : lineEnds) {
+            string message = " Query " + end +
+                             "Name: first" + end +
+                             "Escaped:  line\\none " + end +
+                             "NAME : second" + end +
+                             "Content-Length: 5" + end +
+                             end + "helloGET";
+            SHTTPView view;
+
+            // Incomplete messages aren't parsed.
+            ASSERT_EQUAL(view.parse(message.c_str(), message.size() - 4), 0);
+            ASSERT_EQUAL(view.methodLine(), "");
+
+            // A complete one is, ignoring anything after it.
+            ASSERT_EQUAL(view.parse(message.c_str(), message.size()), (int)message.size() - 3);
+            ASSERT_EQUAL(view.methodLine(), "Query");
+            ASSERT_EQUAL(view.content(), "hello");
+            ASSERT_EQUAL(view.headers().size(), 4);
+
+            // Lookups ignore case and find the last of any duplicates.
+            ASSERT_EQUAL(view.find("name")->value, "second");
+            ASSERT_EQUAL(view.find("content-LENGTH")->value, "5");
+            ASSERT_FALSE(view.find("Missing"));
+            ASSERT_TRUE(view.find("Escaped")->escaped);
+            ASSERT_EQUAL(view.find("Escaped")->value, "line\\none");
+
+            // And SData, which uses this, gets the same result as SParseHTTP.
+            SData request;
+            ASSERT_EQUAL(request.deserialize(message), (int)message.size() - 3);
+            string methodLine, content;
+            STable headers;
+            ASSERT_EQUAL(SParseHTTP(message, methodLine, headers, content), (int)message.size() - 3);
+            ASSERT_EQUAL(request.methodLine, methodLine);
+            ASSERT_EQUAL(request.content, content);
+            ASSERT_TRUE(request.nameValueMap == headers);
+            ASSERT_EQUAL(request["Escaped"], "line\none");
+        }
+    }
+
+    void viewFallback() {
+        // Chunked bodies and folded headers are left to SParseHTTP.
+        SHTTPView view;
+        string chunked = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nA\r\n0\r\n\r\n";
+        ASSERT_EQUAL(view.parse(chunked.c_str(), chunked.size()), SHTTPView::UNSUPPORTED);
+        string folded = "GET / HTTP/1.1\r\nName: a\r\n b\r\n\r\n";
+        ASSERT_EQUAL(view.parse(folded.c_str(), folded.size()), SHTTPView::UNSUPPORTED);
+
+        SData request;
+        ASSERT_EQUAL(request.deserialize(folded), (int)folded.size());
+        ASSERT_EQUAL(request["Name"], "a b");
+
+        // Repeated cookies are combined, as always.
+        string cookies = "GET / HTTP/1.1\r\nSet-Cookie: a=1\r\nSet-Cookie: b=2\r\n\r\n";
+        ASSERT_EQUAL(request.deserialize(cookies), (int)cookies.size());
+        ASSERT_EQUAL(SParseList(request["Set-Cookie"], (char)0xFF).size(), 2);
+
+        // Lots of headers grow the index.
+        string many = "GET / HTTP/1.1\r\n";
+        for (int i = 0; i < 100; i++) {
+            many += "Header" + to_string(i) + ": " + to_string(i) + "\r\n";
+        }
+        many += "\r\n";
+        ASSERT_EQUAL(view.parse(many.c_str(), many.size()), (int)many.size());
+        for (int i = 0; i < 100; i++) {
+            ASSERT_EQUAL(view.find("header" + to_string(i))->value, to_string(i));
+        }
+    }
+
+    void composeReuse() {
+        SData response("200 OK");
+        response["Plain"] = "value";
+        response["Multiline"] = "a\nb";
+        response.content = "body";
+
+        string buffer = "leftovers";
+        response.serialize(buffer);
+        ASSERT_EQUAL(buffer, response.serialize());
+        ASSERT_EQUAL(buffer, "200 OK\r\nMultiline: a\\nb\r\nPlain: value\r\nContent-Length: 4\r\n\r\nbody");
+    }
+
+    // Header values are NUL-terminated strings as far as SEscape and SUnescape are concerned, so both parsing and
+    // composing stop a value at its first NUL.
+    void nulValues() {
+        const string message = "GET / HTTP/1.1\r\nName: before\0after\r\nOther: ok\r\n\r\n"s;
+        SData request;
+        ASSERT_EQUAL(request.deserialize(message), (int)message.size());
+        ASSERT_EQUAL(request["Name"], "before");
+        ASSERT_EQUAL(request["Other"], "ok");
+
+        SData response("200 OK");
+        response["Name"] = "before\0after"s;
+        ASSERT_EQUAL(response.serialize(), "200 OK\r\nName: before\r\nContent-Length: 0\r\n\r\n");
+    }
+
+    // Random messages made of the characters that matter to the parser have to come out of SData exactly as they do
+    // out of SParseHTTP, and composing random headers has to match escaping every value with SEscape.
+    void fuzzParity() {
+        const string alphabet = "aB1: \r\n\t\\\0"s;
+        const vector<string> names = {"Name", "NAME", "Set-Cookie", "Content-Length", "Transfer-Encoding", "X", ""};
+        const vector<string> values = {"", "5", "chunked", " padded ", "a\\nb", "0x10", "n\0ul"s};
+        auto randomString = [&](size_t maxLength) {
+            string result;
+            for (size_t i = SRandom::rand64() % (maxLength + 1); i > 0; i--) {
+                result += alphabet[SRandom::rand64() % alphabet.size()];
+            }
+            return result;
+        };
+        auto pick = [](const vector<string>& from) {
+            return from[SRandom::rand64() % from.size()];
+        };
+
+        for (int i = 0; i < 100'000; i++) {
+            // Mostly well-formed headers, with random junk mixed in.
+            string message = (SRandom::rand64() % 8 ? "GET / HTTP/1.1" : randomString(10)) + "\r\n";
+            for (size_t header = SRandom::rand64() % 6; header > 0; header--) {
+                switch (SRandom::rand64() % 3) {
+                    case 0:
+                        message += pick(names) + ": " + pick(values);
+                        break;
+                    case 1:
+                        message += pick(names) + ":" + randomString(12);
+                        break;
+                    default:
+                        message += randomString(16);
+                        break;
+                }
+                message += SRandom::rand64() % 4 ? "\r\n" : "\n";
+            }
+            message += "\r\n" + randomString(8);
+
+            SData request;
+            string methodLine, content;
+            STable headers;
+            const int expected = SParseHTTP(message.c_str(), message.size(), methodLine, headers, content);
+            ASSERT_EQUAL(request.deserialize(message), expected);
+            ASSERT_EQUAL(request.methodLine, methodLine);
+            ASSERT_EQUAL(request.content, content);
+            ASSERT_TRUE(request.nameValueMap == headers);
+
+            STable table;
+            string reference = "200 OK\r\n";
+            for (size_t header = SRandom::rand64() % 4; header > 0; header--) {
+                table["H" + to_string(header)] = randomString(12);
+            }
+            for (const auto& [name, value] : table) {
+                reference += name + ": " + SEscape(value, "\r\n\t") + "\r\n";
+            }
+            reference += "Content-Length: 0\r\n\r\n";
+            ASSERT_EQUAL(SComposeHTTP("200 OK", table, ""), reference);
+        }
+    }
 } __FastHTTPParsing;
+
+// Compares SData parsing and composing against the old approach of parsing straight into an STable and composing each
+// message into a new string.
+// Run with `-perf`.
+struct FastHTTPParsingPerfTest : tpunit::TestFixture {
+    FastHTTPParsingPerfTest() : tpunit::TestFixture("PerfFastHTTPParsing",
+                                                    TEST(FastHTTPParsingPerfTest::parse),
+                                                    TEST(FastHTTPParsingPerfTest::compose)) { }
+
+    static constexpr int MESSAGES = 500'000;
+
+    // A typical escalated command.
+    static SData makeMessage() {
+        SData message("Query");
+        message["query"] = "SELECT * FROM accounts WHERE accountID = 1234567;";
+        message["format"] = "json";
+        message["commitCount"] = "123456789";
+        message["requestID"] = "ABCD1234";
+        message["lastIP"] = "127.0.0.1";
+        message["logParam"] = "value";
+        message["Connection"] = "wait";
+        message["timeout"] = "290000";
+        message.content = string(200, 'x');
+        return message;
+    }
+
+    void parse() {
+        const string serialized = makeMessage().serialize();
+        size_t bytes = 0;
+
+        uint64_t start = STimeNow();
+        for (int i = 0; i < MESSAGES; i++) {
+            string methodLine, content;
+            STable headers;
+            bytes += SParseHTTP(serialized, methodLine, headers, content);
+        }
+        uint64_t elapsed = STimeNow() - start;
+        cout << "[PerfFastHTTPParsing] SParseHTTP: " << (MESSAGES * 1'000'000ull / elapsed) << " messages/sec." << endl;
+
+        start = STimeNow();
+        for (int i = 0; i < MESSAGES; i++) {
+            SData request;
+            bytes += request.deserialize(serialized);
+        }
+        elapsed = STimeNow() - start;
+        cout << "[PerfFastHTTPParsing] SData::deserialize: " << (MESSAGES * 1'000'000ull / elapsed) << " messages/sec." << endl;
+
+        SHTTPView view;
+        start = STimeNow();
+        for (int i = 0; i < MESSAGES; i++) {
+            bytes += view.parse(serialized.c_str(), serialized.size());
+            bytes += view.find("commitCount")->value.size();
+        }
+        elapsed = STimeNow() - start;
+        cout << "[PerfFastHTTPParsing] SHTTPView::parse: " << (MESSAGES * 1'000'000ull / elapsed) << " messages/sec." << endl;
+        ASSERT_TRUE(bytes);
+    }
+
+    void compose() {
+        const SData message = makeMessage();
+        size_t bytes = 0;
+
+        uint64_t start = STimeNow();
+        for (int i = 0; i < MESSAGES; i++) {
+            bytes += message.serialize().size();
+        }
+        uint64_t elapsed = STimeNow() - start;
+        cout << "[PerfFastHTTPParsing] serialize(): " << (MESSAGES * 1'000'000ull / elapsed) << " messages/sec." << endl;
+
+        string buffer;
+        start = STimeNow();
+        for (int i = 0; i < MESSAGES; i++) {
+            message.serialize(buffer);
+            bytes += buffer.size();
+        }
+        elapsed = STimeNow() - start;
+        cout << "[PerfFastHTTPParsing] serialize(buffer): " << (MESSAGES * 1'000'000ull / elapsed) << " messages/sec." << endl;
+        ASSERT_TRUE(bytes);
+    }
+} __FastHTTPParsingPerfTest;
@@ -0,0 +1,104 @@
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLite.h>
+#include <sqlitecluster/SQLiteUtils.h>
+#include <test/lib/BedrockTester.h>
+#include <test/lib/TestSQLiteDB.h>
+
+// Compares pages written per commit and conflict rates for each of the ID allocation strategies in SQLiteUtils, and
+// time taken with and without an ID filter. Run with `-perf`.
+struct IDAllocationPerfTest : tpunit::TestFixture {
+    IDAllocationPerfTest() : tpunit::TestFixture("PerfIDAllocation",
+                                                 TEST(IDAllocationPerfTest::random),
+                                                 TEST(IDAllocationPerfTest::threadPartitioned),
+                                                 TEST(IDAllocationPerfTest::timeOrdered),
+                                                 TEST(IDAllocationPerfTest::randomFiltered)) { }
+
+    static constexpr int THREADS = 8;
+    static constexpr int COMMITS_PER_THREAD = 250;
+    static constexpr int INSERTS_PER_COMMIT = 10;
+    static constexpr int PRELOADED_ROWS = 200'000;
+
+    void random() {
+        runAllocation("random", SQLiteUtils::ID_ALLOCATION::RANDOM);
+    }
+
+    void threadPartitioned() {
+        runAllocation("thread", SQLiteUtils::ID_ALLOCATION::THREAD_PARTITIONED);
+    }
+
+    void timeOrdered() {
+        runAllocation("time", SQLiteUtils::ID_ALLOCATION::TIME_ORDERED);
+    }
+
+    void randomFiltered() {
+        // This applies to every DB file opened from now on, so it goes last.
+        SQLite::addIDFilter("ids", "id");
+        runAllocation("random+filter", SQLiteUtils::ID_ALLOCATION::RANDOM);
+    }
+
+    void runAllocation(const string& name, SQLiteUtils::ID_ALLOCATION allocation) {
+        const string filename = BedrockTester::getTempFileName("idallocation");
+        SQLite mainDB(filename, 100'000, 1'000'000, THREADS);
+
+        // Start with a table that's big enough that random inserts are spread over many pages.
+        mainDB.beginTransaction(SQLite::TRANSACTION_TYPE::EXCLUSIVE);
+        ASSERT_TRUE(mainDB.write("CREATE TABLE ids (id INTEGER PRIMARY KEY, value TEXT NOT NULL);"));
+        ASSERT_TRUE(mainDB.write("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < " + SQ(PRELOADED_ROWS) + ") "
+                                 "INSERT OR IGNORE INTO ids SELECT random() & 0x7FFFFFFFFFFFFFFF, hex(zeroblob(50)) FROM c;"));
+        ASSERT_TRUE(mainDB.prepare());
+        ASSERT_EQUAL(mainDB.commit(), SQLITE_OK);
+
+        SQLiteUtils::setIDAllocation("ids", allocation);
+        atomic<uint64_t> commits(0);
+        atomic<uint64_t> conflicts(0);
+        atomic<uint64_t> pages(0);
+        const string value = SQ(string(100, 'x'));
+
+        uint64_t start = STimeNow();
+        list<thread> threads;
+        for (int i = 0; i < THREADS; i++) {
+            threads.emplace_back([&]() {
+                SQLite db(mainDB);
+                for (int commit = 0; commit < COMMITS_PER_THREAD; commit++) {
+                    while (true) {
+                        db.beginTransaction();
+                        try {
+                            for (int insert = 0; insert < INSERTS_PER_COMMIT; insert++) {
+                                const int64_t id = SQLiteUtils::getNewID(db, "ids", "id");
+                                db.write("INSERT INTO ids VALUES (" + SQ(id) + ", " + value + ");");
+                            }
+                        } catch (const SQLite::constraint_error& e) {
+                            // Two threads picked the same ID at the same time. Count it as a conflict and go again.
+                            db.rollback();
+                            conflicts++;
+                            continue;
+                        }
+                        db.prepare();
+                        int pagesBefore, pagesAfter, ignore;
+                        sqlite3_db_status(db.getDBHandle(), SQLITE_DBSTATUS_CACHE_WRITE, &pagesBefore, &ignore, 0);
+                        if (db.commit("PerfIDAllocation") == SQLITE_OK) {
+                            sqlite3_db_status(db.getDBHandle(), SQLITE_DBSTATUS_CACHE_WRITE, &pagesAfter, &ignore, 0);
+                            pages += pagesAfter - pagesBefore;
+                            commits++;
+                            break;
+                        }
+                        db.rollback();
+                        conflicts++;
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        uint64_t elapsed = STimeNow() - start;
+
+        cout << "[PerfIDAllocation] " << name << ": " << commits << " commits in " << (elapsed / 1000) << "ms, "
+             << (double)pages / commits << " pages written per commit, " << conflicts << " conflicts ("
+             << (100.0 * conflicts / (commits + conflicts)) << "%)." << endl;
+        ASSERT_EQUAL(commits.load(), (uint64_t)(THREADS * COMMITS_PER_THREAD));
+        SQLiteUtils::setIDAllocation("ids", SQLiteUtils::ID_ALLOCATION::RANDOM);
+
+        TestDBFile::remove(filename);
+    }
+} __IDAllocationPerfTest;
@@ -0,0 +1,100 @@
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLite.h>
+#include <sqlitecluster/SQLiteUtils.h>
+#include <test/lib/BedrockTester.h>
+#include <test/lib/TestSQLiteDB.h>
+
+struct IDAllocationTest : tpunit::TestFixture {
+    IDAllocationTest() : tpunit::TestFixture("IDAllocation",
+                                             TEST(IDAllocationTest::parse),
+                                             TEST(IDAllocationTest::threadPartitioned),
+                                             TEST(IDAllocationTest::timeOrdered)) { }
+
+    using ID_ALLOCATION = SQLiteUtils::ID_ALLOCATION;
+    static constexpr int PARTITION_SHIFT = SQLiteUtils::ID_TIME_BITS + SQLiteUtils::ID_RANDOM_BITS;
+
+    // Milliseconds since the ID epoch, as stored in localized IDs.
+    static uint64_t nowMS() {
+        return STimeNow() / 1000 - SQLiteUtils::ID_EPOCH_MS;
+    }
+
+    void parse() {
+        ID_ALLOCATION allocation = ID_ALLOCATION::RANDOM;
+        ASSERT_TRUE(SQLiteUtils::parseIDAllocation("thread", allocation));
+        ASSERT_TRUE(allocation == ID_ALLOCATION::THREAD_PARTITIONED);
+        ASSERT_TRUE(SQLiteUtils::parseIDAllocation("TIME", allocation));
+        ASSERT_TRUE(allocation == ID_ALLOCATION::TIME_ORDERED);
+        ASSERT_TRUE(SQLiteUtils::parseIDAllocation("Random", allocation));
+        ASSERT_TRUE(allocation == ID_ALLOCATION::RANDOM);
+
+        // Typos are rejected rather than quietly treated as random.
+        allocation = ID_ALLOCATION::TIME_ORDERED;
+        ASSERT_FALSE(SQLiteUtils::parseIDAllocation("threads", allocation));
+        ASSERT_FALSE(SQLiteUtils::parseIDAllocation("", allocation));
+        ASSERT_TRUE(allocation == ID_ALLOCATION::TIME_ORDERED);
+    }
+
+    void threadPartitioned() {
+        TestSQLiteDB test("idallocation");
+        TestSQLiteDB::commit(test.db, "CREATE TABLE ids (id INTEGER PRIMARY KEY);");
+
+        // Each thread gets its own handle, and allocates a few IDs.
+        const int threadCount = 4;
+        vector<list<int64_t>> ids(threadCount);
+        vector<uint64_t> before(threadCount);
+        vector<uint64_t> after(threadCount);
+        list<thread> threads;
+        for (int i = 0; i < threadCount; i++) {
+            threads.emplace_back([&, i]() {
+                SQLite db(test.db);
+                db.beginTransaction();
+                before[i] = nowMS();
+                for (int j = 0; j < 10; j++) {
+                    ids[i].push_back(SQLiteUtils::getLocalizedID(db, "ids", "id", ID_ALLOCATION::THREAD_PARTITIONED));
+                }
+                after[i] = nowMS();
+                db.rollback();
+            });
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+
+        // [0][partition][time][random]: positive, one partition per thread, and the time they were made.
+        set<int64_t> partitions;
+        for (int i = 0; i < threadCount; i++) {
+            const int64_t partition = ids[i].front() >> PARTITION_SHIFT;
+            partitions.insert(partition);
+            for (int64_t id : ids[i]) {
+                ASSERT_GREATER_THAN(id, 0);
+                ASSERT_EQUAL(id >> PARTITION_SHIFT, partition);
+                const uint64_t timeMS = (id >> SQLiteUtils::ID_RANDOM_BITS) & ((1ll << SQLiteUtils::ID_TIME_BITS) - 1);
+                ASSERT_GREATER_THAN_EQUAL(timeMS, before[i]);
+                ASSERT_LESS_THAN_EQUAL(timeMS, after[i]);
+            }
+        }
+        ASSERT_EQUAL(partitions.size(), (size_t)threadCount);
+    }
+
+    void timeOrdered() {
+        TestSQLiteDB test("idallocation");
+        SQLite& db = test.db;
+        TestSQLiteDB::commit(db, "CREATE TABLE ids (id INTEGER PRIMARY KEY);");
+
+        // [0][time][random], so IDs made at least a millisecond apart sort in the order they were made.
+        db.beginTransaction();
+        int64_t previous = 0;
+        for (int i = 0; i < 10; i++) {
+            const uint64_t before = nowMS();
+            const int64_t id = SQLiteUtils::getLocalizedID(db, "ids", "id", ID_ALLOCATION::TIME_ORDERED);
+            const uint64_t after = nowMS();
+            ASSERT_GREATER_THAN(id, previous);
+            const uint64_t timeMS = id >> (SQLiteUtils::ID_PARTITION_BITS + SQLiteUtils::ID_RANDOM_BITS);
+            ASSERT_GREATER_THAN_EQUAL(timeMS, before);
+            ASSERT_LESS_THAN_EQUAL(timeMS, after);
+            previous = id;
+            usleep(2000);
+        }
+        db.rollback();
+    }
+} __IDAllocationTest;
@@ -0,0 +1,112 @@
+#include <libstuff/libstuff.h>
+#include <libstuff/SQResult.h>
+#include <test/lib/BedrockTester.h>
+
+// Measures composing and parsing the JSON payloads Bedrock handles most: `CreateJobs` job lists and query results.
+// Run with `-perf`.
+struct JSONPerfTest : tpunit::TestFixture {
+    JSONPerfTest() : tpunit::TestFixture("PerfJSON",
+                                         TEST(JSONPerfTest::createJobs),
+                                         TEST(JSONPerfTest::queryResult)) { }
+
+    static constexpr int ITERATIONS = 2'000;
+
+    // A `jobs` parameter for CreateJobs, with a mix of numbers, strings that need escaping, and nested data.
+    static string makeCreateJobs() {
+        list<string> jobs;
+        for (int i = 0; i < 100; i++) {
+            STable data;
+            data["accountID"] = to_string(1'000'000 + i);
+            data["reportID"] = to_string(80'000'000'000ll + i);
+            data["amount"] = to_string(i * 1.25);
+            data["email"] = "user" + to_string(i) + "@example.com";
+            data["note"] = "Line one\nLine \"two\"\twith a tab";
+            data["sync"] = i % 2 ? "true" : "false";
+            data["tags"] = SComposeJSONArray(list<string>{"alpha", "beta", to_string(i)});
+
+            STable job;
+            job["name"] = "www-prod/SendEmail?reportID=" + data["reportID"];
+            job["priority"] = "500";
+            job["firstRun"] = "2025-01-01 00:00:00";
+            job["repeat"] = "SCHEDULED, +1 HOUR";
+            job["data"] = SComposeJSONObject(data);
+            jobs.push_back(SComposeJSONObject(job));
+        }
+        return SComposeJSONArray(jobs);
+    }
+
+    // A result like a `Query` command returns, mostly short numeric and text columns.
+    static SQResult makeQueryResult() {
+        SQResult result;
+        result.headers = {"jobID", "state", "name", "nextRun", "priority", "data"};
+        for (int i = 0; i < 200; i++) {
+            SQResultRow row(result);
+            row.push_back(to_string(5'000'000'000ll + i));
+            row.push_back("QUEUED");
+            row.push_back("www-prod/job" + to_string(i));
+            row.push_back("2025-01-01 00:00:00");
+            row.push_back(to_string(i % 3 * 500));
+            row.push_back("{\"accountID\":" + to_string(i) + ",\"email\":\"user" + to_string(i) + "@example.com\"}");
+            result.rows.push_back(row);
+        }
+        return result;
+    }
+
+    void createJobs() {
+        const string payload = makeCreateJobs();
+
+        // Parsing and recomposing is lossless.
+        list<string> parsed = SParseJSONArray(payload);
+        ASSERT_EQUAL(parsed.size(), 100);
+        ASSERT_EQUAL(SComposeJSONArray(parsed), payload);
+        STable first = SParseJSONObject(parsed.front());
+        ASSERT_EQUAL(SParseJSONObject(first["data"])["note"], "Line one\nLine \"two\"\twith a tab");
+
+        uint64_t start = STimeNow();
+        size_t jobs = 0;
+        for (int i = 0; i < ITERATIONS; i++) {
+            for (const string& job : SParseJSONArray(payload)) {
+                STable fields = SParseJSONObject(job);
+                jobs += SParseJSONObject(fields["data"]).size() ? 1 : 0;
+            }
+        }
+        uint64_t elapsed = STimeNow() - start;
+        cout << "[PerfJSON] CreateJobs parse: " << (jobs * 1'000'000ull / elapsed) << " jobs/sec, "
+             << (payload.size() * ITERATIONS * 1'000'000ull / elapsed / 1'000'000) << " MB/sec." << endl;
+
+        start = STimeNow();
+        size_t bytes = 0;
+        for (int i = 0; i < ITERATIONS; i++) {
+            bytes += makeCreateJobs().size();
+        }
+        elapsed = STimeNow() - start;
+        cout << "[PerfJSON] CreateJobs compose: " << (bytes * 1'000'000ull / elapsed / 1'000'000) << " MB/sec." << endl;
+    }
+
+    void queryResult() {
+        const SQResult result = makeQueryResult();
+        const string json = result.serializeToJSON();
+
+        SQResult parsed;
+        ASSERT_TRUE(parsed.deserialize(json));
+        ASSERT_EQUAL(parsed.size(), result.size());
+        ASSERT_EQUAL(parsed.serializeToJSON(), json);
+
+        uint64_t start = STimeNow();
+        size_t bytes = 0;
+        for (int i = 0; i < ITERATIONS; i++) {
+            bytes += result.serializeToJSON().size();
+        }
+        uint64_t elapsed = STimeNow() - start;
+        cout << "[PerfJSON] Query serialize: " << (ITERATIONS * 1'000'000ull / elapsed) << " results/sec, "
+             << (bytes * 1'000'000ull / elapsed / 1'000'000) << " MB/sec." << endl;
+
+        start = STimeNow();
+        for (int i = 0; i < ITERATIONS; i++) {
+            parsed.deserialize(json);
+        }
+        elapsed = STimeNow() - start;
+        cout << "[PerfJSON] Query deserialize: " << (ITERATIONS * 1'000'000ull / elapsed) << " results/sec, "
+             << (json.size() * ITERATIONS * 1'000'000ull / elapsed / 1'000'000) << " MB/sec." << endl;
+    }
+} __JSONPerfTest;
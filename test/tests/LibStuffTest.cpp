@@ -1,9 +1,11 @@
 #include <cstring>
+#include <sys/socket.h>
 
 #include <libstuff/libstuff.h>
 #include <libstuff/SData.h>
 #include <libstuff/SQResult.h>
 #include <libstuff/SRandom.h>
+#include <libstuff/STCPManager.h>
 #include <sqlitecluster/SQLite.h>
 #include <test/lib/BedrockTester.h>
 
@@ -32,7 +34,9 @@ struct LibStuff : tpunit::TestFixture {
                                     TEST(LibStuff::testBase32Conversion),
                                     TEST(LibStuff::testContains),
                                     TEST(LibStuff::testFirstOfMonth),
-                                    TEST(LibStuff::SQResultTest)
+                                    TEST(LibStuff::SQResultTest),
+                                    TEST(LibStuff::testSharedSendBuffer),
+                                    TEST(LibStuff::testFastBufferReserveTail)
                                     )
     { }
 
@@ -88,6 +92,22 @@ struct LibStuff : tpunit::TestFixture {
         ASSERT_EQUAL(SToJSON("{\"science\":9e+61}"), "{\"science\":9e+61}");
         ASSERT_EQUAL(SToJSON("{\"science\":1E+99}"), "{\"science\":1E+99}");
 
+        // Only values that survive a round trip through a number are written as numbers.
+        ASSERT_EQUAL(SToJSON("-42"), "-42");
+        ASSERT_EQUAL(SToJSON("042"), "\"042\"");
+        ASSERT_EQUAL(SToJSON("9223372036854775807"), "9223372036854775807");
+        ASSERT_EQUAL(SToJSON("9223372036854775808"), "\"9223372036854775808\"");
+        ASSERT_EQUAL(SToJSON("1.500000"), "1.500000");
+        ASSERT_EQUAL(SToJSON("1.5"), "\"1.5\"");
+        ASSERT_EQUAL(SToJSON("TRUE"), "true");
+        ASSERT_EQUAL(SToJSON("a\tb\x01\"c\\"), "\"a\\tb\\u0001\\\"c\\\\\"");
+
+        // Appending matches composing.
+        string appended = "[";
+        SAppendJSON(appended, "x\ny");
+        SAppendJSON(appended, 7);
+        ASSERT_EQUAL(appended, "[\"x\\ny\"7");
+
         STable innerObject0, innerObject1, innerObject0Verify, innerObject1Verify;
         innerObject0["utf8"] = "{\"foo\":\"\\u00b7\"}";
         innerObject0["singleQuoteTest"] = "These are 'single quotes'.";
@@ -679,4 +699,57 @@ struct LibStuff : tpunit::TestFixture {
         db.rollback();
         ASSERT_EQUAL(result[0]["coco"], "name1");
     }
+
+    void testSharedSendBuffer() {
+        int fds[2];
+        ASSERT_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        STCPManager::Socket socket(fds[0], STCPManager::Socket::CONNECTED);
+
+        // Copied and shared buffers interleave in the order they were sent, and the shared buffer isn't consumed.
+        SSharedBuffer shared = make_shared<const string>("shared");
+        ASSERT_TRUE(socket.send("one,"s));
+        ASSERT_TRUE(socket.send(shared));
+        ASSERT_TRUE(socket.send(",two,"s));
+        ASSERT_TRUE(socket.send(shared));
+        ASSERT_TRUE(socket.sendBufferEmpty());
+        ASSERT_EQUAL(*shared, "shared");
+
+        char buffer[100];
+        ssize_t received = ::recv(fds[1], buffer, sizeof(buffer), 0);
+        ASSERT_EQUAL(string(buffer, received), "one,shared,two,shared");
+        close(fds[1]);
+    }
+
+    void testFastBufferReserveTail() {
+        SFastBuffer buffer;
+        buffer.append("hello", 5);
+        buffer.consumeFront(2);
+
+        // Only the committed part of the reserved space becomes part of the buffer.
+        char* tail = buffer.reserveTail(100);
+        memcpy(tail, "world", 5);
+        buffer.commitTail(5);
+        ASSERT_EQUAL(string(buffer.c_str(), buffer.size()), "lloworld");
+        buffer.reserveTail(100);
+        buffer.commitTail(0);
+        ASSERT_EQUAL(string(buffer.c_str(), buffer.size()), "lloworld");
+        ASSERT_EQUAL(strlen(buffer.c_str()), 8);
+
+        // Growing past the reserved space keeps what's there, and copies are independent.
+        for (int i = 0; i < 1000; i++) {
+            tail = buffer.reserveTail(1000);
+            memset(tail, 'a' + i % 26, 1000);
+            buffer.commitTail(i % 2 ? 1000 : 10);
+        }
+        ASSERT_EQUAL(buffer.size(), 8 + 500 * 1000 + 500 * 10);
+        ASSERT_EQUAL(string(buffer.c_str(), 8), "lloworld");
+        ASSERT_EQUAL(buffer.c_str()[buffer.size() - 1], 'a' + 999 % 26);
+        SFastBuffer copy = buffer;
+        buffer.consumeFront(buffer.size() - 3);
+        ASSERT_EQUAL(string(buffer.c_str(), buffer.size()), string(3, 'a' + 999 % 26));
+        ASSERT_EQUAL(copy.size(), 8 + 500 * 1000 + 500 * 10);
+        buffer.consumeFront(3);
+        ASSERT_TRUE(buffer.empty());
+        ASSERT_EQUAL(string(buffer.c_str()), "");
+    }
 } __LibStuff;
@@ -0,0 +1,162 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLite.h>
+#include <sqlitecluster/SQLitePageCache.h>
+#include <test/lib/BedrockTester.h>
+#include <test/lib/TestSQLiteDB.h>
+
+// Compares random point reads over a hot working set much larger than the TLB covers, using SQLite's built-in page
+// cache and the arena page cache, with and without huge pages. Reports throughput and, where the kernel lets us count
+// them, dTLB misses per read. Run with `-perf`.
+struct PageCachePerfTest : tpunit::TestFixture {
+    PageCachePerfTest() : tpunit::TestFixture("PerfPageCache",
+                                              BEFORE_CLASS(PageCachePerfTest::setup),
+                                              AFTER_CLASS(PageCachePerfTest::tearDown),
+                                              TEST(PageCachePerfTest::builtin),
+                                              TEST(PageCachePerfTest::arena),
+                                              TEST(PageCachePerfTest::arenaHugePages)) { }
+
+    static constexpr int THREADS = 4;
+    static constexpr int ROWS = 400'000;
+    static constexpr int READS_PER_THREAD = 500'000;
+
+    // Enough for every handle to hold the whole table.
+    static constexpr int CACHE_SIZE_KB = 256 * 1024;
+
+    string filename;
+
+    void setup() {
+        filename = BedrockTester::getTempFileName("pagecache");
+        SQLite db(filename, CACHE_SIZE_KB, 1'000'000, THREADS);
+        db.beginTransaction(SQLite::TRANSACTION_TYPE::EXCLUSIVE);
+        ASSERT_TRUE(db.write("CREATE TABLE rows (id INTEGER PRIMARY KEY, value TEXT NOT NULL);"));
+        ASSERT_TRUE(db.write("WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < " + SQ(ROWS) + ") "
+                             "INSERT INTO rows SELECT x, hex(randomblob(100)) FROM c;"));
+        ASSERT_TRUE(db.prepare());
+        ASSERT_EQUAL(db.commit(), SQLITE_OK);
+    }
+
+    void tearDown() {
+        reinstall(false, false);
+        TestDBFile::remove(filename);
+    }
+
+    void builtin() {
+        reinstall(false, false);
+        run("builtin");
+    }
+
+    void arena() {
+        reinstall(true, false);
+        run("arena");
+    }
+
+    void arenaHugePages() {
+        reinstall(true, true);
+        run("arena+hugepages");
+        cout << "[PerfPageCache] " << SQLitePageCache::getInfo()["hugePageBytes"] << " bytes in explicit huge pages." << endl;
+    }
+
+    // The page cache can only be changed while SQLite isn't initialized, which also means no handles are open.
+    void reinstall(bool useArena, bool hugePages) {
+        sqlite3_shutdown();
+        if (useArena) {
+            SQLitePageCache::uninstall();
+            ASSERT_TRUE(SQLitePageCache::install(0, hugePages));
+        } else {
+            ASSERT_TRUE(SQLitePageCache::uninstall());
+        }
+        sqlite3_initialize();
+    }
+
+    // Opens a counter of dTLB read misses in user space for the calling thread, or returns -1 if we're not allowed.
+    static int openTLBCounter() {
+        perf_event_attr attr = {};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        return fd;
+    }
+
+    void run(const string& name) {
+        SQLite mainDB(filename, CACHE_SIZE_KB, 1'000'000, THREADS);
+        atomic<uint64_t> reads(0);
+        atomic<uint64_t> tlbMisses(0);
+        atomic<bool> countersAvailable(true);
+        atomic<int> warm(0);
+
+        uint64_t start = 0;
+        list<thread> threads;
+        for (int i = 0; i < THREADS; i++) {
+            threads.emplace_back([&, i]() {
+                SQLite db(mainDB);
+
+                // Pull the whole table into this handle's cache before timing anything.
+                db.beginTransaction();
+                ASSERT_EQUAL(db.read("SELECT COUNT(*) FROM rows WHERE value != '';"), to_string(ROWS));
+                db.rollback();
+                warm++;
+                while (warm < THREADS) {
+                    this_thread::yield();
+                }
+
+                int counter = openTLBCounter();
+                if (counter < 0) {
+                    countersAvailable = false;
+                }
+                uint64_t seed = 0x9E3779B97F4A7C15ull * (i + 1);
+                db.beginTransaction();
+                for (int read = 0; read < READS_PER_THREAD; read++) {
+                    // xorshift, so picking the row costs next to nothing.
+                    seed ^= seed << 13;
+                    seed ^= seed >> 7;
+                    seed ^= seed << 17;
+                    sqlite3_stmt* statement;
+                    sqlite3_prepare_v2(db.getDBHandle(), "SELECT value FROM rows WHERE id = ?;", -1, &statement, nullptr);
+                    sqlite3_bind_int64(statement, 1, seed % ROWS + 1);
+                    if (sqlite3_step(statement) == SQLITE_ROW) {
+                        reads++;
+                    }
+                    sqlite3_finalize(statement);
+                }
+                db.rollback();
+                if (counter >= 0) {
+                    uint64_t misses = 0;
+                    if (::read(counter, &misses, sizeof(misses)) == sizeof(misses)) {
+                        tlbMisses += misses;
+                    }
+                    close(counter);
+                }
+            });
+        }
+        while (warm < THREADS) {
+            this_thread::yield();
+        }
+        start = STimeNow();
+        for (auto& t : threads) {
+            t.join();
+        }
+        const uint64_t elapsed = STimeNow() - start;
+
+        cout << "[PerfPageCache] " << name << ": " << reads << " reads in " << (elapsed / 1000) << "ms, "
+             << (uint64_t)(reads * (double)STIME_US_PER_S / elapsed) << " reads/s, ";
+        if (countersAvailable) {
+            cout << (double)tlbMisses / reads << " dTLB misses per read." << endl;
+        } else {
+            cout << "dTLB misses not available." << endl;
+        }
+        ASSERT_EQUAL(reads.load(), (uint64_t)THREADS * READS_PER_THREAD);
+    }
+} __PageCachePerfTest;
@@ -0,0 +1,82 @@
+#include <libstuff/SData.h>
+#include <test/lib/BedrockTester.h>
+
+struct PageCacheTest : tpunit::TestFixture {
+    PageCacheTest()
+        : tpunit::TestFixture("PageCache",
+                              TEST(PageCacheTest::arena),
+                              TEST(PageCacheTest::notInstalled)) { }
+
+    // Returns the `pageCache` section of Status.
+    STable getPageCacheInfo(BedrockTester& tester) {
+        return SParseJSONObject(SParseJSONObject(tester.executeWaitVerifyContent(SData("Status"), "200", true))["pageCache"]);
+    }
+
+    // Runs a query on the server (rather than `readDB`, which opens the file in this process, without the arenas), and
+    // returns the first row.
+    vector<string> queryRow(BedrockTester& tester, const string& sql) {
+        SData query("Query");
+        query["Format"] = "json";
+        query["Query"] = sql;
+        const list<string> rows = SParseJSONArray(SParseJSONObject(tester.executeWaitVerifyContent(query))["rows"]);
+        if (rows.empty()) {
+            return {};
+        }
+        const list<string> row = SParseJSONArray(rows.front());
+        return vector<string>(row.begin(), row.end());
+    }
+
+    // A server with its pages in the arenas reads back what it wrote, including after its budget is cut to less than
+    // the table takes up.
+    void arena() {
+        BedrockTester tester({{"-arenaPageCache", ""}, {"-arenaPageCacheMB", "64"}},
+                             {"CREATE TABLE pages (id INTEGER PRIMARY KEY, value TEXT NOT NULL);"});
+
+        SData query("Query");
+        query["Query"] = "INSERT INTO pages WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 5000) "
+                         "SELECT x, printf('%01000d', x) FROM c;";
+        tester.executeWaitVerifyContent(query);
+
+        vector<string> row = queryRow(tester, "SELECT COUNT(*), SUM(length(value)), SUM(CAST(value AS INTEGER)) FROM pages;");
+        ASSERT_EQUAL(row.size(), 3);
+        ASSERT_EQUAL(row[0], "5000");
+        ASSERT_EQUAL(row[1], "5000000");
+        ASSERT_EQUAL(row[2], "12502500");
+
+        STable info = getPageCacheInfo(tester);
+        ASSERT_EQUAL(info["budgetBytes"], to_string(64 * 1024 * 1024));
+        ASSERT_GREATER_THAN(SToUInt64(info["caches"]), 0);
+        ASSERT_GREATER_THAN(SToUInt64(info["usedBytes"]), 0);
+        ASSERT_GREATER_THAN_EQUAL(SToUInt64(info["mappedBytes"]), SToUInt64(info["usedBytes"]));
+
+        // Cut the budget below the ~5MB the table takes, so handles reuse their own pages to read it.
+        SData command("SetCacheParams");
+        command["ArenaBudgetMB"] = "1";
+        const SData response = tester.executeWaitMultipleData({command}, 1, true)[0];
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_EQUAL(response["previousArenaBudgetMB"], "64");
+        ASSERT_EQUAL(getPageCacheInfo(tester)["budgetBytes"], to_string(1024 * 1024));
+
+        for (int i = 0; i < 3; i++) {
+            row = queryRow(tester, "SELECT COUNT(*), SUM(CAST(value AS INTEGER)) FROM pages WHERE length(value) = 1000;");
+            ASSERT_EQUAL(row.size(), 2);
+            ASSERT_EQUAL(row[0], "5000");
+            ASSERT_EQUAL(row[1], "12502500");
+        }
+        row = queryRow(tester, "SELECT value FROM pages WHERE id = 4321;");
+        ASSERT_EQUAL(row.size(), 1);
+        ASSERT_EQUAL(row[0], string(996, '0') + "4321");
+    }
+
+    // Setting an arena budget on a server that isn't using the arenas is an error rather than silently ignored.
+    void notInstalled() {
+        BedrockTester tester;
+        SData command("SetCacheParams");
+        command["ArenaBudgetMB"] = "64";
+        tester.executeWaitVerifyContent(command, "400 Arena page cache not installed", true);
+
+        const STable status = SParseJSONObject(tester.executeWaitVerifyContent(SData("Status"), "200", true));
+        ASSERT_FALSE(status.count("pageCache"));
+    }
+
+} __PageCacheTest;
@@ -0,0 +1,55 @@
+#include <libstuff/libstuff.h>
+#include <libstuff/SData.h>
+#include <sqlitecluster/SQLitePeer.h>
+#include <test/lib/BedrockTester.h>
+
+// Compares the cost of serializing and parsing replication messages in the text and binary peer formats.
+// Run with `-perf`. Correctness is covered by PeerProtocolTest.
+struct PeerProtocolPerfTest : tpunit::TestFixture {
+    PeerProtocolPerfTest() : tpunit::TestFixture("PerfPeerProtocol",
+                                                 TEST(PeerProtocolPerfTest::throughput)) { }
+
+    static constexpr int MESSAGES = 200'000;
+
+    // A typical BEGIN_TRANSACTION, as sent by a leader to its followers.
+    static SData makeMessage() {
+        SData message("BEGIN_TRANSACTION");
+        message["NewCount"] = "123456789";
+        message["NewHash"] = "0123456789ABCDEF0123456789ABCDEF01234567";
+        message["ID"] = "ASYNC_123456789";
+        message["leaderSendTime"] = to_string(STimeNow());
+        message["dbCountAtStart"] = "123456788";
+        message["CommitCount"] = "123456788";
+        message["Hash"] = "76543210FEDCBA9876543210FEDCBA9876543210";
+        message["commandAddress"] = "127.0.0.1:8890";
+        message["unknownHeader"] = "value";
+        message.content = "INSERT INTO cache VALUES ('" + string(1000, 'x') + "');";
+        return message;
+    }
+
+    void throughput() {
+        const SData message = makeMessage();
+
+        uint64_t start = STimeNow();
+        size_t bytes = 0;
+        for (int i = 0; i < MESSAGES; i++) {
+            SData parsed;
+            string serialized = message.serialize();
+            bytes += parsed.deserialize(serialized);
+        }
+        uint64_t textElapsed = STimeNow() - start;
+        cout << "[PerfPeerProtocol] text: " << (MESSAGES * 1'000'000ull / textElapsed) << " messages/sec, "
+             << (bytes / MESSAGES) << " bytes/message." << endl;
+
+        start = STimeNow();
+        bytes = 0;
+        for (int i = 0; i < MESSAGES; i++) {
+            SData parsed;
+            string serialized = SQLitePeer::serializeBinary(message);
+            bytes += SQLitePeer::deserializeBinary(serialized.c_str(), serialized.size(), parsed);
+        }
+        uint64_t binaryElapsed = STimeNow() - start;
+        cout << "[PerfPeerProtocol] binary: " << (MESSAGES * 1'000'000ull / binaryElapsed) << " messages/sec, "
+             << (bytes / MESSAGES) << " bytes/message." << endl;
+    }
+} __PeerProtocolPerfTest;
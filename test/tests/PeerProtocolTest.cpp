@@ -0,0 +1,107 @@
+#include <libstuff/libstuff.h>
+#include <libstuff/SData.h>
+#include <sqlitecluster/SQLitePeer.h>
+#include <test/lib/BedrockTester.h>
+
+struct PeerProtocolTest : tpunit::TestFixture {
+    PeerProtocolTest() : tpunit::TestFixture("PeerProtocol",
+                                             TEST(PeerProtocolTest::roundTrip),
+                                             TEST(PeerProtocolTest::varints),
+                                             TEST(PeerProtocolTest::malformed)) { }
+
+    // A typical BEGIN_TRANSACTION, as sent by a leader to its followers.
+    static SData makeMessage() {
+        SData message("BEGIN_TRANSACTION");
+        message["NewCount"] = "123456789";
+        message["NewHash"] = "0123456789ABCDEF0123456789ABCDEF01234567";
+        message["ID"] = "ASYNC_123456789";
+        message["leaderSendTime"] = to_string(STimeNow());
+        message["dbCountAtStart"] = "123456788";
+        message["CommitCount"] = "123456788";
+        message["Hash"] = "76543210FEDCBA9876543210FEDCBA9876543210";
+        message["commandAddress"] = "127.0.0.1:8890";
+        message["unknownHeader"] = "value";
+        message.content = "INSERT INTO cache VALUES ('" + string(1000, 'x') + "');";
+        return message;
+    }
+
+    static void verifyParsed(const SData& parsed, const SData& message) {
+        ASSERT_EQUAL(parsed.methodLine, message.methodLine);
+        ASSERT_EQUAL(parsed.content, message.content);
+        for (const auto& [name, value] : message.nameValueMap) {
+            ASSERT_EQUAL(parsed[name], value);
+        }
+        ASSERT_EQUAL(parsed.nameValueMap.size(), message.nameValueMap.size());
+    }
+
+    void roundTrip() {
+        SData message = makeMessage();
+        string serialized = SQLitePeer::serializeBinary(message);
+        ASSERT_EQUAL((uint8_t)serialized[0], SQLitePeer::BINARY_FRAME_MAGIC);
+
+        // Incomplete frames aren't consumed.
+        SData parsed;
+        for (size_t length : {(size_t)0, (size_t)5, serialized.size() - 1}) {
+            ASSERT_EQUAL(SQLitePeer::deserializeBinary(serialized.c_str(), length, parsed), 0);
+        }
+
+        // A complete frame followed by the start of another only consumes the first.
+        string twoFrames = serialized + serialized.substr(0, 10);
+        ASSERT_EQUAL(SQLitePeer::deserializeBinary(twoFrames.c_str(), twoFrames.size(), parsed), serialized.size());
+        verifyParsed(parsed, message);
+
+        // Content-Length is implied by the frame, and comes back out as it went in.
+        message["Content-Length"] = to_string(message.content.size());
+        serialized = SQLitePeer::serializeBinary(message);
+        ASSERT_EQUAL(SQLitePeer::deserializeBinary(serialized.c_str(), serialized.size(), parsed), serialized.size());
+        ASSERT_EQUAL(parsed.content, message.content);
+    }
+
+    // Lengths on either side of each varint byte boundary survive the round trip.
+    void varints() {
+        for (size_t size : {0, 1, 127, 128, 129, 16383, 16384, 16385, 2'097'152}) {
+            SData message("METHOD_" + string(size % 200, 'm'));
+            message["header" + string(size % 300, 'h')] = string(size, 'v');
+            message["NewCount"] = to_string(size);
+            message.content = string(size, 'c');
+            string serialized = SQLitePeer::serializeBinary(message);
+            SData parsed;
+            ASSERT_EQUAL(SQLitePeer::deserializeBinary(serialized.c_str(), serialized.size(), parsed), serialized.size());
+            verifyParsed(parsed, message);
+        }
+    }
+
+    void malformed() {
+        SData message = makeMessage();
+        SData parsed;
+
+        // Corrupting the version is rejected.
+        string serialized = SQLitePeer::serializeBinary(message);
+        serialized[1] = 99;
+        ASSERT_THROW(SQLitePeer::deserializeBinary(serialized.c_str(), serialized.size(), parsed), SException);
+
+        // So is a text message.
+        serialized = message.serialize();
+        ASSERT_THROW(SQLitePeer::deserializeBinary(serialized.c_str(), serialized.size(), parsed), SException);
+
+        // A frame that ends part way through a varint, or a string whose length runs past the end of the frame.
+        const string header = string(1, (char)SQLitePeer::BINARY_FRAME_MAGIC) + (char)SQLitePeer::BINARY_PROTOCOL_VERSION;
+        for (const string& body : {string("\x80", 1), string("\x05" "ab", 3), string("\x80\x80\x80\x80\x80\x80\x80\x80\x80\x80\x01", 11)}) {
+            string frame = header;
+            for (int i = 0; i < 4; i++) {
+                frame += (char)((body.size() >> (8 * i)) & 0xFF);
+            }
+            frame += body;
+            ASSERT_THROW(SQLitePeer::deserializeBinary(frame.c_str(), frame.size(), parsed), SException);
+        }
+
+        // An unknown header index.
+        string body = string("\x01" "A" "\x01" "\xFF" "\x00", 5);
+        string frame = header;
+        for (int i = 0; i < 4; i++) {
+            frame += (char)((body.size() >> (8 * i)) & 0xFF);
+        }
+        frame += body;
+        ASSERT_THROW(SQLitePeer::deserializeBinary(frame.c_str(), frame.size(), parsed), SException);
+    }
+} __PeerProtocolTest;
@@ -0,0 +1,99 @@
+#include <libstuff/libstuff.h>
+#include <libstuff/SQResult.h>
+#include <sqlitecluster/SQLite.h>
+#include <test/lib/BedrockTester.h>
+#include <test/lib/TestSQLiteDB.h>
+
+struct SQLiteAuthorizerTest : tpunit::TestFixture {
+    SQLiteAuthorizerTest() : tpunit::TestFixture("SQLiteAuthorizer",
+                                                 TEST(SQLiteAuthorizerTest::repeatedQueries),
+                                                 TEST(SQLiteAuthorizerTest::whitelist)) { }
+
+    void repeatedQueries() {
+        TestSQLiteDB test("authorizer");
+        SQLite& db = test.db;
+        TestSQLiteDB::commit(db, "CREATE TABLE a (id INTEGER PRIMARY KEY, value TEXT);");
+        TestSQLiteDB::commit(db, "CREATE TABLE b (id INTEGER PRIMARY KEY, value TEXT);");
+        TestSQLiteDB::commit(db, "INSERT INTO a VALUES (1, 'one'), (2, 'two');");
+
+        // The same query with different literals still records the tables it uses.
+        for (const char* id : {"1", "2", "0x1", "'it''s'"}) {
+            ASSERT_TRUE(db.beginTransaction());
+            ASSERT_TRUE(db.getTablesUsed().empty());
+            db.read("SELECT value FROM a WHERE id = "s + id + ";");
+            ASSERT_TRUE(db.getTablesUsed() == set<string>{"a"});
+            db.rollback();
+        }
+
+        // A string where a name is expected is a name, so queries differing only in a quoted table name aren't
+        // mistaken for each other.
+        for (const char* table : {"a", "b"}) {
+            ASSERT_TRUE(db.beginTransaction());
+            db.read("SELECT value FROM '"s + table + "' WHERE id = 2;");
+            ASSERT_TRUE(db.getTablesUsed() == set<string>{table});
+            db.rollback();
+        }
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_EQUAL(db.read("SELECT value FROM a WHERE id = 2;"), "two");
+        ASSERT_EQUAL(db.read("SELECT value FROM b WHERE id = 2;"), "");
+        ASSERT_TRUE(db.getTablesUsed() == (set<string>{"a", "b"}));
+        db.rollback();
+
+        // Writes too, and `current_timestamp` is denied in them even when the same query has been allowed in a read.
+        TestSQLiteDB::commit(db, "UPDATE a SET value = 'uno' WHERE id = 1;");
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_TRUE(db.write("UPDATE a SET value = 'dos' WHERE id = 2;"));
+        ASSERT_TRUE(db.getTablesUsed() == set<string>{"a"});
+        ASSERT_FALSE(db.read("SELECT current_timestamp;").empty());
+        ASSERT_FALSE(db.write("SELECT current_timestamp;"));
+        db.rollback();
+
+        // A schema change by another handle is picked up, here by replacing a view with one over a different table.
+        TestSQLiteDB::commit(db, "CREATE VIEW v AS SELECT value FROM a;");
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_EQUAL(db.read("SELECT value FROM v LIMIT 1;"), "uno");
+        ASSERT_TRUE(db.getTablesUsed().count("a"));
+        db.rollback();
+        {
+            SQLite other(db);
+            TestSQLiteDB::commit(other, "DROP VIEW v;");
+            TestSQLiteDB::commit(other, "CREATE VIEW v AS SELECT value FROM b;");
+        }
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_EQUAL(db.read("SELECT value FROM v LIMIT 2;"), "");
+        ASSERT_TRUE(db.getTablesUsed().count("b"));
+        ASSERT_FALSE(db.getTablesUsed().count("a"));
+        db.rollback();
+    }
+
+    void whitelist() {
+        TestSQLiteDB test("authorizer");
+        SQLite& db = test.db;
+        TestSQLiteDB::commit(db, "CREATE TABLE a (id INTEGER PRIMARY KEY, value TEXT, secret TEXT);");
+        TestSQLiteDB::commit(db, "INSERT INTO a VALUES (1, 'one', 'hidden');");
+        ASSERT_EQUAL(db.read("SELECT secret FROM a WHERE id = 1;"), "hidden");
+
+        // Queries already seen without a whitelist are checked against it once one is set.
+        map<string, set<string>> allowed = {{"a", {"id", "value"}}};
+        db.whitelist = &allowed;
+        ASSERT_EQUAL(db.read("SELECT secret FROM a WHERE id = 1;"), "");
+        ASSERT_EQUAL(db.read("SELECT value FROM a WHERE id = 1;"), "one");
+        ASSERT_EQUAL(db.read("SELECT value FROM a WHERE id = 1;"), "one");
+        ASSERT_EQUAL(db.read("SELECT secret FROM a WHERE id = 1;"), "");
+        db.whitelist = nullptr;
+        ASSERT_EQUAL(db.read("SELECT secret FROM a WHERE id = 1;"), "hidden");
+
+        // Quoted table names are checked too, even right after the same query for an allowed table.
+        TestSQLiteDB::commit(db, "CREATE TABLE pub (value TEXT);");
+        TestSQLiteDB::commit(db, "CREATE TABLE secret (value TEXT);");
+        TestSQLiteDB::commit(db, "INSERT INTO pub VALUES ('public');");
+        TestSQLiteDB::commit(db, "INSERT INTO secret VALUES ('hidden');");
+        allowed = {{"pub", {"value"}}};
+        db.whitelist = &allowed;
+        ASSERT_EQUAL(db.read("SELECT value FROM 'pub';"), "public");
+        ASSERT_EQUAL(db.read("SELECT value FROM 'secret';"), "");
+        ASSERT_EQUAL(db.read("SELECT value FROM 'pub';"), "public");
+        ASSERT_EQUAL(db.read("SELECT value FROM 'secret';"), "");
+        db.whitelist = nullptr;
+    }
+} __SQLiteAuthorizerTest;
@@ -0,0 +1,171 @@
+#include <libstuff/libstuff.h>
+#include <libstuff/SRandom.h>
+#include <sqlitecluster/SQLite.h>
+#include <sqlitecluster/SQLiteIDFilter.h>
+#include <sqlitecluster/SQLiteUtils.h>
+#include <test/lib/BedrockTester.h>
+#include <test/lib/TestSQLiteDB.h>
+
+struct SQLiteIDFilterTest : tpunit::TestFixture {
+    SQLiteIDFilterTest() : tpunit::TestFixture("SQLiteIDFilter",
+                                               TEST(SQLiteIDFilterTest::filter),
+                                               TEST(SQLiteIDFilterTest::grows),
+                                               TEST(SQLiteIDFilterTest::builtAtStartup),
+                                               TEST(SQLiteIDFilterTest::updatedOnWrite),
+                                               TEST(SQLiteIDFilterTest::notRowID),
+                                               TEST(SQLiteIDFilterTest::attachedDatabase)) { }
+
+    // The filter for `tableName` is read from the table in the background, and isn't used until it's done.
+    void waitForReady(SQLite& db, const string& tableName) {
+        for (int i = 0; i < 1000; i++) {
+            if (SParseJSONObject(db.getIDFilterInfo()[tableName])["ready"] == "true") {
+                return;
+            }
+            usleep(10'000);
+        }
+        STHROW("ID filter for " + tableName + " never became ready");
+    }
+
+    void filter() {
+        SQLiteIDFilter filter(100'000);
+        for (int64_t id = 1; id <= 100'000; id++) {
+            filter.add(id * 7919);
+        }
+        ASSERT_EQUAL(filter.size(), 100'000);
+
+        // Never a false negative, and rarely a false positive.
+        for (int64_t id = 1; id <= 100'000; id++) {
+            ASSERT_TRUE(filter.mayContain(id * 7919));
+        }
+        int falsePositives = 0;
+        for (int i = 0; i < 100'000; i++) {
+            falsePositives += filter.mayContain(-(int64_t)(SRandom::rand64() >> 1) - 1);
+        }
+        ASSERT_LESS_THAN(falsePositives, 3'000);
+        ASSERT_EQUAL(filter.layers(), 1);
+    }
+
+    void grows() {
+        // Far more IDs than it was sized for start new layers instead of filling the first one up.
+        SQLiteIDFilter filter(1000);
+        for (int64_t id = 1; id <= 100'000; id++) {
+            filter.add(id * 7919);
+        }
+        ASSERT_EQUAL(filter.size(), 100'000);
+        ASSERT_GREATER_THAN(filter.layers(), 1);
+        ASSERT_GREATER_THAN_EQUAL(filter.capacity(), 100'000);
+        for (int64_t id = 1; id <= 100'000; id++) {
+            ASSERT_TRUE(filter.mayContain(id * 7919));
+        }
+
+        // Each layer adds its own false positives.
+        size_t falsePositives = 0;
+        for (int i = 0; i < 100'000; i++) {
+            falsePositives += filter.mayContain(-(int64_t)(SRandom::rand64() >> 1) - 1);
+        }
+        ASSERT_LESS_THAN(falsePositives, 3'000 * filter.layers());
+
+        // Reserving room up front takes a single new layer.
+        SQLiteIDFilter reserved(1000);
+        reserved.reserve(100'000);
+        ASSERT_EQUAL(reserved.layers(), 2);
+        for (int64_t id = 1; id <= 100'000; id++) {
+            reserved.add(id);
+        }
+        ASSERT_EQUAL(reserved.layers(), 2);
+    }
+
+    void builtAtStartup() {
+        SQLite::addIDFilter("idfilterstartup", "id");
+        TestDBFile file("idfilter");
+        const string& filename = file.filename;
+
+        // Write the table before Bedrock has ever opened the file.
+        sqlite3* raw;
+        ASSERT_EQUAL(sqlite3_open(filename.c_str(), &raw), SQLITE_OK);
+        ASSERT_EQUAL(SQuery(raw, "creating table", "CREATE TABLE idfilterstartup (id INTEGER PRIMARY KEY, value TEXT);"), SQLITE_OK);
+        ASSERT_EQUAL(SQuery(raw, "inserting rows", "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 1000) "
+                                                   "INSERT INTO idfilterstartup SELECT x * 1000003, 'x' FROM c;"), SQLITE_OK);
+        sqlite3_close(raw);
+
+        SQLite db(filename, 1000, 1'000'000, 0);
+        waitForReady(db, "idfilterstartup");
+        ASSERT_TRUE(db.beginTransaction());
+        for (int64_t x = 1; x <= 1000; x++) {
+            ASSERT_TRUE(db.idMayExist("idfilterstartup", "id", x * 1000003));
+        }
+        int unknown = 0;
+        for (int64_t x = 1; x <= 1000; x++) {
+            unknown += db.idMayExist("idfilterstartup", "id", x * 1000003 + 1);
+        }
+        ASSERT_LESS_THAN(unknown, 50);
+
+        // Only for the column it was registered with.
+        ASSERT_TRUE(db.idMayExist("idfilterstartup", "value", 1));
+        db.rollback();
+    }
+
+    void updatedOnWrite() {
+        SQLite::addIDFilter("idfilterwrite", "rowid");
+        TestSQLiteDB test("idfilter");
+        SQLite& db = test.db;
+        SQLite other(db);
+
+        // The table doesn't exist when the filter is built, so it's checked once it's created.
+        TestSQLiteDB::commit(db, "CREATE TABLE idfilterwrite (name TEXT PRIMARY KEY, value TEXT);");
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_FALSE(db.idMayExist("idfilterwrite", "rowid", 12345));
+        db.rollback();
+
+        // Rows written on one handle are in the filter for the other, whether they're inserted or moved.
+        TestSQLiteDB::commit(other, "INSERT INTO idfilterwrite (rowid, name, value) VALUES (12345, 'a', 'b');");
+        TestSQLiteDB::commit(other, "INSERT INTO idfilterwrite (rowid, name, value) VALUES (1, 'c', 'd');");
+        TestSQLiteDB::commit(other, "UPDATE idfilterwrite SET rowid = 67890 WHERE rowid = 1;");
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_TRUE(db.idMayExist("idfilterwrite", "rowid", 12345));
+        ASSERT_TRUE(db.idMayExist("idfilterwrite", "rowid", 67890));
+
+        // And random IDs are mostly checked without a query.
+        for (int i = 0; i < 100; i++) {
+            SQLiteUtils::getRandomID(db, "idfilterwrite", "rowid");
+        }
+        db.rollback();
+        STable info = SParseJSONObject(db.getIDFilterInfo()["idfilterwrite"]);
+        ASSERT_EQUAL(info["usable"], "true");
+        ASSERT_GREATER_THAN(SToUInt64(info["skipped"]), 90);
+    }
+
+    void notRowID() {
+        // A filter on a column that isn't the rowid is never used.
+        SQLite::addIDFilter("idfiltertext", "id");
+        TestSQLiteDB test("idfilter");
+        SQLite& db = test.db;
+        TestSQLiteDB::commit(db, "CREATE TABLE idfiltertext (id INT PRIMARY KEY, value TEXT);");
+        TestSQLiteDB::commit(db, "INSERT INTO idfiltertext VALUES (5, 'five');");
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_TRUE(db.idMayExist("idfiltertext", "id", 6));
+        ASSERT_TRUE(db.idMayExist("idfiltertext", "id", 5));
+        db.rollback();
+        ASSERT_EQUAL(SParseJSONObject(db.getIDFilterInfo()["idfiltertext"])["usable"], "false");
+    }
+
+    void attachedDatabase() {
+        // Rows written to a table with the same name in an attached database don't go in the filter.
+        SQLite::addIDFilter("idfilterattached", "id");
+        TestSQLiteDB test("idfilter");
+        SQLite& db = test.db;
+        TestDBFile other("idfilterother");
+        TestSQLiteDB::commit(db, "CREATE TABLE idfilterattached (id INTEGER PRIMARY KEY, value TEXT);");
+        TestSQLiteDB::commit(db, "INSERT INTO idfilterattached VALUES (1, 'main');");
+        ASSERT_EQUAL(SParseJSONObject(db.getIDFilterInfo()["idfilterattached"])["ids"], "1");
+
+        sqlite3* raw = db.getDBHandle();
+        ASSERT_EQUAL(SQuery(raw, "attaching", "ATTACH DATABASE " + SQ(other.filename) + " AS other;"), SQLITE_OK);
+        ASSERT_EQUAL(SQuery(raw, "creating table", "CREATE TABLE other.idfilterattached (id INTEGER PRIMARY KEY, value TEXT);"), SQLITE_OK);
+        ASSERT_EQUAL(SQuery(raw, "inserting rows", "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c WHERE x < 100) "
+                                                   "INSERT INTO other.idfilterattached SELECT x + 1, 'other' FROM c;"), SQLITE_OK);
+        ASSERT_EQUAL(SQuery(raw, "detaching", "DETACH DATABASE other;"), SQLITE_OK);
+        ASSERT_EQUAL(SParseJSONObject(db.getIDFilterInfo()["idfilterattached"])["ids"], "1");
+    }
+
+} __SQLiteIDFilterTest;
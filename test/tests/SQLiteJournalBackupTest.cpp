@@ -0,0 +1,83 @@
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLite.h>
+#include <sqlitecluster/SQLiteJournalBackup.h>
+#include <test/lib/BedrockTester.h>
+#include <test/lib/TestSQLiteDB.h>
+
+struct SQLiteJournalBackupTest : tpunit::TestFixture {
+    SQLiteJournalBackupTest() : tpunit::TestFixture("SQLiteJournalBackup",
+                                                    TEST(SQLiteJournalBackupTest::roundTrip)) { }
+
+    void roundTrip() {
+        TestSQLiteDB test("journalbackup");
+        SQLite& db = test.db;
+        const string dbFilename = basename((char*)test.filename.c_str());
+        TestDBFile base("journalbackupbase");
+        TestDBFile restored("journalbackuprestored");
+
+        // Each copy needs its own name, as DB handles for the same file share their commit count.
+        TestDBFile tampered("journalbackuptampered");
+        const string directory = BedrockTester::getTempFileName("segments");
+        unlink(directory.c_str());
+        ASSERT_FALSE(mkdir(directory.c_str(), 0755));
+
+        TestSQLiteDB::commit(db, "CREATE TABLE t (id INTEGER PRIMARY KEY, value TEXT);");
+        for (int i = 0; i < 10; i++) {
+            TestSQLiteDB::commit(db, "INSERT INTO t VALUES (" + SQ(i) + ", 'base');");
+        }
+
+        // Take a full backup to start from.
+        uint64_t baseCommit;
+        string baseHash;
+        ASSERT_EQUAL(db.backup(base.filename, 16, [](uint64_t, uint64_t) { return true; }, baseCommit, baseHash), SQLITE_OK);
+        ASSERT_EQUAL(baseCommit, db.getCommitCount());
+        ASSERT_EQUAL(baseHash, db.getCommittedHash());
+
+        // Two incremental backups, the second picking up where the first left off.
+        for (int i = 10; i < 100; i++) {
+            TestSQLiteDB::commit(db, "INSERT INTO t VALUES (" + SQ(i) + ", 'first');");
+        }
+        list<string> segments = SQLiteJournalBackup::exportSegments(db, directory, baseCommit, db.getCommitCount());
+        ASSERT_EQUAL(segments.size(), 1);
+        for (int i = 100; i < 250; i++) {
+            TestSQLiteDB::commit(db, "INSERT INTO t VALUES (" + SQ(i) + ", 'second');");
+        }
+        uint64_t lastExported = SQLiteJournalBackup::lastExportedCommit(directory, dbFilename);
+        ASSERT_EQUAL(lastExported, baseCommit + 90);
+        segments.splice(segments.end(), SQLiteJournalBackup::exportSegments(db, directory, lastExported, db.getCommitCount()));
+        ASSERT_EQUAL(segments.size(), 2);
+        ASSERT_EQUAL(SQLiteJournalBackup::lastExportedCommit(directory, dbFilename), db.getCommitCount());
+
+        // Replaying them on the base gets back to exactly the same state.
+        ASSERT_TRUE(SFileCopy(base.filename, restored.filename));
+        {
+            SQLite restoredDB(restored.filename, 1000, 1'000'000, -2);
+            ASSERT_EQUAL(SQLiteJournalBackup::restore(restoredDB, directory, dbFilename), 240);
+            ASSERT_EQUAL(restoredDB.getCommitCount(), db.getCommitCount());
+            ASSERT_EQUAL(restoredDB.getCommittedHash(), db.getCommittedHash());
+            ASSERT_EQUAL(restoredDB.read("SELECT COUNT(*) FROM t;"), "250");
+
+            // There's nothing left to apply a second time.
+            ASSERT_EQUAL(SQLiteJournalBackup::restore(restoredDB, directory, dbFilename), 0);
+        }
+
+        // A segment that's been tampered with isn't applied.
+        string segment = SGUnzip(SFileLoad(segments.back()));
+        segment.replace(segment.rfind("'second'"), 8, "'SECOND'");
+        ASSERT_TRUE(SFileSave(segments.back(), SGZip(segment)));
+        ASSERT_TRUE(SFileCopy(base.filename, tampered.filename));
+        {
+            SQLite tamperedDB(tampered.filename, 1000, 1'000'000, -2);
+            ASSERT_THROW(SQLiteJournalBackup::restore(tamperedDB, directory, dbFilename), SException);
+            ASSERT_EQUAL(tamperedDB.getCommitCount(), lastExported);
+        }
+
+        for (const string& file : segments) {
+            unlink(file.c_str());
+        }
+        rmdir(directory.c_str());
+    }
+} __SQLiteJournalBackupTest;
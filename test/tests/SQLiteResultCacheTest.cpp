@@ -0,0 +1,92 @@
+#include <libstuff/libstuff.h>
+#include <libstuff/SQResult.h>
+#include <sqlitecluster/SQLite.h>
+#include <sqlitecluster/SQLiteResultCache.h>
+#include <test/lib/BedrockTester.h>
+#include <test/lib/TestSQLiteDB.h>
+
+struct SQLiteResultCacheTest : tpunit::TestFixture {
+    SQLiteResultCacheTest() : tpunit::TestFixture("SQLiteResultCache",
+                                                  TEST(SQLiteResultCacheTest::sharedBetweenHandles),
+                                                  TEST(SQLiteResultCacheTest::eviction)) { }
+
+    void sharedBetweenHandles() {
+        TestSQLiteDB test("resultcache");
+        SQLite& db = test.db;
+        SQLite other(db);
+        TestSQLiteDB::commit(db, "CREATE TABLE t (id INTEGER PRIMARY KEY, value TEXT);");
+        TestSQLiteDB::commit(db, "INSERT INTO t VALUES (1, 'one');");
+        db.setResultCacheSize(1024 * 1024);
+
+        // A read on one handle is reused by another at the same commit, with the tables it used.
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_EQUAL(db.read("SELECT value FROM t WHERE id = 1;"), "one");
+        db.rollback();
+        ASSERT_TRUE(other.beginTransaction());
+        ASSERT_EQUAL(other.read("SELECT value FROM t WHERE id = 1;"), "one");
+        ASSERT_TRUE(other.getTablesUsed() == set<string>{"t"});
+        other.rollback();
+        ASSERT_EQUAL(db.getResultCacheInfo()["hits"], "1");
+
+        // Once there's a new commit, it's not.
+        TestSQLiteDB::commit(db, "UPDATE t SET value = 'uno' WHERE id = 1;");
+        ASSERT_TRUE(other.beginTransaction());
+        ASSERT_EQUAL(other.read("SELECT value FROM t WHERE id = 1;"), "uno");
+        other.rollback();
+        ASSERT_EQUAL(db.getResultCacheInfo()["hits"], "1");
+
+        // Non-deterministic reads, and reads after a write in the same transaction, aren't shared.
+        for (int i = 0; i < 2; i++) {
+            ASSERT_TRUE(db.beginTransaction());
+            db.read("SELECT value, random() FROM t WHERE id = 1;");
+            db.read("SELECT current_timestamp;");
+            ASSERT_TRUE(db.write("UPDATE t SET value = 'ein' WHERE id = 1;"));
+            ASSERT_EQUAL(db.read("SELECT value FROM t WHERE id = 1;"), "ein");
+            db.rollback();
+        }
+        ASSERT_EQUAL(db.getResultCacheInfo()["hits"], "1");
+
+        // A transaction that started before a commit keeps reading its own snapshot.
+        ASSERT_TRUE(other.beginTransaction());
+        TestSQLiteDB::commit(db, "UPDATE t SET value = 'un' WHERE id = 1;");
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_EQUAL(db.read("SELECT value FROM t WHERE id = 1;"), "un");
+        db.rollback();
+        ASSERT_EQUAL(other.read("SELECT value FROM t WHERE id = 1;"), "uno");
+        other.rollback();
+
+        db.setResultCacheSize(0);
+    }
+
+    void eviction() {
+        SQLiteResultCache cache;
+        SQResult result;
+        result.headers = {"value"};
+        result.rows.resize(1);
+        result.rows[0].push_back(string(1000, 'x'));
+        vector<string> tables = {"t"};
+
+        // Disabled until it has a size.
+        cache.put(1, "q1", result, tables);
+        ASSERT_EQUAL(cache.getInfo()["entries"], "0");
+
+        // Older commits are evicted first.
+        cache.setMaxBytes(50'000);
+        for (uint64_t commit = 1; commit <= 10; commit++) {
+            cache.put(commit, "q" + to_string(commit), result, tables);
+        }
+        SQResult found;
+        vector<string> foundTables;
+        ASSERT_TRUE(cache.get(10, "q10", found, foundTables));
+        ASSERT_EQUAL(found[0][0], result[0][0]);
+        ASSERT_TRUE(foundTables == tables);
+        ASSERT_FALSE(cache.get(9, "q10", found, foundTables));
+        for (uint64_t commit = 11; commit <= 100; commit++) {
+            cache.put(commit, "q", result, tables);
+        }
+        ASSERT_FALSE(cache.get(1, "q1", found, foundTables));
+        ASSERT_TRUE(cache.get(100, "q", found, foundTables));
+        ASSERT_LESS_THAN_EQUAL(SToUInt64(cache.getInfo()["bytes"]), 50'000);
+        ASSERT_GREATER_THAN(SToUInt64(cache.getInfo()["evictions"]), 0);
+    }
+} __SQLiteResultCacheTest;
@@ -0,0 +1,46 @@
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLiteSequentialNotifier.h>
+#include <test/lib/BedrockTester.h>
+
+// Measures how long threads blocked in SQLiteSequentialNotifier::waitFor take to wake up once their value is reached,
+// the way replication threads wait on commits on a busy follower.
+// Run with `-perf`.
+struct SequentialNotifierPerfTest : tpunit::TestFixture {
+    SequentialNotifierPerfTest() : tpunit::TestFixture("PerfSequentialNotifier",
+                                                       TEST(SequentialNotifierPerfTest::wakeLatency)) { }
+
+    static constexpr int THREADS = 16;
+    static constexpr uint64_t VALUES = 100'000;
+
+    void wakeLatency() {
+        SQLiteSequentialNotifier notifier;
+
+        // Each thread waits for every THREADS-th value in turn, and records how long after that value was notified it
+        // woke up.
+        vector<uint64_t> notifyTimes(VALUES + 1);
+        atomic<uint64_t> totalLatency(0);
+        list<thread> threads;
+        for (int i = 0; i < THREADS; i++) {
+            threads.emplace_back([&, i]() {
+                for (uint64_t value = i + 1; value <= VALUES; value += THREADS) {
+                    notifier.waitFor(value);
+                    totalLatency += STimeNow() - __atomic_load_n(&notifyTimes[value], __ATOMIC_ACQUIRE);
+                }
+            });
+        }
+
+        uint64_t start = STimeNow();
+        for (uint64_t value = 1; value <= VALUES; value++) {
+            __atomic_store_n(&notifyTimes[value], STimeNow(), __ATOMIC_RELEASE);
+            notifier.notifyThrough(value);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        uint64_t elapsed = STimeNow() - start;
+
+        cout << "[PerfSequentialNotifier] " << VALUES << " notifications to " << THREADS << " threads in "
+             << (elapsed / 1000) << "ms, average wake latency " << (totalLatency / VALUES) << "us." << endl;
+        ASSERT_EQUAL(notifier.getValue(), VALUES);
+    }
+} __SequentialNotifierPerfTest;
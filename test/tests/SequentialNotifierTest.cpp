@@ -0,0 +1,89 @@
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLiteSequentialNotifier.h>
+#include <test/lib/BedrockTester.h>
+
+struct SequentialNotifierTest : tpunit::TestFixture {
+    SequentialNotifierTest() : tpunit::TestFixture("SequentialNotifier",
+                                                   TEST(SequentialNotifierTest::notify),
+                                                   TEST(SequentialNotifierTest::cancelAfter),
+                                                   TEST(SequentialNotifierTest::cancelAll)) { }
+
+    typedef SQLiteSequentialNotifier::RESULT RESULT;
+
+    // Starts a thread waiting for `value`, which stores the result in `result` when it returns.
+    static thread startWaiting(SQLiteSequentialNotifier& notifier, uint64_t value, atomic<RESULT>& result) {
+        return thread([&notifier, value, &result]() { result = notifier.waitFor(value); });
+    }
+
+    void notify() {
+        SQLiteSequentialNotifier notifier;
+        notifier.notifyThrough(10);
+        ASSERT_EQUAL(notifier.waitFor(5), RESULT::COMPLETED);
+        ASSERT_EQUAL(notifier.waitFor(10), RESULT::COMPLETED);
+
+        // Values that share a slot (SLOT_COUNT apart) are only completed when their own value is reached.
+        atomic<RESULT> first(RESULT::UNKNOWN);
+        atomic<RESULT> second(RESULT::UNKNOWN);
+        thread firstThread = startWaiting(notifier, 20, first);
+        thread secondThread = startWaiting(notifier, 20 + 64, second);
+        usleep(10'000);
+        notifier.notifyThrough(20);
+        firstThread.join();
+        ASSERT_EQUAL(first.load(), RESULT::COMPLETED);
+        usleep(10'000);
+        ASSERT_EQUAL(second.load(), RESULT::UNKNOWN);
+
+        // Notifying past a value completes it, and the value never goes backwards.
+        notifier.notifyThrough(100);
+        secondThread.join();
+        ASSERT_EQUAL(second.load(), RESULT::COMPLETED);
+        notifier.notifyThrough(50);
+        ASSERT_EQUAL(notifier.getValue(), 100);
+    }
+
+    void cancelAfter() {
+        SQLiteSequentialNotifier notifier;
+        notifier.notifyThrough(10);
+
+        // Waiters past the cutoff are canceled, but waiters before it keep waiting for their value.
+        atomic<RESULT> beforeCutoff(RESULT::UNKNOWN);
+        atomic<RESULT> afterCutoff(RESULT::UNKNOWN);
+        thread before = startWaiting(notifier, 12, beforeCutoff);
+        thread after = startWaiting(notifier, 20, afterCutoff);
+        usleep(10'000);
+        notifier.cancel(15);
+        after.join();
+        ASSERT_EQUAL(afterCutoff.load(), RESULT::CANCELED);
+        usleep(10'000);
+        ASSERT_EQUAL(beforeCutoff.load(), RESULT::UNKNOWN);
+
+        // New waits follow the same rule until `reset`.
+        ASSERT_EQUAL(notifier.waitFor(16), RESULT::CANCELED);
+        ASSERT_EQUAL(notifier.waitFor(10), RESULT::COMPLETED);
+        notifier.notifyThrough(12);
+        before.join();
+        ASSERT_EQUAL(beforeCutoff.load(), RESULT::COMPLETED);
+
+        notifier.reset();
+        ASSERT_EQUAL(notifier.getValue(), 0);
+    }
+
+    void cancelAll() {
+        SQLiteSequentialNotifier notifier;
+        atomic<RESULT> result(RESULT::UNKNOWN);
+        thread waiting = startWaiting(notifier, 5, result);
+        usleep(10'000);
+        notifier.cancel();
+        waiting.join();
+        ASSERT_EQUAL(result.load(), RESULT::CANCELED);
+        ASSERT_EQUAL(notifier.waitFor(1), RESULT::CANCELED);
+
+        // After a reset, threads wait again.
+        notifier.reset();
+        waiting = startWaiting(notifier, 1, result);
+        usleep(10'000);
+        notifier.notifyThrough(1);
+        waiting.join();
+        ASSERT_EQUAL(result.load(), RESULT::COMPLETED);
+    }
+} __SequentialNotifierTest;
@@ -0,0 +1,80 @@
+#include <libstuff/libstuff.h>
+#include <sqlitecluster/SQLite.h>
+#include <test/lib/BedrockTester.h>
+#include <test/lib/TestSQLiteDB.h>
+
+struct TableChangeListenerTest : tpunit::TestFixture {
+    TableChangeListenerTest() : tpunit::TestFixture("TableChangeListener",
+                                                    TEST(TableChangeListenerTest::columns),
+                                                    TEST(TableChangeListenerTest::attachedDatabase)) { }
+
+    // Rows reported to a listener. Listeners are never removed, and are called with an empty set by schema changes in
+    // any test, so this outlives the test, and empty sets are ignored.
+    struct Reported {
+        mutex m;
+        set<int64_t> rowIDs;
+
+        set<int64_t> take() {
+            lock_guard<mutex> lock(m);
+            return move(rowIDs);
+        }
+    };
+
+    static shared_ptr<Reported> listen(const string& tableName, const set<int>& columns) {
+        auto reported = make_shared<Reported>();
+        SQLite::addTableChangeListener(tableName, [reported](const set<int64_t>& rowIDs) {
+            lock_guard<mutex> lock(reported->m);
+            reported->rowIDs.insert(rowIDs.begin(), rowIDs.end());
+        }, columns);
+        return reported;
+    }
+
+    void columns() {
+        // Only changes to `value` (column 1) count, not `accessed`.
+        shared_ptr<Reported> reported = listen("listenercolumns", {1});
+        TestSQLiteDB test("listener");
+        SQLite& db = test.db;
+        TestSQLiteDB::commit(db, "CREATE TABLE listenercolumns (name TEXT, value TEXT, accessed INTEGER);");
+        reported->take();
+
+        TestSQLiteDB::commit(db, "INSERT INTO listenercolumns (rowid, name, value, accessed) VALUES (1, 'a', 'one', 0), (2, 'b', 'two', 0);");
+        ASSERT_TRUE(reported->take() == set<int64_t>({1, 2}));
+
+        TestSQLiteDB::commit(db, "UPDATE listenercolumns SET accessed = 5;");
+        ASSERT_TRUE(reported->take().empty());
+
+        // Setting a value to what it already was doesn't count either.
+        TestSQLiteDB::commit(db, "UPDATE listenercolumns SET value = 'one', accessed = 6 WHERE rowid = 1;");
+        ASSERT_TRUE(reported->take().empty());
+
+        TestSQLiteDB::commit(db, "UPDATE listenercolumns SET value = 'uno' WHERE rowid = 1;");
+        ASSERT_TRUE(reported->take() == set<int64_t>({1}));
+
+        // Moving a row reports both rowids, whatever columns it changes.
+        TestSQLiteDB::commit(db, "UPDATE listenercolumns SET rowid = 3 WHERE rowid = 2;");
+        ASSERT_TRUE(reported->take() == set<int64_t>({2, 3}));
+
+        TestSQLiteDB::commit(db, "DELETE FROM listenercolumns WHERE rowid = 3;");
+        ASSERT_TRUE(reported->take() == set<int64_t>({3}));
+    }
+
+    void attachedDatabase() {
+        // Rows written to a table with the same name in an attached database aren't reported.
+        shared_ptr<Reported> reported = listen("listenerattached", {});
+        TestSQLiteDB test("listener");
+        SQLite& db = test.db;
+        TestDBFile other("listenerother");
+        TestSQLiteDB::commit(db, "CREATE TABLE listenerattached (name TEXT, value TEXT);");
+        reported->take();
+
+        sqlite3* raw = db.getDBHandle();
+        ASSERT_EQUAL(SQuery(raw, "attaching", "ATTACH DATABASE " + SQ(other.filename) + " AS other;"), SQLITE_OK);
+        ASSERT_EQUAL(SQuery(raw, "creating table", "CREATE TABLE other.listenerattached (name TEXT, value TEXT);"), SQLITE_OK);
+        ASSERT_EQUAL(SQuery(raw, "inserting rows", "INSERT INTO other.listenerattached (rowid, name, value) VALUES (2, 'b', 'other');"), SQLITE_OK);
+        ASSERT_EQUAL(SQuery(raw, "detaching", "DETACH DATABASE other;"), SQLITE_OK);
+
+        // The next commit reports only its own row.
+        TestSQLiteDB::commit(db, "INSERT INTO listenerattached (rowid, name, value) VALUES (1, 'a', 'main');");
+        ASSERT_TRUE(reported->take() == set<int64_t>({1}));
+    }
+} __TableChangeListenerTest;
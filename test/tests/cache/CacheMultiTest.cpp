@@ -0,0 +1,103 @@
+#include <libstuff/SData.h>
+#include <test/lib/BedrockTester.h>
+
+struct CacheMultiTest : tpunit::TestFixture {
+    CacheMultiTest()
+        : tpunit::TestFixture("CacheMulti",
+                              BEFORE_CLASS(CacheMultiTest::setupClass),
+                              TEST(CacheMultiTest::writeAndRead),
+                              TEST(CacheMultiTest::invalidate),
+                              TEST(CacheMultiTest::malformed),
+                              AFTER(CacheMultiTest::tearDown),
+                              AFTER_CLASS(CacheMultiTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    // With hot values on, a repeated ReadCacheMulti is answered from memory, so both paths get run.
+    void setupClass() { tester = new BedrockTester({{"-plugins", "Cache,DB"}, {"-cache.hotBytes", "1MB"}}, {}); }
+
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM cache;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    void writeCacheMulti(const list<string>& names, const list<string>& values, const string& invalidateName = "") {
+        SData command("WriteCacheMulti");
+        command["names"] = SComposeJSONArray(names);
+        list<string> valueLengths;
+        for (const string& value : values) {
+            valueLengths.push_back(to_string(value.size()));
+            command.content += value;
+        }
+        command["valueLengths"] = SComposeJSONArray(valueLengths);
+        if (!invalidateName.empty()) {
+            command["invalidateName"] = invalidateName;
+        }
+        tester->executeWaitVerifyContent(command);
+    }
+
+    vector<SData> readCacheMulti(const list<string>& names) {
+        SData command("ReadCacheMulti");
+        command["names"] = SComposeJSONArray(names);
+        return tester->executeWaitMultipleData({command}, 1);
+    }
+
+    void writeAndRead() {
+        writeCacheMulti({"a", "b", "c"}, {"one", "three", "xy"});
+        for (int i = 0; i < 2; i++) {
+            vector<SData> responses = readCacheMulti({"a", "b", "c"});
+            ASSERT_TRUE(SStartsWith(responses[0].methodLine, "200"));
+            ASSERT_EQUAL(responses[0]["names"], SComposeJSONArray(list<string>{"a", "b", "c"}));
+            ASSERT_EQUAL(responses[0]["valueLengths"], "[3,5,2]");
+            ASSERT_EQUAL(responses[0].content, "onethreexy");
+        }
+
+        // Names that don't match anything are left out, and patterns return the name they matched.
+        vector<SData> responses = readCacheMulti({"missing", "b*", "a"});
+        ASSERT_TRUE(SStartsWith(responses[0].methodLine, "200"));
+        ASSERT_EQUAL(responses[0]["names"], SComposeJSONArray(list<string>{"b", "a"}));
+        ASSERT_EQUAL(responses[0]["valueLengths"], "[5,3]");
+        ASSERT_EQUAL(responses[0].content, "threeone");
+
+        // Overwriting one value is seen by the next read.
+        writeCacheMulti({"b"}, {"four"});
+        responses = readCacheMulti({"a", "b", "c"});
+        ASSERT_EQUAL(responses[0].content, "onefourxy");
+    }
+
+    void invalidate() {
+        writeCacheMulti({"v1/a", "v1/b"}, {"old", "old"});
+        writeCacheMulti({"v2/a"}, {"new"}, "v1/*");
+        vector<SData> responses = readCacheMulti({"v1/a", "v1/b", "v2/a"});
+        ASSERT_EQUAL(responses[0]["names"], SComposeJSONArray(list<string>{"v2/a"}));
+        ASSERT_EQUAL(responses[0].content, "new");
+    }
+
+    void malformed() {
+        SData command("WriteCacheMulti");
+        command["names"] = SComposeJSONArray(list<string>{"a", "b"});
+        command["valueLengths"] = "[3]";
+        command.content = "abc";
+        tester->executeWaitVerifyContent(command, "402");
+        command["valueLengths"] = "[3,3]";
+        tester->executeWaitVerifyContent(command, "402");
+        command["valueLengths"] = "[1,1]";
+        tester->executeWaitVerifyContent(command, "402");
+
+        list<string> names;
+        for (int i = 0; i < 1001; i++) {
+            names.push_back("name" + to_string(i));
+        }
+        command.clear();
+        command.methodLine = "ReadCacheMulti";
+        command["names"] = SComposeJSONArray(names);
+        tester->executeWaitVerifyContent(command, "402");
+        command["names"] = SComposeJSONArray(list<string>{"a", ""});
+        tester->executeWaitVerifyContent(command, "402");
+        command["names"] = "[]";
+        tester->executeWaitVerifyContent(command, "402");
+    }
+} __CacheMultiTest;
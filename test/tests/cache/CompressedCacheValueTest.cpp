@@ -0,0 +1,117 @@
+#include <libstuff/SData.h>
+#include <libstuff/SQResult.h>
+#include <plugins/Cache.h>
+#include <sqlitecluster/SQLiteCompression.h>
+#include <test/lib/BedrockTester.h>
+#include <test/lib/TestSQLiteDB.h>
+
+struct CompressedCacheValueTest : tpunit::TestFixture {
+    CompressedCacheValueTest()
+        : tpunit::TestFixture("CompressedCacheValue",
+                              BEFORE_CLASS(CompressedCacheValueTest::setupClass),
+                              TEST(CompressedCacheValueTest::writeAndRead),
+                              TEST(CompressedCacheValueTest::writeMulti),
+                              TEST(CompressedCacheValueTest::smallValue),
+                              TEST(CompressedCacheValueTest::decompressLimit),
+                              AFTER(CompressedCacheValueTest::tearDown),
+                              AFTER_CLASS(CompressedCacheValueTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+    const string pad = string(5000, 'x');
+
+    void setupClass() {
+        tester = new BedrockTester({{"-plugins", "Cache,DB"}, {"-cache.compressValueBytes", "1000"}}, {});
+    }
+
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM cache;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() {
+        delete tester;
+    }
+
+    // Large values are stored compressed, count towards the cache size at that size, and read back as they went in.
+    void writeAndRead() {
+        SData command("WriteCache");
+        command["name"] = "compressed";
+        command["value"] = pad;
+        tester->executeWaitVerifyContent(command);
+
+        SQResult result;
+        tester->readDB("SELECT typeof(value), length(value), DECOMPRESS(value) FROM cache WHERE name = 'compressed';", result);
+        ASSERT_EQUAL(result[0][0], "blob");
+        ASSERT_LESS_THAN(SToInt64(result[0][1]), 1000);
+        ASSERT_EQUAL(result[0][2], pad);
+        ASSERT_EQUAL(tester->readDB(BedrockPlugin_Cache::getCacheSizeQuery()), result[0][1]);
+
+        command.clear();
+        command.methodLine = "ReadCache";
+        command["name"] = "compressed";
+        ASSERT_EQUAL(tester->executeWaitVerifyContent(command), pad);
+
+        // Replacing the value compresses it again.
+        command.clear();
+        command.methodLine = "WriteCache";
+        command["name"] = "compressed";
+        command["value"] = pad + "y";
+        tester->executeWaitVerifyContent(command);
+        tester->readDB("SELECT typeof(value), DECOMPRESS(value) FROM cache WHERE name = 'compressed';", result);
+        ASSERT_EQUAL(result[0][0], "blob");
+        ASSERT_EQUAL(result[0][1], pad + "y");
+    }
+
+    // Each value of a WriteCacheMulti is compressed or not on its own.
+    void writeMulti() {
+        SData command("WriteCacheMulti");
+        command["names"] = SComposeJSONArray(list<string>{"big", "small"});
+        command["valueLengths"] = SComposeJSONArray(list<string>{to_string(pad.size()), "5"});
+        command.content = pad + "small";
+        tester->executeWaitVerifyContent(command);
+
+        SQResult result;
+        tester->readDB("SELECT name, typeof(value) FROM cache ORDER BY name;", result);
+        ASSERT_EQUAL(result.size(), 2);
+        ASSERT_EQUAL(result[0][1], "blob");
+        ASSERT_EQUAL(result[1][1], "text");
+
+        command.clear();
+        command.methodLine = "ReadCacheMulti";
+        command["names"] = SComposeJSONArray(list<string>{"big", "small"});
+        SData response = tester->executeWaitMultipleData({command}, 1)[0];
+        ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+        ASSERT_EQUAL(response.content, pad + "small");
+    }
+
+    // Values below the threshold are left alone.
+    void smallValue() {
+        SData command("WriteCache");
+        command["name"] = "uncompressed";
+        command["value"] = "value";
+        tester->executeWaitVerifyContent(command);
+
+        SQResult result;
+        tester->readDB("SELECT typeof(value), value FROM cache WHERE name = 'uncompressed';", result);
+        ASSERT_EQUAL(result[0][0], "text");
+        ASSERT_EQUAL(result[0][1], "value");
+    }
+
+    // A small compressed value that expands past the handle's length limit is an error, rather than allocated in full.
+    void decompressLimit() {
+        TestSQLiteDB test("decompress");
+        SQLite& db = test.db;
+        sqlite3_limit(db.getDBHandle(), SQLITE_LIMIT_LENGTH, 1'000'000);
+        const string fits = SQLiteCompression::literal(string(500'000, 'z'), 1);
+        const string bomb = SQLiteCompression::literal(string(2'000'000, 'z'), 1);
+        ASSERT_LESS_THAN(bomb.size(), 10'000);
+
+        SQResult result;
+        ASSERT_TRUE(db.beginTransaction());
+        ASSERT_TRUE(db.read("SELECT length(DECOMPRESS(" + fits + "));", result));
+        ASSERT_EQUAL(result[0][0], "500000");
+        ASSERT_FALSE(db.read("SELECT length(DECOMPRESS(" + bomb + "));", result));
+        db.rollback();
+    }
+} __CompressedCacheValueTest;
@@ -0,0 +1,81 @@
+#include <libstuff/SData.h>
+#include <test/lib/BedrockTester.h>
+
+struct ReadCacheTest : tpunit::TestFixture {
+    ReadCacheTest()
+        : tpunit::TestFixture("ReadCache",
+                              BEFORE_CLASS(ReadCacheTest::setupClass),
+                              TEST(ReadCacheTest::overwritten),
+                              TEST(ReadCacheTest::replaced),
+                              TEST(ReadCacheTest::deletedAll),
+                              TEST(ReadCacheTest::badName),
+                              AFTER(ReadCacheTest::tearDown),
+                              AFTER_CLASS(ReadCacheTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+
+    // Keep hot values in memory, so repeated reads of the same name are answered without reading the DB.
+    void setupClass() { tester = new BedrockTester({{"-plugins", "Cache,DB"}, {"-cache.hotBytes", "1MB"}}, {}); }
+
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM cache;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    void writeCache(const string& name, const string& value) {
+        SData command("WriteCache");
+        command["name"] = name;
+        command["value"] = value;
+        tester->executeWaitVerifyContent(command);
+    }
+
+    string readCache(const string& name, const string& expectedResult = "200 OK") {
+        SData command("ReadCache");
+        command["name"] = name;
+        return tester->executeWaitVerifyContent(command, expectedResult);
+    }
+
+    void query(const string& query) {
+        SData command("Query");
+        command["query"] = query;
+        tester->executeWaitVerifyContent(command);
+    }
+
+    // Reading twice puts the value in memory, and then serves it from there.
+    void readTwice(const string& name, const string& value) {
+        ASSERT_EQUAL(readCache(name), value);
+        ASSERT_EQUAL(readCache(name), value);
+    }
+
+    void overwritten() {
+        writeCache("name", "first");
+        readTwice("name", "first");
+        writeCache("name", "second");
+        ASSERT_EQUAL(readCache("name"), "second");
+    }
+
+    // Rows deleted by REPLACE conflict resolution don't get a normal update hook call, but must still be dropped.
+    void replaced() {
+        writeCache("name", "first");
+        readTwice("name", "first");
+        query("INSERT OR REPLACE INTO cache (name, value) VALUES ('name', 'replaced');");
+        ASSERT_EQUAL(readCache("name"), "replaced");
+    }
+
+    // Deleting everything can skip visiting each row (the truncate optimization), but must still drop everything.
+    void deletedAll() {
+        writeCache("name", "first");
+        readTwice("name", "first");
+        query("DELETE FROM cache;");
+        readCache("name", "404");
+    }
+
+    // Names are checked before looking in memory, too.
+    void badName() {
+        readCache("", "402");
+        readCache(string(256, 'x'), "402");
+    }
+} __ReadCacheTest;
@@ -0,0 +1,108 @@
+#include <libstuff/SData.h>
+#include <libstuff/SQResult.h>
+#include <plugins/Cache.h>
+#include <test/lib/BedrockTester.h>
+
+struct WriteCacheTest : tpunit::TestFixture {
+    WriteCacheTest()
+        : tpunit::TestFixture("WriteCache",
+                              BEFORE_CLASS(WriteCacheTest::setupClass),
+                              TEST(WriteCacheTest::shardedSize),
+                              TEST(WriteCacheTest::evict),
+                              TEST(WriteCacheTest::accessEpochs),
+                              AFTER(WriteCacheTest::tearDown),
+                              AFTER_CLASS(WriteCacheTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+    static constexpr int64_t MAX_CACHE_SIZE = 10 * 1024;
+
+    void setupClass() { tester = new BedrockTester({{"-plugins", "Cache,DB"}, {"-cache.max", "10KB"}}, {}); }
+
+    void tearDown() {
+        SData command("Query");
+        command["query"] = "DELETE FROM cache;";
+        tester->executeWaitVerifyContent(command);
+    }
+
+    void tearDownClass() { delete tester; }
+
+    void writeCache(const string& name, const string& value, const string& invalidateName = "") {
+        SData command("WriteCache");
+        command["name"] = name;
+        command["value"] = value;
+        if (!invalidateName.empty()) {
+            command["invalidateName"] = invalidateName;
+        }
+        tester->executeWaitVerifyContent(command);
+    }
+
+    // Returns the size of the cache according to the size tables.
+    int64_t getCacheSize() {
+        return SToInt64(tester->readDB(BedrockPlugin_Cache::getCacheSizeQuery()));
+    }
+
+    // Returns the real size of the values in the cache.
+    int64_t getValuesSize() {
+        return SToInt64(tester->readDB("SELECT COALESCE(SUM(LENGTH(value)), 0) FROM cache;"));
+    }
+
+    // The size tables add up to the size of everything in the cache, through inserts, replacements and invalidations.
+    void shardedSize() {
+        for (int i = 0; i < 40; i++) {
+            writeCache("name" + to_string(i), string(10 + i, 'x'));
+        }
+        ASSERT_EQUAL(getCacheSize(), 40 * 10 + (39 * 40) / 2);
+        ASSERT_EQUAL(getCacheSize(), getValuesSize());
+
+        // The rows are spread across the size tables.
+        int usedShards = 0;
+        for (int shard = 0; shard < BedrockPlugin_Cache::CACHE_SIZE_SHARDS; shard++) {
+            if (SToInt64(tester->readDB("SELECT size FROM " + BedrockPlugin_Cache::getCacheSizeTableName(shard) + ";"))) {
+                usedShards++;
+            }
+        }
+        ASSERT_GREATER_THAN(usedShards, 1);
+
+        // Replacing a value moves it to a new rowid, which can be in a different shard.
+        writeCache("name0", string(100, 'y'));
+        ASSERT_EQUAL(getCacheSize(), 40 * 10 + (39 * 40) / 2 + 90);
+
+        // Invalidating removes every matching value.
+        writeCache("other", "value", "name1*");
+        ASSERT_EQUAL(getCacheSize(), getValuesSize());
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM cache WHERE name GLOB 'name1*';"), "0");
+    }
+
+    // Writing past the maximum evicts the values that were least recently used, and the size is kept up to date.
+    void evict() {
+        for (int i = 0; i < 30; i++) {
+            writeCache("evict" + to_string(i), string(1024, 'x'));
+        }
+        ASSERT_EQUAL(getCacheSize(), getValuesSize());
+        ASSERT_LESS_THAN_EQUAL(getCacheSize(), MAX_CACHE_SIZE);
+        ASSERT_LESS_THAN(SToInt64(tester->readDB("SELECT COUNT(*) FROM cache;")), 30);
+        ASSERT_EQUAL(tester->readDB("SELECT COUNT(*) FROM cache WHERE name = 'evict29';"), "1");
+    }
+
+    // Names that are read have the epoch they were read in written back by later writes, without changing the size.
+    void accessEpochs() {
+        writeCache("epoch", "value");
+        SData command("Query");
+        command["query"] = "UPDATE cache SET accessEpoch = 0 WHERE name = 'epoch';";
+        tester->executeWaitVerifyContent(command);
+        ASSERT_EQUAL(getCacheSize(), getValuesSize());
+
+        // Restart, so the LRU map is loaded from the epochs in the DB by the next write.
+        tester->stopServer();
+        tester->startServer();
+        writeCache("load", "value");
+
+        command.clear();
+        command.methodLine = "ReadCache";
+        command["name"] = "epoch";
+        ASSERT_EQUAL(tester->executeWaitVerifyContent(command), "value");
+        writeCache("persist", "value");
+        ASSERT_GREATER_THAN(SToUInt64(tester->readDB("SELECT accessEpoch FROM cache WHERE name = 'epoch';")), 0);
+        ASSERT_EQUAL(getCacheSize(), getValuesSize());
+    }
+} __WriteCacheTest;
@@ -0,0 +1,112 @@
+#include <libstuff/SData.h>
+#include <libstuff/SQResult.h>
+#include <test/lib/BedrockTester.h>
+
+struct CompressedJobDataTest : tpunit::TestFixture {
+    CompressedJobDataTest()
+            : tpunit::TestFixture("CompressedJobData",
+                                  BEFORE_CLASS(CompressedJobDataTest::setupClass),
+                                  TEST(CompressedJobDataTest::createAndGet),
+                                  TEST(CompressedJobDataTest::updateInSQL),
+                                  TEST(CompressedJobDataTest::failJob),
+                                  TEST(CompressedJobDataTest::smallData),
+                                  AFTER_CLASS(CompressedJobDataTest::tearDownClass)) { }
+
+    BedrockTester* tester;
+    const string pad = string(5000, 'x');
+
+    void setupClass() {
+        tester = new BedrockTester({{"-plugins", "Jobs,DB"}, {"-jobs.compressDataBytes", "1000"}}, {});
+    }
+
+    void tearDownClass() {
+        delete tester;
+    }
+
+    // Large data is stored compressed, and comes back out as it went in.
+    void createAndGet() {
+        SData command("CreateJob");
+        command["name"] = "compressed";
+        command["data"] = "{\"pad\":\"" + pad + "\"}";
+        const string jobID = tester->executeWaitVerifyContentTable(command)["jobID"];
+
+        SQResult result;
+        tester->readDB("SELECT typeof(data), length(data), JSON_EXTRACT(DECOMPRESS(data), '$.pad') FROM jobs WHERE jobID = " + jobID + ";", result);
+        ASSERT_EQUAL(result[0][0], "blob");
+        ASSERT_LESS_THAN(SToInt64(result[0][1]), 1000);
+        ASSERT_EQUAL(result[0][2], pad);
+
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "compressed";
+        STable response = tester->executeWaitVerifyContentTable(command);
+        ASSERT_EQUAL(response["jobID"], jobID);
+        ASSERT_EQUAL(SParseJSONObject(response["data"])["pad"], pad);
+
+        // Replacing the data compresses it again.
+        command.clear();
+        command.methodLine = "UpdateJob";
+        command["jobID"] = jobID;
+        command["data"] = "{\"pad\":\"" + pad + "\",\"key\":\"value\"}";
+        tester->executeWaitVerifyContent(command);
+        tester->readDB("SELECT typeof(data), JSON_EXTRACT(DECOMPRESS(data), '$.key') FROM jobs WHERE jobID = " + jobID + ";", result);
+        ASSERT_EQUAL(result[0][0], "blob");
+        ASSERT_EQUAL(result[0][1], "value");
+    }
+
+    // Data changed by SQL on the existing value (here, counting retries) stays compressed.
+    void updateInSQL() {
+        SData command("CreateJob");
+        command["name"] = "compressedRetry";
+        command["retryAfter"] = "+1 HOUR";
+        command["data"] = "{\"pad\":\"" + pad + "\"}";
+        const string jobID = tester->executeWaitVerifyContentTable(command)["jobID"];
+
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "compressedRetry";
+        tester->executeWaitVerifyContent(command);
+
+        SQResult result;
+        tester->readDB("SELECT typeof(data), JSON_EXTRACT(DECOMPRESS(data), '$.retryAfterCount') FROM jobs WHERE jobID = " + jobID + ";", result);
+        ASSERT_EQUAL(result[0][0], "blob");
+        ASSERT_EQUAL(result[0][1], "1");
+    }
+
+    // Data given when failing a job is compressed too.
+    void failJob() {
+        SData command("CreateJob");
+        command["name"] = "compressedFail";
+        const string jobID = tester->executeWaitVerifyContentTable(command)["jobID"];
+
+        command.clear();
+        command.methodLine = "GetJob";
+        command["name"] = "compressedFail";
+        tester->executeWaitVerifyContent(command);
+
+        command.clear();
+        command.methodLine = "FailJob";
+        command["jobID"] = jobID;
+        command["data"] = "{\"pad\":\"" + pad + "\"}";
+        tester->executeWaitVerifyContent(command);
+
+        SQResult result;
+        tester->readDB("SELECT state, typeof(data), JSON_EXTRACT(DECOMPRESS(data), '$.pad') FROM jobs WHERE jobID = " + jobID + ";", result);
+        ASSERT_EQUAL(result[0][0], "FAILED");
+        ASSERT_EQUAL(result[0][1], "blob");
+        ASSERT_EQUAL(result[0][2], pad);
+    }
+
+    // Data below the threshold is left alone.
+    void smallData() {
+        SData command("CreateJob");
+        command["name"] = "uncompressed";
+        command["data"] = "{\"key\":\"value\"}";
+        const string jobID = tester->executeWaitVerifyContentTable(command)["jobID"];
+
+        SQResult result;
+        tester->readDB("SELECT typeof(data), data FROM jobs WHERE jobID = " + jobID + ";", result);
+        ASSERT_EQUAL(result[0][0], "text");
+        ASSERT_EQUAL(result[0][1], "{\"key\":\"value\"}");
+    }
+} __CompressedJobDataTest;